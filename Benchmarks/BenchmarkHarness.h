@@ -0,0 +1,75 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+
+// Runs a body repeatedly until it has taken long enough to time, then prints the time per operation.
+// With --quick every body runs once, which is what CTest does to keep the benchmarks building and
+// running without spending time on them. Benchmarks that take sizes or latencies read them as
+// --name=value.
+class BenchmarkRunner {
+public:
+    BenchmarkRunner(int argc, char** argv) : m_argc(argc), m_argv(argv), m_quick(false) {
+        for (int i = 1; i < argc; ++i)
+            m_quick = m_quick || std::strcmp(argv[i], "--quick") == 0;
+    }
+
+    bool Quick() const { return m_quick; }
+
+    // The value of --name=value, or the default when it isn't given or isn't a number.
+    uint64_t Option(const char* name, uint64_t defaultValue) const {
+        size_t length = std::strlen(name);
+        for (int i = 1; i < m_argc; ++i) {
+            const char* argument = m_argv[i];
+            if (std::strncmp(argument, "--", 2) != 0 || std::strncmp(argument + 2, name, length) != 0 || argument[2 + length] != '=')
+                continue;
+
+            const char* text = argument + 3 + length;
+            char* end = nullptr;
+            unsigned long long value = std::strtoull(text, &end, 10);
+            if (end != text && *end == '\0')
+                return value;
+            std::fprintf(stderr, "ignoring %s: not a number\n", argument);
+        }
+        return defaultValue;
+    }
+
+    // The body performs `operations` operations per call.
+    template <typename F>
+    double Run(const char* name, uint64_t operations, F&& body) {
+        using Clock = std::chrono::steady_clock;
+        const Clock::duration minimum = m_quick ? Clock::duration::zero() : std::chrono::milliseconds(200);
+
+        body();
+        uint64_t calls = 0;
+        Clock::time_point start = Clock::now();
+        Clock::duration elapsed;
+        do {
+            body();
+            ++calls;
+            elapsed = Clock::now() - start;
+        } while (elapsed < minimum);
+
+        double nanoseconds = std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(calls * operations);
+        Report(name, nanoseconds);
+        return nanoseconds;
+    }
+
+    // For benchmarks that time only part of each round themselves
+    void Report(const char* name, double nanosecondsPerOperation) const {
+        std::printf("%-48s %12.1f ns/op\n", name, nanosecondsPerOperation);
+        std::fflush(stdout);
+    }
+private:
+    int m_argc;
+    char** m_argv;
+    bool m_quick;
+};
+
+// Keeps a result alive so the work producing it isn't optimized away
+inline void KeepResult(uint64_t value) {
+    static volatile uint64_t sink;
+    sink = sink + value;
+}
@@ -0,0 +1,101 @@
+#include "BenchmarkHarness.h"
+
+#include <string>
+#include <vector>
+
+#include "DevicePropertyDispatch.h"
+
+// The watcher's property updates, applied through the perfect hash table and through the chain of
+// compares it replaced. The values are plain numbers, since unboxing WinRT values costs the same
+// either way.
+
+struct WatchedDevice {
+    int64_t fields[7] = {};
+};
+
+template <size_t Field>
+static bool ApplyField(WatchedDevice& device, const int64_t& value) {
+    if (device.fields[Field] == value)
+        return false;
+    device.fields[Field] = value;
+    return true;
+}
+
+static constexpr DevicePropertyDispatch<WatchedDevice, int64_t, 7> PROPERTIES(
+    std::array<DevicePropertyHandler<WatchedDevice, int64_t>, 7>{ {
+        { L"System.ItemNameDisplay", ApplyField<0> },
+        { L"System.Devices.Aep.CanPair", ApplyField<1> },
+        { L"System.Devices.Aep.IsPaired", ApplyField<2> },
+        { L"System.Devices.Aep.IsConnected", ApplyField<3> },
+        { L"System.Devices.Aep.SignalStrength", ApplyField<4> },
+        { L"System.Devices.Aep.ContainerId", ApplyField<5> },
+        { L"System.Devices.Aep.ProtocolId", ApplyField<6> },
+    } });
+
+static bool ApplyByComparing(WatchedDevice& device, std::wstring_view name, const int64_t& value) {
+    if (name == L"System.ItemNameDisplay")
+        return ApplyField<0>(device, value);
+    if (name == L"System.Devices.Aep.CanPair")
+        return ApplyField<1>(device, value);
+    if (name == L"System.Devices.Aep.IsPaired")
+        return ApplyField<2>(device, value);
+    if (name == L"System.Devices.Aep.IsConnected")
+        return ApplyField<3>(device, value);
+    if (name == L"System.Devices.Aep.SignalStrength")
+        return ApplyField<4>(device, value);
+    if (name == L"System.Devices.Aep.ContainerId")
+        return ApplyField<5>(device, value);
+    if (name == L"System.Devices.Aep.ProtocolId")
+        return ApplyField<6>(device, value);
+    return false;
+}
+
+int main(int argc, char** argv) {
+    BenchmarkRunner runner(argc, argv);
+
+    // An update as the watcher gets it: the watched properties and a few others the system adds.
+    // The names are copies, like the hstrings of a property map.
+    std::vector<std::wstring> update = {
+        L"System.ItemNameDisplay",
+        L"System.Devices.Aep.IsPresent",
+        L"System.Devices.Aep.SignalStrength",
+        L"System.Devices.Aep.Bluetooth.Cod",
+        L"System.Devices.Aep.IsConnected",
+        L"System.Devices.Aep.DeviceAddress",
+        L"System.Devices.Aep.ContainerId",
+        L"System.Devices.Aep.ProtocolId",
+    };
+
+    WatchedDevice device;
+    int64_t value = 0;
+    runner.Run("perfect hash update", update.size(), [&]() {
+        uint64_t changed = 0;
+        ++value;
+        for (const std::wstring& name : update)
+            changed += PROPERTIES.Apply(device, name, value);
+        KeepResult(changed);
+    });
+    runner.Run("if-chain update", update.size(), [&]() {
+        uint64_t changed = 0;
+        ++value;
+        for (const std::wstring& name : update)
+            changed += ApplyByComparing(device, name, value);
+        KeepResult(changed);
+    });
+
+    // Only the names the watcher doesn't handle: the chain compares each against every known name
+    std::vector<std::wstring> unknown = { update[1], update[3], update[5] };
+    runner.Run("perfect hash unknown names", unknown.size(), [&]() {
+        uint64_t found = 0;
+        for (const std::wstring& name : unknown)
+            found += PROPERTIES.Find(name) != nullptr;
+        KeepResult(found);
+    });
+    runner.Run("if-chain unknown names", unknown.size(), [&]() {
+        uint64_t found = 0;
+        for (const std::wstring& name : unknown)
+            found += ApplyByComparing(device, name, value);
+        KeepResult(found);
+    });
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include "BenchmarkHarness.h"
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+
+#include "DeviceStateStore.h"
+#include "DeviceResolutionQueue.h"
+
+// The watcher's devices, read as a whole by the menu and the control server while the watcher
+// thread updates them. Compared with a map behind a mutex that readers copy, which is what the
+// store replaced.
+
+using Store = DeviceStateStore<uint64_t, ResolvedDevice>;
+
+class LockedDeviceMap {
+public:
+    void Put(uint64_t key, const ResolvedDevice& device) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_devices.insert_or_assign(key, device);
+    }
+
+    void Toggle(uint64_t key) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_devices.at(key).connected = !m_devices.at(key).connected;
+    }
+
+    std::unordered_map<uint64_t, ResolvedDevice> Copy() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_devices;
+    }
+private:
+    std::mutex m_mutex;
+    std::unordered_map<uint64_t, ResolvedDevice> m_devices;
+};
+
+static ResolvedDevice Device(uint64_t key) {
+    return ResolvedDevice{ key, 0x240404, false };
+}
+
+// Reads per reader thread while one writer keeps updating, in ns per read
+template <typename Read, typename Write>
+static double ContendedReads(BenchmarkRunner& runner, size_t readerCount, Read read, Write write) {
+    std::chrono::milliseconds duration(runner.Quick() ? 10 : 300);
+    std::atomic<bool> stop = false;
+    std::atomic<uint64_t> reads = 0;
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < readerCount; ++i) {
+        readers.emplace_back([&]() {
+            uint64_t count = 0;
+            uint64_t seen = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                seen += read();
+                ++count;
+            }
+            reads += count;
+            KeepResult(seen);
+        });
+    }
+
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + duration;
+    for (uint64_t i = 0; std::chrono::steady_clock::now() < end; ++i)
+        write(i);
+    stop = true;
+    for (std::thread& reader : readers)
+        reader.join();
+
+    double nanoseconds = std::chrono::duration<double, std::nano>(duration).count();
+    return nanoseconds * static_cast<double>(readerCount) / static_cast<double>(std::max<uint64_t>(reads, 1));
+}
+
+int main(int argc, char** argv) {
+    BenchmarkRunner runner(argc, argv);
+    for (size_t count : { size_t{ 32 }, size_t{ 256 } }) {
+        std::string prefix = std::to_string(count) + " devices, ";
+        Store store;
+        LockedDeviceMap locked;
+        for (uint64_t key = 0; key < count; ++key) {
+            store.Put(key, Device(key));
+            locked.Put(key, Device(key));
+        }
+
+        runner.Run((prefix + "store snapshot").c_str(), 1, [&]() { KeepResult(store.Current()->value.size()); });
+        runner.Run((prefix + "locked copy").c_str(), 1, [&]() { KeepResult(locked.Copy().size()); });
+        runner.Run((prefix + "store find").c_str(), count, [&]() {
+            for (uint64_t key = 0; key < count; ++key)
+                KeepResult(store.Find(key)->address);
+        });
+
+        uint64_t next = 0;
+        runner.Run((prefix + "store update").c_str(), 1, [&]() {
+            store.Update(next++ % count, [](ResolvedDevice& device) {
+                device.connected = !device.connected;
+                return true;
+            });
+        });
+        runner.Run((prefix + "locked update").c_str(), 1, [&]() { locked.Toggle(next++ % count); });
+
+        for (size_t readers : { size_t{ 1 }, size_t{ 3 } }) {
+            std::string suffix = readers == 1 ? ", a reader and a writer" : ", " + std::to_string(readers) + " readers and a writer";
+            runner.Report((prefix + "store snapshot" + suffix).c_str(), ContendedReads(runner, readers,
+                [&store]() {
+                    uint64_t connected = 0;
+                    std::shared_ptr<const Snapshot<Store::Map>> snapshot = store.Current();
+                    for (const std::pair<const uint64_t, std::shared_ptr<const ResolvedDevice>>& device : snapshot->value)
+                        connected += device.second->connected;
+                    return connected;
+                },
+                [&store, count](uint64_t i) {
+                    store.Update(i % count, [](ResolvedDevice& device) {
+                        device.connected = !device.connected;
+                        return true;
+                    });
+                }));
+            runner.Report((prefix + "locked copy" + suffix).c_str(), ContendedReads(runner, readers,
+                [&locked]() {
+                    uint64_t connected = 0;
+                    for (const std::pair<const uint64_t, ResolvedDevice>& device : locked.Copy())
+                        connected += device.second.connected;
+                    return connected;
+                },
+                [&locked, count](uint64_t i) { locked.Toggle(i % count); }));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include "BenchmarkHarness.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+#include "DeviceTable.h"
+
+// Inquiry streams over thousands of devices in range, like a busy office. Compared with the same
+// table kept as one struct per row, where a scan reads every field of every device.
+
+static constexpr uint32_t HEADPHONES_CLASS = 0x240418;
+static constexpr uint32_t PHONE_CLASS = 0x5A020C;
+
+static const std::chrono::steady_clock::time_point START = std::chrono::steady_clock::time_point() + std::chrono::hours(1);
+
+class RowDeviceTable {
+public:
+    struct Row {
+        uint64_t address;
+        uint32_t classOfDevice;
+        uint8_t flags;
+        std::chrono::steady_clock::time_point lastSeen;
+        InternedName name;
+    };
+
+    void Observe(const DiscoveredDevice& device, std::chrono::steady_clock::time_point seen) {
+        uint8_t flags = (device.connected ? DEVICE_CONNECTED : 0) | (device.remembered ? DEVICE_REMEMBERED : 0);
+        auto [ite, inserted] = m_index.try_emplace(device.address, m_rows.size());
+        if (inserted) {
+            m_rows.push_back(Row{ device.address, device.classOfDevice, flags, seen, NamePool::Shared().Intern(device.name) });
+            return;
+        }
+        Row& row = m_rows[ite->second];
+        if (device.classOfDevice != 0)
+            row.classOfDevice = device.classOfDevice;
+        row.flags = flags;
+        row.lastSeen = std::max(row.lastSeen, seen);
+        if (!device.name.empty())
+            row.name = NamePool::Shared().Intern(device.name);
+    }
+
+    void Select(const DeviceQuery& query, std::vector<uint32_t>& rows) const {
+        for (size_t i = 0; i < m_rows.size(); ++i) {
+            const Row& row = m_rows[i];
+            if (query.seenSince.has_value() && row.lastSeen < *query.seenSince)
+                continue;
+            if (query.majorClass.has_value() && DeviceMajorClass(row.classOfDevice) != *query.majorClass)
+                continue;
+            if ((row.flags & query.flags) != query.flags)
+                continue;
+            rows.push_back(static_cast<uint32_t>(i));
+        }
+    }
+private:
+    std::vector<Row> m_rows;
+    std::unordered_map<uint64_t, size_t> m_index;
+};
+
+// One inquiry round: every device, a third of them without a name and a class
+static std::vector<DiscoveredDevice> Inquiry(size_t count) {
+    std::vector<DiscoveredDevice> devices;
+    for (size_t i = 0; i < count; ++i) {
+        bool partial = i % 3 == 1;
+        std::wstring name = partial ? std::wstring() : L"Device " + std::to_wstring(i);
+        devices.push_back(DiscoveredDevice{ 0x001A7D000000ull + i * 7919, std::move(name), partial ? 0 : (i % 4 == 0 ? PHONE_CLASS : HEADPHONES_CLASS), i % 5 == 0, true, false });
+    }
+    return devices;
+}
+
+int main(int argc, char** argv) {
+    BenchmarkRunner runner(argc, argv);
+    for (size_t count : { size_t{ 1000 }, size_t{ 10000 } }) {
+        std::string prefix = std::to_string(count) + " devices, ";
+        std::vector<DiscoveredDevice> inquiry = Inquiry(count);
+        DeviceTable table;
+        RowDeviceTable rowTable;
+        for (const DiscoveredDevice& device : inquiry) {
+            table.Observe(device, START);
+            rowTable.Observe(device, START);
+        }
+
+        uint64_t round = 0;
+        runner.Run((prefix + "table repeat hits").c_str(), count, [&]() {
+            std::chrono::steady_clock::time_point seen = START + std::chrono::seconds(++round);
+            for (const DiscoveredDevice& device : inquiry)
+                table.Observe(device, seen);
+            KeepResult(table.Size());
+        });
+        runner.Run((prefix + "rows repeat hits").c_str(), count, [&]() {
+            std::chrono::steady_clock::time_point seen = START + std::chrono::seconds(++round);
+            for (const DiscoveredDevice& device : inquiry)
+                rowTable.Observe(device, seen);
+        });
+
+        // What the menu asks for: audio devices seen recently
+        DeviceQuery recentAudio{ START, DEVICE_MAJOR_CLASS_AUDIO };
+        DeviceQuery connected{ std::nullopt, std::nullopt, DEVICE_CONNECTED };
+        std::vector<DeviceTable::Row> rows;
+        rows.reserve(count);
+        for (const auto& [name, query] : { std::pair{ "recent audio", recentAudio }, std::pair{ "connected", connected } }) {
+            runner.Run((prefix + "table select " + name).c_str(), count, [&]() {
+                rows.clear();
+                table.Select(query, rows);
+                KeepResult(rows.size());
+            });
+            runner.Run((prefix + "rows select " + name).c_str(), count, [&]() {
+                rows.clear();
+                rowTable.Select(query, rows);
+                KeepResult(rows.size());
+            });
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include "BenchmarkHarness.h"
+
+#include <random>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "GuidMap.h"
+
+// The hash GUID maps used before GuidMap: XOR of the fields, with the tail read through memcpy
+// instead of the original misaligned casts.
+struct XorGuidHasher {
+    size_t operator()(const GUID& guid) const {
+        uint32_t low;
+        uint32_t high;
+        std::memcpy(&low, guid.Data4, sizeof(low));
+        std::memcpy(&high, guid.Data4 + 4, sizeof(high));
+        return guid.Data1 ^ ((static_cast<uint32_t>(guid.Data2) << 16) | guid.Data3) ^ low ^ high;
+    }
+};
+
+// Container ids as Windows hands them out: random version 4 GUIDs
+static std::vector<GUID> ContainerIds(size_t count, std::mt19937_64& random) {
+    std::vector<GUID> ids(count);
+    for (GUID& id : ids) {
+        uint64_t a = random();
+        uint64_t b = random();
+        std::memcpy(&id, &a, sizeof(a));
+        std::memcpy(reinterpret_cast<uint8_t*>(&id) + sizeof(a), &b, sizeof(b));
+        id.Data3 = static_cast<uint16_t>((id.Data3 & 0x0fff) | 0x4000);
+        id.Data4[0] = static_cast<uint8_t>((id.Data4[0] & 0x3f) | 0x80);
+    }
+    return ids;
+}
+
+// Sequential ids whose fields move together, which cancel out under the XOR hash
+static std::vector<GUID> CorrelatedIds(size_t count) {
+    std::vector<GUID> ids(count);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t value = static_cast<uint32_t>(i);
+        ids[i] = GUID{ value, 0x1000, 0x8000, {} };
+        std::memcpy(ids[i].Data4, &value, sizeof(value));
+    }
+    return ids;
+}
+
+template <typename Map>
+static void BenchmarkMap(BenchmarkRunner& runner, const std::string& name, const std::vector<GUID>& keys, const std::vector<GUID>& misses) {
+    runner.Run((name + " insert").c_str(), keys.size(), [&]() {
+        Map map;
+        for (size_t i = 0; i < keys.size(); ++i)
+            map.emplace(keys[i], i);
+        KeepResult(map.size());
+    });
+
+    Map map;
+    for (size_t i = 0; i < keys.size(); ++i)
+        map.emplace(keys[i], i);
+    runner.Run((name + " hit").c_str(), keys.size(), [&]() {
+        uint64_t sum = 0;
+        for (const GUID& key : keys)
+            sum += map.find(key)->second;
+        KeepResult(sum);
+    });
+    runner.Run((name + " miss").c_str(), misses.size(), [&]() {
+        uint64_t found = 0;
+        for (const GUID& key : misses)
+            found += map.find(key) != map.end();
+        KeepResult(found);
+    });
+}
+
+int main(int argc, char** argv) {
+    BenchmarkRunner runner(argc, argv);
+    std::mt19937_64 random(42);
+
+    for (size_t count : { 16, 256, 4096 }) {
+        std::vector<GUID> keys = ContainerIds(count, random);
+        std::vector<GUID> misses = ContainerIds(count, random);
+        std::string suffix = " random/" + std::to_string(count);
+        BenchmarkMap<GuidMap<size_t>>(runner, "GuidMap" + suffix, keys, misses);
+        BenchmarkMap<std::unordered_map<GUID, size_t, GUIDHasher, GUIDEqualityComparer>>(runner, "unordered_map" + suffix, keys, misses);
+        BenchmarkMap<std::unordered_map<GUID, size_t, XorGuidHasher, GUIDEqualityComparer>>(runner, "unordered_map xor" + suffix, keys, misses);
+    }
+
+    std::vector<GUID> correlated = CorrelatedIds(4096);
+    std::vector<GUID> correlatedMisses = CorrelatedIds(8192);
+    correlatedMisses.erase(correlatedMisses.begin(), correlatedMisses.begin() + 4096);
+    BenchmarkMap<GuidMap<size_t>>(runner, "GuidMap correlated/4096", correlated, correlatedMisses);
+    BenchmarkMap<std::unordered_map<GUID, size_t, XorGuidHasher, GUIDEqualityComparer>>(runner, "unordered_map xor correlated/4096", correlated, correlatedMisses);
+
+    // Batch lookup against one find per key
+    std::vector<GUID> keys = ContainerIds(4096, random);
+    GuidMap<size_t> map;
+    for (size_t i = 0; i < keys.size(); ++i)
+        map.emplace(keys[i], i);
+    std::vector<size_t*> values(keys.size());
+    runner.Run("GuidMap find_many/4096", keys.size(), [&]() {
+        map.find_many(keys, values);
+        KeepResult(*values.back());
+    });
+    runner.Run("GuidMap find loop/4096", keys.size(), [&]() {
+        for (size_t i = 0; i < keys.size(); ++i)
+            values[i] = &map.find(keys[i])->second;
+        KeepResult(*values.back());
+    });
+
+    runner.Run("GUIDHasher", keys.size(), [&]() {
+        size_t hash = 0;
+        for (const GUID& key : keys)
+            hash ^= GUIDHasher{}(key);
+        KeepResult(hash);
+    });
+    return 0;
+}
@@ -0,0 +1,384 @@
+#include <mutex>
+#include <string>
+#include <chrono>
+#include <memory>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <optional>
+#include <condition_variable>
+
+#include "BenchmarkHarness.h"
+#include "SimulatedLatency.h"
+#include "LatencyStats.h"
+#include "FakeAudioEndpointSource.h"
+#include "FakeContainerSource.h"
+#include "FakeDeviceResolver.h"
+#include "ConnectorRegistry.h"
+#include "ConnectorCommandQueue.h"
+#include "EnumerationPipeline.h"
+#include "DeviceStateStore.h"
+#include "DeviceResolutionQueue.h"
+#include "WorkerPool.h"
+#include "NamePool.h"
+#include "MenuModel.h"
+
+// Runs the registry, the enumeration pipeline, the menu model and the command queue against
+// simulated backends, with latencies like those of real drivers, and prints where the time goes.
+// Unlike the other benchmarks it reports latencies rather than time per operation.
+//
+//   --devices=N                 bluetooth audio devices (8)
+//   --threads=N                 worker threads resolving endpoints and devices (4)
+//   --iterations=N              refreshes of each kind and commands to time (100)
+//   --topology-latency-us=N     median time of an endpoint's topology walk (3000)
+//   --container-latency-us=N    median time of resolving a container name (8000)
+//   --driver-latency-us=N       median time of a connect or disconnect driver call (20000)
+//   --watched-devices=N         paired devices the watcher adds at once (32)
+//   --concurrent-resolves=N     how many of them resolve at a time (4)
+//   --resolve-latency-us=N      median time of resolving one of them (20000)
+
+struct LatencyBenchmarkOptions {
+    size_t deviceCount = 8;
+    // Every device has a render endpoint per profile, e.g. stereo and hands-free
+    size_t endpointsPerDevice = 2;
+    // Speakers and other endpoints without a bluetooth topology
+    size_t otherEndpointCount = 4;
+    SimulatedLatency topologyLatency{ std::chrono::milliseconds(3), 0.5 };
+    SimulatedLatency containerLatency{ std::chrono::milliseconds(8), 0.5 };
+    SimulatedLatency driverLatency{ std::chrono::milliseconds(20), 0.5 };
+    // Paired devices the watcher adds at once when it starts, and how many resolve at a time
+    size_t watchedDeviceCount = 32;
+    size_t concurrentResolves = 4;
+    SimulatedLatency resolveLatency{ std::chrono::milliseconds(20), 0.5 };
+    // Threads taking snapshots of the watched devices while one thread keeps updating them
+    size_t storeReaders = 3;
+    std::chrono::milliseconds storeDuration{ 200 };
+    size_t workerThreads = 4;
+    size_t iterations = 100;
+};
+
+struct LatencyBenchmarkResult {
+    // From the refresh request to the menu model updated from the published connectors, which is
+    // what a click waits for before the menu shows, with the container names cached and with them
+    // resolved again
+    LatencyStats menuReady;
+    LatencyStats menuReadyCold;
+    // From enqueuing a command to the first driver call
+    LatencyStats commandIssued;
+    // The shared name pool after every refresh, which stays at one entry per distinct name however
+    // many times the names were resolved again
+    size_t refreshes = 0;
+    // The menu is only patched the first time, since the devices don't change between refreshes
+    size_t menuPatches = 0;
+    size_t internedNames = 0;
+    size_t internedBytes = 0;
+    // Resolving every device the watcher added: how long adding them held up the watcher thread,
+    // how long the last one took to resolve, and the queue the resolves went through
+    std::chrono::steady_clock::duration addBlocked{};
+    std::chrono::steady_clock::duration allResolved{};
+    DeviceResolutionMetrics resolution{};
+    // Snapshots read and updates published over storeDuration
+    size_t storeReads = 0;
+    size_t storeWrites = 0;
+};
+
+// Publishes what the benchmark waits for from the pipeline and command queue threads.
+class BenchmarkSignals {
+public:
+    void Published(uint64_t generation) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_generation = generation;
+        }
+        m_changed.notify_all();
+    }
+
+    void CallIssued() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_issued.has_value())
+                m_issued = std::chrono::steady_clock::now();
+        }
+        m_changed.notify_all();
+    }
+
+    void CommandCompleted() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_completed;
+        }
+        m_changed.notify_all();
+    }
+
+    uint64_t Generation() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_generation;
+    }
+
+    void WaitForGeneration(uint64_t generation) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [this, generation] { return m_generation >= generation; });
+    }
+
+    void ResetIssued() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_issued.reset();
+    }
+
+    // Waits for the command to complete and returns when its first driver call was issued.
+    std::chrono::steady_clock::time_point WaitForCommand(size_t completed) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [this, completed] { return m_completed >= completed && m_issued.has_value(); });
+        return *m_issued;
+    }
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    uint64_t m_generation = 0;
+    size_t m_completed = 0;
+    std::optional<std::chrono::steady_clock::time_point> m_issued;
+};
+
+// Readers take snapshots of the store and look at every device while one writer keeps updating them.
+static void RunDeviceStoreBenchmark(const LatencyBenchmarkOptions& options, LatencyBenchmarkResult& result) {
+    DeviceStateStore<uint64_t, ResolvedDevice> store;
+    for (size_t device = 0; device < options.watchedDeviceCount; ++device)
+        store.Put(device + 1, ResolvedDevice{ device + 1, 0x240404, false });
+
+    std::atomic<bool> stop = false;
+    std::atomic<size_t> reads = 0;
+    std::atomic<size_t> connected = 0;
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < options.storeReaders; ++i) {
+        readers.emplace_back([&store, &stop, &reads, &connected]() {
+            size_t count = 0;
+            size_t seen = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                std::shared_ptr<const Snapshot<DeviceStateStore<uint64_t, ResolvedDevice>::Map>> snapshot = store.Current();
+                for (const auto& device : snapshot->value)
+                    seen += device.second->connected;
+                ++count;
+            }
+            reads += count;
+            // Keeps the reads from being optimized away
+            connected += seen;
+        });
+    }
+
+    size_t writes = 0;
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + options.storeDuration;
+    while (std::chrono::steady_clock::now() < end && options.watchedDeviceCount > 0) {
+        store.Update(writes % options.watchedDeviceCount + 1, [](ResolvedDevice& device) {
+            device.connected = !device.connected;
+            return true;
+        });
+        ++writes;
+    }
+    stop = true;
+    for (std::thread& reader : readers)
+        reader.join();
+
+    result.storeReads = reads;
+    result.storeWrites = writes;
+}
+
+static GUID BenchmarkContainerId(size_t device) {
+    GUID containerId{};
+    containerId.Data1 = static_cast<uint32_t>(device + 1);
+    containerId.Data4[7] = 0xbe;
+    return containerId;
+}
+
+static LatencyBenchmarkResult RunLatencyBenchmark(const LatencyBenchmarkOptions& options) {
+    LatencyBenchmarkResult result;
+    BenchmarkSignals signals;
+
+    WorkerPool pool;
+    pool.Start(options.workerThreads);
+
+    FakeAudioEndpointSource endpoints;
+    endpoints.SetWorkerPool(&pool);
+    endpoints.SetResolveLatency(options.topologyLatency);
+    FakeContainerSource containers;
+    containers.SetResolveLatency(options.containerLatency);
+
+    for (size_t device = 0; device < options.deviceCount; ++device) {
+        GUID containerId = BenchmarkContainerId(device);
+        containers.SetContainerName(containerId, L"Device " + std::to_wstring(device));
+
+        std::shared_ptr<FakeConnectorControl> control = std::make_shared<FakeConnectorControl>();
+        control->SetLatency(options.driverLatency);
+        control->SetCallObserver([&signals]() { signals.CallIssued(); });
+        for (size_t i = 0; i < options.endpointsPerDevice; ++i)
+            endpoints.AddEndpoint(AudioEndpoint{ L"bth." + std::to_wstring(device) + L"." + std::to_wstring(i), containerId, i == 0, { control } });
+    }
+    for (size_t i = 0; i < options.otherEndpointCount; ++i)
+        endpoints.AddEndpoint(AudioEndpoint{ L"other." + std::to_wstring(i), GUID_NULL, true, {} });
+
+    ContainerNameIndex containerNames(containers);
+    ConnectorRegistry registry(endpoints, containerNames);
+    EnumerationPipeline pipeline(
+        [&registry](bool full) {
+            if (full)
+                registry.Refresh();
+            return registry.Snapshot();
+        },
+        [&signals](uint64_t generation) { signals.Published(generation); });
+    ConnectorCommandQueue commandQueue(std::chrono::seconds(30), [&signals](const ConnectorCommandCompletion&) { signals.CommandCompleted(); });
+
+    containerNames.Start();
+    registry.Start();
+    pipeline.Start();
+    commandQueue.Start();
+    signals.WaitForGeneration(1);
+
+    MenuModel menu;
+    std::vector<MenuItem> items;
+    for (size_t i = 0; i < 2 * options.iterations; ++i) {
+        // Alternate between a refresh with the names cached and one that has to resolve them again
+        bool cold = i % 2 == 1;
+        if (cold)
+            containerNames.Clear();
+
+        uint64_t generation = signals.Generation() + 1;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        pipeline.RequestRefresh(true);
+        signals.WaitForGeneration(generation);
+
+        // What ToothTrayMenu::BuildMenu does before it patches the native menu
+        std::shared_ptr<const ConnectorSnapshot> snapshot = pipeline.Current();
+        items.clear();
+        for (const BluetoothConnector& connector : snapshot->value)
+            items.push_back(MenuItem{ connector.ContainerId(), connector.DeviceNameHandle(), connector.IsConnected() });
+        result.menuPatches += menu.Update(items).size();
+        (cold ? result.menuReadyCold : result.menuReady).Add(std::chrono::steady_clock::now() - start);
+        ++result.refreshes;
+    }
+    result.internedNames = NamePool::Shared().Size();
+    result.internedBytes = NamePool::Shared().Bytes();
+
+    std::vector<BluetoothConnector> connectors = pipeline.Current()->value;
+    std::vector<bool> connected(connectors.size(), false);
+    for (size_t i = 0; i < options.iterations && !connectors.empty(); ++i) {
+        size_t device = i % connectors.size();
+        ConnectorCommandType type = connected[device] ? ConnectorCommandType::Disconnect : ConnectorCommandType::Connect;
+        connected[device] = !connected[device];
+
+        signals.ResetIssued();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        commandQueue.Enqueue(connectors[device], type);
+        result.commandIssued.Add(signals.WaitForCommand(i + 1) - start);
+    }
+
+    FakeDeviceResolver resolver;
+    resolver.SetWorkerPool(&pool);
+    resolver.SetResolveLatency(options.resolveLatency);
+    for (size_t device = 0; device < options.watchedDeviceCount; ++device)
+        resolver.AddDevice(L"watched." + std::to_wstring(device), ResolvedDevice{ device + 1, 0x240404, false });
+
+    {
+        DeviceResolutionQueue resolutions(resolver, options.concurrentResolves, nullptr);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t device = 0; device < options.watchedDeviceCount; ++device)
+            resolutions.Enqueue(L"watched." + std::to_wstring(device));
+        result.addBlocked = std::chrono::steady_clock::now() - start;
+        resolutions.WaitIdle();
+        result.allResolved = std::chrono::steady_clock::now() - start;
+        result.resolution = resolutions.Metrics();
+    }
+
+    RunDeviceStoreBenchmark(options, result);
+
+    commandQueue.Stop();
+    pipeline.Stop();
+    registry.Stop();
+    containerNames.Stop();
+    pool.Stop();
+    return result;
+}
+
+static void AppendStats(std::string& report, const char* name, LatencyStats& stats) {
+    auto milliseconds = [](std::chrono::steady_clock::duration duration) {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    };
+
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-28s n=%-5zu p50=%8.2fms p99=%8.2fms max=%8.2fms\n",
+        name, stats.Count(), milliseconds(stats.Percentile(50)), milliseconds(stats.Percentile(99)), milliseconds(stats.Max()));
+    report += line;
+}
+
+static std::string FormatLatencyReport(const LatencyBenchmarkOptions& options, LatencyBenchmarkResult& result) {
+    auto microseconds = [](const SimulatedLatency& latency) {
+        return static_cast<long long>(latency.Median().count());
+    };
+
+    char header[512];
+    std::snprintf(header, sizeof(header), "devices=%zu endpoints/device=%zu other endpoints=%zu threads=%zu iterations=%zu\n"
+        "median latencies: topology=%lldus container=%lldus driver=%lldus resolve=%lldus\n",
+        options.deviceCount, options.endpointsPerDevice, options.otherEndpointCount, options.workerThreads, options.iterations,
+        microseconds(options.topologyLatency), microseconds(options.containerLatency), microseconds(options.driverLatency), microseconds(options.resolveLatency));
+
+    std::string report = header;
+    AppendStats(report, "click to menu model ready", result.menuReady);
+    AppendStats(report, "  with names resolved again", result.menuReadyCold);
+    AppendStats(report, "command to driver call", result.commandIssued);
+
+    char names[256];
+    std::snprintf(names, sizeof(names), "%-28s %zu names, %zu bytes after %zu refreshes, %zu menu patches\n", "interned device names",
+        result.internedNames, result.internedBytes, result.refreshes, result.menuPatches);
+    report += names;
+
+    auto milliseconds = [](std::chrono::steady_clock::duration duration) {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    };
+    char resolves[256];
+    std::snprintf(resolves, sizeof(resolves), "%-28s %zu devices, %zu at a time: added in %.2fms, all resolved in %.2fms, peak queue %zu\n",
+        "watcher device resolution", options.watchedDeviceCount, options.concurrentResolves, milliseconds(result.addBlocked),
+        milliseconds(result.allResolved), result.resolution.peakQueued);
+    report += resolves;
+    AppendStats(report, "  queued before resolving", result.resolution.waitLatency);
+    AppendStats(report, "  resolving", result.resolution.resolveLatency);
+
+    double seconds = std::chrono::duration<double>(options.storeDuration).count();
+    char store[256];
+    std::snprintf(store, sizeof(store), "%-28s %zu readers: %.0f snapshots/s, 1 writer: %.0f updates/s\n", "watched device store",
+        options.storeReaders, result.storeReads / seconds, result.storeWrites / seconds);
+    report += store;
+    return report;
+}
+
+// Only the median is configurable; the spread stays that of the defaults, for the long tail of real calls
+static SimulatedLatency LatencyOption(const BenchmarkRunner& runner, const char* name, SimulatedLatency defaultLatency) {
+    uint64_t median = runner.Option(name, static_cast<uint64_t>(defaultLatency.Median().count()));
+    return SimulatedLatency(std::chrono::microseconds(median), 0.5);
+}
+
+static LatencyBenchmarkOptions ParseOptions(const BenchmarkRunner& runner) {
+    LatencyBenchmarkOptions options;
+    // Just enough to make sure every stage still runs
+    if (runner.Quick()) {
+        options.iterations = 2;
+        options.storeDuration = std::chrono::milliseconds(10);
+    }
+
+    options.deviceCount = runner.Option("devices", options.deviceCount);
+    options.workerThreads = runner.Option("threads", options.workerThreads);
+    options.iterations = runner.Option("iterations", options.iterations);
+    options.topologyLatency = LatencyOption(runner, "topology-latency-us", options.topologyLatency);
+    options.containerLatency = LatencyOption(runner, "container-latency-us", options.containerLatency);
+    options.driverLatency = LatencyOption(runner, "driver-latency-us", options.driverLatency);
+    options.watchedDeviceCount = runner.Option("watched-devices", options.watchedDeviceCount);
+    options.concurrentResolves = runner.Option("concurrent-resolves", options.concurrentResolves);
+    options.resolveLatency = LatencyOption(runner, "resolve-latency-us", options.resolveLatency);
+    return options;
+}
+
+int main(int argc, char** argv) {
+    BenchmarkRunner runner(argc, argv);
+    LatencyBenchmarkOptions options = ParseOptions(runner);
+
+    LatencyBenchmarkResult result = RunLatencyBenchmark(options);
+    std::fputs(FormatLatencyReport(options, result).c_str(), stdout);
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "BenchmarkHarness.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <sstream>
+
+#include "Log.h"
+
+// What every DebugLogl(DebugLogStream{} << ...) call did: format into a wostringstream, then hand
+// the text to OutputDebugStringW, which stands in here as a sink that only reads the length.
+class DebugLogStream : public std::wostringstream {
+public:
+    void Logl() {
+        *this << std::endl;
+        KeepResult(str().size());
+    }
+};
+
+static constexpr int RECORDS_PER_ROUND = 256;
+
+static void DiscardLines() {
+    LogDrain::Drain([](const std::wstring& line) { KeepResult(line.size()); });
+}
+
+int main(int argc, char** argv) {
+    BenchmarkRunner runner(argc, argv);
+    std::wstring name = L"WH-CH510 Wireless Headphones";
+    const int rounds = runner.Quick() ? 1 : 2000;
+
+    runner.Run("DebugLogStream", RECORDS_PER_ROUND, [&]() {
+        for (int i = 0; i < RECORDS_PER_ROUND; ++i)
+            DebugLogStream{} << L"Endpoint " << name << L" state=" << i << L" connected=" << (i % 2 == 0);
+    });
+    runner.Run("DebugLogStream + Logl", RECORDS_PER_ROUND, [&]() {
+        for (int i = 0; i < RECORDS_PER_ROUND; ++i) {
+            DebugLogStream stream;
+            stream << L"Endpoint " << name << L" state=" << i << L" connected=" << (i % 2 == 0);
+            stream.Logl();
+        }
+    });
+
+    // Only the logging thread's cost is timed; the rounds are small enough to fit the ring, which is
+    // drained between rounds like the drain thread would.
+    DiscardLines();
+    std::chrono::steady_clock::duration recording{};
+    for (int round = 0; round < rounds; ++round) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < RECORDS_PER_ROUND; ++i)
+            LOG_INFO(L"Endpoint {} state={} connected={}", name, i, i % 2 == 0);
+        recording += std::chrono::steady_clock::now() - start;
+        DiscardLines();
+    }
+    runner.Report("LOG_INFO at the call site", std::chrono::duration<double, std::nano>(recording).count() / (rounds * RECORDS_PER_ROUND));
+
+    runner.Run("LOG_INFO + drain and format", RECORDS_PER_ROUND, [&]() {
+        for (int i = 0; i < RECORDS_PER_ROUND; ++i)
+            LOG_INFO(L"Endpoint {} state={} connected={}", name, i, i % 2 == 0);
+        DiscardLines();
+    });
+
+    runner.Run("LOG_TRACE compiled out", RECORDS_PER_ROUND, [&]() {
+        for (int i = 0; i < RECORDS_PER_ROUND; ++i)
+            LOG_TRACE(L"Endpoint {} state={}", name, i);
+    });
+
+    // Several threads logging at once while a drain thread runs, as in the app
+    const int threads = 4;
+    const int perThread = runner.Quick() ? 1000 : 200000;
+    std::atomic<uint64_t> lines = 0;
+    LogDrain drain;
+    drain.Start([&](const std::wstring&) { lines.fetch_add(1, std::memory_order_relaxed); }, std::chrono::milliseconds(1));
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&]() {
+            for (int i = 0; i < perThread; ++i)
+                LOG_INFO(L"Endpoint {} state={}", name, i);
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    drain.Stop();
+    runner.Report("LOG_INFO, 4 threads with drain thread", elapsed / (threads * perThread));
+    std::printf("  %llu of %d records drained, the rest dropped as the rings filled\n", static_cast<unsigned long long>(lines.load()), threads * perThread);
+    return 0;
+}
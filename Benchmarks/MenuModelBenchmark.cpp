@@ -0,0 +1,62 @@
+#include "BenchmarkHarness.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "MenuModel.h"
+
+// Menu updates with hundreds of paired devices, as on a machine that has been paired with every
+// headset in an office. Each round alternates between two item lists, so every update does the
+// same work and returns the model to where the next one expects it.
+
+static std::vector<MenuItem> PairedDevices(size_t count) {
+    std::vector<MenuItem> items;
+    for (size_t i = 0; i < count; ++i) {
+        GUID containerId{};
+        containerId.Data1 = static_cast<uint32_t>(i + 1);
+        containerId.Data4[7] = 0x5a;
+        wchar_t name[32];
+        std::swprintf(name, sizeof(name) / sizeof(name[0]), L"Headset %04zu", i);
+        items.push_back(MenuItem{ containerId, NamePool::Shared().Intern(name), false });
+    }
+    return items;
+}
+
+static void BenchmarkAlternating(BenchmarkRunner& runner, const char* name, const std::vector<MenuItem>& first, const std::vector<MenuItem>& second) {
+    MenuModel model;
+    model.Update(first);
+    size_t patches = 0;
+    runner.Run(name, 2, [&]() {
+        patches += model.Update(second).size();
+        patches += model.Update(first).size();
+    });
+    KeepResult(patches);
+}
+
+int main(int argc, char** argv) {
+    BenchmarkRunner runner(argc, argv);
+    for (size_t count : { size_t{ 10 }, size_t{ 300 }, size_t{ 900 } }) {
+        std::vector<MenuItem> devices = PairedDevices(count);
+        std::string prefix = std::to_string(count) + " devices, ";
+
+        BenchmarkAlternating(runner, (prefix + "unchanged").c_str(), devices, devices);
+
+        std::vector<MenuItem> connected = devices;
+        connected[count / 2].checked = true;
+        BenchmarkAlternating(runner, (prefix + "one connected").c_str(), devices, connected);
+
+        // The last device moves to the top, e.g. after a rename
+        std::vector<MenuItem> moved = devices;
+        std::rotate(moved.begin(), moved.end() - 1, moved.end());
+        BenchmarkAlternating(runner, (prefix + "one moved").c_str(), devices, moved);
+
+        std::vector<MenuItem> paired = devices;
+        paired.insert(paired.begin() + static_cast<ptrdiff_t>(count / 2), PairedDevices(count + 1).back());
+        BenchmarkAlternating(runner, (prefix + "one paired and unpaired").c_str(), devices, paired);
+
+        std::vector<MenuItem> reversed(devices.rbegin(), devices.rend());
+        BenchmarkAlternating(runner, (prefix + "reversed").c_str(), devices, reversed);
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "BenchmarkHarness.h"
+
+#include <vector>
+
+#include "SdpParser.h"
+#include "FakeSdpRecordSource.h"
+
+// The validation SdpSequence did before it was iterative, one call per nesting level
+static bool IsWellFormedRecursive(std::span<const uint8_t> bytes) {
+    while (!bytes.empty()) {
+        size_t size = 0;
+        std::optional<SdpElement> element = SdpElement::Parse(bytes, size);
+        if (!element.has_value())
+            return false;
+        if (element->IsSequence() && !IsWellFormedRecursive(element->Value()))
+            return false;
+        bytes = bytes.subspan(size);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BenchmarkRunner runner(argc, argv);
+
+    // A device's worth of records, repeated like a cache holding many headphones
+    std::vector<SdpBytes> records;
+    for (size_t i = 0; i < 64; ++i) {
+        for (SdpBytes& record : SdpHeadphoneRecords())
+            records.emplace_back(std::move(record));
+    }
+
+    runner.Run("SdpRecord validate", records.size(), [&]() {
+        uint64_t valid = 0;
+        for (const SdpBytes& record : records)
+            valid += SdpRecord(record).IsValid();
+        KeepResult(valid);
+    });
+
+    runner.Run("recursive validate", records.size(), [&]() {
+        uint64_t valid = 0;
+        for (const SdpBytes& record : records) {
+            size_t size = 0;
+            std::optional<SdpElement> element = SdpElement::Parse(record, size);
+            valid += element.has_value() && IsWellFormedRecursive(element->Value());
+        }
+        KeepResult(valid);
+    });
+
+    // What the cache does for each record it stores: find the profiles
+    runner.Run("SdpRecord validate + profile descriptors", records.size(), [&]() {
+        uint64_t versions = 0;
+        for (const SdpBytes& record : records) {
+            SdpRecord parsed(record);
+            std::optional<SdpElement> list = parsed.Find(SDP_ATTRIBUTE_PROFILE_DESCRIPTOR_LIST);
+            if (!parsed.IsValid() || !list.has_value())
+                continue;
+            for (const SdpProfileDescriptor& profile : SdpProfileDescriptorList(*list))
+                versions += profile.version;
+        }
+        KeepResult(versions);
+    });
+
+    runner.Run("SdpRecord all attributes", records.size(), [&]() {
+        uint64_t ids = 0;
+        for (const SdpBytes& record : records) {
+            for (const SdpAttribute& attribute : SdpRecord(record))
+                ids += attribute.id;
+        }
+        KeepResult(ids);
+    });
+    return 0;
+}
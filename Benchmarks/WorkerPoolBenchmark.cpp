@@ -0,0 +1,82 @@
+#include <string>
+#include <chrono>
+#include <memory>
+#include <cstdio>
+
+#include "BenchmarkHarness.h"
+#include "SimulatedLatency.h"
+#include "FakeAudioEndpointSource.h"
+#include "FakeContainerSource.h"
+#include "ConnectorRegistry.h"
+#include "WorkerPool.h"
+
+// Walks the endpoints of every device serially and on the worker pool, the way
+// BluetoothAudioDeviceEnumerator does, with each walk taking as long as a topology walk of a real
+// driver. The time per endpoint is what a refresh spends on it, so the two show the speedup.
+//
+//   --devices=N       bluetooth devices, each with two render endpoints (16)
+//   --latency-us=N    time each endpoint's walk takes, in microseconds (2000)
+//   --threads=N       worker threads for the parallel walk (4)
+
+struct WalkFixture {
+    FakeAudioEndpointSource endpoints;
+    FakeContainerSource containers;
+    ContainerNameIndex containerNames{ containers };
+    ConnectorRegistry registry{ endpoints, containerNames };
+
+    WalkFixture(size_t deviceCount, SimulatedLatency latency, WorkerPool* pool) {
+        endpoints.SetWorkerPool(pool);
+        std::shared_ptr<FakeConnectorControl> control = std::make_shared<FakeConnectorControl>();
+        for (size_t device = 0; device < deviceCount; ++device) {
+            GUID containerId{};
+            containerId.Data1 = static_cast<uint32_t>(device + 1);
+            containers.SetContainerName(containerId, L"Device " + std::to_wstring(device));
+            endpoints.AddEndpoint(AudioEndpoint{ L"bth." + std::to_wstring(device) + L".stereo", containerId, true, { control } });
+            endpoints.AddEndpoint(AudioEndpoint{ L"bth." + std::to_wstring(device) + L".handsfree", containerId, false, { control } });
+        }
+        // Only the walks are timed, not resolving the container names
+        endpoints.SetResolveLatency(latency);
+        containerNames.Start();
+        registry.Start();
+    }
+
+    ~WalkFixture() {
+        registry.Stop();
+        containerNames.Stop();
+    }
+};
+
+int main(int argc, char** argv) {
+    BenchmarkRunner runner(argc, argv);
+    size_t deviceCount = runner.Option("devices", 16);
+    SimulatedLatency latency{ std::chrono::microseconds(runner.Option("latency-us", 2000)) };
+    size_t threadCount = runner.Option("threads", 4);
+    std::printf("devices=%zu latency=%lldus threads=%zu\n", deviceCount, static_cast<long long>(latency.Median().count()), threadCount);
+
+    WorkerPool pool;
+    pool.Start(threadCount);
+    WalkFixture serial(deviceCount, latency, nullptr);
+    WalkFixture parallel(deviceCount, latency, &pool);
+    uint64_t endpointCount = 2 * deviceCount;
+
+    double serialWalk = runner.Run("serial endpoint walk", endpointCount, [&]() {
+        KeepResult(serial.endpoints.EnumerateEndpoints().size());
+    });
+    double parallelWalk = runner.Run("parallel endpoint walk", endpointCount, [&]() {
+        KeepResult(parallel.endpoints.EnumerateEndpoints().size());
+    });
+
+    // The whole refresh: the walk, then grouping the endpoints by container
+    double serialRefresh = runner.Run("serial refresh and grouping", endpointCount, [&]() {
+        serial.registry.Refresh();
+        KeepResult(serial.registry.Snapshot().size());
+    });
+    double parallelRefresh = runner.Run("parallel refresh and grouping", endpointCount, [&]() {
+        parallel.registry.Refresh();
+        KeepResult(parallel.registry.Snapshot().size());
+    });
+
+    std::printf("speedup: walk %.2fx, refresh %.2fx\n", serialWalk / parallelWalk, serialRefresh / parallelRefresh);
+    pool.Stop();
+    return 0;
+}
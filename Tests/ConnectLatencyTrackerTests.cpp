@@ -0,0 +1,104 @@
+#include "TestHarness.h"
+
+#include "ConnectLatencyTracker.h"
+#include "MappedFile.h"
+
+using std::chrono::milliseconds;
+
+static const std::chrono::steady_clock::time_point START = std::chrono::steady_clock::time_point() + std::chrono::hours(1);
+
+TEST_CASE(TimesCallsUntilEndpointFollows) {
+    ConnectLatencyTracker tracker;
+    CHECK(tracker.CallStarted(L"endpoint", TestGuid(1), true, START));
+    // Not the state the call asked for
+    CHECK(!tracker.EndpointStateChanged(L"endpoint", false, START + milliseconds(10)).has_value());
+
+    std::optional<ConnectLatencySample> sample = tracker.EndpointStateChanged(L"endpoint", true, START + milliseconds(800));
+    CHECK(sample.has_value() && sample->connect);
+    CHECK(sample->elapsed == milliseconds(800));
+    CHECK(GUIDEqualityComparer{}(sample->containerId, TestGuid(1)));
+    // Recorded once
+    CHECK(!tracker.EndpointStateChanged(L"endpoint", true, START + milliseconds(900)).has_value());
+
+    std::optional<DeviceLatencySummary> summary = tracker.Summary(TestGuid(1));
+    CHECK(summary.has_value());
+    CHECK_EQUAL(summary->connect.count, 1u);
+    CHECK_EQUAL(summary->disconnect.count, 0u);
+    CHECK(summary->connect.p50 >= milliseconds(800) && summary->connect.p50 <= milliseconds(800) * 33 / 32);
+}
+
+TEST_CASE(RepeatedCallKeepsFirstStart) {
+    ConnectLatencyTracker tracker;
+    CHECK(tracker.CallStarted(L"endpoint", TestGuid(1), true, START));
+    CHECK(!tracker.CallStarted(L"endpoint", TestGuid(1), true, START + milliseconds(100)));
+    CHECK(tracker.EndpointStateChanged(L"endpoint", true, START + milliseconds(500))->elapsed == milliseconds(500));
+
+    // The opposite direction starts over
+    CHECK(tracker.CallStarted(L"endpoint", TestGuid(1), true, START + milliseconds(1000)));
+    CHECK(tracker.CallStarted(L"endpoint", TestGuid(1), false, START + milliseconds(1200)));
+    CHECK(tracker.EndpointStateChanged(L"endpoint", false, START + milliseconds(1500))->elapsed == milliseconds(300));
+}
+
+TEST_CASE(FailedCallIsNotTimed) {
+    ConnectLatencyTracker tracker;
+    CHECK(tracker.CallStarted(L"endpoint", TestGuid(1), true, START));
+    tracker.CallFailed(L"endpoint", true);
+    // The endpoint connecting on its own later isn't the call's doing
+    CHECK(!tracker.EndpointStateChanged(L"endpoint", true, START + milliseconds(5000)).has_value());
+    CHECK(!tracker.Summary(TestGuid(1)).has_value());
+
+    // A failure for the other direction leaves a pending call alone
+    CHECK(tracker.CallStarted(L"endpoint", TestGuid(1), false, START));
+    tracker.CallFailed(L"endpoint", true);
+    CHECK(tracker.EndpointStateChanged(L"endpoint", false, START + milliseconds(200)).has_value());
+}
+
+TEST_CASE(DropsCallsNeverFollowed) {
+    ConnectLatencyTracker tracker;
+    tracker.CallStarted(L"endpoint", TestGuid(1), true, START);
+    CHECK(!tracker.EndpointStateChanged(L"endpoint", true, START + ConnectLatencyTracker::PENDING_TIMEOUT + milliseconds(1)).has_value());
+
+    // Expired calls are dropped when the next one starts
+    tracker.CallStarted(L"stale", TestGuid(2), true, START);
+    tracker.CallStarted(L"endpoint", TestGuid(1), true, START + ConnectLatencyTracker::PENDING_TIMEOUT * 2);
+    CHECK(!tracker.EndpointStateChanged(L"stale", true, START + ConnectLatencyTracker::PENDING_TIMEOUT * 2).has_value());
+    CHECK(tracker.Summaries().empty());
+}
+
+TEST_CASE(SavesAndLoadsCounts) {
+    TemporaryDirectory directory;
+    std::filesystem::path path = directory.Path() / "latencies.dat";
+    {
+        ConnectLatencyTracker empty;
+        CHECK(empty.Save(path));
+        CHECK(!std::filesystem::exists(path));
+    }
+    {
+        ConnectLatencyTracker tracker;
+        for (int i = 1; i <= 10; ++i) {
+            tracker.CallStarted(L"a", TestGuid(1), true, START);
+            tracker.EndpointStateChanged(L"a", true, START + milliseconds(100 * i));
+        }
+        tracker.CallStarted(L"b", TestGuid(2), false, START);
+        tracker.EndpointStateChanged(L"b", false, START + milliseconds(40));
+        CHECK(tracker.Save(path));
+    }
+
+    ConnectLatencyTracker tracker;
+    tracker.Load(path);
+    tracker.Load(directory.Path() / "missing.dat");
+    CHECK_EQUAL(tracker.Summaries().size(), 2u);
+    DeviceLatencySummary first = *tracker.Summary(TestGuid(1));
+    CHECK_EQUAL(first.connect.count, 10u);
+    CHECK(first.connect.p50 >= milliseconds(500) && first.connect.p50 < milliseconds(520));
+    CHECK_EQUAL(tracker.Summary(TestGuid(2))->disconnect.count, 1u);
+
+    // A corrupt file adds nothing
+    std::vector<uint8_t> bytes(MappedFile::Open(path)->Bytes().begin(), MappedFile::Open(path)->Bytes().end());
+    bytes.back() ^= 0x01;
+    CHECK(!ValidateConnectLatencies(bytes));
+    CHECK(MappedFile::WriteAtomically(path, bytes));
+    ConnectLatencyTracker corrupt;
+    corrupt.Load(path);
+    CHECK(corrupt.Summaries().empty());
+}
@@ -0,0 +1,158 @@
+#include "TestHarness.h"
+
+#include <future>
+
+#include "ConnectorBatch.h"
+#include "FakeAudioEndpointSource.h"
+
+static constexpr std::chrono::seconds WAIT_TIMEOUT(10);
+
+struct Device {
+    std::shared_ptr<FakeConnectorControl> control = std::make_shared<FakeConnectorControl>();
+    BluetoothConnector connector;
+
+    Device(uint32_t id, bool isConnected) : connector(TestGuid(id), NamePool::Shared().Intern(L"Device " + std::to_wstring(id))) {
+        connector.addConnectorControl(control, isConnected);
+    }
+};
+
+// Holds every call of a control until released, like a driver call that hangs
+class CallGate {
+public:
+    CallGate() : m_released(m_release.get_future().share()) {}
+
+    void Hold(FakeConnectorControl& control) {
+        std::shared_future<void> released = m_released;
+        std::shared_ptr<std::promise<void>> entered = m_entered;
+        control.SetCallObserver([released, entered]() {
+            try {
+                entered->set_value();
+            }
+            catch (const std::future_error&) {
+            }
+            released.wait();
+        });
+    }
+
+    bool WaitEntered() {
+        return m_entered->get_future().wait_for(WAIT_TIMEOUT) == std::future_status::ready;
+    }
+
+    void Release() {
+        m_release.set_value();
+    }
+private:
+    std::promise<void> m_release;
+    std::shared_future<void> m_released;
+    std::shared_ptr<std::promise<void>> m_entered = std::make_shared<std::promise<void>>();
+};
+
+struct BatchFixture {
+    std::promise<BatchResult> done;
+    ConnectorCommandQueue queue;
+    ConnectorBatch batch;
+
+    explicit BatchFixture(std::chrono::steady_clock::duration timeout = std::chrono::seconds(10))
+        : queue(timeout, nullptr), batch(queue, [this](const BatchResult& result) { done.set_value(result); }) {
+        queue.Start();
+    }
+
+    BatchResult Wait() {
+        std::future<BatchResult> result = done.get_future();
+        if (result.wait_for(WAIT_TIMEOUT) != std::future_status::ready)
+            FailTest(__FILE__, __LINE__, "the batch didn't finish");
+        return result.get();
+    }
+};
+
+TEST_CASE(SwitchDisconnectsOthersThenConnectsTarget) {
+    BatchFixture fixture;
+    Device first(1, true);
+    Device second(2, true);
+    Device target(3, false);
+
+    fixture.batch.RunAsync(ConnectorBatch::SwitchTo({ first.connector, second.connector, target.connector }, TestGuid(3)));
+    BatchResult result = fixture.Wait();
+
+    CHECK(result.Succeeded());
+    CHECK_EQUAL(result.outcomes.size(), 3u);
+    CHECK(result.outcomes[2].type == ConnectorCommandType::Connect);
+    CHECK_EQUAL(first.control->DisconnectCount(), 1);
+    CHECK_EQUAL(second.control->DisconnectCount(), 1);
+    CHECK_EQUAL(target.control->ConnectCount(), 1);
+}
+
+TEST_CASE(FailedDisconnectSkipsConnect) {
+    BatchFixture fixture;
+    Device other(1, true);
+    Device target(2, false);
+    other.control->SetResult(-1);
+
+    fixture.batch.RunAsync(ConnectorBatch::SwitchTo({ other.connector, target.connector }, TestGuid(2)));
+    BatchResult result = fixture.Wait();
+
+    CHECK(!result.Succeeded());
+    CHECK_EQUAL(result.outcomes.size(), 1u);
+    CHECK(result.outcomes[0].result == ConnectorCommandResult::Failed);
+    CHECK_EQUAL(result.skipped, 1u);
+    CHECK_EQUAL(target.control->ConnectCount(), 0);
+}
+
+TEST_CASE(TimedOutDisconnectSkipsConnect) {
+    BatchFixture fixture(std::chrono::milliseconds(20));
+    Device other(1, true);
+    Device target(2, false);
+    CallGate gate;
+    gate.Hold(*other.control);
+
+    fixture.batch.RunAsync(ConnectorBatch::SwitchTo({ other.connector, target.connector }, TestGuid(2)));
+    BatchResult result = fixture.Wait();
+    gate.Release();
+
+    CHECK_EQUAL(result.outcomes.size(), 1u);
+    CHECK(result.outcomes[0].result == ConnectorCommandResult::TimedOut);
+    CHECK_EQUAL(result.skipped, 1u);
+    CHECK_EQUAL(target.control->ConnectCount(), 0);
+}
+
+TEST_CASE(BatchJoinsCommandAlreadyRunningForDevice) {
+    BatchFixture fixture;
+    Device device(1, false);
+    CallGate gate;
+    gate.Hold(*device.control);
+
+    // A click connects first; the batch must wait for it rather than call the driver alongside it
+    CHECK(fixture.queue.Enqueue(device.connector, ConnectorCommandType::Connect));
+    CHECK(gate.WaitEntered());
+    fixture.batch.RunAsync(ConnectorBatch::ConnectAll({ device.connector }));
+    gate.Release();
+    BatchResult result = fixture.Wait();
+
+    CHECK(result.Succeeded());
+    CHECK_EQUAL(result.outcomes.size(), 1u);
+    CHECK_EQUAL(device.control->ConnectCount(), 1);
+}
+
+TEST_CASE(BatchOnStoppedQueueIsCancelled) {
+    BatchFixture fixture;
+    fixture.queue.Stop();
+    Device device(1, true);
+
+    fixture.batch.RunAsync(ConnectorBatch::DisconnectAll({ device.connector }));
+    BatchResult result = fixture.Wait();
+
+    CHECK(!result.Succeeded());
+    CHECK(result.outcomes[0].result == ConnectorCommandResult::Cancelled);
+    CHECK_EQUAL(device.control->DisconnectCount(), 0);
+}
+
+TEST_CASE(EmptyPlanSucceedsAtOnce) {
+    BatchFixture fixture;
+    Device device(1, false);
+
+    fixture.batch.RunAsync(ConnectorBatch::DisconnectAll({ device.connector }));
+    BatchResult result = fixture.Wait();
+
+    CHECK(result.Succeeded());
+    CHECK(result.outcomes.empty());
+}
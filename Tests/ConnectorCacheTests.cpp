@@ -0,0 +1,176 @@
+#include "TestHarness.h"
+
+#include <cstring>
+
+#include "ConnectorCache.h"
+#include "FakeAudioEndpointSource.h"
+
+static BluetoothConnector Connector(uint32_t id, std::wstring_view name, std::initializer_list<std::wstring_view> endpointIds, bool connected) {
+    BluetoothConnector connector(TestGuid(id), NamePool::Shared().Intern(name));
+    for (std::wstring_view endpointId : endpointIds) {
+        connector.addConnectorControl(std::make_shared<FakeConnectorControl>(), connected);
+        connector.addEndpointId(endpointId);
+    }
+    return connector;
+}
+
+static std::vector<BluetoothConnector> TwoConnectors() {
+    std::vector<BluetoothConnector> connectors;
+    connectors.push_back(Connector(1, L"Headphones", { L"{0.0.0.00000000}.{headphones-a}", L"{0.0.1.00000000}.{headphones-b}" }, true));
+    connectors.push_back(Connector(2, L"Speaker", { L"{0.0.0.00000000}.{speaker}" }, false));
+    return connectors;
+}
+
+static ConnectorCacheHeader Header(const std::vector<uint8_t>& bytes) {
+    ConnectorCacheHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    return header;
+}
+
+// Rewrites the checksum after a change, so only the change itself can make the file invalid
+static void Reseal(std::vector<uint8_t>& bytes) {
+    ConnectorCacheHeader header = Header(bytes);
+    uint32_t hash = 2166136261u;
+    for (size_t i = sizeof(header); i < bytes.size(); ++i)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    header.checksum = hash;
+    std::memcpy(bytes.data(), &header, sizeof(header));
+}
+
+static ConnectorCacheEntry* Entry(std::vector<uint8_t>& bytes, size_t index) {
+    return reinterpret_cast<ConnectorCacheEntry*>(bytes.data() + sizeof(ConnectorCacheHeader)) + index;
+}
+
+static ConnectorCacheEndpoint* Endpoint(std::vector<uint8_t>& bytes, size_t index) {
+    size_t offset = sizeof(ConnectorCacheHeader) + Header(bytes).connectorCount * sizeof(ConnectorCacheEntry);
+    return reinterpret_cast<ConnectorCacheEndpoint*>(bytes.data() + offset) + index;
+}
+
+TEST_CASE(SavesAndReopensConnectors) {
+    TemporaryDirectory directory;
+    std::vector<BluetoothConnector> connectors = TwoConnectors();
+    {
+        ConnectorCache cache;
+        cache.Open(directory.Path() / "connectors.cache");
+        CHECK_EQUAL(cache.Size(), 0u);
+        CHECK(cache.Save(connectors));
+    }
+
+    ConnectorCache cache;
+    cache.Open(directory.Path() / "connectors.cache");
+    CHECK_EQUAL(cache.Size(), 2u);
+    CachedConnector headphones = cache.At(0);
+    CHECK(GUIDEqualityComparer{}(headphones.ContainerId(), TestGuid(1)));
+    CHECK(headphones.Name() == L"Headphones");
+    CHECK(headphones.IsConnected());
+    CHECK_EQUAL(headphones.EndpointCount(), 2u);
+    CHECK(headphones.EndpointId(1) == L"{0.0.1.00000000}.{headphones-b}");
+    CHECK(cache.At(1).Name() == L"Speaker" && !cache.At(1).IsConnected());
+}
+
+TEST_CASE(RejectsTruncatedFile) {
+    std::vector<uint8_t> bytes = SerializeConnectorCache(TwoConnectors());
+    CHECK(ValidateConnectorCache(bytes));
+    for (size_t size = 0; size < bytes.size(); ++size)
+        CHECK(!ValidateConnectorCache(std::span<const uint8_t>(bytes.data(), size)));
+}
+
+TEST_CASE(RejectsChecksumMismatch) {
+    std::vector<uint8_t> bytes = SerializeConnectorCache(TwoConnectors());
+    for (size_t i = sizeof(ConnectorCacheHeader); i < bytes.size(); ++i) {
+        bytes[i] ^= 0x01;
+        CHECK(!ValidateConnectorCache(bytes));
+        bytes[i] ^= 0x01;
+    }
+    CHECK(ValidateConnectorCache(bytes));
+}
+
+TEST_CASE(RejectsOutOfRangeOffsets) {
+    const std::vector<uint8_t> valid = SerializeConnectorCache(TwoConnectors());
+    uint32_t textSize = Header(valid).textSize;
+    uint32_t endpointCount = Header(valid).endpointCount;
+
+    std::vector<uint8_t> bytes = valid;
+    Entry(bytes, 1)->nameOffset = textSize;
+    Reseal(bytes);
+    CHECK(!ValidateConnectorCache(bytes));
+
+    bytes = valid;
+    Entry(bytes, 0)->nameLength = textSize + 1;
+    Reseal(bytes);
+    CHECK(!ValidateConnectorCache(bytes));
+
+    // A length whose sum with the offset only fits in 64 bits
+    bytes = valid;
+    Entry(bytes, 0)->nameLength = UINT32_MAX;
+    Reseal(bytes);
+    CHECK(!ValidateConnectorCache(bytes));
+
+    bytes = valid;
+    Entry(bytes, 1)->firstEndpoint = endpointCount;
+    Reseal(bytes);
+    CHECK(!ValidateConnectorCache(bytes));
+
+    bytes = valid;
+    Endpoint(bytes, 2)->idOffset = textSize - 1;
+    Reseal(bytes);
+    CHECK(!ValidateConnectorCache(bytes));
+
+    // Counts that don't add up to the file size
+    bytes = valid;
+    reinterpret_cast<ConnectorCacheHeader*>(bytes.data())->connectorCount = UINT32_MAX;
+    CHECK(!ValidateConnectorCache(bytes));
+}
+
+TEST_CASE(SavesWhileMapped) {
+    TemporaryDirectory directory;
+    ConnectorCache cache;
+    cache.Open(directory.Path() / "connectors.cache");
+    std::vector<BluetoothConnector> connectors = TwoConnectors();
+    CHECK(cache.Save(connectors));
+
+    // The mapped file is kept as is; the change goes to a new version
+    connectors.pop_back();
+    CHECK(cache.Save(connectors));
+    CHECK_EQUAL(cache.Size(), 1u);
+
+    ConnectorCache reopened;
+    reopened.Open(directory.Path() / "connectors.cache");
+    CHECK_EQUAL(reopened.Size(), 1u);
+    CHECK(reopened.At(0).Name() == L"Headphones");
+}
+
+TEST_CASE(FallsBackFromCorruptVersion) {
+    TemporaryDirectory directory;
+    {
+        ConnectorCache cache;
+        cache.Open(directory.Path() / "connectors.cache");
+        cache.Save(TwoConnectors());
+    }
+    std::vector<uint8_t> corrupt = SerializeConnectorCache(TwoConnectors());
+    corrupt.back() ^= 0x01;
+    CHECK(MappedFile::WriteAtomically(directory.Path() / "connectors.2.cache", corrupt));
+
+    ConnectorCache cache;
+    cache.Open(directory.Path() / "connectors.cache");
+    CHECK_EQUAL(cache.Size(), 2u);
+}
+
+TEST_CASE(ConnectorsResolveEndpointsWhenUsed) {
+    TemporaryDirectory directory;
+    ConnectorCache cache;
+    cache.Open(directory.Path() / "connectors.cache");
+    cache.Save(TwoConnectors());
+
+    FakeAudioEndpointSource source;
+    std::shared_ptr<FakeConnectorControl> control = std::make_shared<FakeConnectorControl>();
+    source.AddEndpoint(AudioEndpoint{ L"{0.0.0.00000000}.{speaker}", TestGuid(2), false, { control } });
+
+    std::vector<BluetoothConnector> connectors = cache.Connectors(source);
+    CHECK_EQUAL(connectors.size(), 2u);
+    CHECK_EQUAL(source.ResolveCount(), 0u);
+    CHECK_EQUAL(connectors[1].Connect(), 0);
+    CHECK_EQUAL(control->ConnectCount(), 1);
+    // The headphones' endpoints are gone
+    CHECK_EQUAL(connectors[0].Connect(), CachedEndpointControl::ENDPOINT_NOT_FOUND);
+}
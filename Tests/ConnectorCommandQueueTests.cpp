@@ -0,0 +1,205 @@
+#include "TestHarness.h"
+
+#include <mutex>
+#include <future>
+
+#include "ConnectorCommandQueue.h"
+#include "FakeAudioEndpointSource.h"
+
+using std::chrono::milliseconds;
+
+struct Device {
+    std::shared_ptr<FakeConnectorControl> control = std::make_shared<FakeConnectorControl>();
+    BluetoothConnector connector;
+
+    explicit Device(uint32_t id) : connector(TestGuid(id), NamePool::Shared().Intern(L"Device " + std::to_wstring(id))) {
+        connector.addConnectorControl(control, false);
+    }
+};
+
+// Holds every call of a control until released, like a driver call that hangs
+class CallGate {
+public:
+    CallGate() : m_released(m_release.get_future().share()) {}
+
+    ~CallGate() {
+        Release();
+    }
+
+    // The observer only holds shared state, so a call released by the destructor can still return
+    void Hold(FakeConnectorControl& control) {
+        std::shared_future<void> released = m_released;
+        std::shared_ptr<std::atomic<size_t>> entered = m_entered;
+        control.SetCallObserver([released, entered]() {
+            ++*entered;
+            released.wait();
+        });
+    }
+
+    bool WaitEntered() {
+        return WaitUntil([this]() { return *m_entered > 0; });
+    }
+
+    void Release() {
+        std::call_once(m_releaseOnce, [this]() { m_release.set_value(); });
+    }
+private:
+    std::promise<void> m_release;
+    std::shared_future<void> m_released;
+    std::once_flag m_releaseOnce;
+    std::shared_ptr<std::atomic<size_t>> m_entered = std::make_shared<std::atomic<size_t>>(0);
+};
+
+// Every completion the queue reports, in order
+class Completions {
+public:
+    ConnectorCommandQueue::CompletedCallback Callback() {
+        return [this](const ConnectorCommandCompletion& completion) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_completions.push_back(completion);
+        };
+    }
+
+    bool WaitFor(size_t count) {
+        return WaitUntil([this, count]() { return Size() >= count; });
+    }
+
+    size_t Size() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_completions.size();
+    }
+
+    ConnectorCommandCompletion At(size_t index) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_completions.at(index);
+    }
+private:
+    std::mutex m_mutex;
+    std::vector<ConnectorCommandCompletion> m_completions;
+};
+
+TEST_CASE(CollapsesRepeatedCommands) {
+    Completions completions;
+    ConnectorCommandQueue queue(std::chrono::seconds(10), completions.Callback());
+    queue.Start();
+    Device device(1);
+    CallGate gate;
+    gate.Hold(*device.control);
+
+    CHECK(queue.Enqueue(device.connector, ConnectorCommandType::Disconnect));
+    CHECK(gate.WaitEntered());
+    // Collapsed into the running disconnect
+    CHECK(!queue.Enqueue(device.connector, ConnectorCommandType::Disconnect));
+    CHECK(queue.Enqueue(device.connector, ConnectorCommandType::Connect));
+    // Collapsed into the queued connect, and told when it's done
+    Completions waiter;
+    CHECK(!queue.Enqueue(device.connector, ConnectorCommandType::Connect, waiter.Callback()));
+    CHECK(!queue.Enqueue(device.connector, ConnectorCommandType::Connect));
+
+    gate.Release();
+    CHECK(completions.WaitFor(2));
+    CHECK(waiter.WaitFor(1));
+    CHECK(waiter.At(0).type == ConnectorCommandType::Connect && waiter.At(0).result == ConnectorCommandResult::Succeeded);
+    queue.Stop();
+    CHECK_EQUAL(completions.Size(), 2u);
+    CHECK_EQUAL(device.control->DisconnectCount(), 1);
+    CHECK_EQUAL(device.control->ConnectCount(), 1);
+}
+
+TEST_CASE(DisconnectCancelsQueuedConnect) {
+    Completions completions;
+    ConnectorCommandQueue queue(std::chrono::seconds(10), completions.Callback());
+    queue.Start();
+    Device device(1);
+    CallGate gate;
+    gate.Hold(*device.control);
+
+    CHECK(queue.Enqueue(device.connector, ConnectorCommandType::Disconnect));
+    CHECK(gate.WaitEntered());
+    Completions connectWaiter;
+    CHECK(queue.Enqueue(device.connector, ConnectorCommandType::Connect, connectWaiter.Callback()));
+    // Cancels the queued connect and joins the running disconnect
+    CHECK(!queue.Enqueue(device.connector, ConnectorCommandType::Disconnect));
+    CHECK(connectWaiter.WaitFor(1));
+    CHECK(connectWaiter.At(0).result == ConnectorCommandResult::Cancelled);
+
+    gate.Release();
+    CHECK(completions.WaitFor(2));
+    queue.Stop();
+    CHECK_EQUAL(completions.Size(), 2u);
+    CHECK(completions.At(0).type == ConnectorCommandType::Connect && completions.At(0).result == ConnectorCommandResult::Cancelled);
+    CHECK(completions.At(1).type == ConnectorCommandType::Disconnect && completions.At(1).result == ConnectorCommandResult::Succeeded);
+    CHECK_EQUAL(device.control->ConnectCount(), 0);
+    CHECK_EQUAL(device.control->DisconnectCount(), 1);
+}
+
+TEST_CASE(ReportsDriverFailure) {
+    Completions completions;
+    ConnectorCommandQueue queue(std::chrono::seconds(10), completions.Callback());
+    queue.Start();
+    Device device(1);
+    device.control->SetResult(-2147023728);
+
+    CHECK(queue.Enqueue(device.connector, ConnectorCommandType::Connect));
+    CHECK(completions.WaitFor(1));
+    CHECK(completions.At(0).result == ConnectorCommandResult::Failed);
+    CHECK_EQUAL(completions.At(0).hr, -2147023728L);
+}
+
+TEST_CASE(HungCallTimesOutWithoutBlockingOtherDevices) {
+    Completions completions;
+    ConnectorCommandQueue queue(milliseconds(50), completions.Callback());
+    queue.Start();
+    Device hung(1);
+    Device other(2);
+    Device third(3);
+    CallGate gate;
+    gate.Hold(*hung.control);
+
+    Completions waiter;
+    CHECK(queue.Enqueue(hung.connector, ConnectorCommandType::Connect, waiter.Callback()));
+    CHECK(waiter.WaitFor(1));
+    CHECK(waiter.At(0).result == ConnectorCommandResult::TimedOut);
+
+    // Another device still gets its calls while the driver call for the first one hangs
+    CHECK(queue.Enqueue(other.connector, ConnectorCommandType::Connect));
+    CHECK(queue.Enqueue(third.connector, ConnectorCommandType::Connect));
+    CHECK(completions.WaitFor(3));
+    CHECK(completions.At(1).result == ConnectorCommandResult::Succeeded);
+    CHECK(completions.At(2).result == ConnectorCommandResult::Succeeded);
+
+    // A new attempt for the hung device waits behind the call that timed out
+    CHECK(queue.Enqueue(hung.connector, ConnectorCommandType::Connect));
+    gate.Release();
+    CHECK(completions.WaitFor(4));
+    CHECK(GUIDEqualityComparer{}(completions.At(3).containerId, TestGuid(1)) && completions.At(3).result == ConnectorCommandResult::Succeeded);
+    CHECK_EQUAL(hung.control->ConnectCount(), 2);
+}
+
+TEST_CASE(StopLeavesHungCallBehind) {
+    Completions completions;
+    Device device(1);
+    CallGate gate;
+    gate.Hold(*device.control);
+    {
+        ConnectorCommandQueue queue(milliseconds(50), completions.Callback());
+        queue.Start();
+        CHECK(queue.Enqueue(device.connector, ConnectorCommandType::Connect));
+        CHECK(gate.WaitEntered());
+        CHECK(queue.Enqueue(device.connector, ConnectorCommandType::Disconnect));
+
+        std::future<void> stopped = std::async(std::launch::async, [&queue]() { queue.Stop(); });
+        CHECK(stopped.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+        // Timed out while stopping, and the disconnect behind it never ran
+        CHECK_EQUAL(completions.Size(), 2u);
+        CHECK(completions.At(0).result == ConnectorCommandResult::TimedOut);
+        CHECK(completions.At(1).result == ConnectorCommandResult::Cancelled);
+    }
+
+    // The call returns after the queue is gone, and reports nothing. Once its thread is done, only the
+    // device and its connector hold the control.
+    gate.Release();
+    CHECK(WaitUntil([&device]() { return device.control.use_count() == 2; }));
+    CHECK_EQUAL(completions.Size(), 2u);
+    CHECK_EQUAL(device.control->DisconnectCount(), 0);
+}
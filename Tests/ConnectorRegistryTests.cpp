@@ -0,0 +1,174 @@
+#include "TestHarness.h"
+
+#include <functional>
+
+#include "ConnectorRegistry.h"
+#include "FakeAudioEndpointSource.h"
+#include "FakeContainerSource.h"
+
+// Runs a hook between resolving and returning, where a notification can race with the registry
+class RacingEndpointSource : public FakeAudioEndpointSource {
+public:
+    std::function<void()> afterResolve;
+
+    std::vector<AudioEndpoint> EnumerateEndpoints() override {
+        std::vector<AudioEndpoint> endpoints = FakeAudioEndpointSource::EnumerateEndpoints();
+        RunHook();
+        return endpoints;
+    }
+
+    std::optional<AudioEndpoint> GetEndpoint(std::wstring_view endpointId) override {
+        std::optional<AudioEndpoint> endpoint = FakeAudioEndpointSource::GetEndpoint(endpointId);
+        RunHook();
+        return endpoint;
+    }
+private:
+    void RunHook() {
+        std::function<void()> hook = std::move(afterResolve);
+        afterResolve = nullptr;
+        if (hook)
+            hook();
+    }
+};
+
+struct RegistryFixture {
+    RacingEndpointSource endpoints;
+    FakeContainerSource containers;
+    ContainerNameIndex names{ containers };
+    ConnectorRegistry registry{ endpoints, names };
+    std::shared_ptr<FakeConnectorControl> control = std::make_shared<FakeConnectorControl>();
+
+    RegistryFixture() {
+        containers.SetContainerName(TestGuid(1), L"Headphones");
+        containers.SetContainerName(TestGuid(2), L"Speaker");
+        names.Start();
+        registry.Start();
+    }
+
+    AudioEndpoint Endpoint(const wchar_t* id, uint32_t container, bool isActive) {
+        return AudioEndpoint{ id, TestGuid(container), isActive, { control } };
+    }
+};
+
+TEST_CASE(GroupsEndpointsByContainer) {
+    RegistryFixture fixture;
+    fixture.registry.Stop();
+    fixture.endpoints.AddEndpoint(fixture.Endpoint(L"a1", 1, false));
+    fixture.endpoints.AddEndpoint(fixture.Endpoint(L"a2", 1, true));
+    fixture.endpoints.AddEndpoint(fixture.Endpoint(L"b1", 2, false));
+    // No controls: not a bluetooth endpoint
+    fixture.endpoints.AddEndpoint(AudioEndpoint{ L"c1", TestGuid(1), true, {} });
+    fixture.registry.Refresh();
+
+    std::vector<BluetoothConnector> connectors = fixture.registry.Snapshot();
+    CHECK(connectors.size() == 2);
+    CHECK(connectors[0].DeviceName() == L"Headphones");
+    CHECK(connectors[0].EndpointIds().size() == 2);
+    CHECK(connectors[0].IsConnected());
+    CHECK(connectors[1].DeviceName() == L"Speaker");
+    CHECK(!connectors[1].IsConnected());
+}
+
+TEST_CASE(PatchesStateWithoutResolving) {
+    RegistryFixture fixture;
+    fixture.endpoints.AddEndpoint(fixture.Endpoint(L"a1", 1, false));
+    size_t resolves = fixture.endpoints.ResolveCount();
+
+    fixture.endpoints.SetEndpointState(L"a1", true);
+    CHECK(fixture.endpoints.ResolveCount() == resolves);
+    CHECK(fixture.registry.Snapshot()[0].IsConnected());
+
+    fixture.endpoints.RemoveEndpoint(L"a1");
+    CHECK(fixture.registry.Snapshot().empty());
+}
+
+TEST_CASE(RemovalDuringResolveIsNotUndone) {
+    RegistryFixture fixture;
+    fixture.endpoints.afterResolve = [&]() { fixture.endpoints.RemoveEndpoint(L"a1"); };
+    fixture.endpoints.AddEndpoint(fixture.Endpoint(L"a1", 1, true));
+
+    CHECK(fixture.registry.Snapshot().empty());
+    // A later add still goes through
+    fixture.endpoints.AddEndpoint(fixture.Endpoint(L"a1", 1, true));
+    CHECK(fixture.registry.Snapshot().size() == 1);
+}
+
+TEST_CASE(RemovalDuringRefreshIsNotUndone) {
+    RegistryFixture fixture;
+    fixture.endpoints.AddEndpoint(fixture.Endpoint(L"a1", 1, true));
+    fixture.endpoints.AddEndpoint(fixture.Endpoint(L"b1", 2, true));
+
+    fixture.endpoints.afterResolve = [&]() { fixture.endpoints.RemoveEndpoint(L"a1"); };
+    fixture.registry.Refresh();
+
+    std::vector<BluetoothConnector> connectors = fixture.registry.Snapshot();
+    CHECK(connectors.size() == 1);
+    CHECK(connectors[0].DeviceName() == L"Speaker");
+}
+
+TEST_CASE(StateChangeDuringRefreshIsKept) {
+    RegistryFixture fixture;
+    fixture.endpoints.AddEndpoint(fixture.Endpoint(L"a1", 1, false));
+
+    fixture.endpoints.afterResolve = [&]() { fixture.endpoints.SetEndpointState(L"a1", true); };
+    fixture.registry.Refresh();
+    CHECK(fixture.registry.Snapshot()[0].IsConnected());
+}
+
+TEST_CASE(AddDuringRefreshIsKept) {
+    RegistryFixture fixture;
+    fixture.endpoints.AddEndpoint(fixture.Endpoint(L"a1", 1, false));
+
+    fixture.endpoints.afterResolve = [&]() { fixture.endpoints.AddEndpoint(fixture.Endpoint(L"b1", 2, false)); };
+    fixture.registry.Refresh();
+    CHECK(fixture.registry.Snapshot().size() == 2);
+}
+
+TEST_CASE(RenamedContainerShowsNewName) {
+    RegistryFixture fixture;
+    fixture.endpoints.AddEndpoint(fixture.Endpoint(L"a1", 1, false));
+    CHECK(fixture.registry.Snapshot()[0].DeviceName() == L"Headphones");
+
+    fixture.containers.SetContainerName(TestGuid(1), L"Renamed");
+    CHECK(fixture.registry.Snapshot()[0].DeviceName() == L"Renamed");
+}
+
+TEST_CASE(ResolvesOnlyOneContainer) {
+    RegistryFixture fixture;
+    fixture.endpoints.AddEndpoint(fixture.Endpoint(L"a1", 1, false));
+    fixture.endpoints.AddEndpoint(fixture.Endpoint(L"a2", 1, false));
+    fixture.endpoints.AddEndpoint(fixture.Endpoint(L"b1", 2, true));
+    size_t resolves = fixture.endpoints.ResolveCount();
+
+    std::optional<BluetoothConnector> headphones = fixture.registry.ResolveContainer(TestGuid(1));
+    CHECK_EQUAL(fixture.endpoints.ResolveCount(), resolves + 2);
+    CHECK(headphones.has_value());
+    CHECK(headphones->DeviceName() == L"Headphones");
+    CHECK_EQUAL(headphones->EndpointIds().size(), 2u);
+    CHECK(!headphones->IsConnected());
+
+    // A container without known endpoints resolves nothing
+    CHECK(!fixture.registry.ResolveContainer(TestGuid(3)).has_value());
+    CHECK_EQUAL(fixture.endpoints.ResolveCount(), resolves + 2);
+}
+
+TEST_CASE(ResolvingContainerDropsVanishedEndpoints) {
+    RegistryFixture fixture;
+    fixture.endpoints.AddEndpoint(fixture.Endpoint(L"a1", 1, true));
+    fixture.endpoints.AddEndpoint(fixture.Endpoint(L"a2", 1, false));
+    // Gone without a notification, e.g. one that was missed
+    fixture.registry.Stop();
+    fixture.endpoints.RemoveEndpoint(L"a1");
+    fixture.registry.Start();
+
+    std::optional<BluetoothConnector> headphones = fixture.registry.ResolveContainer(TestGuid(1));
+    CHECK(headphones.has_value());
+    CHECK_EQUAL(headphones->EndpointIds().size(), 1u);
+    CHECK(!headphones->IsConnected());
+    CHECK_EQUAL(fixture.registry.Snapshot()[0].EndpointIds().size(), 1u);
+
+    fixture.registry.Stop();
+    fixture.endpoints.RemoveEndpoint(L"a2");
+    fixture.registry.Start();
+    CHECK(!fixture.registry.ResolveContainer(TestGuid(1)).has_value());
+}
@@ -0,0 +1,70 @@
+#include "TestHarness.h"
+
+#include <functional>
+
+#include "ContainerNameIndex.h"
+#include "FakeContainerSource.h"
+
+// Runs a hook after resolving, before the index gets the name
+class RacingContainerSource : public FakeContainerSource {
+public:
+    std::function<void()> afterResolve;
+
+    std::optional<std::wstring> ResolveContainerName(const GUID& containerId) override {
+        std::optional<std::wstring> name = FakeContainerSource::ResolveContainerName(containerId);
+        std::function<void()> hook = std::move(afterResolve);
+        afterResolve = nullptr;
+        if (hook)
+            hook();
+        return name;
+    }
+};
+
+TEST_CASE(CachesResolvedNames) {
+    FakeContainerSource source;
+    source.SetContainerName(TestGuid(1), L"Headphones");
+    ContainerNameIndex index(source);
+
+    CHECK(index.Lookup(TestGuid(1))->View() == L"Headphones");
+    CHECK(index.Lookup(TestGuid(1))->View() == L"Headphones");
+    CHECK(source.ResolveCount() == 1);
+}
+
+TEST_CASE(DoesNotCacheMissingContainers) {
+    FakeContainerSource source;
+    ContainerNameIndex index(source);
+
+    CHECK(!index.Lookup(TestGuid(1)).has_value());
+    source.SetContainerName(TestGuid(1), L"Paired later");
+    CHECK(index.Lookup(TestGuid(1))->View() == L"Paired later");
+}
+
+TEST_CASE(RenameInvalidatesAndNotifies) {
+    FakeContainerSource source;
+    source.SetContainerName(TestGuid(1), L"Old");
+    ContainerNameIndex index(source);
+    index.Start();
+    int changes = 0;
+    index.SetChangedCallback([&](const GUID&) { ++changes; });
+
+    CHECK(index.Lookup(TestGuid(1))->View() == L"Old");
+    source.SetContainerName(TestGuid(1), L"New");
+    CHECK(changes == 1);
+    CHECK(index.Lookup(TestGuid(1))->View() == L"New");
+    index.Stop();
+}
+
+TEST_CASE(RenameDuringResolveIsNotCachedOver) {
+    RacingContainerSource source;
+    source.SetContainerName(TestGuid(1), L"Old");
+    ContainerNameIndex index(source);
+    index.Start();
+
+    source.afterResolve = [&]() { source.SetContainerName(TestGuid(1), L"New"); };
+    // Resolved before the rename, so this lookup may see the old name, but it must not stick
+    CHECK(index.Lookup(TestGuid(1))->View() == L"Old");
+    CHECK(index.Lookup(TestGuid(1))->View() == L"New");
+    CHECK(index.Lookup(TestGuid(1))->View() == L"New");
+    CHECK(source.ResolveCount() == 2);
+    index.Stop();
+}
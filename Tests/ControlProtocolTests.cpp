@@ -0,0 +1,174 @@
+#include "TestHarness.h"
+
+#include <future>
+
+#include "ControlProtocol.h"
+#include "FakeAudioEndpointSource.h"
+
+static const GUID HEADPHONES_ID = { 0x5F1A0C3E, 0x8D2B, 0x4E9A, { 0x9C, 0x1D, 0x0A, 0x2B, 0x3C, 0x4D, 0x5E, 0x6F } };
+// "Spe"akeré🎧" in UTF-8, escaped as JSON
+static const std::string SPEAKER_JSON = "Spe\\\"aker\xc3\xa9\xf0\x9f\x8e\xa7";
+
+struct ProtocolFixture {
+    std::shared_ptr<FakeConnectorControl> headphones = std::make_shared<FakeConnectorControl>();
+    std::shared_ptr<FakeConnectorControl> speaker = std::make_shared<FakeConnectorControl>();
+    std::shared_ptr<const ConnectorSnapshot> snapshot;
+    std::promise<BatchResult> batchDone;
+    ConnectorCommandQueue queue{ std::chrono::seconds(10), nullptr };
+    ConnectorBatch batch{ queue, [this](const BatchResult& result) { batchDone.set_value(result); } };
+    ControlRequestHandler handler{ [this]() { return snapshot; }, queue, batch };
+
+    ProtocolFixture() {
+        std::vector<BluetoothConnector> devices;
+        devices.emplace_back(HEADPHONES_ID, NamePool::Shared().Intern(L"WH-CH510"));
+        devices.back().addConnectorControl(headphones, true);
+        devices.emplace_back(TestGuid(2), NamePool::Shared().Intern(L"Spe\"akeré\U0001F3A7"));
+        devices.back().addConnectorControl(speaker, false);
+        devices.emplace_back(TestGuid(3), NamePool::Shared().Intern(L"Dup"));
+        devices.emplace_back(TestGuid(4), NamePool::Shared().Intern(L"dup"));
+        devices.emplace_back(TestGuid(5), NamePool::Shared().Intern(L"Living room; \"left\""));
+        snapshot = std::make_shared<const ConnectorSnapshot>(ConnectorSnapshot{ 7, std::move(devices) });
+        queue.Start();
+    }
+
+    BatchResult WaitForBatch() {
+        std::future<BatchResult> result = batchDone.get_future();
+        if (result.wait_for(std::chrono::seconds(10)) != std::future_status::ready)
+            FailTest(__FILE__, __LINE__, "the switch didn't finish");
+        return result.get();
+    }
+};
+
+static bool Contains(const std::string& text, const std::string& part) {
+    return text.find(part) != std::string::npos;
+}
+
+TEST_CASE(GuidRoundTrips) {
+    CHECK_EQUAL(FormatControlGuid(HEADPHONES_ID), "{5F1A0C3E-8D2B-4E9A-9C1D-0A2B3C4D5E6F}");
+    std::optional<GUID> parsed = ParseControlGuid(L"{5f1a0c3e-8d2b-4e9a-9c1d-0a2b3c4d5e6f}");
+    CHECK(parsed.has_value() && GUIDEqualityComparer{}(*parsed, HEADPHONES_ID));
+    CHECK(!ParseControlGuid(L"{5f1a0c3e-8d2b-4e9a-9c1d-0a2b3c4d5e6g}").has_value());
+    CHECK(!ParseControlGuid(L"5f1a0c3e-8d2b-4e9a-9c1d-0a2b3c4d5e6f").has_value());
+    CHECK(!ParseControlGuid(L"{5f1a0c3e+8d2b-4e9a-9c1d-0a2b3c4d5e6f}").has_value());
+}
+
+TEST_CASE(ParsesCommands) {
+    std::string error;
+    std::optional<ControlCommand> command = ParseControlCommand("  switch   WH-CH510 \r\n", error);
+    CHECK(command.has_value() && command->type == ControlCommandType::Switch);
+    CHECK(command->device == L"WH-CH510");
+
+    command = ParseControlCommand("list", error);
+    CHECK(command.has_value() && command->type == ControlCommandType::List && command->device.empty());
+
+    command = ParseControlCommand("connect Spe\"aker\xc3\xa9\xf0\x9f\x8e\xa7", error);
+    CHECK(command.has_value() && command->device == L"Spe\"akeré\U0001F3A7");
+}
+
+TEST_CASE(RejectsMalformedCommands) {
+    const std::pair<const char*, const char*> cases[] = {
+        { "bogus", "unknown command" },
+        { "", "unknown command" },
+        { "list x", "list takes no device" },
+        { "connect", "missing device" },
+        { "disconnect  ", "missing device" },
+    };
+    for (const std::pair<const char*, const char*>& testCase : cases) {
+        std::string error;
+        CHECK(!ParseControlCommand(testCase.first, error).has_value());
+        CHECK_EQUAL(error, testCase.second);
+    }
+}
+
+TEST_CASE(ParsesQuotedDevices) {
+    std::string error;
+    std::optional<ControlCommand> command = ParseControlCommand("connect  \"Living room; \\\"left\\\"\" ", error);
+    CHECK(command.has_value() && command->device == L"Living room; \"left\"");
+    // A backslash keeps any character, and a quote inside a bare name is part of it
+    command = ParseControlCommand("connect \"back\\\\slash \\x\"", error);
+    CHECK(command.has_value() && command->device == L"back\\slash x");
+    command = ParseControlCommand("connect Say \"hi\"", error);
+    CHECK(command.has_value() && command->device == L"Say \"hi\"");
+
+    const std::pair<const char*, const char*> cases[] = {
+        { "connect \"Living room", "unterminated quote" },
+        { "connect \"Living room\\\"", "unterminated quote" },
+        { "connect \"Living\" room", "text after quoted device" },
+        { "connect \"\"", "missing device" },
+        { "list \"\"", "list takes no device" },
+    };
+    for (const std::pair<const char*, const char*>& testCase : cases) {
+        CHECK(!ParseControlCommand(testCase.first, error).has_value());
+        CHECK_EQUAL(error, testCase.second);
+    }
+}
+
+TEST_CASE(RejectsInvalidUtf8) {
+    // Lone continuation, overlong NUL, surrogate, above U+10FFFF, truncated, invalid lead
+    for (const char* request : { "connect \x80", "connect \xc0\x80", "connect \xed\xa0\x80", "connect \xf4\x90\x80\x80", "connect \xe2\x82", "connect \xff" }) {
+        std::string error;
+        CHECK(!ParseControlCommand(request, error).has_value());
+        CHECK_EQUAL(error, "invalid UTF-8");
+    }
+}
+
+TEST_CASE(ListsSnapshot) {
+    ProtocolFixture fixture;
+    std::string response = fixture.handler.Handle("list");
+    CHECK(Contains(response, "\"generation\":7"));
+    CHECK(Contains(response, "{\"id\":\"{5F1A0C3E-8D2B-4E9A-9C1D-0A2B3C4D5E6F}\",\"name\":\"WH-CH510\",\"connected\":true}"));
+    CHECK(Contains(response, "\"name\":\"" + SPEAKER_JSON + "\",\"connected\":false}"));
+    CHECK(response.back() == '\n');
+}
+
+TEST_CASE(AnswersEachCommandInOrder) {
+    ProtocolFixture fixture;
+    std::string response = fixture.handler.Handle(" connect  spe\"AKER\xc3\xa9\xf0\x9f\x8e\xa7 ; disconnect {5f1a0c3e-8d2b-4e9a-9c1d-0a2b3c4d5e6f};;"
+        "connect dup; bogus; connect \xff; connect nobody");
+    CHECK_EQUAL(response, "[{\"command\":\"connect\",\"id\":\"{00000002-0000-0000-0000-000000000000}\",\"name\":\"" + SPEAKER_JSON + "\",\"accepted\":true},"
+        "{\"command\":\"disconnect\",\"id\":\"{5F1A0C3E-8D2B-4E9A-9C1D-0A2B3C4D5E6F}\",\"name\":\"WH-CH510\",\"accepted\":true},"
+        "{\"command\":\"connect\",\"error\":\"ambiguous device name\"},"
+        "{\"error\":\"unknown command\"},"
+        "{\"error\":\"invalid UTF-8\"},"
+        "{\"command\":\"connect\",\"error\":\"no such device\"}]\n");
+    CHECK_EQUAL(fixture.handler.Handle(""), "[]\n");
+    CHECK_EQUAL(fixture.handler.Handle(" ; ;"), "[]\n");
+}
+
+TEST_CASE(AddressesNamesWithSemicolons) {
+    ProtocolFixture fixture;
+    // Quoted, the ';' in the name doesn't end the command
+    std::string response = fixture.handler.Handle("disconnect \"living ROOM; \\\"left\\\"\";connect \"nobody;\"; list");
+    CHECK(Contains(response, "[{\"command\":\"disconnect\",\"id\":\"{00000005-0000-0000-0000-000000000000}\",\"name\":\"Living room; \\\"left\\\"\",\"accepted\":true},"
+        "{\"command\":\"connect\",\"error\":\"no such device\"},{\"command\":\"list\""));
+
+    // Unquoted, it does
+    response = fixture.handler.Handle("disconnect Living room; \"left\"");
+    CHECK_EQUAL(response, "[{\"command\":\"disconnect\",\"error\":\"no such device\"},{\"error\":\"unknown command\"}]\n");
+
+    // An unterminated quote takes the rest of the request
+    response = fixture.handler.Handle("connect \"Living room; list");
+    CHECK_EQUAL(response, "[{\"error\":\"unterminated quote\"}]\n");
+}
+
+TEST_CASE(SwitchDisconnectsThenConnects) {
+    ProtocolFixture fixture;
+    std::string response = fixture.handler.Handle("switch {00000002-0000-0000-0000-000000000000}");
+    CHECK(Contains(response, "\"disconnects\":1,\"connects\":1}"));
+
+    BatchResult result = fixture.WaitForBatch();
+    CHECK(result.Succeeded());
+    CHECK_EQUAL(fixture.headphones->DisconnectCount(), 1);
+    CHECK_EQUAL(fixture.speaker->ConnectCount(), 1);
+}
+
+TEST_CASE(SwitchKeepsTargetWhenDisconnectFails) {
+    ProtocolFixture fixture;
+    fixture.headphones->SetResult(-1);
+    fixture.handler.Handle("switch {00000002-0000-0000-0000-000000000000}");
+
+    BatchResult result = fixture.WaitForBatch();
+    CHECK(!result.Succeeded());
+    CHECK_EQUAL(result.skipped, 1u);
+    CHECK_EQUAL(fixture.speaker->ConnectCount(), 0);
+}
@@ -0,0 +1,176 @@
+#include "TestHarness.h"
+
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+
+#include "ControlServer.h"
+
+// A client of the Unix domain socket the server listens on off Windows
+class Client {
+public:
+    explicit Client(const std::filesystem::path& path) : m_fd(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        path.string().copy(address.sun_path, sizeof(address.sun_path) - 1);
+        if (connect(m_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    ~Client() {
+        if (m_fd >= 0)
+            close(m_fd);
+    }
+
+    bool IsConnected() const {
+        return m_fd >= 0;
+    }
+
+    void Send(std::string_view data) {
+        while (!data.empty()) {
+            ssize_t count = send(m_fd, data.data(), data.size(), MSG_NOSIGNAL);
+            if (count <= 0)
+                return;
+            data.remove_prefix(static_cast<size_t>(count));
+        }
+    }
+
+    // Empty once the server closed the connection
+    std::string ReadLine() {
+        std::string line;
+        char c;
+        while (recv(m_fd, &c, 1, 0) == 1) {
+            line += c;
+            if (c == '\n')
+                break;
+        }
+        return line;
+    }
+private:
+    int m_fd;
+};
+
+static std::filesystem::path SocketPath() {
+    return std::filesystem::temp_directory_path() / ("ToothTrayControlTests-" + std::to_string(getpid()) + ".sock");
+}
+
+// Echoes the request, so the tests see how lines were split
+static std::string Echo(std::string_view request) {
+    return "<" + std::string(request) + ">\n";
+}
+
+TEST_CASE(AnswersEachLine) {
+    ControlServer server(Echo);
+    CHECK(server.Start(SocketPath()));
+    Client client(SocketPath());
+    CHECK(client.IsConnected());
+
+    client.Send("list\r\n");
+    CHECK_EQUAL(client.ReadLine(), "<list>\n");
+    // Several lines in one write, and one line over several
+    client.Send("a\nb\nc");
+    client.Send("d\n");
+    CHECK_EQUAL(client.ReadLine(), "<a>\n");
+    CHECK_EQUAL(client.ReadLine(), "<b>\n");
+    CHECK_EQUAL(client.ReadLine(), "<cd>\n");
+}
+
+TEST_CASE(DropsClientSendingTooLongLine) {
+    ControlServer server(Echo);
+    CHECK(server.Start(SocketPath()));
+    {
+        Client client(SocketPath());
+        client.Send(std::string(ControlServer::MAX_REQUEST_LENGTH + 10, 'a'));
+        CHECK_EQUAL(client.ReadLine(), "[{\"error\":\"request too long\"}]\n");
+        CHECK_EQUAL(client.ReadLine(), "");
+    }
+
+    // A line of exactly the limit is served, and the next client gets in after the dropped one
+    Client client(SocketPath());
+    client.Send(std::string(ControlServer::MAX_REQUEST_LENGTH, 'a') + "\n");
+    CHECK_EQUAL(client.ReadLine().size(), ControlServer::MAX_REQUEST_LENGTH + 3);
+}
+
+TEST_CASE(RefusesAddressAlreadyServed) {
+    ControlServer server(Echo);
+    CHECK(server.Start(SocketPath()));
+    ControlServer impostor([](std::string_view) { return std::string("impostor\n"); });
+    CHECK(!impostor.Start(SocketPath()));
+
+    Client client(SocketPath());
+    client.Send("x\n");
+    CHECK_EQUAL(client.ReadLine(), "<x>\n");
+}
+
+TEST_CASE(StopDropsIdleClientAndRemovesSocket) {
+    ControlServer server(Echo);
+    CHECK(server.Start(SocketPath()));
+    Client client(SocketPath());
+    client.Send("x\n");
+    CHECK_EQUAL(client.ReadLine(), "<x>\n");
+
+    server.Stop();
+    CHECK_EQUAL(client.ReadLine(), "");
+    CHECK(!std::filesystem::exists(SocketPath()));
+    CHECK(server.Start(SocketPath()));
+}
+
+TEST_CASE(ReplacesStaleSocketFile) {
+    int stale = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    SocketPath().string().copy(address.sun_path, sizeof(address.sun_path) - 1);
+    CHECK(bind(stale, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+    close(stale);
+    CHECK(std::filesystem::exists(SocketPath()));
+
+    ControlServer server(Echo);
+    CHECK(server.Start(SocketPath()));
+    Client client(SocketPath());
+    client.Send("x\n");
+    CHECK_EQUAL(client.ReadLine(), "<x>\n");
+}
+
+TEST_CASE(RoundTripsManyRequests) {
+    std::atomic<int> served = 0;
+    ControlServer server([&served](std::string_view request) {
+        ++served;
+        return Echo(request);
+    });
+    CHECK(server.Start(SocketPath()));
+    Client client(SocketPath());
+    for (int i = 0; i < 1000; ++i) {
+        client.Send("list\n");
+        CHECK_EQUAL(client.ReadLine(), "<list>\n");
+    }
+    CHECK_EQUAL(served.load(), 1000);
+}
+
+TEST_CASE(DropsIdleClientForTheNextOne) {
+    ControlServer server(Echo, std::chrono::milliseconds(100));
+    CHECK(server.Start(SocketPath()));
+    Client silent(SocketPath());
+    // Sends part of a line, then nothing
+    Client stalled(SocketPath());
+    Client waiting(SocketPath());
+    stalled.Send("li");
+    waiting.Send("x\n");
+
+    // Each idle client holds up the next one for at most the timeout
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    CHECK_EQUAL(waiting.ReadLine(), "<x>\n");
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+    CHECK_EQUAL(silent.ReadLine(), "");
+    CHECK_EQUAL(stalled.ReadLine(), "");
+
+    // A client sending requests keeps its connection past the timeout
+    for (int i = 0; i < 5; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        waiting.Send("y\n");
+        CHECK_EQUAL(waiting.ReadLine(), "<y>\n");
+    }
+}
@@ -0,0 +1,121 @@
+#include "TestHarness.h"
+
+#include "DeviceDiscovery.h"
+
+using std::chrono::seconds;
+
+static DiscoveredDevice Device(uint64_t address, const wchar_t* name, uint32_t classOfDevice, bool connected = false) {
+    return DiscoveredDevice{ address, name, classOfDevice, connected, true, true };
+}
+
+// Runs the session like BluetoothRadio::FindDevices: the cached pass, then an inquiry pass for as
+// long as the session schedules one. Each pass reports the next list of devices, or none once the
+// lists run out, and the inquiry lengths are recorded.
+static std::vector<seconds> Discover(DiscoverySession& session, const std::vector<std::vector<DiscoveredDevice>>& passes) {
+    std::vector<seconds> inquiries;
+    size_t pass = 0;
+    auto search = [&]() {
+        if (pass < passes.size()) {
+            for (const DiscoveredDevice& device : passes[pass]) {
+                if (!session.Report(device))
+                    break;
+            }
+        }
+        ++pass;
+    };
+
+    search();
+    while (std::optional<seconds> inquiry = session.NextInquiry()) {
+        inquiries.push_back(*inquiry);
+        search();
+    }
+    return inquiries;
+}
+
+TEST_CASE(InquiriesDoubleUntilTimeout) {
+    DiscoverySession session([](const DiscoveredDevice&) { return DiscoveryControl::Continue; }, seconds(30));
+    std::vector<seconds> inquiries = Discover(session, {});
+    // The last one only gets what's left
+    CHECK(inquiries == std::vector<seconds>({ seconds(2), seconds(4), seconds(8), seconds(16) }));
+    CHECK(!session.Stopped());
+
+    DiscoverySession shortSession([](const DiscoveredDevice&) { return DiscoveryControl::Continue; }, seconds(10), seconds(3));
+    CHECK(Discover(shortSession, {}) == std::vector<seconds>({ seconds(3), seconds(6), seconds(1) }));
+
+    // Without time, only the cached devices are reported
+    size_t reported = 0;
+    DiscoverySession cachedOnly([&reported](const DiscoveredDevice&) {
+        ++reported;
+        return DiscoveryControl::Continue;
+    }, seconds(0));
+    CHECK(Discover(cachedOnly, { { Device(1, L"Cached", 0) }, { Device(2, L"Found", 0) } }).empty());
+    CHECK_EQUAL(reported, 1u);
+}
+
+TEST_CASE(StopsAtTarget) {
+    DiscoveryTarget target{ std::nullopt, L"WH-CH510" };
+    std::vector<uint64_t> reported;
+    DiscoverySession session([&](const DiscoveredDevice& device) {
+        reported.push_back(device.address);
+        return target.Matches(device) ? DiscoveryControl::Stop : DiscoveryControl::Continue;
+    }, seconds(30));
+
+    // Found by the second inquiry; the device after it in that pass and the later passes are never seen
+    std::vector<seconds> inquiries = Discover(session, {
+        { Device(1, L"Keyboard", 0x2540) },
+        { Device(2, L"Speaker", 0x240414) },
+        { Device(3, L"Phone", 0x5a020c), Device(4, L"WH-CH510", 0x240404), Device(5, L"Mouse", 0x2580) },
+        { Device(6, L"Later", 0) },
+    });
+    CHECK(inquiries == std::vector<seconds>({ seconds(2), seconds(4) }));
+    CHECK(reported == std::vector<uint64_t>({ 1, 2, 3, 4 }));
+    CHECK(session.Stopped());
+
+    // Stopped for good
+    CHECK(!session.Report(Device(7, L"After", 0)));
+    CHECK(!session.NextInquiry().has_value());
+    CHECK_EQUAL(reported.size(), 4u);
+}
+
+TEST_CASE(MergesDeviceReportedBySeveralPasses) {
+    std::vector<DiscoveredDevice> reported;
+    DiscoverySession session([&reported](const DiscoveredDevice& device) {
+        reported.push_back(device);
+        return DiscoveryControl::Continue;
+    }, seconds(6));
+
+    Discover(session, {
+        // Cached without a name, as when the stack never resolved it
+        { Device(1, L"", 0x240404), Device(2, L"Speaker", 0x240414) },
+        // The inquiry found the name; the speaker is reported as it was
+        { Device(2, L"Speaker", 0x240414), Device(1, L"WH-CH510", 0) },
+        // A hit without the name doesn't lose it, but the device connected meanwhile
+        { Device(1, L"", 0, true), Device(2, L"Speaker", 0x240414) },
+    });
+
+    // Reported once per change, with every field learned so far
+    CHECK_EQUAL(reported.size(), 4u);
+    CHECK(reported[0].address == 1 && reported[0].name.empty() && reported[0].classOfDevice == 0x240404);
+    CHECK(reported[1].address == 2 && reported[1].name == L"Speaker");
+    CHECK(reported[2].address == 1 && reported[2].name == L"WH-CH510" && reported[2].classOfDevice == 0x240404 && !reported[2].connected);
+    CHECK(reported[3].address == 1 && reported[3].name == L"WH-CH510" && reported[3].classOfDevice == 0x240404 && reported[3].connected);
+    CHECK(reported[3].remembered && reported[3].authenticated);
+}
+
+TEST_CASE(TargetMatchesOnceNameIsMerged) {
+    // The target is matched by address and name, which only come together in the second pass
+    DiscoveryTarget target{ 1, L"WH-CH510" };
+    size_t reported = 0;
+    DiscoverySession session([&](const DiscoveredDevice& device) {
+        ++reported;
+        return target.Matches(device) ? DiscoveryControl::Stop : DiscoveryControl::Continue;
+    }, seconds(30));
+
+    std::vector<seconds> inquiries = Discover(session, {
+        { Device(1, L"", 0x240404) },
+        { Device(1, L"WH-CH510", 0) },
+    });
+    CHECK(session.Stopped());
+    CHECK(inquiries == std::vector<seconds>({ seconds(2) }));
+    CHECK_EQUAL(reported, 2u);
+}
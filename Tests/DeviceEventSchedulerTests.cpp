@@ -0,0 +1,188 @@
+#include "TestHarness.h"
+
+#include <random>
+
+#include "DeviceEventScheduler.h"
+
+using std::chrono::milliseconds;
+
+// A clock that only moves when the test says so, driving the scheduler like the window's timer does:
+// Advance is called at every deadline the scheduler asks for.
+class VirtualClock {
+public:
+    using TimePoint = DeviceEventScheduler::TimePoint;
+
+    struct Fired {
+        milliseconds at;
+        DeviceEventBatch batch;
+    };
+
+    explicit VirtualClock(const DeviceEventSchedulerOptions& options = {})
+        : m_start(TimePoint() + std::chrono::hours(1)), m_now(m_start),
+          m_scheduler(options, [this](const DeviceEventBatch& batch) { m_fired.push_back(Fired{ Elapsed(), batch }); }, m_now) {}
+
+    DeviceEventScheduler& Scheduler() {
+        return m_scheduler;
+    }
+
+    milliseconds Elapsed() const {
+        return std::chrono::duration_cast<milliseconds>(m_now - m_start);
+    }
+
+    void Post(uint64_t device, uint32_t classes) {
+        m_scheduler.Post(device, classes, m_now);
+    }
+
+    // Moves to the given time since the start, firing every deadline on the way when it comes
+    void RunUntil(milliseconds elapsed) {
+        TimePoint end = m_start + elapsed;
+        for (std::optional<TimePoint> deadline = m_scheduler.NextDeadline(); deadline.has_value() && *deadline <= end; deadline = m_scheduler.NextDeadline()) {
+            m_now = std::max(m_now, *deadline);
+            m_scheduler.Advance(m_now);
+        }
+        m_now = end;
+        m_scheduler.Advance(m_now);
+    }
+
+    // Moves without firing the deadlines on the way, like a timer that was held up
+    void JumpTo(milliseconds elapsed) {
+        m_now = m_start + elapsed;
+    }
+
+    const std::vector<Fired>& FiredBatches() const {
+        return m_fired;
+    }
+private:
+    TimePoint m_start;
+    TimePoint m_now;
+    std::vector<Fired> m_fired;
+    DeviceEventScheduler m_scheduler;
+};
+
+TEST_CASE(CoalescesBurstUntilQuiet) {
+    VirtualClock clock;
+    CHECK(!clock.Scheduler().NextDeadline().has_value());
+
+    // A device that reports every 50ms for 200ms
+    for (int i = 0; i <= 4; ++i) {
+        clock.RunUntil(milliseconds(50 * i));
+        clock.Post(1, i == 0 ? DEVICE_EVENT_ARRIVAL : DEVICE_EVENT_CONNECTION);
+    }
+    clock.RunUntil(milliseconds(449));
+    CHECK(clock.FiredBatches().empty());
+    clock.RunUntil(milliseconds(2000));
+
+    CHECK_EQUAL(clock.FiredBatches().size(), 1u);
+    const VirtualClock::Fired& fired = clock.FiredBatches()[0];
+    CHECK_EQUAL(fired.at.count(), 450);
+    CHECK_EQUAL(fired.batch.changes.size(), 1u);
+    CHECK_EQUAL(fired.batch.classes, uint32_t{ DEVICE_EVENT_ARRIVAL | DEVICE_EVENT_CONNECTION });
+    CHECK_EQUAL(clock.Scheduler().PendingCount(), 0u);
+}
+
+TEST_CASE(SteadyStreamFiresAfterMaxDelay) {
+    VirtualClock clock;
+    // Every 100ms for 3 seconds, never quiet for a whole window
+    for (int i = 0; i < 30; ++i) {
+        clock.RunUntil(milliseconds(100 * i));
+        clock.Post(1, DEVICE_EVENT_RANGE);
+    }
+    clock.RunUntil(milliseconds(5000));
+
+    const std::vector<VirtualClock::Fired>& fired = clock.FiredBatches();
+    CHECK_EQUAL(fired.size(), 3u);
+    CHECK_EQUAL(fired[0].at.count(), 1000);
+    CHECK_EQUAL(fired[1].at.count(), 2000);
+    // The posts from 2s on, held no longer than the first of them allows
+    CHECK_EQUAL(fired[2].at.count(), 3000);
+}
+
+TEST_CASE(PostsBetweenTicksNeverFireEarly) {
+    VirtualClock clock;
+    clock.RunUntil(milliseconds(1005));
+    clock.Post(1, DEVICE_EVENT_ARRIVAL);
+    clock.RunUntil(milliseconds(1254));
+    CHECK(clock.FiredBatches().empty());
+    clock.RunUntil(milliseconds(2000));
+    CHECK_EQUAL(clock.FiredBatches().size(), 1u);
+    CHECK_EQUAL(clock.FiredBatches()[0].at.count(), 1260);
+}
+
+TEST_CASE(BatchesDevicesDueTogether) {
+    VirtualClock clock;
+    clock.Post(3, DEVICE_EVENT_REMOVAL);
+    clock.Post(DEVICE_EVENT_ANY_DEVICE, DEVICE_EVENT_NODES_CHANGED);
+    clock.RunUntil(milliseconds(100));
+    clock.Post(2, DEVICE_EVENT_ARRIVAL);
+    clock.RunUntil(milliseconds(1000));
+
+    const std::vector<VirtualClock::Fired>& fired = clock.FiredBatches();
+    CHECK_EQUAL(fired.size(), 2u);
+    CHECK_EQUAL(fired[0].at.count(), 250);
+    CHECK_EQUAL(fired[0].batch.changes.size(), 2u);
+    // In device order
+    CHECK_EQUAL(fired[0].batch.changes[0].device, DEVICE_EVENT_ANY_DEVICE);
+    CHECK_EQUAL(fired[0].batch.changes[1].device, 3u);
+    CHECK_EQUAL(fired[0].batch.classes, uint32_t{ DEVICE_EVENT_NODES_CHANGED | DEVICE_EVENT_REMOVAL });
+    CHECK_EQUAL(fired[1].at.count(), 350);
+    CHECK_EQUAL(fired[1].batch.changes[0].device, 2u);
+}
+
+TEST_CASE(LateTimerFiresEverythingOnce) {
+    VirtualClock clock;
+    clock.Post(1, DEVICE_EVENT_ARRIVAL);
+    clock.RunUntil(milliseconds(30));
+    clock.Post(2, DEVICE_EVENT_ARRIVAL);
+
+    // Held up for more than a turn of the wheel
+    clock.JumpTo(milliseconds(10 * DeviceEventScheduler::WHEEL_SLOTS * 3));
+    clock.RunUntil(milliseconds(10 * DeviceEventScheduler::WHEEL_SLOTS * 3));
+    CHECK_EQUAL(clock.FiredBatches().size(), 1u);
+    CHECK_EQUAL(clock.FiredBatches()[0].batch.changes.size(), 2u);
+
+    // A post after the jump is timed from then
+    clock.Post(1, DEVICE_EVENT_REMOVAL);
+    clock.RunUntil(milliseconds(10 * DeviceEventScheduler::WHEEL_SLOTS * 3 + 1000));
+    CHECK_EQUAL(clock.FiredBatches().size(), 2u);
+    CHECK_EQUAL(clock.FiredBatches()[1].at.count(), 10 * static_cast<int64_t>(DeviceEventScheduler::WHEEL_SLOTS) * 3 + 250);
+}
+
+TEST_CASE(RandomPostsFireWithinBounds) {
+    DeviceEventSchedulerOptions options;
+    VirtualClock clock(options);
+    std::mt19937 random(99);
+
+    // For every device, the times of its posts not yet fired
+    std::unordered_map<uint64_t, std::vector<milliseconds>> posted;
+    size_t fired = 0;
+    auto check = [&]() {
+        for (; fired < clock.FiredBatches().size(); ++fired) {
+            const VirtualClock::Fired& batch = clock.FiredBatches()[fired];
+            for (const DeviceEventChange& change : batch.batch.changes) {
+                std::vector<milliseconds>& times = posted[change.device];
+                CHECK(!times.empty());
+                // Quiet for a window, or held for the longest delay, but never early and at most a tick late
+                bool quiet = batch.at >= times.back() + options.window;
+                bool held = batch.at >= times.front() + options.maxDelay;
+                CHECK(quiet || held);
+                CHECK(batch.at <= std::min(times.back() + options.window, times.front() + options.maxDelay) + options.tick);
+                times.clear();
+            }
+        }
+    };
+
+    milliseconds now(0);
+    for (int i = 0; i < 5000; ++i) {
+        now += milliseconds(random() % 120);
+        clock.RunUntil(now);
+        check();
+        uint64_t device = random() % 20;
+        clock.Post(device, 1u << (random() % 5));
+        posted[device].push_back(now);
+    }
+    clock.RunUntil(now + options.maxDelay * 2);
+    check();
+    CHECK_EQUAL(clock.Scheduler().PendingCount(), 0u);
+    for (const std::pair<const uint64_t, std::vector<milliseconds>>& device : posted)
+        CHECK(device.second.empty());
+}
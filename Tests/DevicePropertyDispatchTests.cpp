@@ -0,0 +1,125 @@
+#include "TestHarness.h"
+
+#include <random>
+#include <string>
+#include <type_traits>
+
+#include "DevicePropertyDispatch.h"
+
+// The watcher's properties, on a device and values that don't need WinRT
+struct WatchedDevice {
+    std::wstring name;
+    bool canPair = false;
+    bool isPaired = false;
+    bool isConnected = false;
+    int64_t signalStrength = 0;
+    int64_t containerId = 0;
+    int64_t protocolId = 0;
+
+    bool operator==(const WatchedDevice&) const = default;
+};
+
+struct PropertyValue {
+    std::wstring text;
+    int64_t number = 0;
+};
+
+template <auto Field>
+static bool ApplyNumber(WatchedDevice& device, const PropertyValue& value) {
+    auto number = static_cast<std::remove_reference_t<decltype(device.*Field)>>(value.number);
+    if (device.*Field == number)
+        return false;
+    device.*Field = number;
+    return true;
+}
+
+static bool ApplyName(WatchedDevice& device, const PropertyValue& value) {
+    if (device.name == value.text)
+        return false;
+    device.name = value.text;
+    return true;
+}
+
+static constexpr DevicePropertyDispatch<WatchedDevice, PropertyValue, 7> PROPERTIES(
+    std::array<DevicePropertyHandler<WatchedDevice, PropertyValue>, 7>{ {
+        { L"System.ItemNameDisplay", ApplyName },
+        { L"System.Devices.Aep.CanPair", ApplyNumber<&WatchedDevice::canPair> },
+        { L"System.Devices.Aep.IsPaired", ApplyNumber<&WatchedDevice::isPaired> },
+        { L"System.Devices.Aep.IsConnected", ApplyNumber<&WatchedDevice::isConnected> },
+        { L"System.Devices.Aep.SignalStrength", ApplyNumber<&WatchedDevice::signalStrength> },
+        { L"System.Devices.Aep.ContainerId", ApplyNumber<&WatchedDevice::containerId> },
+        { L"System.Devices.Aep.ProtocolId", ApplyNumber<&WatchedDevice::protocolId> },
+    } });
+
+// How the watcher applied a property before the table: one compare per known name
+static bool ApplyByComparing(WatchedDevice& device, std::wstring_view name, const PropertyValue& value) {
+    if (name == L"System.ItemNameDisplay")
+        return ApplyName(device, value);
+    if (name == L"System.Devices.Aep.CanPair")
+        return ApplyNumber<&WatchedDevice::canPair>(device, value);
+    if (name == L"System.Devices.Aep.IsPaired")
+        return ApplyNumber<&WatchedDevice::isPaired>(device, value);
+    if (name == L"System.Devices.Aep.IsConnected")
+        return ApplyNumber<&WatchedDevice::isConnected>(device, value);
+    if (name == L"System.Devices.Aep.SignalStrength")
+        return ApplyNumber<&WatchedDevice::signalStrength>(device, value);
+    if (name == L"System.Devices.Aep.ContainerId")
+        return ApplyNumber<&WatchedDevice::containerId>(device, value);
+    if (name == L"System.Devices.Aep.ProtocolId")
+        return ApplyNumber<&WatchedDevice::protocolId>(device, value);
+    return false;
+}
+
+TEST_CASE(FindsEveryHandler) {
+    for (const DevicePropertyHandler<WatchedDevice, PropertyValue>& handler : PROPERTIES.Handlers()) {
+        const DevicePropertyHandler<WatchedDevice, PropertyValue>* found = PROPERTIES.Find(handler.name);
+        CHECK(found != nullptr && found->name == handler.name);
+        // From a copy, so the compare can't just match the pointer
+        CHECK(PROPERTIES.Find(std::wstring(handler.name)) == found);
+    }
+}
+
+TEST_CASE(RejectsUnknownNames) {
+    CHECK(PROPERTIES.Find(L"") == nullptr);
+    CHECK(PROPERTIES.Find(L"System.Devices.Aep.IsPresent") == nullptr);
+    CHECK(PROPERTIES.Find(L"System.Devices.Aep.Bluetooth.Cod") == nullptr);
+    CHECK(PROPERTIES.Find(L"System.Devices.Aep.CanPai") == nullptr);
+    // Same length and the same hashed suffix as a handled name, only the prefix differs
+    CHECK(PROPERTIES.Find(L"Xystem.Devices.Aep.IsConnected") == nullptr);
+    CHECK(PROPERTIES.Find(L"System.Devices.Aep.isConnected") == nullptr);
+
+    WatchedDevice device;
+    CHECK(!PROPERTIES.Apply(device, L"System.Devices.Aep.IsPresent", PropertyValue{ L"", 1 }));
+    CHECK(device == WatchedDevice{});
+}
+
+TEST_CASE(AppliesOnlyChanges) {
+    WatchedDevice device;
+    CHECK(PROPERTIES.Apply(device, L"System.ItemNameDisplay", PropertyValue{ L"Headphones" }));
+    CHECK(device.name == L"Headphones");
+    CHECK(!PROPERTIES.Apply(device, L"System.ItemNameDisplay", PropertyValue{ L"Headphones" }));
+    CHECK(PROPERTIES.Apply(device, L"System.Devices.Aep.IsConnected", PropertyValue{ L"", 1 }));
+    CHECK(device.isConnected);
+    CHECK(!PROPERTIES.Apply(device, L"System.Devices.Aep.IsConnected", PropertyValue{ L"", 1 }));
+    CHECK(PROPERTIES.Apply(device, L"System.Devices.Aep.SignalStrength", PropertyValue{ L"", -60 }));
+    CHECK_EQUAL(device.signalStrength, -60);
+}
+
+TEST_CASE(MatchesTheComparingChain) {
+    std::vector<std::wstring> names;
+    for (const DevicePropertyHandler<WatchedDevice, PropertyValue>& handler : PROPERTIES.Handlers())
+        names.emplace_back(handler.name);
+    names.emplace_back(L"System.Devices.Aep.IsPresent");
+    names.emplace_back(L"System.Devices.Aep.Bluetooth.Cod");
+    names.emplace_back(L"System.Devices.Aep.DeviceAddress");
+
+    std::mt19937 random(7);
+    WatchedDevice byTable;
+    WatchedDevice byChain;
+    for (size_t i = 0; i < 20000; ++i) {
+        const std::wstring& name = names[random() % names.size()];
+        PropertyValue value{ random() % 2 == 0 ? L"Headphones" : L"Speaker", static_cast<int64_t>(random() % 3) - 1 };
+        CHECK_EQUAL(PROPERTIES.Apply(byTable, name, value), ApplyByComparing(byChain, name, value));
+        CHECK(byTable == byChain);
+    }
+}
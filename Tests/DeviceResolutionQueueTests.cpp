@@ -0,0 +1,218 @@
+#include "TestHarness.h"
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "DeviceResolutionQueue.h"
+#include "FakeDeviceResolver.h"
+
+// Holds every resolve until the test completes it, so the order of starts and completions is the test's
+class HeldResolver : public IDeviceResolver {
+public:
+    void ResolveAsync(const std::wstring& id, Completion completed) override {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_started.push_back(id);
+        m_running.emplace(id, std::move(completed));
+    }
+
+    std::vector<std::wstring> Started() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_started;
+    }
+
+    size_t Running() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_running.size();
+    }
+
+    void Complete(const std::wstring& id, std::optional<ResolvedDevice> device) {
+        Completion completed;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            completed = std::move(m_running.at(id));
+            m_running.erase(id);
+        }
+        completed(device);
+    }
+private:
+    std::mutex m_mutex;
+    std::vector<std::wstring> m_started;
+    std::unordered_map<std::wstring, Completion> m_running;
+};
+
+// Records what the queue delivers
+class Deliveries {
+public:
+    DeviceResolutionQueue::ResolvedCallback Callback() {
+        return [this](const std::wstring& id, const std::optional<ResolvedDevice>& device) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_ids.push_back(id);
+            m_found += device.has_value();
+        };
+    }
+
+    std::vector<std::wstring> Ids() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_ids;
+    }
+
+    size_t Found() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_found;
+    }
+private:
+    std::mutex m_mutex;
+    std::vector<std::wstring> m_ids;
+    size_t m_found = 0;
+};
+
+static const ResolvedDevice HEADPHONES{ 0x001122334455, 0x240418, false };
+
+TEST_CASE(LimitsResolvesInFlightAndKeepsOrder) {
+    HeldResolver resolver;
+    Deliveries deliveries;
+    DeviceResolutionQueue queue(resolver, 2, deliveries.Callback());
+    for (const wchar_t* id : { L"a", L"b", L"c", L"d" })
+        CHECK(queue.Enqueue(id));
+    CHECK(resolver.Started() == std::vector<std::wstring>({ L"a", L"b" }));
+    CHECK_EQUAL(queue.Metrics().queued, 2u);
+    CHECK_EQUAL(queue.Metrics().peakQueued, 2u);
+
+    resolver.Complete(L"b", HEADPHONES);
+    CHECK(resolver.Started() == std::vector<std::wstring>({ L"a", L"b", L"c" }));
+    resolver.Complete(L"a", std::nullopt);
+    resolver.Complete(L"c", HEADPHONES);
+    resolver.Complete(L"d", HEADPHONES);
+    queue.WaitIdle();
+
+    CHECK(deliveries.Ids() == std::vector<std::wstring>({ L"b", L"a", L"c", L"d" }));
+    DeviceResolutionMetrics metrics = queue.Metrics();
+    CHECK_EQUAL(metrics.resolved, 3u);
+    CHECK_EQUAL(metrics.failed, 1u);
+    CHECK_EQUAL(metrics.inFlight, 0u);
+    CHECK_EQUAL(metrics.resolveLatency.Count(), 4u);
+}
+
+TEST_CASE(ResolvesRepeatedDeviceOnce) {
+    HeldResolver resolver;
+    Deliveries deliveries;
+    DeviceResolutionQueue queue(resolver, 1, deliveries.Callback());
+    CHECK(queue.Enqueue(L"a"));
+    CHECK(queue.Enqueue(L"b"));
+    // Resolving and queued
+    CHECK(!queue.Enqueue(L"a"));
+    CHECK(!queue.Enqueue(L"b"));
+
+    resolver.Complete(L"a", HEADPHONES);
+    resolver.Complete(L"b", HEADPHONES);
+    CHECK_EQUAL(resolver.Started().size(), 2u);
+    // Done, so it's resolved again
+    CHECK(queue.Enqueue(L"a"));
+    resolver.Complete(L"a", HEADPHONES);
+    CHECK_EQUAL(deliveries.Ids().size(), 3u);
+}
+
+TEST_CASE(CancelledDevicesAreSkippedOrDropped) {
+    HeldResolver resolver;
+    Deliveries deliveries;
+    DeviceResolutionQueue queue(resolver, 1, deliveries.Callback());
+    queue.Enqueue(L"a");
+    queue.Enqueue(L"b");
+    queue.Enqueue(L"c");
+
+    // Queued: never started
+    queue.Cancel(L"b");
+    // Resolving: its result is dropped
+    queue.Cancel(L"a");
+    resolver.Complete(L"a", HEADPHONES);
+    CHECK(resolver.Started() == std::vector<std::wstring>({ L"a", L"c" }));
+    resolver.Complete(L"c", HEADPHONES);
+    queue.WaitIdle();
+    CHECK(deliveries.Ids() == std::vector<std::wstring>({ L"c" }));
+
+    // Removed and added back while the resolve runs: the running one delivers
+    queue.Enqueue(L"d");
+    queue.Cancel(L"d");
+    CHECK(!queue.Enqueue(L"d"));
+    resolver.Complete(L"d", HEADPHONES);
+    CHECK(deliveries.Ids() == std::vector<std::wstring>({ L"c", L"d" }));
+    queue.Cancel(L"unknown");
+}
+
+TEST_CASE(InlineCompletionsDontRecurse) {
+    // Without a pool every resolve completes before ResolveAsync returns
+    FakeDeviceResolver resolver;
+    Deliveries deliveries;
+    constexpr size_t DEVICES = 20000;
+    for (size_t i = 0; i < DEVICES; i += 2)
+        resolver.AddDevice(L"device " + std::to_wstring(i), HEADPHONES);
+
+    DeviceResolutionQueue queue(resolver, 1, deliveries.Callback());
+    for (size_t i = 0; i < DEVICES; ++i)
+        queue.Enqueue(L"device " + std::to_wstring(i));
+    queue.WaitIdle();
+    CHECK_EQUAL(deliveries.Ids().size(), DEVICES);
+    CHECK_EQUAL(deliveries.Found(), DEVICES / 2);
+    CHECK_EQUAL(resolver.PeakConcurrency(), 1u);
+}
+
+TEST_CASE(StopDropsQueuedAndWaitsForRunning) {
+    HeldResolver resolver;
+    Deliveries deliveries;
+    DeviceResolutionQueue queue(resolver, 1, deliveries.Callback());
+    queue.Enqueue(L"a");
+    queue.Enqueue(L"b");
+
+    std::atomic<bool> stopped = false;
+    std::thread stopper([&queue, &stopped]() {
+        queue.Stop();
+        stopped = true;
+    });
+    // Stop drops the queued device right away, then waits
+    CHECK(WaitUntil([&queue]() { return queue.Metrics().queued == 0; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(!stopped);
+
+    resolver.Complete(L"a", HEADPHONES);
+    stopper.join();
+    // Nothing more started, and the result of the running one isn't delivered after Stop
+    CHECK(resolver.Started() == std::vector<std::wstring>({ L"a" }));
+    CHECK(deliveries.Ids().empty());
+    CHECK(!queue.Enqueue(L"c"));
+}
+
+TEST_CASE(ResolvesConcurrentlyOnPool) {
+    WorkerPool pool;
+    pool.Start(8);
+    FakeDeviceResolver resolver;
+    resolver.SetWorkerPool(&pool);
+    resolver.SetResolveLatency(SimulatedLatency(std::chrono::microseconds(500), 0.5));
+    constexpr size_t DEVICES = 400;
+    for (size_t i = 0; i < DEVICES; ++i)
+        resolver.AddDevice(L"device " + std::to_wstring(i), HEADPHONES);
+
+    Deliveries deliveries;
+    {
+        DeviceResolutionQueue queue(resolver, 4, deliveries.Callback());
+        // Added from several threads at once, with repeats
+        std::vector<std::thread> adders;
+        for (size_t t = 0; t < 4; ++t) {
+            adders.emplace_back([&queue, t]() {
+                for (size_t i = t; i < DEVICES; i += 2)
+                    queue.Enqueue(L"device " + std::to_wstring(i));
+            });
+        }
+        for (std::thread& adder : adders)
+            adder.join();
+        queue.WaitIdle();
+        CHECK_EQUAL(queue.Metrics().resolved, resolver.ResolveCount());
+    }
+    pool.Stop();
+
+    CHECK(resolver.PeakConcurrency() <= 4);
+    // Each device at least once; a repeat added after its resolve finished runs again
+    CHECK(deliveries.Ids().size() >= DEVICES && deliveries.Ids().size() <= 2 * DEVICES);
+    CHECK_EQUAL(deliveries.Ids().size(), resolver.ResolveCount());
+}
@@ -0,0 +1,120 @@
+#include "TestHarness.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "DeviceStateStore.h"
+
+// Written as a whole, so a reader seeing the halves disagree saw a torn value
+struct CountedState {
+    uint64_t count;
+    uint64_t doubled;
+};
+
+using Store = DeviceStateStore<uint64_t, CountedState>;
+
+TEST_CASE(PutsUpdatesAndRemoves) {
+    Store store;
+    CHECK(store.Find(1) == nullptr);
+    CHECK(!store.Update(1, [](CountedState&) { return true; }));
+    CHECK_EQUAL(store.Current()->generation, 0u);
+
+    store.Put(1, CountedState{ 1, 2 });
+    std::shared_ptr<const CountedState> first = store.Find(1);
+    CHECK(store.Update(1, [](CountedState& state) { state.count = 5; return true; }));
+    // The reader's value is untouched by the write
+    CHECK_EQUAL(first->count, 1u);
+    CHECK_EQUAL(store.Find(1)->count, 5u);
+
+    // Declined: nothing is published
+    uint64_t generation = store.Current()->generation;
+    CHECK(store.Update(1, [](CountedState& state) { state.count = 9; return false; }));
+    CHECK_EQUAL(store.Current()->generation, generation);
+    CHECK_EQUAL(store.Find(1)->count, 5u);
+
+    CHECK_EQUAL(store.Remove(1)->count, 5u);
+    CHECK(store.Remove(1) == nullptr);
+    CHECK(store.Current()->value.empty());
+}
+
+TEST_CASE(SnapshotsStayAsTaken) {
+    Store store;
+    store.Put(1, CountedState{ 1, 2 });
+    store.Put(2, CountedState{ 1, 2 });
+    std::shared_ptr<const Snapshot<Store::Map>> snapshot = store.Current();
+
+    store.Remove(1);
+    store.Update(2, [](CountedState& state) { state.count = 7; return true; });
+    CHECK_EQUAL(snapshot->value.size(), 2u);
+    CHECK_EQUAL(snapshot->value.at(2)->count, 1u);
+    // Values nobody wrote are shared between snapshots
+    store.Put(3, CountedState{ 0, 0 });
+    CHECK(store.Current()->value.at(2) == store.Find(2));
+}
+
+TEST_CASE(ReadersSeeConsistentSnapshotsUnderConcurrentWrites) {
+    constexpr uint64_t WRITERS = 4;
+    constexpr uint64_t KEYS_PER_WRITER = 16;
+    constexpr uint64_t UPDATES = 20000;
+    constexpr size_t READERS = 4;
+    Store store;
+    for (uint64_t key = 0; key < WRITERS * KEYS_PER_WRITER; ++key)
+        store.Put(key, CountedState{ 0, 0 });
+
+    std::atomic<bool> done = false;
+    std::atomic<size_t> failures = 0;
+    std::atomic<size_t> reads = 0;
+    std::vector<std::thread> readers;
+    for (size_t r = 0; r < READERS; ++r) {
+        readers.emplace_back([&]() {
+            std::vector<uint64_t> lastSeen(WRITERS * KEYS_PER_WRITER, 0);
+            uint64_t lastGeneration = 0;
+            size_t count = 0;
+            while (!done) {
+                std::shared_ptr<const Snapshot<Store::Map>> snapshot = store.Current();
+                // Generations only move forward, and so does every counter in them
+                failures += snapshot->generation < lastGeneration;
+                lastGeneration = snapshot->generation;
+                for (const std::pair<const uint64_t, std::shared_ptr<const CountedState>>& entry : snapshot->value) {
+                    failures += entry.second->doubled != 2 * entry.second->count;
+                    failures += entry.second->count < lastSeen[entry.first];
+                    lastSeen[entry.first] = entry.second->count;
+                }
+                ++count;
+            }
+            reads += count;
+        });
+    }
+
+    // Each writer owns its keys, so at the end every key holds exactly its writer's updates. Then
+    // each removes one of its keys.
+    std::vector<std::thread> writers;
+    for (uint64_t w = 0; w < WRITERS; ++w) {
+        writers.emplace_back([&store, w]() {
+            for (uint64_t i = 0; i < UPDATES; ++i) {
+                uint64_t key = w * KEYS_PER_WRITER + i % KEYS_PER_WRITER;
+                store.Update(key, [](CountedState& state) {
+                    ++state.count;
+                    state.doubled = 2 * state.count;
+                    return true;
+                });
+            }
+            store.Remove(w * KEYS_PER_WRITER);
+        });
+    }
+    for (std::thread& writer : writers)
+        writer.join();
+    done = true;
+    for (std::thread& reader : readers)
+        reader.join();
+
+    CHECK_EQUAL(failures.load(), 0u);
+    CHECK(reads > 0);
+    std::shared_ptr<const Snapshot<Store::Map>> last = store.Current();
+    CHECK_EQUAL(last->value.size(), WRITERS * (KEYS_PER_WRITER - 1));
+    for (const std::pair<const uint64_t, std::shared_ptr<const CountedState>>& entry : last->value)
+        CHECK_EQUAL(entry.second->count, UPDATES / KEYS_PER_WRITER);
+    // One publish per update and per removal, on top of the puts
+    CHECK_EQUAL(last->generation, WRITERS * KEYS_PER_WRITER + WRITERS * UPDATES + WRITERS);
+}
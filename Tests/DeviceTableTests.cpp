@@ -0,0 +1,211 @@
+#include "TestHarness.h"
+
+#include <random>
+#include <algorithm>
+#include <unordered_map>
+
+#include "DeviceTable.h"
+
+using std::chrono::seconds;
+
+// Major class audio, minor class headphones
+static constexpr uint32_t HEADPHONES_CLASS = 0x240418;
+// Major class phone
+static constexpr uint32_t PHONE_CLASS = 0x5A020C;
+
+static const std::chrono::steady_clock::time_point START = std::chrono::steady_clock::time_point() + std::chrono::hours(1);
+
+static DiscoveredDevice Device(uint64_t address, std::wstring name, uint32_t classOfDevice, bool connected = false) {
+    return DiscoveredDevice{ address, std::move(name), classOfDevice, connected, true, false };
+}
+
+// What a row should hold, kept as one struct per device to check the columns against
+struct ExpectedDevice {
+    uint64_t address;
+    std::wstring name;
+    uint32_t classOfDevice;
+    uint8_t flags;
+    std::chrono::steady_clock::time_point lastSeen;
+};
+
+// Inquiry rounds over a few thousand devices in range. A round reports most of them, often without
+// a name or a class, and rounds overlap, so hits can arrive out of order.
+class InquiryStream {
+public:
+    InquiryStream(size_t deviceCount, uint32_t seed) : m_random(seed) {
+        for (size_t i = 0; i < deviceCount; ++i) {
+            uint64_t address = 0x001A7D000000ull + i * 7919;
+            // Four devices to a name, like a room of the same model
+            std::wstring name = L"Device " + std::to_wstring(i % (deviceCount / 4));
+            m_devices.push_back(Device(address, std::move(name), i % 3 == 0 ? PHONE_CLASS : HEADPHONES_CLASS));
+        }
+    }
+
+    // The hits of one round; the names and classes a round leaves out are empty
+    std::vector<std::pair<DiscoveredDevice, std::chrono::steady_clock::time_point>> Round(size_t round) {
+        std::vector<std::pair<DiscoveredDevice, std::chrono::steady_clock::time_point>> hits;
+        for (const DiscoveredDevice& device : m_devices) {
+            if (m_random() % 4 == 0)
+                continue;
+            DiscoveredDevice hit = device;
+            if (m_random() % 3 == 0)
+                hit.name.clear();
+            if (m_random() % 3 == 0)
+                hit.classOfDevice = 0;
+            hit.connected = m_random() % 2 == 0;
+            hit.authenticated = m_random() % 2 == 0;
+            // Up to a round late
+            hits.emplace_back(hit, START + seconds(round * 10 + m_random() % 20));
+        }
+        std::shuffle(hits.begin(), hits.end(), m_random);
+        return hits;
+    }
+private:
+    std::mt19937 m_random;
+    std::vector<DiscoveredDevice> m_devices;
+};
+
+static uint8_t FlagsOf(const DiscoveredDevice& device) {
+    return (device.connected ? DEVICE_CONNECTED : 0)
+        | (device.remembered ? DEVICE_REMEMBERED : 0)
+        | (device.authenticated ? DEVICE_AUTHENTICATED : 0);
+}
+
+static void Expect(std::unordered_map<uint64_t, ExpectedDevice>& expected, const DiscoveredDevice& device, std::chrono::steady_clock::time_point seen) {
+    auto [ite, inserted] = expected.try_emplace(device.address, ExpectedDevice{ device.address, device.name, device.classOfDevice, FlagsOf(device), seen });
+    if (inserted)
+        return;
+    ExpectedDevice& known = ite->second;
+    if (!device.name.empty())
+        known.name = device.name;
+    if (device.classOfDevice != 0)
+        known.classOfDevice = device.classOfDevice;
+    known.flags = FlagsOf(device);
+    known.lastSeen = std::max(known.lastSeen, seen);
+}
+
+static bool Matches(const ExpectedDevice& device, const DeviceQuery& query) {
+    return (!query.seenSince.has_value() || device.lastSeen >= *query.seenSince)
+        && (!query.majorClass.has_value() || DeviceMajorClass(device.classOfDevice) == *query.majorClass)
+        && (device.flags & query.flags) == query.flags;
+}
+
+TEST_CASE(ObservesNewDevice) {
+    DeviceTable table;
+    DeviceTable::Row row = table.Observe(Device(0x1234, L"Headphones", HEADPHONES_CLASS, true), START);
+    CHECK_EQUAL(table.Size(), 1u);
+    CHECK(table.Find(0x1234) == row);
+    CHECK(!table.Find(0x5678).has_value());
+    CHECK_EQUAL(table.Address(row), 0x1234u);
+    CHECK_EQUAL(table.ClassOfDevice(row), HEADPHONES_CLASS);
+    CHECK(table.Flags(row) == (DEVICE_CONNECTED | DEVICE_REMEMBERED));
+    CHECK(table.LastSeen(row) == START);
+    CHECK(table.Name(row) == L"Headphones");
+}
+
+TEST_CASE(RepeatHitsKeepKnownNameAndClass) {
+    DeviceTable table;
+    DeviceTable::Row row = table.Observe(Device(0x1234, L"Headphones", HEADPHONES_CLASS), START);
+    CHECK_EQUAL(table.Observe(Device(0x1234, L"", 0, true), START + seconds(5)), row);
+    CHECK_EQUAL(table.Size(), 1u);
+    CHECK(table.Name(row) == L"Headphones");
+    CHECK_EQUAL(table.ClassOfDevice(row), HEADPHONES_CLASS);
+    // Flags always come from the latest hit
+    CHECK(table.Flags(row) == (DEVICE_CONNECTED | DEVICE_REMEMBERED));
+    CHECK(table.LastSeen(row) == START + seconds(5));
+
+    table.Observe(Device(0x1234, L"Renamed", PHONE_CLASS), START + seconds(1));
+    CHECK(table.Name(row) == L"Renamed");
+    CHECK_EQUAL(table.ClassOfDevice(row), PHONE_CLASS);
+    // A late hit doesn't move the last-seen time back
+    CHECK(table.LastSeen(row) == START + seconds(5));
+}
+
+TEST_CASE(LearnsNameAndClassReportedLater) {
+    DeviceTable table;
+    DeviceTable::Row row = table.Observe(Device(0x1234, L"", 0), START);
+    CHECK(table.Name(row).empty());
+    CHECK(table.NameHandle(row) == NamePool::Shared().Empty());
+    table.Observe(Device(0x1234, L"Headphones", HEADPHONES_CLASS), START);
+    CHECK(table.Name(row) == L"Headphones");
+    CHECK(table.NameHandle(row) == NamePool::Shared().Intern(L"Headphones"));
+    CHECK_EQUAL(DeviceMajorClass(table.ClassOfDevice(row)), DEVICE_MAJOR_CLASS_AUDIO);
+}
+
+TEST_CASE(SelectsByEachField) {
+    DeviceTable table;
+    table.Observe(Device(1, L"Old headphones", HEADPHONES_CLASS), START);
+    table.Observe(Device(2, L"Phone", PHONE_CLASS, true), START + seconds(10));
+    table.Observe(Device(3, L"Headphones", HEADPHONES_CLASS, true), START + seconds(10));
+
+    std::vector<DeviceTable::Row> rows;
+    table.Select(DeviceQuery{}, rows);
+    CHECK(rows == (std::vector<DeviceTable::Row>{ 0, 1, 2 }));
+
+    rows.clear();
+    table.Select(DeviceQuery{ std::nullopt, DEVICE_MAJOR_CLASS_AUDIO }, rows);
+    CHECK(rows == (std::vector<DeviceTable::Row>{ 0, 2 }));
+
+    rows.clear();
+    table.Select(DeviceQuery{ START + seconds(10), DEVICE_MAJOR_CLASS_AUDIO }, rows);
+    CHECK(rows == (std::vector<DeviceTable::Row>{ 2 }));
+
+    rows.clear();
+    table.Select(DeviceQuery{ std::nullopt, std::nullopt, DEVICE_CONNECTED | DEVICE_REMEMBERED }, rows);
+    CHECK(rows == (std::vector<DeviceTable::Row>{ 1, 2 }));
+
+    // Select appends
+    table.Select(DeviceQuery{ std::nullopt, std::nullopt, DEVICE_AUTHENTICATED }, rows);
+    CHECK_EQUAL(rows.size(), 2u);
+}
+
+TEST_CASE(TracksSyntheticInquiryStreams) {
+    for (size_t deviceCount : { 1000u, 5000u }) {
+        DeviceTable table;
+        InquiryStream stream(deviceCount, static_cast<uint32_t>(deviceCount));
+        std::unordered_map<uint64_t, ExpectedDevice> expected;
+        size_t namesBefore = 0;
+        for (size_t round = 0; round < 8; ++round) {
+            for (const auto& [device, seen] : stream.Round(round)) {
+                table.Observe(device, seen);
+                Expect(expected, device, seen);
+            }
+            CHECK_EQUAL(table.Size(), expected.size());
+
+            for (const auto& [address, device] : expected) {
+                std::optional<DeviceTable::Row> row = table.Find(address);
+                CHECK(row.has_value());
+                CHECK_EQUAL(table.Address(*row), address);
+                CHECK(table.Name(*row) == device.name);
+                CHECK_EQUAL(table.ClassOfDevice(*row), device.classOfDevice);
+                CHECK(table.Flags(*row) == device.flags);
+                CHECK(table.LastSeen(*row) == device.lastSeen);
+            }
+
+            // Names repeat across rounds and devices, so once each was reported the pool stops growing
+            size_t names = NamePool::Shared().Size();
+            if (round >= 4)
+                CHECK_EQUAL(names, namesBefore);
+            namesBefore = names;
+        }
+
+        DeviceQuery queries[] = {
+            DeviceQuery{},
+            DeviceQuery{ START + seconds(70), DEVICE_MAJOR_CLASS_AUDIO },
+            DeviceQuery{ START + seconds(75), std::nullopt, DEVICE_CONNECTED | DEVICE_AUTHENTICATED },
+            DeviceQuery{ std::nullopt, DEVICE_MAJOR_CLASS_AUDIO, DEVICE_CONNECTED },
+            DeviceQuery{ START + seconds(1000), std::nullopt },
+        };
+        for (const DeviceQuery& query : queries) {
+            std::vector<DeviceTable::Row> rows;
+            table.Select(query, rows);
+            CHECK(std::is_sorted(rows.begin(), rows.end()));
+            size_t matching = 0;
+            for (const auto& [address, device] : expected)
+                matching += Matches(device, query);
+            CHECK_EQUAL(rows.size(), matching);
+            for (DeviceTable::Row row : rows)
+                CHECK(Matches(expected.at(table.Address(row)), query));
+        }
+    }
+}
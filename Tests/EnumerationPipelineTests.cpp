@@ -0,0 +1,224 @@
+#include "TestHarness.h"
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+
+#include "EnumerationPipeline.h"
+
+// Enumerates connectors whose container ids all carry the number of the enumeration, so a reader can
+// tell a torn snapshot. Enumerations can be held until released, like a slow system.
+class FakeEnumeration {
+public:
+    static constexpr size_t CONNECTORS = 16;
+
+    std::vector<BluetoothConnector> Enumerate(bool full) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        uint32_t number = static_cast<uint32_t>(++m_count);
+        m_fullCount += full;
+        m_released.wait(lock, [this] { return !m_held; });
+        lock.unlock();
+
+        std::vector<BluetoothConnector> connectors;
+        for (size_t i = 0; i < CONNECTORS; ++i)
+            connectors.emplace_back(TestGuid(number), NamePool::Shared().Intern(L"Device"));
+        return connectors;
+    }
+
+    void Hold(bool held) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_held = held;
+        }
+        m_released.notify_all();
+    }
+
+    size_t Count() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_count;
+    }
+
+    size_t FullCount() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_fullCount;
+    }
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_released;
+    bool m_held = false;
+    size_t m_count = 0;
+    size_t m_fullCount = 0;
+};
+
+// Published generations, in the order the callback saw them
+class Publications {
+public:
+    void Add(uint64_t generation) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_generations.push_back(generation);
+    }
+
+    std::vector<uint64_t> Generations() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_generations;
+    }
+
+    size_t Size() {
+        return Generations().size();
+    }
+private:
+    std::mutex m_mutex;
+    std::vector<uint64_t> m_generations;
+};
+
+struct PipelineFixture {
+    FakeEnumeration enumeration;
+    Publications publications;
+    EnumerationPipeline pipeline{
+        [this](bool full) { return enumeration.Enumerate(full); },
+        [this](uint64_t generation) { publications.Add(generation); } };
+};
+
+TEST_CASE(StartEnumeratesFully) {
+    PipelineFixture fixture;
+    fixture.pipeline.Start();
+    CHECK(WaitUntil([&]() { return fixture.publications.Size() == 1; }));
+    CHECK_EQUAL(fixture.enumeration.FullCount(), 1u);
+    CHECK_EQUAL(fixture.pipeline.Current()->generation, 1u);
+    CHECK_EQUAL(fixture.pipeline.Current()->value.size(), FakeEnumeration::CONNECTORS);
+
+    fixture.pipeline.RequestRefresh(false);
+    CHECK(WaitUntil([&]() { return fixture.publications.Size() == 2; }));
+    CHECK_EQUAL(fixture.enumeration.FullCount(), 1u);
+    fixture.pipeline.Stop();
+}
+
+TEST_CASE(SeedPublishesWithoutCallback) {
+    PipelineFixture fixture;
+    std::vector<BluetoothConnector> known;
+    known.emplace_back(TestGuid(100), NamePool::Shared().Intern(L"From the last run"));
+    fixture.pipeline.Seed(std::move(known));
+    CHECK_EQUAL(fixture.pipeline.Current()->generation, 1u);
+    CHECK(fixture.pipeline.Current()->value.front().DeviceName() == L"From the last run");
+    CHECK_EQUAL(fixture.publications.Size(), 0u);
+
+    // The first enumeration replaces the seed
+    fixture.pipeline.Start();
+    CHECK(WaitUntil([&]() { return fixture.publications.Size() == 1; }));
+    CHECK(fixture.publications.Generations() == std::vector<uint64_t>{ 2 });
+    CHECK(GUIDEqualityComparer{}(fixture.pipeline.Current()->value.front().ContainerId(), TestGuid(1)));
+    fixture.pipeline.Stop();
+}
+
+TEST_CASE(BurstOfRequestsCollapses) {
+    PipelineFixture fixture;
+    fixture.enumeration.Hold(true);
+    fixture.pipeline.Start();
+    CHECK(WaitUntil([&]() { return fixture.enumeration.Count() == 1; }));
+
+    // Requests made while an enumeration runs become one more enumeration, a full one if any asked for it
+    std::vector<std::thread> requesters;
+    for (size_t t = 0; t < 8; ++t) {
+        requesters.emplace_back([&fixture, t]() {
+            for (size_t i = 0; i < 200; ++i)
+                fixture.pipeline.RequestRefresh(t == 3 && i == 100);
+        });
+    }
+    for (std::thread& requester : requesters)
+        requester.join();
+
+    fixture.enumeration.Hold(false);
+    CHECK(WaitUntil([&]() { return fixture.publications.Size() == 2; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK_EQUAL(fixture.enumeration.Count(), 2u);
+    CHECK_EQUAL(fixture.enumeration.FullCount(), 2u);
+    fixture.pipeline.Stop();
+}
+
+TEST_CASE(ConcurrentRefreshesAndReads) {
+    constexpr size_t REQUESTERS = 4;
+    constexpr size_t REQUESTS = 500;
+    PipelineFixture fixture;
+    fixture.pipeline.Start();
+
+    std::atomic<bool> requesting = true;
+    std::atomic<size_t> failures = 0;
+    std::vector<std::thread> readers;
+    for (size_t r = 0; r < 4; ++r) {
+        readers.emplace_back([&]() {
+            uint64_t lastGeneration = 0;
+            uint32_t lastEnumeration = 0;
+            while (requesting) {
+                std::shared_ptr<const ConnectorSnapshot> snapshot = fixture.pipeline.Current();
+                if (snapshot->generation < lastGeneration)
+                    ++failures;
+                lastGeneration = snapshot->generation;
+                if (snapshot->value.empty())
+                    continue;
+                // All from one enumeration, and never an earlier one than already seen
+                uint32_t enumeration = snapshot->value.front().ContainerId().Data1;
+                for (const BluetoothConnector& connector : snapshot->value) {
+                    if (connector.ContainerId().Data1 != enumeration)
+                        ++failures;
+                }
+                if (enumeration < lastEnumeration)
+                    ++failures;
+                lastEnumeration = enumeration;
+            }
+        });
+    }
+
+    std::vector<std::thread> requesters;
+    for (size_t t = 0; t < REQUESTERS; ++t) {
+        requesters.emplace_back([&fixture, t]() {
+            for (size_t i = 0; i < REQUESTS; ++i) {
+                fixture.pipeline.RequestRefresh(i % 50 == t);
+                if (i % 10 == 0)
+                    std::this_thread::yield();
+            }
+        });
+    }
+    for (std::thread& requester : requesters)
+        requester.join();
+
+    CHECK(WaitUntil([&]() { return fixture.publications.Size() == fixture.enumeration.Count(); }));
+    requesting = false;
+    for (std::thread& reader : readers)
+        reader.join();
+    fixture.pipeline.Stop();
+
+    CHECK_EQUAL(failures.load(), 0u);
+    // Never more than the first one and one per request
+    CHECK(fixture.enumeration.Count() <= REQUESTERS * REQUESTS + 1);
+    std::vector<uint64_t> generations = fixture.publications.Generations();
+    for (size_t i = 0; i < generations.size(); ++i)
+        CHECK_EQUAL(generations[i], i + 1);
+    CHECK_EQUAL(fixture.pipeline.Current()->generation, generations.size());
+}
+
+TEST_CASE(StopFinishesRunningEnumeration) {
+    PipelineFixture fixture;
+    std::atomic<int> started = 0;
+    std::atomic<int> stopping = 0;
+    fixture.enumeration.Hold(true);
+    fixture.pipeline.Start([&]() { ++started; }, [&]() { ++stopping; });
+    CHECK(WaitUntil([&]() { return fixture.enumeration.Count() == 1; }));
+    fixture.pipeline.RequestRefresh(false);
+
+    std::thread stopper([&]() { fixture.pipeline.Stop(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    fixture.enumeration.Hold(false);
+    stopper.join();
+
+    // The running enumeration was published; the pending request was dropped
+    CHECK(fixture.publications.Generations() == std::vector<uint64_t>{ 1 });
+    CHECK_EQUAL(fixture.enumeration.Count(), 1u);
+    CHECK(started == 1 && stopping == 1);
+
+    // Requests after Stop do nothing, and stopping again is harmless
+    fixture.pipeline.RequestRefresh(true);
+    fixture.pipeline.Stop();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK_EQUAL(fixture.enumeration.Count(), 1u);
+}
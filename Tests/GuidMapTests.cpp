@@ -0,0 +1,156 @@
+#include "TestHarness.h"
+
+#include <map>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include "GuidMap.h"
+
+static GUID MakeGuid(uint32_t data1, uint16_t data2 = 0, uint16_t data3 = 0, uint64_t tail = 0) {
+    GUID guid{ data1, data2, data3, {} };
+    std::memcpy(guid.Data4, &tail, sizeof(guid.Data4));
+    return guid;
+}
+
+struct GuidLess {
+    bool operator()(const GUID& a, const GUID& b) const {
+        return std::memcmp(&a, &b, sizeof(GUID)) < 0;
+    }
+};
+
+TEST_CASE(FindsInsertedEntries) {
+    GuidMap<int> map;
+    CHECK(map.empty());
+    CHECK(map.find(MakeGuid(1)) == map.end());
+
+    for (uint32_t i = 0; i < 1000; ++i)
+        CHECK(map.emplace(MakeGuid(i), static_cast<int>(i)).second);
+    CHECK_EQUAL(map.size(), 1000u);
+    CHECK(!map.emplace(MakeGuid(7), 0).second);
+
+    for (uint32_t i = 0; i < 1000; ++i) {
+        GuidMap<int>::iterator ite = map.find(MakeGuid(i));
+        CHECK(ite != map.end());
+        CHECK_EQUAL(ite->second, static_cast<int>(i));
+    }
+    CHECK(!map.contains(MakeGuid(1000)));
+}
+
+TEST_CASE(KeepsInsertionOrderUntilErase) {
+    GuidMap<int> map;
+    for (uint32_t i = 0; i < 10; ++i)
+        map[MakeGuid(i * 7919)] = static_cast<int>(i);
+
+    int expected = 0;
+    for (const std::pair<GUID, int>& entry : map)
+        CHECK_EQUAL(entry.second, expected++);
+}
+
+TEST_CASE(InsertOrAssignReplacesValue) {
+    GuidMap<std::string> map;
+    CHECK(map.insert_or_assign(MakeGuid(1), std::string("a")).second);
+    CHECK(!map.insert_or_assign(MakeGuid(1), std::string("b")).second);
+    CHECK_EQUAL(map.size(), 1u);
+    CHECK_EQUAL(map.find(MakeGuid(1))->second, "b");
+}
+
+// Random operations checked against std::map, including the backward shift of erase
+TEST_CASE(MatchesReferenceMapUnderRandomOperations) {
+    std::mt19937_64 random(7);
+    GuidMap<uint64_t> map;
+    std::map<GUID, uint64_t, GuidLess> reference;
+    for (int step = 0; step < 200000; ++step) {
+        // A small key space so inserts, hits and erases all happen often
+        GUID key = MakeGuid(static_cast<uint32_t>(random() % 512), 0, 0, random() % 2);
+        uint64_t value = random();
+        switch (random() % 4) {
+        case 0:
+        case 1:
+            CHECK_EQUAL(map.insert_or_assign(key, value).second, reference.insert_or_assign(key, value).second);
+            break;
+        case 2:
+            CHECK_EQUAL(map.erase(key), reference.erase(key));
+            break;
+        case 3: {
+            std::map<GUID, uint64_t, GuidLess>::iterator expected = reference.find(key);
+            GuidMap<uint64_t>::iterator actual = map.find(key);
+            CHECK_EQUAL(actual == map.end(), expected == reference.end());
+            if (actual != map.end())
+                CHECK_EQUAL(actual->second, expected->second);
+            break;
+        }
+        }
+        CHECK_EQUAL(map.size(), reference.size());
+    }
+
+    for (const std::pair<const GUID, uint64_t>& entry : reference)
+        CHECK_EQUAL(map.find(entry.first)->second, entry.second);
+}
+
+TEST_CASE(EraseByIteratorVisitsEveryEntry) {
+    GuidMap<int> map;
+    for (uint32_t i = 0; i < 100; ++i)
+        map[MakeGuid(i)] = static_cast<int>(i);
+
+    for (GuidMap<int>::iterator ite = map.begin(); ite != map.end();) {
+        if (ite->second % 3 == 0)
+            ite = map.erase(ite);
+        else
+            ++ite;
+    }
+    CHECK_EQUAL(map.size(), 66u);
+    for (uint32_t i = 0; i < 100; ++i)
+        CHECK_EQUAL(map.contains(MakeGuid(i)), i % 3 != 0);
+}
+
+TEST_CASE(FindManyMatchesFind) {
+    GuidMap<int> map;
+    for (uint32_t i = 0; i < 64; i += 2)
+        map[MakeGuid(i)] = static_cast<int>(i);
+
+    std::vector<GUID> keys;
+    for (uint32_t i = 0; i < 64; ++i)
+        keys.push_back(MakeGuid(i));
+    std::vector<int*> values(keys.size());
+    map.find_many(keys, values);
+    for (uint32_t i = 0; i < 64; ++i) {
+        CHECK_EQUAL(values[i] != nullptr, i % 2 == 0);
+        if (values[i] != nullptr)
+            CHECK_EQUAL(*values[i], static_cast<int>(i));
+    }
+}
+
+TEST_CASE(ClearAndReserveKeepTheMapUsable) {
+    GuidMap<int> map;
+    map.reserve(100);
+    for (uint32_t i = 0; i < 100; ++i)
+        map[MakeGuid(i)] = 1;
+    map.clear();
+    CHECK(map.empty());
+    CHECK(!map.contains(MakeGuid(5)));
+    map[MakeGuid(5)] = 2;
+    CHECK_EQUAL(map.find(MakeGuid(5))->second, 2);
+}
+
+// GUIDs that differ only in one field, or only in correlated fields, must still spread over the low
+// bits a table indexes with. The XOR hash this replaced mapped all of these to a handful of values.
+TEST_CASE(HashSpreadsCorrelatedGuids) {
+    const size_t buckets = 1024;
+    std::vector<std::vector<GUID>> inputs(4);
+    for (uint32_t i = 0; i < 4096; ++i) {
+        inputs[0].push_back(MakeGuid(i));
+        inputs[1].push_back(MakeGuid(0, 0, 0, uint64_t{ i } << 40));
+        // Same value in Data1 and the tail cancels out under XOR
+        inputs[2].push_back(MakeGuid(i, 0, 0, i));
+        inputs[3].push_back(MakeGuid(0x12345678, static_cast<uint16_t>(i), static_cast<uint16_t>(i)));
+    }
+
+    for (const std::vector<GUID>& keys : inputs) {
+        std::vector<size_t> counts(buckets);
+        for (const GUID& key : keys)
+            ++counts[GUIDHasher{}(key) % buckets];
+        // 4 expected per bucket; a decent hash stays far below this
+        CHECK(*std::max_element(counts.begin(), counts.end()) <= 16);
+    }
+}
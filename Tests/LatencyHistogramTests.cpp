@@ -0,0 +1,95 @@
+#include "TestHarness.h"
+
+#include <thread>
+#include <vector>
+
+#include "LatencyHistogram.h"
+
+using std::chrono::microseconds;
+
+TEST_CASE(BucketsCoverEveryValueOnce) {
+    CHECK_EQUAL(LatencyHistogram::BucketLowest(0), 0u);
+    for (size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+        uint64_t lowest = LatencyHistogram::BucketLowest(i);
+        uint64_t highest = LatencyHistogram::BucketHighest(i);
+        CHECK(lowest <= highest);
+        CHECK_EQUAL(LatencyHistogram::BucketIndex(lowest), i);
+        CHECK_EQUAL(LatencyHistogram::BucketIndex(highest), i);
+        if (i + 1 < LatencyHistogram::BUCKET_COUNT)
+            CHECK_EQUAL(LatencyHistogram::BucketLowest(i + 1), highest + 1);
+        // Exact below 2 * SUB_BUCKETS, then within 1 / SUB_BUCKETS of the values in the bucket
+        if (lowest < 2 * LatencyHistogram::SUB_BUCKETS)
+            CHECK_EQUAL(highest, lowest);
+        else
+            CHECK((highest - lowest + 1) * LatencyHistogram::SUB_BUCKETS <= lowest);
+    }
+    CHECK_EQUAL(LatencyHistogram::BucketHighest(LatencyHistogram::BUCKET_COUNT - 1), LatencyHistogram::MAX_VALUE);
+}
+
+TEST_CASE(ClampsOutOfRangeDurations) {
+    LatencyHistogram histogram;
+    histogram.Record(microseconds(-5));
+    histogram.Record(std::chrono::hours(10));
+    CHECK_EQUAL(histogram.BucketCount(0), 1u);
+    CHECK_EQUAL(histogram.BucketCount(LatencyHistogram::BUCKET_COUNT - 1), 1u);
+    CHECK_EQUAL(histogram.Count(), 2u);
+}
+
+TEST_CASE(PercentilesUseNearestRank) {
+    LatencyHistogram histogram;
+    CHECK(histogram.Percentile(50) == microseconds::zero());
+
+    // 1 to 100us, all in exact buckets up to 63
+    for (int i = 1; i <= 100; ++i)
+        histogram.Record(microseconds(i));
+    CHECK_EQUAL(histogram.Count(), 100u);
+    CHECK_EQUAL(histogram.Percentile(0).count(), 1);
+    CHECK_EQUAL(histogram.Percentile(1).count(), 1);
+    CHECK_EQUAL(histogram.Percentile(50).count(), 50);
+    // 90 shares its bucket with 91
+    CHECK_EQUAL(histogram.Percentile(90).count(), 91);
+    CHECK_EQUAL(histogram.Percentile(100).count(), 101);
+
+    LatencyHistogram single;
+    single.Record(std::chrono::milliseconds(250));
+    microseconds p99 = single.Percentile(99);
+    CHECK(p99 >= std::chrono::milliseconds(250) && p99 <= std::chrono::milliseconds(250) * 33 / 32);
+}
+
+TEST_CASE(AddsEarlierCounts) {
+    LatencyHistogram histogram;
+    histogram.Add(LatencyHistogram::BucketIndex(1000), 3);
+    histogram.Record(microseconds(1000));
+    CHECK_EQUAL(histogram.BucketCount(LatencyHistogram::BucketIndex(1000)), 4u);
+    CHECK_EQUAL(histogram.Count(), 4u);
+}
+
+TEST_CASE(CountsEveryConcurrentRecord) {
+    constexpr int THREADS = 8;
+    constexpr int RECORDS = 20000;
+    LatencyHistogram histogram;
+    std::atomic<bool> done = false;
+
+    // A reader racing the recorders only ever sees values that were recorded
+    std::thread reader([&histogram, &done] {
+        while (!done) {
+            microseconds p50 = histogram.Percentile(50);
+            CHECK(p50 == microseconds::zero() || (p50 >= microseconds(1) && p50 <= microseconds(8)));
+        }
+    });
+    std::vector<std::thread> recorders;
+    for (int t = 0; t < THREADS; ++t) {
+        recorders.emplace_back([&histogram, t] {
+            for (int i = 0; i < RECORDS; ++i)
+                histogram.Record(microseconds(t + 1));
+        });
+    }
+    for (std::thread& recorder : recorders)
+        recorder.join();
+    done = true;
+    reader.join();
+
+    CHECK_EQUAL(histogram.Count(), uint64_t{ THREADS } * RECORDS);
+    for (int t = 0; t < THREADS; ++t)
+        CHECK_EQUAL(histogram.BucketCount(static_cast<size_t>(t + 1)), static_cast<uint32_t>(RECORDS));
+}
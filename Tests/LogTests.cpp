@@ -0,0 +1,129 @@
+#include "TestHarness.h"
+
+#include <thread>
+#include <vector>
+
+#include "Log.h"
+#include "LogDecoder.h"
+
+static std::vector<std::wstring> DrainLines() {
+    std::vector<std::wstring> lines;
+    LogDrain::Drain([&](const std::wstring& line) { lines.push_back(line); });
+    return lines;
+}
+
+// The message part of "[12.345678 I #3] message\n"
+static std::wstring Message(const std::wstring& line) {
+    size_t start = line.find(L"] ");
+    return line.substr(start + 2, line.size() - start - 3);
+}
+
+struct Point {
+    int x;
+    int y;
+};
+
+static std::wostream& operator<<(std::wostream& stream, const Point& point) {
+    return stream << L'(' << point.x << L',' << point.y << L')';
+}
+
+TEST_CASE(FormatsArgumentsWhenDrained) {
+    DrainLines();
+    std::wstring name = L"WH-CH510";
+    LOG_WARNING(L"name={}, connected={}, count={}, delta={}, ratio={}, letter={}, point={}", name, true, 42u, -7, 0.5, L'x', Point{ 1, 2 });
+
+    std::vector<std::wstring> lines = DrainLines();
+    CHECK(lines.size() == 1);
+    CHECK(lines[0].find(L" W #") != std::wstring::npos);
+    CHECK(Message(lines[0]) == L"name=WH-CH510, connected=1, count=42, delta=-7, ratio=0.5, letter=x, point=(1,2)");
+}
+
+TEST_CASE(AppendsArgumentsWithoutPlaceholder) {
+    DrainLines();
+    const wchar_t* missing = nullptr;
+    LOG_ERROR(L"failed:", 5, missing);
+    std::vector<std::wstring> lines = DrainLines();
+    CHECK(lines.size() == 1);
+    CHECK(Message(lines[0]) == L"failed: 5 (null)");
+}
+
+TEST_CASE(TruncatesLongStrings) {
+    DrainLines();
+    std::wstring huge(LogRecordBuilder::MAX_STRING_LENGTH + 100, L'a');
+    LOG_INFO(L"{}", huge);
+    std::vector<std::wstring> lines = DrainLines();
+    CHECK(lines.size() == 1);
+    CHECK(Message(lines[0]).size() == LogRecordBuilder::MAX_STRING_LENGTH);
+}
+
+TEST_CASE(RejectsMalformedRecords) {
+    LogRecordHeader header{};
+    header.size = sizeof(header) + 4;
+    header.argumentCount = 1;
+    header.format = L"{}";
+    std::vector<uint8_t> record(header.size);
+    std::memcpy(record.data(), &header, sizeof(header));
+    record[sizeof(header)] = static_cast<uint8_t>(LogArgumentType::Unsigned);
+    // The value is cut short
+    CHECK(!DecodeLogRecord(record.data(), record.size(), 1).has_value());
+    // The size doesn't match
+    CHECK(!DecodeLogRecord(record.data(), record.size() - 1, 1).has_value());
+}
+
+TEST_CASE(ReportsDroppedRecordsWhenTheRingIsFull) {
+    DrainLines();
+    std::thread([]() {
+        std::wstring text(1000, L'x');
+        for (int i = 0; i < 200; ++i)
+            LOG_INFO(L"{}", text);
+    }).join();
+
+    std::vector<std::wstring> lines = DrainLines();
+    // A 64KB ring holds about 32 of these records; the rest are counted
+    CHECK(lines.size() > 10 && lines.size() < 200);
+    CHECK(lines.back().find(L"log records dropped") != std::wstring::npos);
+}
+
+// Records of exited threads are still drained, and all lines come out in time order.
+TEST_CASE(MergesThreadsInTimeOrder) {
+    DrainLines();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([t]() {
+            for (int i = 0; i < 100; ++i)
+                LOG_INFO(L"thread {} record {}", t, i);
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    std::vector<std::wstring> lines = DrainLines();
+    CHECK(lines.size() == 400);
+    std::vector<int> next(4);
+    for (const std::wstring& line : lines) {
+        int thread = 0;
+        int record = 0;
+        CHECK(swscanf(Message(line).c_str(), L"thread %d record %d", &thread, &record) == 2);
+        CHECK(record == next[thread]++);
+    }
+    CHECK(DrainLines().empty());
+}
+
+TEST_CASE(DisabledLevelsRecordNothing) {
+    DrainLines();
+    int evaluated = 0;
+    LOG_DEBUG(L"{}", ++evaluated);
+    CHECK(!LogLevelEnabled(LogLevel::Debug));
+    CHECK(evaluated == 0);
+    CHECK(DrainLines().empty());
+}
+
+TEST_CASE(DrainThreadDeliversOnStop) {
+    DrainLines();
+    std::vector<std::wstring> lines;
+    LogDrain drain;
+    drain.Start([&](const std::wstring& line) { lines.push_back(line); }, std::chrono::milliseconds(10));
+    LOG_INFO(L"before stop");
+    drain.Stop();
+    CHECK(lines.size() == 1);
+}
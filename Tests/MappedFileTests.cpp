@@ -0,0 +1,94 @@
+#include "TestHarness.h"
+
+#include <fstream>
+#include <algorithm>
+
+#include "MappedFile.h"
+
+static std::vector<uint8_t> Bytes(std::string_view text) {
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+static std::string Text(const std::shared_ptr<const MappedFile>& file) {
+    return std::string(file->Bytes().begin(), file->Bytes().end());
+}
+
+static std::vector<std::string> FileNames(const std::filesystem::path& directory) {
+    std::vector<std::string> names;
+    for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(directory))
+        names.push_back(entry.path().filename().string());
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+static void WriteFile(const std::filesystem::path& path, std::string_view text) {
+    std::ofstream(path, std::ios::binary) << text;
+}
+
+static bool AnyFile(std::span<const uint8_t>) {
+    return true;
+}
+
+TEST_CASE(WritesAtomically) {
+    TemporaryDirectory directory;
+    std::filesystem::path path = directory.Path() / "nested" / "file.dat";
+    CHECK(MappedFile::WriteAtomically(path, Bytes("first")));
+    CHECK(MappedFile::WriteAtomically(path, Bytes("second")));
+    CHECK_EQUAL(Text(MappedFile::Open(path)), "second");
+    CHECK(FileNames(path.parent_path()) == std::vector<std::string>{ "file.dat" });
+}
+
+TEST_CASE(OpensNothingForMissingOrEmptyFile) {
+    TemporaryDirectory directory;
+    CHECK(MappedFile::Open(directory.Path() / "missing") == nullptr);
+    WriteFile(directory.Path() / "empty", "");
+    CHECK(MappedFile::Open(directory.Path() / "empty") == nullptr);
+}
+
+TEST_CASE(KeepsOnlyNewestVersion) {
+    TemporaryDirectory directory;
+    VersionedMappedFile files(directory.Path() / "records.cache");
+    CHECK(files.Open(AnyFile) == nullptr);
+
+    std::shared_ptr<const MappedFile> first = files.Write(Bytes("first"));
+    std::shared_ptr<const MappedFile> second = files.Write(Bytes("second"));
+    CHECK_EQUAL(Text(second), "second");
+    // A reader of the first version still sees it; off Windows its file is gone already
+    CHECK_EQUAL(Text(first), "first");
+    CHECK(FileNames(directory.Path()) == std::vector<std::string>{ "records.2.cache" });
+
+    VersionedMappedFile reopened(directory.Path() / "records.cache");
+    CHECK_EQUAL(Text(reopened.Open(AnyFile)), "second");
+    reopened.Write(Bytes("third"));
+    CHECK(FileNames(directory.Path()) == std::vector<std::string>{ "records.3.cache" });
+}
+
+TEST_CASE(FallsBackToNewestValidVersion) {
+    TemporaryDirectory directory;
+    VersionedMappedFile files(directory.Path() / "records.cache");
+    files.Write(Bytes("valid"));
+    // E.g. cut short by a full disk, or written by a newer build
+    WriteFile(directory.Path() / "records.2.cache", "corrupt");
+
+    VersionedMappedFile reopened(directory.Path() / "records.cache");
+    std::shared_ptr<const MappedFile> file = reopened.Open([](std::span<const uint8_t> bytes) { return bytes.size() == 5; });
+    CHECK_EQUAL(Text(file), "valid");
+    CHECK(FileNames(directory.Path()) == std::vector<std::string>{ "records.1.cache" });
+
+    // The next version is numbered above the rejected one
+    reopened.Write(Bytes("next"));
+    CHECK(FileNames(directory.Path()) == std::vector<std::string>{ "records.3.cache" });
+}
+
+TEST_CASE(ReplacesUnversionedFileAndLeavesOthersAlone) {
+    TemporaryDirectory directory;
+    WriteFile(directory.Path() / "records.cache", "legacy");
+    WriteFile(directory.Path() / "records.x.cache", "unrelated");
+    WriteFile(directory.Path() / "other.1.cache", "unrelated");
+    WriteFile(directory.Path() / "records.1.dat", "unrelated");
+
+    VersionedMappedFile files(directory.Path() / "records.cache");
+    CHECK(files.Open(AnyFile) == nullptr);
+    files.Write(Bytes("new"));
+    CHECK(FileNames(directory.Path()) == (std::vector<std::string>{ "other.1.cache", "records.1.cache", "records.1.dat", "records.x.cache" }));
+}
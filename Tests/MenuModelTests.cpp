@@ -0,0 +1,169 @@
+#include "TestHarness.h"
+
+#include <random>
+#include <string>
+#include <algorithm>
+
+#include "MenuModel.h"
+
+// What the native menu holds: the slot and label of every device item, in menu order
+struct ShownItem {
+    uint32_t slot;
+    std::wstring name;
+    bool checked;
+};
+
+// Applies the patches like ToothTrayMenu does to the native menu, then checks it shows the model
+static void ApplyAndCheck(std::vector<ShownItem>& menu, const MenuModel& model, const std::vector<MenuPatch>& patches) {
+    for (const MenuPatch& patch : patches) {
+        switch (patch.type) {
+        case MenuPatchType::Remove:
+            CHECK(patch.position < menu.size() && menu[patch.position].slot == patch.slot);
+            menu.erase(menu.begin() + static_cast<ptrdiff_t>(patch.position));
+            break;
+        case MenuPatchType::Insert: {
+            CHECK(patch.position <= menu.size());
+            const MenuEntry& entry = model.Entries()[patch.position];
+            CHECK_EQUAL(entry.slot, patch.slot);
+            menu.insert(menu.begin() + static_cast<ptrdiff_t>(patch.position), ShownItem{ patch.slot, std::wstring(entry.item.name.View()), entry.item.checked });
+            break;
+        }
+        case MenuPatchType::Update: {
+            CHECK(patch.position < menu.size() && menu[patch.position].slot == patch.slot);
+            const MenuEntry& entry = model.Entries()[patch.position];
+            menu[patch.position].name = entry.item.name.View();
+            menu[patch.position].checked = entry.item.checked;
+            break;
+        }
+        }
+    }
+
+    CHECK_EQUAL(menu.size(), model.Entries().size());
+    for (size_t i = 0; i < menu.size(); ++i) {
+        const MenuEntry& entry = model.Entries()[i];
+        CHECK_EQUAL(menu[i].slot, entry.slot);
+        CHECK(menu[i].name == entry.item.name.View());
+        CHECK_EQUAL(menu[i].checked, entry.item.checked);
+        CHECK_EQUAL(*model.IndexOfSlot(entry.slot), i);
+    }
+}
+
+static MenuItem Item(uint32_t id, std::wstring_view name, bool checked = false) {
+    return MenuItem{ TestGuid(id), NamePool::Shared().Intern(name), checked };
+}
+
+static size_t CountPatches(const std::vector<MenuPatch>& patches, MenuPatchType type) {
+    return static_cast<size_t>(std::count_if(patches.begin(), patches.end(), [type](const MenuPatch& patch) { return patch.type == type; }));
+}
+
+TEST_CASE(InsertsEverythingFirst) {
+    MenuModel model;
+    std::vector<ShownItem> menu;
+    std::vector<MenuItem> items{ Item(1, L"Headphones"), Item(2, L"Speaker", true) };
+    std::vector<MenuPatch> patches = model.Update(items);
+    CHECK_EQUAL(CountPatches(patches, MenuPatchType::Insert), 2u);
+    ApplyAndCheck(menu, model, patches);
+
+    // Nothing changed, nothing to do
+    CHECK(model.Update(items).empty());
+}
+
+TEST_CASE(UpdatesChangedItemsInPlace) {
+    MenuModel model;
+    std::vector<ShownItem> menu;
+    ApplyAndCheck(menu, model, model.Update(std::vector<MenuItem>{ Item(1, L"Headphones"), Item(2, L"Speaker") }));
+
+    std::vector<MenuPatch> patches = model.Update(std::vector<MenuItem>{ Item(1, L"Headphones", true), Item(2, L"Kitchen speaker") });
+    CHECK_EQUAL(patches.size(), 2u);
+    CHECK_EQUAL(CountPatches(patches, MenuPatchType::Update), 2u);
+    ApplyAndCheck(menu, model, patches);
+}
+
+TEST_CASE(MovesFewestItemsAndKeepsSlots) {
+    MenuModel model;
+    std::vector<ShownItem> menu;
+    ApplyAndCheck(menu, model, model.Update(std::vector<MenuItem>{ Item(1, L"a"), Item(2, L"b"), Item(3, L"c"), Item(4, L"d") }));
+    uint32_t slotOfD = model.Entries()[3].slot;
+
+    // Renamed so it sorts first: only that one moves
+    std::vector<MenuPatch> patches = model.Update(std::vector<MenuItem>{ Item(4, L"0 d"), Item(1, L"a"), Item(2, L"b"), Item(3, L"c") });
+    CHECK_EQUAL(patches.size(), 2u);
+    CHECK_EQUAL(CountPatches(patches, MenuPatchType::Remove), 1u);
+    CHECK_EQUAL(CountPatches(patches, MenuPatchType::Insert), 1u);
+    ApplyAndCheck(menu, model, patches);
+    CHECK_EQUAL(model.Entries()[0].slot, slotOfD);
+}
+
+TEST_CASE(ReusesSlotsOfRemovedItems) {
+    MenuModel model;
+    std::vector<ShownItem> menu;
+    ApplyAndCheck(menu, model, model.Update(std::vector<MenuItem>{ Item(1, L"a"), Item(2, L"b") }));
+    uint32_t slotOfA = model.Entries()[0].slot;
+
+    ApplyAndCheck(menu, model, model.Update(std::vector<MenuItem>{ Item(2, L"b") }));
+    CHECK(!model.IndexOfSlot(slotOfA).has_value());
+    ApplyAndCheck(menu, model, model.Update(std::vector<MenuItem>{ Item(2, L"b"), Item(3, L"c") }));
+    CHECK_EQUAL(model.Entries()[1].slot, slotOfA);
+    CHECK(!model.IndexOfSlot(0).has_value() && !model.IndexOfSlot(MenuModel::MAX_SLOTS + 1).has_value());
+}
+
+TEST_CASE(ShowsRepeatedContainerOnce) {
+    MenuModel model;
+    std::vector<ShownItem> menu;
+    std::vector<MenuPatch> patches = model.Update(std::vector<MenuItem>{ Item(1, L"a"), Item(1, L"a") });
+    ApplyAndCheck(menu, model, patches);
+    // The repeat is new every time, so it gets its own slot
+    CHECK_EQUAL(model.Entries().size(), 2u);
+    CHECK(model.Entries()[0].slot != model.Entries()[1].slot);
+    ApplyAndCheck(menu, model, model.Update(std::vector<MenuItem>{ Item(1, L"a") }));
+}
+
+TEST_CASE(LeavesOutItemsPastMaxSlots) {
+    MenuModel model;
+    std::vector<ShownItem> menu;
+    std::vector<MenuItem> items;
+    for (uint32_t i = 0; i < MenuModel::MAX_SLOTS + 10; ++i)
+        items.push_back(Item(i + 1, L"device " + std::to_wstring(i)));
+    ApplyAndCheck(menu, model, model.Update(items));
+    CHECK_EQUAL(model.Entries().size(), size_t{ MenuModel::MAX_SLOTS });
+
+    // Turning over every device still finds free slots
+    for (MenuItem& item : items)
+        item.containerId.Data2 = 1;
+    ApplyAndCheck(menu, model, model.Update(items));
+    CHECK_EQUAL(model.Entries().size(), size_t{ MenuModel::MAX_SLOTS });
+}
+
+TEST_CASE(RandomChangesKeepMenuInSync) {
+    std::mt19937 random(777);
+    MenuModel model;
+    std::vector<ShownItem> menu;
+    std::vector<MenuItem> items;
+    uint32_t nextId = 1;
+    for (int round = 0; round < 2000; ++round) {
+        // Devices pair and unpair, connect and disconnect, get renamed and move in the order
+        switch (random() % 5) {
+        case 0:
+            items.insert(items.begin() + static_cast<ptrdiff_t>(random() % (items.size() + 1)), Item(nextId, L"device " + std::to_wstring(nextId)));
+            ++nextId;
+            break;
+        case 1:
+            if (!items.empty())
+                items.erase(items.begin() + static_cast<ptrdiff_t>(random() % items.size()));
+            break;
+        case 2:
+            if (!items.empty())
+                items[random() % items.size()].checked ^= true;
+            break;
+        case 3:
+            if (items.size() > 1)
+                std::swap(items[random() % items.size()], items[random() % items.size()]);
+            break;
+        default:
+            if (!items.empty())
+                items[random() % items.size()].name = NamePool::Shared().Intern(L"renamed " + std::to_wstring(random() % 10));
+            break;
+        }
+        ApplyAndCheck(menu, model, model.Update(items));
+    }
+}
@@ -0,0 +1,143 @@
+#include "TestHarness.h"
+
+#include <new>
+#include <atomic>
+#include <thread>
+#include <cstdlib>
+
+#include "NamePool.h"
+#include "ContainerNameIndex.h"
+#include "FakeContainerSource.h"
+
+// Every allocation in this executable goes through these, so a test can count the ones its body makes.
+// GCC can't tell the replaced operator new allocates with malloc.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static std::atomic<size_t> g_allocations = 0;
+
+void* operator new(size_t size) {
+    ++g_allocations;
+    if (void* memory = std::malloc(size == 0 ? 1 : size))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+template <typename F>
+static size_t AllocationsDuring(F&& body) {
+    size_t before = g_allocations;
+    body();
+    return g_allocations - before;
+}
+
+// Longer than any small string buffer, like real device names
+static std::wstring DeviceName(size_t index) {
+    return L"WH-1000XM4 Wireless Headphones #" + std::to_wstring(index);
+}
+
+TEST_CASE(InternsEachNameOnce) {
+    NamePool pool;
+    CHECK_EQUAL(pool.Size(), 1u);
+    CHECK(pool.Intern(L"") == pool.Empty());
+
+    InternedName first = pool.Intern(DeviceName(1));
+    CHECK(pool.Intern(DeviceName(1)) == first);
+    CHECK(!(pool.Intern(DeviceName(2)) == first));
+    CHECK(first.View() == DeviceName(1));
+    CHECK_EQUAL(pool.Size(), 3u);
+    CHECK_EQUAL(pool.Bytes(), (DeviceName(1).size() + DeviceName(2).size() + 3) * sizeof(wchar_t));
+}
+
+TEST_CASE(InterningAKnownNameAllocatesNothing) {
+    NamePool pool;
+    std::wstring name = DeviceName(1);
+    CHECK(AllocationsDuring([&]() { pool.Intern(name); }) > 0);
+    CHECK_EQUAL(AllocationsDuring([&]() {
+        for (size_t i = 0; i < 1000; ++i)
+            pool.Intern(name);
+    }), 0u);
+}
+
+TEST_CASE(HandlesCopyWithoutAllocating) {
+    NamePool pool;
+    std::vector<std::wstring> strings;
+    std::vector<InternedName> handles;
+    for (size_t i = 0; i < 64; ++i) {
+        strings.push_back(DeviceName(i));
+        handles.push_back(pool.Intern(strings.back()));
+    }
+
+    // What the menu and the batches used to hold: a copy of each name, made again on every refresh
+    CHECK_EQUAL(AllocationsDuring([&]() { std::vector<std::wstring> copy = strings; }), strings.size() + 1);
+    CHECK_EQUAL(AllocationsDuring([&]() { std::vector<InternedName> copy = handles; }), 1u);
+}
+
+TEST_CASE(RefreshCyclesDontGrowThePool) {
+    constexpr size_t CONTAINERS = 64;
+    FakeContainerSource source;
+    for (size_t i = 0; i < CONTAINERS; ++i)
+        source.SetContainerName(TestGuid(static_cast<uint32_t>(i)), DeviceName(i));
+    ContainerNameIndex index(source);
+
+    // A refresh resolves every container again after a device change dropped the cached names
+    std::vector<InternedName> names(CONTAINERS);
+    auto refresh = [&]() {
+        index.Clear();
+        for (size_t i = 0; i < CONTAINERS; ++i)
+            names[i] = *index.Lookup(TestGuid(static_cast<uint32_t>(i)));
+    };
+
+    refresh();
+    std::vector<InternedName> firstNames = names;
+    size_t poolSize = NamePool::Shared().Size();
+    size_t poolBytes = NamePool::Shared().Bytes();
+    size_t cycleAllocations = AllocationsDuring(refresh);
+    for (size_t cycle = 0; cycle < 10; ++cycle) {
+        // Resolving and caching allocate the same each time; the names add nothing
+        CHECK_EQUAL(AllocationsDuring(refresh), cycleAllocations);
+        CHECK_EQUAL(NamePool::Shared().Size(), poolSize);
+        CHECK_EQUAL(NamePool::Shared().Bytes(), poolBytes);
+        CHECK(names == firstNames);
+    }
+
+    // A rename adds only the new name
+    index.Start();
+    source.SetContainerName(TestGuid(3), L"Renamed headphones");
+    refresh();
+    CHECK_EQUAL(NamePool::Shared().Size(), poolSize + 1);
+    CHECK(names[3].View() == L"Renamed headphones");
+    index.Stop();
+}
+
+TEST_CASE(ConcurrentInterningSharesHandles) {
+    constexpr size_t NAMES = 200;
+    NamePool pool;
+    std::vector<std::vector<InternedName>> handles(4, std::vector<InternedName>(NAMES));
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < handles.size(); ++t) {
+        threads.emplace_back([&pool, &handles, t]() {
+            // Each thread starts at another name, so they race to add the same ones
+            for (size_t i = 0; i < NAMES; ++i) {
+                size_t name = (i + t * NAMES / handles.size()) % NAMES;
+                handles[t][name] = pool.Intern(DeviceName(name));
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    CHECK_EQUAL(pool.Size(), NAMES + 1);
+    for (size_t t = 1; t < handles.size(); ++t)
+        CHECK(handles[t] == handles[0]);
+    for (size_t i = 0; i < NAMES; ++i)
+        CHECK(handles[0][i].View() == DeviceName(i));
+}
@@ -0,0 +1,151 @@
+#include "TestHarness.h"
+
+#include <random>
+
+#include "PresencePolicy.h"
+#include "DeviceTable.h"
+
+using std::chrono::seconds;
+
+// Major class audio, minor class headphones
+static constexpr uint32_t HEADPHONES_CLASS = 0x240418;
+// Major class phone
+static constexpr uint32_t PHONE_CLASS = 0x5A020C;
+
+static const PresencePolicy::TimePoint START = PresencePolicy::TimePoint() + std::chrono::hours(1);
+
+// One report of a synthetic presence stream: a device in range, or gone when inRange is false
+struct PresenceEvent {
+    seconds at;
+    uint64_t address;
+    bool inRange;
+    bool connected = false;
+};
+
+struct StreamResult {
+    size_t prewarms = 0;
+    size_t autoConnects = 0;
+};
+
+static StreamResult Play(PresencePolicy& policy, const std::vector<PresenceEvent>& events, uint32_t classOfDevice = HEADPHONES_CLASS, bool paired = true) {
+    StreamResult result;
+    for (const PresenceEvent& event : events) {
+        if (!event.inRange) {
+            policy.OutOfRange(event.address, START + event.at);
+            continue;
+        }
+        PresenceDecision decision = policy.InRange(event.address, classOfDevice, paired, event.connected, START + event.at);
+        result.prewarms += decision.prewarm;
+        result.autoConnects += decision.autoConnect;
+    }
+    return result;
+}
+
+static PresencePolicy AutoConnecting(const PresencePolicyOptions& options = {}) {
+    PresencePolicy policy(options, START);
+    policy.SetDefaultPolicy(DevicePresencePolicy{ true, true });
+    return policy;
+}
+
+TEST_CASE(OnlyArrivalsAct) {
+    PresencePolicy policy = AutoConnecting();
+    // Reports while staying in range, e.g. as the connected flag changes
+    StreamResult result = Play(policy, {
+        { seconds(0), 1, true }, { seconds(1), 1, true }, { seconds(5), 1, true, true }, { seconds(9), 1, true } });
+    CHECK_EQUAL(result.prewarms, 1u);
+    CHECK_EQUAL(result.autoConnects, 1u);
+}
+
+TEST_CASE(IgnoresUnpairedAndNonAudioDevices) {
+    PresencePolicy policy = AutoConnecting();
+    std::vector<PresenceEvent> arrival{ { seconds(0), 1, true } };
+    CHECK_EQUAL(Play(policy, arrival, PHONE_CLASS).prewarms, 0u);
+    CHECK_EQUAL(Play(policy, arrival, HEADPHONES_CLASS, false).prewarms, 0u);
+    CHECK_EQUAL(Play(policy, arrival).prewarms, 1u);
+}
+
+TEST_CASE(FlappingWithinGraceIsOneArrival) {
+    PresencePolicy policy = AutoConnecting();
+    // At the edge of range: gone and back every few seconds for ten minutes
+    std::vector<PresenceEvent> events;
+    for (int i = 0; i < 100; ++i) {
+        events.push_back({ seconds(i * 6), 1, true });
+        events.push_back({ seconds(i * 6 + 3), 1, false });
+    }
+    StreamResult result = Play(policy, events);
+    CHECK_EQUAL(result.prewarms, 1u);
+    CHECK_EQUAL(result.autoConnects, 1u);
+}
+
+TEST_CASE(ReturningAfterGraceIsArrivalSubjectToIntervals) {
+    PresencePolicyOptions options;
+    PresencePolicy policy = AutoConnecting(options);
+    StreamResult result = Play(policy, {
+        { seconds(0), 1, true }, { seconds(10), 1, false },
+        // Past the grace, but within the prewarm and connect intervals
+        { seconds(50), 1, true }, { seconds(55), 1, false },
+        // Past the prewarm interval only
+        { seconds(120), 1, true }, { seconds(125), 1, false },
+        // Past both
+        { seconds(700), 1, true } });
+    CHECK_EQUAL(result.prewarms, 3u);
+    CHECK_EQUAL(result.autoConnects, 2u);
+}
+
+TEST_CASE(ConnectedDeviceIsNotConnectedAgain) {
+    PresencePolicy policy = AutoConnecting();
+    StreamResult result = Play(policy, { { seconds(0), 1, true, true } });
+    CHECK_EQUAL(result.prewarms, 1u);
+    CHECK_EQUAL(result.autoConnects, 0u);
+}
+
+TEST_CASE(DevicePolicyOverridesDefault) {
+    PresencePolicy policy(PresencePolicyOptions{}, START);
+    policy.SetDevicePolicy(2, DevicePresencePolicy{ false, true });
+    StreamResult result = Play(policy, { { seconds(0), 1, true }, { seconds(0), 2, true } });
+    CHECK_EQUAL(result.prewarms, 1u);
+    CHECK_EQUAL(result.autoConnects, 1u);
+}
+
+TEST_CASE(AutoConnectsAreRateLimitedAcrossDevices) {
+    PresencePolicy policy = AutoConnecting();
+    CHECK_EQUAL(policy.AutoConnectTokens(START), 2u);
+
+    // A room full of paired headphones comes into range at once
+    std::vector<PresenceEvent> events;
+    for (uint64_t address = 1; address <= 20; ++address)
+        events.push_back({ seconds(0), address, true });
+    StreamResult result = Play(policy, events);
+    CHECK_EQUAL(result.prewarms, 20u);
+    CHECK_EQUAL(result.autoConnects, 2u);
+    CHECK_EQUAL(policy.AutoConnectTokens(START), 0u);
+
+    // One token per refill, never more than the burst
+    CHECK_EQUAL(policy.AutoConnectTokens(START + seconds(300)), 1u);
+    CHECK_EQUAL(policy.AutoConnectTokens(START + seconds(3000)), 2u);
+}
+
+TEST_CASE(RandomStreamStaysWithinLimits) {
+    PresencePolicyOptions options;
+    PresencePolicy policy = AutoConnecting(options);
+    std::mt19937 random(4321);
+    constexpr uint64_t DEVICES = 50;
+    constexpr int HOURS = 24;
+
+    // Devices come and go at random for a day
+    std::vector<PresenceEvent> events;
+    std::vector<bool> inRange(DEVICES + 1, false);
+    for (int second = 0; second < HOURS * 3600; second += 1 + static_cast<int>(random() % 20)) {
+        uint64_t address = 1 + random() % DEVICES;
+        inRange[address] = random() % 3 != 0;
+        events.push_back({ seconds(second), address, inRange[address], random() % 4 == 0 });
+    }
+    StreamResult result = Play(policy, events);
+
+    // The token bucket bounds the connects; the interval bounds each device's prewarms
+    size_t maximumConnects = options.autoConnectBurst + HOURS * 3600 / static_cast<size_t>(options.autoConnectRefill.count());
+    CHECK(result.autoConnects > 0 && result.autoConnects <= maximumConnects);
+    size_t maximumPrewarms = DEVICES * (HOURS * 3600 / static_cast<size_t>(options.prewarmInterval.count()) + 1);
+    CHECK(result.prewarms > 0 && result.prewarms <= maximumPrewarms);
+    CHECK(result.prewarms < events.size() / 2);
+}
@@ -0,0 +1,98 @@
+#include <random>
+#include <cstdio>
+#include <cstdint>
+
+#include "SdpParser.h"
+#include "FakeSdpRecordSource.h"
+
+// Service records come from whatever device answers the query, so every view must hold up against
+// arbitrary bytes. Built with TOOTHTRAY_FUZZ this is a libFuzzer target; otherwise main runs a fixed
+// number of random mutations of the headphone records, as a test.
+
+static uint64_t Consume(const SdpElement& element) {
+    uint64_t sum = static_cast<uint64_t>(element.Type());
+    if (std::optional<uint64_t> value = element.AsUInt())
+        sum += *value;
+    if (std::optional<int64_t> value = element.AsSInt())
+        sum += static_cast<uint64_t>(*value);
+    if (std::optional<bool> value = element.AsBool())
+        sum += *value;
+    if (std::optional<SdpUuid> value = element.AsUuid())
+        sum += value->ShortValue().value_or(value->value.Data1);
+    if (std::optional<std::string_view> value = element.AsText())
+        sum += value->size();
+    return sum;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    SdpRecord record(std::span<const uint8_t>(data, size));
+    if (!record.IsValid())
+        return 0;
+
+    uint64_t sum = 0;
+    for (const SdpAttribute& attribute : record) {
+        sum += attribute.id + Consume(attribute.value);
+        for (const SdpElement& element : SdpSequence(attribute.value))
+            sum += Consume(element);
+        for (const SdpProtocolDescriptor& protocol : SdpProtocolDescriptorList(attribute.value))
+            sum += protocol.protocol.size + protocol.parameter.value_or(0);
+        for (const SdpProfileDescriptor& profile : SdpProfileDescriptorList(attribute.value))
+            sum += profile.version;
+    }
+    volatile uint64_t sink = sum;
+    static_cast<void>(sink);
+    return 0;
+}
+
+#ifndef TOOTHTRAY_LIBFUZZER
+static constexpr size_t ITERATIONS = 200000;
+
+static void Mutate(SdpBytes& bytes, std::mt19937& random) {
+    std::uniform_int_distribution<size_t> position(0, bytes.size() - 1);
+    switch (random() % 5) {
+    case 0:
+        bytes[position(random)] ^= static_cast<uint8_t>(1 << (random() % 8));
+        break;
+    case 1:
+        bytes[position(random)] = static_cast<uint8_t>(random());
+        break;
+    case 2:
+        bytes.resize(position(random));
+        break;
+    case 3:
+        bytes.insert(bytes.begin() + static_cast<ptrdiff_t>(position(random)), static_cast<uint8_t>(random()));
+        break;
+    default:
+        // Descriptors of sequences with a 1 byte length, so lengths and nesting get mixed up
+        bytes.insert(bytes.begin() + static_cast<ptrdiff_t>(position(random)), { 0x35, static_cast<uint8_t>(random()) });
+        break;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // A file argument is replayed, e.g. a crash libFuzzer saved
+    for (int i = 1; i < argc; ++i) {
+        FILE* file = std::fopen(argv[i], "rb");
+        if (file == nullptr)
+            return 1;
+        SdpBytes bytes;
+        for (int c = std::fgetc(file); c != EOF; c = std::fgetc(file))
+            bytes.push_back(static_cast<uint8_t>(c));
+        std::fclose(file);
+        LLVMFuzzerTestOneInput(bytes.data(), bytes.size());
+    }
+    if (argc > 1)
+        return 0;
+
+    std::vector<SdpBytes> seeds = SdpHeadphoneRecords();
+    std::mt19937 random(12345);
+    for (size_t i = 0; i < ITERATIONS; ++i) {
+        SdpBytes bytes = seeds[i % seeds.size()];
+        for (unsigned mutations = 1 + random() % 8; mutations > 0 && !bytes.empty(); --mutations)
+            Mutate(bytes, random);
+        LLVMFuzzerTestOneInput(bytes.data(), bytes.size());
+    }
+    std::printf("%zu inputs\n", ITERATIONS);
+    return 0;
+}
+#endif
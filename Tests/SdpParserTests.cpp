@@ -0,0 +1,102 @@
+#include "TestHarness.h"
+
+#include "SdpParser.h"
+#include "FakeSdpRecordSource.h"
+
+// count sequences, each holding the next, around a single integer
+static SdpBytes NestedSequences(size_t count) {
+    SdpBytes bytes = SdpEncodeUInt(1, 1);
+    for (size_t i = 0; i < count; ++i)
+        bytes = SdpEncodeVariable(SdpType::Sequence, bytes);
+    return bytes;
+}
+
+// Sequences with a 4 byte length, so any depth fits; the bytes are built from the inside out
+static SdpBytes DeeplyNestedSequences(size_t count) {
+    SdpBytes bytes(count * 5 + 2);
+    size_t valueSize = 2;
+    size_t offset = count * 5;
+    bytes[offset] = static_cast<uint8_t>(static_cast<uint8_t>(SdpType::UInt) << 3);
+    bytes[offset + 1] = 1;
+    while (offset > 0) {
+        offset -= 5;
+        bytes[offset] = static_cast<uint8_t>((static_cast<uint8_t>(SdpType::Sequence) << 3) | 7);
+        for (size_t i = 0; i < 4; ++i)
+            bytes[offset + 1 + i] = static_cast<uint8_t>(valueSize >> (8 * (3 - i)));
+        valueSize += 5;
+    }
+    return bytes;
+}
+
+TEST_CASE(ParsesElements) {
+    SdpBytes bytes = SdpEncodeUInt(0x0103, 2);
+    size_t size = 0;
+    std::optional<SdpElement> element = SdpElement::Parse(bytes, size);
+    CHECK(element.has_value());
+    CHECK_EQUAL(size, 3u);
+    CHECK_EQUAL(*element->AsUInt(), 0x0103u);
+    CHECK(!element->AsUuid().has_value());
+
+    bytes = SdpEncodeUuid16(0x110B);
+    element = SdpElement::Parse(bytes, size);
+    CHECK(element.has_value() && element->AsUuid().has_value());
+    CHECK_EQUAL(*element->AsUuid()->ShortValue(), 0x110Bu);
+
+    bytes = SdpEncodeText(std::string("Audio Sink") + '\0');
+    element = SdpElement::Parse(bytes, size);
+    CHECK(element.has_value() && *element->AsText() == "Audio Sink");
+
+    // 0xFF: type 31; a UUID of 8 bytes; a text whose length runs past the end
+    for (SdpBytes bad : { SdpBytes{ 0xFF }, SdpBytes{ 0x1B, 0, 0, 0, 0, 0, 0, 0, 0 }, SdpBytes{ 0x25, 4, 'a' } })
+        CHECK(!SdpElement::Parse(bad, size).has_value());
+}
+
+TEST_CASE(DecodesHeadphoneRecords) {
+    std::vector<SdpBytes> records = SdpHeadphoneRecords();
+    SdpRecord sink(records[0]);
+    CHECK(sink.IsValid());
+    CHECK_EQUAL(*sink.Find(SDP_ATTRIBUTE_SERVICE_NAME)->AsText(), "Audio Sink");
+
+    SdpProtocolDescriptorList protocols(*sink.Find(SDP_ATTRIBUTE_PROTOCOL_DESCRIPTOR_LIST));
+    std::vector<SdpProtocolDescriptor> decoded(protocols.begin(), protocols.end());
+    CHECK_EQUAL(decoded.size(), 2u);
+    CHECK_EQUAL(*decoded[0].protocol.ShortValue(), 0x0100u);
+    CHECK_EQUAL(*decoded[0].parameter, 0x0019u);
+
+    SdpProfileDescriptorList profiles(*sink.Find(SDP_ATTRIBUTE_PROFILE_DESCRIPTOR_LIST));
+    CHECK(profiles.begin() != profiles.end());
+    CHECK_EQUAL(*profiles.begin()->profile.ShortValue(), 0x110Du);
+    CHECK_EQUAL(profiles.begin()->version, 0x0103u);
+
+    for (const SdpBytes& record : records)
+        CHECK(SdpRecord(record).IsValid());
+    // The vendor service's 128 bit UUID has no short alias
+    SdpSequence vendorClasses(*SdpRecord(records[3]).Find(SDP_ATTRIBUTE_SERVICE_CLASS_ID_LIST));
+    CHECK(!vendorClasses.begin()->AsUuid()->ShortValue().has_value());
+}
+
+TEST_CASE(RejectsTruncatedRecord) {
+    SdpBytes record = SdpHeadphoneRecords()[0];
+    for (size_t size = 0; size < record.size(); ++size)
+        CHECK(!SdpRecord(std::span<const uint8_t>(record.data(), size)).IsValid());
+}
+
+TEST_CASE(RejectsNestedElementOverrunningItsSequence) {
+    // A sequence of 3 bytes holding a 2 byte integer whose value continues past it
+    SdpBytes record = SdpEncodeRecord({ { 0x0001, SdpBytes{ 0x35, 0x03, 0x09, 0x01, 0x02, 0x03 } } });
+    CHECK(!SdpRecord(record).IsValid());
+}
+
+TEST_CASE(AcceptsNestingUpToLimit) {
+    // The attribute value sequences start one level down
+    SdpBytes record = SdpEncodeRecord({ { 0x0001, NestedSequences(SDP_MAX_NESTING) } });
+    CHECK(SdpRecord(record).IsValid());
+    record = SdpEncodeRecord({ { 0x0001, NestedSequences(SDP_MAX_NESTING + 1) } });
+    CHECK(!SdpRecord(record).IsValid());
+}
+
+TEST_CASE(RejectsDeepNestingWithoutRecursing) {
+    // Deep enough to overflow a 1MB stack when every level is a call
+    SdpBytes record = DeeplyNestedSequences(200000);
+    CHECK(!SdpRecord(record).IsValid());
+}
@@ -0,0 +1,141 @@
+#include "TestHarness.h"
+
+#include "SdpRecordCache.h"
+#include "FakeSdpRecordSource.h"
+#include "WorkerPool.h"
+
+static constexpr uint64_t HEADPHONES = 0x001122334455;
+static constexpr uint64_t SPEAKER = 0x00AABBCCDDEE;
+
+static const SdpRefreshPolicy TEST_POLICY{ std::chrono::hours(1), std::chrono::milliseconds(100), std::chrono::milliseconds(400) };
+
+static bool HasProfile(const SdpCachedDevice& device, uint32_t shortUuid) {
+    for (const SdpCacheProfile& profile : device.Profiles()) {
+        if (profile.profile.Data1 == shortUuid)
+            return true;
+    }
+    return false;
+}
+
+TEST_CASE(UpdatesAndFindsDevices) {
+    TemporaryDirectory directory;
+    SdpRecordCache cache;
+    cache.Open(directory.Path() / "sdp-records.cache");
+    CHECK(!cache.Find(HEADPHONES).has_value());
+
+    std::vector<SdpBytes> records = SdpHeadphoneRecords();
+    CHECK(cache.Update(SPEAKER, { records[0] }, std::chrono::system_clock::now()));
+    CHECK(cache.Update(HEADPHONES, records, std::chrono::system_clock::now()));
+
+    std::optional<SdpCachedDevice> headphones = cache.Find(HEADPHONES);
+    CHECK(headphones.has_value());
+    CHECK_EQUAL(headphones->RecordCount(), records.size());
+    CHECK(headphones->Record(0).IsValid());
+    // A2DP sink, AVRCP and hands-free
+    CHECK(HasProfile(*headphones, 0x110D) && HasProfile(*headphones, 0x110E) && HasProfile(*headphones, 0x111E));
+    CHECK_EQUAL(cache.Find(SPEAKER)->RecordCount(), 1u);
+}
+
+TEST_CASE(ReopensLatestVersion) {
+    TemporaryDirectory directory;
+    std::vector<SdpBytes> records = SdpHeadphoneRecords();
+    {
+        SdpRecordCache cache;
+        cache.Open(directory.Path() / "sdp-records.cache");
+        cache.Update(HEADPHONES, records, std::chrono::system_clock::now());
+        cache.Update(SPEAKER, { records[0] }, std::chrono::system_clock::now());
+    }
+
+    SdpRecordCache cache;
+    cache.Open(directory.Path() / "sdp-records.cache");
+    CHECK_EQUAL(cache.Find(HEADPHONES)->RecordCount(), records.size());
+    CHECK_EQUAL(cache.Find(SPEAKER)->RecordCount(), 1u);
+}
+
+TEST_CASE(ReaderKeepsRecordsAcrossUpdates) {
+    TemporaryDirectory directory;
+    SdpRecordCache cache;
+    cache.Open(directory.Path() / "sdp-records.cache");
+    std::vector<SdpBytes> records = SdpHeadphoneRecords();
+    cache.Update(HEADPHONES, records, std::chrono::system_clock::now());
+
+    std::optional<SdpCachedDevice> held = cache.Find(HEADPHONES);
+    for (int i = 0; i < 3; ++i)
+        CHECK(cache.Update(HEADPHONES, { records[i] }, std::chrono::system_clock::now()));
+
+    CHECK_EQUAL(held->RecordCount(), records.size());
+    CHECK_EQUAL(held->Record(3).Find(SDP_ATTRIBUTE_SERVICE_NAME)->AsText()->size(), 200u);
+    CHECK_EQUAL(cache.Find(HEADPHONES)->RecordCount(), 1u);
+}
+
+TEST_CASE(RetriesFailedQueriesWithBackoff) {
+    TemporaryDirectory directory;
+    SdpRecordCache cache;
+    cache.Open(directory.Path() / "sdp-records.cache");
+    FakeSdpRecordSource source;
+    WorkerPool pool;
+    pool.Start(1);
+    cache.SetRefreshSource(&pool, &source, TEST_POLICY);
+
+    // Out of range: the query fails and the next one waits for the retry delay
+    cache.RequestRefresh(HEADPHONES);
+    CHECK(WaitUntil([&]() { return source.QueryCount() == 1; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    cache.RequestRefresh(HEADPHONES);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK_EQUAL(source.QueryCount(), 1u);
+
+    std::this_thread::sleep_for(TEST_POLICY.retryDelay);
+    cache.RequestRefresh(HEADPHONES);
+    CHECK(WaitUntil([&]() { return source.QueryCount() == 2; }));
+
+    // The delay doubled, so the first one has passed but not the second
+    std::this_thread::sleep_for(TEST_POLICY.retryDelay + std::chrono::milliseconds(20));
+    cache.RequestRefresh(HEADPHONES);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK_EQUAL(source.QueryCount(), 2u);
+
+    // Back in range; once the query succeeds the records are fresh and not queried again
+    source.SetRecords(HEADPHONES, SdpHeadphoneRecords());
+    std::this_thread::sleep_for(TEST_POLICY.retryDelay);
+    cache.RequestRefresh(HEADPHONES);
+    CHECK(WaitUntil([&]() { return cache.Find(HEADPHONES).has_value(); }));
+    cache.RequestRefresh(HEADPHONES);
+    pool.Stop();
+    CHECK_EQUAL(source.QueryCount(), 3u);
+}
+
+TEST_CASE(FailuresOfOneDeviceDontHoldBackOthers) {
+    TemporaryDirectory directory;
+    SdpRecordCache cache;
+    cache.Open(directory.Path() / "sdp-records.cache");
+    FakeSdpRecordSource source;
+    source.SetRecords(SPEAKER, { SdpHeadphoneRecords()[0] });
+    WorkerPool pool;
+    pool.Start(1);
+    cache.SetRefreshSource(&pool, &source, TEST_POLICY);
+
+    cache.RequestRefresh(HEADPHONES);
+    cache.RequestRefresh(SPEAKER);
+    CHECK(WaitUntil([&]() { return cache.Find(SPEAKER).has_value(); }));
+    pool.Stop();
+    CHECK_EQUAL(source.QueryCount(), 2u);
+}
+
+TEST_CASE(ClearingSourceDropsQueuedQueries) {
+    TemporaryDirectory directory;
+    SdpRecordCache cache;
+    cache.Open(directory.Path() / "sdp-records.cache");
+    FakeSdpRecordSource source;
+    source.SetQueryLatency(SimulatedLatency(std::chrono::milliseconds(50)));
+    WorkerPool pool;
+    pool.Start(1);
+    cache.SetRefreshSource(&pool, &source, TEST_POLICY);
+
+    for (uint64_t address = 1; address <= 5; ++address)
+        cache.RequestRefresh(address);
+    CHECK(WaitUntil([&]() { return source.QueryCount() == 1; }));
+    cache.SetRefreshSource(nullptr, nullptr, TEST_POLICY);
+    pool.Stop();
+    CHECK_EQUAL(source.QueryCount(), 1u);
+}
@@ -0,0 +1,78 @@
+#include "TestHarness.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "SnapshotPublisher.h"
+
+TEST_CASE(StartsWithEmptySnapshot) {
+    SnapshotPublisher<std::vector<int>> publisher;
+    CHECK_EQUAL(publisher.Current()->generation, 0u);
+    CHECK(publisher.Current()->value.empty());
+
+    CHECK_EQUAL(publisher.Publish({ 1, 2 }), 1u);
+    std::shared_ptr<const Snapshot<std::vector<int>>> first = publisher.Current();
+    CHECK_EQUAL(publisher.Publish({ 3 }), 2u);
+    // A reader keeps the snapshot it got
+    CHECK_EQUAL(first->generation, 1u);
+    CHECK_EQUAL(first->value.size(), 2u);
+    CHECK_EQUAL(publisher.Current()->value.front(), 3);
+}
+
+TEST_CASE(ConcurrentPublishesAndReads) {
+    constexpr size_t WRITERS = 4;
+    constexpr size_t READERS = 4;
+    constexpr size_t PUBLISHES = 2000;
+    constexpr size_t SIZE = 64;
+    SnapshotPublisher<std::vector<uint64_t>> publisher;
+
+    std::atomic<bool> writing = true;
+    std::atomic<size_t> failures = 0;
+    std::vector<std::thread> readers;
+    for (size_t r = 0; r < READERS; ++r) {
+        readers.emplace_back([&]() {
+            uint64_t lastGeneration = 0;
+            while (writing) {
+                std::shared_ptr<const Snapshot<std::vector<uint64_t>>> snapshot = publisher.Current();
+                // Never older than one already seen
+                if (snapshot->generation < lastGeneration)
+                    ++failures;
+                lastGeneration = snapshot->generation;
+                // Never torn: every element is the same value a single writer put there
+                for (uint64_t value : snapshot->value) {
+                    if (value != snapshot->value.front())
+                        ++failures;
+                }
+            }
+        });
+    }
+
+    std::vector<std::thread> writers;
+    std::vector<std::vector<uint64_t>> generations(WRITERS);
+    for (size_t w = 0; w < WRITERS; ++w) {
+        writers.emplace_back([&, w]() {
+            for (size_t i = 0; i < PUBLISHES; ++i)
+                generations[w].push_back(publisher.Publish(std::vector<uint64_t>(SIZE, w * PUBLISHES + i)));
+        });
+    }
+    for (std::thread& writer : writers)
+        writer.join();
+    writing = false;
+    for (std::thread& reader : readers)
+        reader.join();
+
+    CHECK_EQUAL(failures.load(), 0u);
+    // Each writer's generations only increase, and together they're every generation once
+    std::vector<uint64_t> all;
+    for (const std::vector<uint64_t>& writer : generations) {
+        CHECK(std::is_sorted(writer.begin(), writer.end()));
+        all.insert(all.end(), writer.begin(), writer.end());
+    }
+    std::sort(all.begin(), all.end());
+    for (size_t i = 0; i < all.size(); ++i)
+        CHECK_EQUAL(all[i], i + 1);
+    // The newest snapshot won, whichever writer finished last
+    CHECK_EQUAL(publisher.Current()->generation, WRITERS * PUBLISHES);
+}
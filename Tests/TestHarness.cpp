@@ -0,0 +1,64 @@
+#include "TestHarness.h"
+
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <cstring>
+#include <exception>
+
+std::vector<TestCase>& TestCases() {
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+TemporaryDirectory::TemporaryDirectory() {
+    std::random_device random;
+    for (;;) {
+        m_path = std::filesystem::temp_directory_path() / ("ToothTrayTests-" + std::to_string(random()));
+        if (std::filesystem::create_directory(m_path))
+            return;
+    }
+}
+
+TemporaryDirectory::~TemporaryDirectory() {
+    std::error_code error;
+    std::filesystem::remove_all(m_path, error);
+}
+
+bool WaitUntil(const std::function<bool()>& condition, std::chrono::milliseconds timeout) {
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() >= deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+void FailTest(const char* file, int line, const std::string& message) {
+    throw TestFailure(std::string(file) + ":" + std::to_string(line) + ": " + message);
+}
+
+int main(int argc, char** argv) {
+    const char* filter = argc > 1 ? argv[1] : nullptr;
+    int run = 0;
+    int failed = 0;
+    for (const TestCase& test : TestCases()) {
+        if (filter != nullptr && std::strstr(test.name, filter) == nullptr)
+            continue;
+
+        ++run;
+        try {
+            test.run();
+            std::printf("[ pass ] %s\n", test.name);
+        }
+        catch (const std::exception& e) {
+            ++failed;
+            std::printf("[ FAIL ] %s\n    %s\n", test.name, e.what());
+        }
+        std::fflush(stdout);
+    }
+
+    std::printf("%d of %d passed\n", run - failed, run);
+    return failed == 0 && run > 0 ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+#include <filesystem>
+#include <functional>
+
+#include "Guid.h"
+
+// A minimal test runner: TEST_CASE registers a function, CHECK ends the case with the failed
+// condition. Each test executable runs all its cases, or those whose name contains argv[1].
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+std::vector<TestCase>& TestCases();
+
+struct TestRegistration {
+    TestRegistration(const char* name, void (*run)()) {
+        TestCases().push_back(TestCase{ name, run });
+    }
+};
+
+class TestFailure : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// A GUID that only differs in Data1, for tests that need a few distinct ids
+inline GUID TestGuid(uint32_t value) {
+    GUID guid{};
+    guid.Data1 = value;
+    return guid;
+}
+
+// A new directory under the system's temporary one, deleted with its contents at the end of the test
+class TemporaryDirectory {
+public:
+    TemporaryDirectory();
+    ~TemporaryDirectory();
+
+    TemporaryDirectory(const TemporaryDirectory&) = delete;
+    TemporaryDirectory& operator=(const TemporaryDirectory&) = delete;
+
+    const std::filesystem::path& Path() const {
+        return m_path;
+    }
+private:
+    std::filesystem::path m_path;
+};
+
+// Polls until the condition holds, for work finishing on another thread. False if it timed out.
+bool WaitUntil(const std::function<bool()>& condition, std::chrono::milliseconds timeout = std::chrono::seconds(10));
+
+[[noreturn]] void FailTest(const char* file, int line, const std::string& message);
+
+template <typename A, typename B>
+void CheckEqual(const A& actual, const B& expected, const char* expression, const char* file, int line) {
+    if (actual == expected)
+        return;
+    std::ostringstream message;
+    message << expression << ": got " << actual << ", expected " << expected;
+    FailTest(file, line, message.str());
+}
+
+#define TEST_CASE(name) \
+    static void name(); \
+    static const TestRegistration name##Registration(#name, name); \
+    static void name()
+
+#define CHECK(condition) do { if (!(condition)) FailTest(__FILE__, __LINE__, #condition); } while (false)
+// For values that can be streamed, so the failure shows both sides
+#define CHECK_EQUAL(actual, expected) CheckEqual((actual), (expected), #actual " == " #expected, __FILE__, __LINE__)
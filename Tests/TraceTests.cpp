@@ -0,0 +1,129 @@
+#include "TestHarness.h"
+
+#include <thread>
+#include <algorithm>
+
+#include "Trace.h"
+
+// The tracer is global, so every case starts by taking what earlier ones left behind
+static void ResetTracer(bool enabled) {
+    Tracer::Enable(enabled);
+    Tracer::Collect();
+}
+
+TEST_CASE(SpansRecordBeginAndEnd) {
+    ResetTracer(true);
+    uint64_t before = Tracer::Now();
+    {
+        TRACE_SPAN("outer");
+        TraceSpan inner("inner");
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    uint64_t after = Tracer::Now();
+
+    std::vector<TraceEvent> events = Tracer::Collect();
+    CHECK_EQUAL(events.size(), 2u);
+    const TraceEvent& outer = std::string(events[0].name) == "outer" ? events[0] : events[1];
+    const TraceEvent& inner = std::string(events[0].name) == "outer" ? events[1] : events[0];
+    CHECK(std::string(inner.name) == "inner");
+    CHECK(before <= outer.start && outer.start <= inner.start);
+    // The inner span ends first, as it was constructed last
+    CHECK(inner.start + inner.duration <= outer.start + outer.duration);
+    CHECK(outer.start + outer.duration <= after);
+    CHECK(inner.duration >= 2000000u);
+    CHECK_EQUAL(outer.threadIndex, inner.threadIndex);
+
+    // Collecting takes the events
+    CHECK(Tracer::Collect().empty());
+}
+
+TEST_CASE(DisabledSpansRecordNothing) {
+    ResetTracer(false);
+    {
+        TRACE_SPAN("disabled");
+    }
+    CHECK(Tracer::Collect().empty());
+
+    // A span started while disabled stays unrecorded, even if tracing is enabled before it ends
+    {
+        TraceSpan span("started disabled");
+        Tracer::Enable(true);
+    }
+    CHECK(Tracer::Collect().empty());
+    Tracer::Enable(false);
+}
+
+TEST_CASE(CapsEventsPerThread) {
+    ResetTracer(true);
+    for (size_t i = 0; i < Tracer::MAX_EVENTS_PER_THREAD + 100; ++i)
+        Tracer::Record("event", i, i + 1);
+    std::vector<TraceEvent> events = Tracer::Collect();
+    CHECK_EQUAL(events.size(), Tracer::MAX_EVENTS_PER_THREAD);
+    // The first ones are kept
+    CHECK_EQUAL(events.back().start, Tracer::MAX_EVENTS_PER_THREAD - 1);
+
+    // The cap is per thread, so another thread still records
+    for (size_t i = 0; i < Tracer::MAX_EVENTS_PER_THREAD; ++i)
+        Tracer::Record("event", i, i + 1);
+    std::thread([]() { Tracer::Record("other thread", 0, 1); }).join();
+    events = Tracer::Collect();
+    CHECK_EQUAL(events.size(), Tracer::MAX_EVENTS_PER_THREAD + 1);
+
+    // And collecting makes room again
+    Tracer::Record("after collect", 0, 1);
+    CHECK_EQUAL(Tracer::Collect().size(), 1u);
+    Tracer::Enable(false);
+}
+
+TEST_CASE(CollectOrdersThreadsByStart) {
+    constexpr size_t THREADS = 4;
+    constexpr size_t EVENTS = 500;
+    ResetTracer(true);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < THREADS; ++t) {
+        threads.emplace_back([t]() {
+            // Interleaved: thread t records the starts t, t + THREADS, ...
+            for (size_t i = 0; i < EVENTS; ++i) {
+                uint64_t start = i * THREADS + t;
+                Tracer::Record("interleaved", start, start + 10);
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    std::vector<TraceEvent> events = Tracer::Collect();
+    CHECK_EQUAL(events.size(), THREADS * EVENTS);
+    for (size_t i = 0; i < events.size(); ++i) {
+        CHECK_EQUAL(events[i].start, i);
+        CHECK_EQUAL(events[i].duration, 10u);
+    }
+    // Each thread has an index of its own, the same for all its events
+    for (size_t t = 0; t < THREADS; ++t) {
+        for (size_t i = t + THREADS; i < events.size(); i += THREADS)
+            CHECK_EQUAL(events[i].threadIndex, events[t].threadIndex);
+        for (size_t other = 0; other < t; ++other)
+            CHECK(events[t].threadIndex != events[other].threadIndex);
+    }
+    Tracer::Enable(false);
+}
+
+TEST_CASE(ExportsChromeTrace) {
+    std::vector<TraceEvent> events = {
+        TraceEvent{ "refresh", 1, 5000000, 1500 },
+        TraceEvent{ "enumerate", 2, 5002500, 250000 },
+    };
+    CHECK_EQUAL(ExportChromeTrace(events),
+        "{\"traceEvents\":[\n"
+        "{\"name\":\"refresh\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":0.000,\"dur\":1.500},\n"
+        "{\"name\":\"enumerate\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":2.500,\"dur\":250.000}\n"
+        "],\"displayTimeUnit\":\"ms\"}\n");
+
+    CHECK_EQUAL(ExportChromeTrace({}), "{\"traceEvents\":[\n],\"displayTimeUnit\":\"ms\"}\n");
+}
+
+TEST_CASE(ExportEscapesNames) {
+    std::vector<TraceEvent> events = { TraceEvent{ "say \"hi\"\\\n\t\x01" "caf\xc3\xa9", 1, 0, 0 } };
+    std::string json = ExportChromeTrace(events);
+    CHECK(json.find("\"name\":\"say \\\"hi\\\"\\\\\\u000a\\u0009\\u0001caf\xc3\xa9\",") != std::string::npos);
+}
@@ -0,0 +1,140 @@
+#include "TestHarness.h"
+
+#include <atomic>
+#include <future>
+#include <thread>
+
+#include "WorkerPool.h"
+#include "ConnectorRegistry.h"
+#include "FakeAudioEndpointSource.h"
+#include "FakeContainerSource.h"
+
+// Work that takes longer for some indices, so the parallel results finish out of order
+static std::wstring Work(size_t i) {
+    if (i % 7 == 0)
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    return std::to_wstring(i * 2654435761u % 1000003);
+}
+
+TEST_CASE(ParallelMapMatchesSerial) {
+    constexpr size_t COUNT = 1000;
+    WorkerPool pool;
+    pool.Start(4);
+
+    std::vector<std::atomic<int>> calls(COUNT);
+    std::vector<std::wstring> parallel = ParallelMap<std::wstring>(&pool, COUNT, [&calls](size_t i) {
+        ++calls[i];
+        return Work(i);
+    });
+    std::vector<std::wstring> serial = ParallelMap<std::wstring>(nullptr, COUNT, Work);
+    pool.Stop();
+
+    CHECK(parallel == serial);
+    for (size_t i = 0; i < COUNT; ++i)
+        CHECK_EQUAL(calls[i].load(), 1);
+    CHECK(ParallelMap<int>(&pool, 0, [](size_t) { return 1; }).empty());
+}
+
+TEST_CASE(ParallelMapRunsSeriallyWithoutThreads) {
+    std::thread::id caller = std::this_thread::get_id();
+    auto onCaller = [caller](size_t) { return std::this_thread::get_id() == caller; };
+
+    WorkerPool stopped;
+    std::vector<bool> results = ParallelMap<bool>(&stopped, 16, onCaller);
+    CHECK(results == std::vector<bool>(16, true));
+    results = ParallelMap<bool>(nullptr, 16, onCaller);
+    CHECK(results == std::vector<bool>(16, true));
+}
+
+TEST_CASE(ParallelMapFromWorker) {
+    // The only worker is busy running the outer task, so the caller has to do the inner map itself
+    WorkerPool pool;
+    pool.Start(1);
+    std::promise<std::vector<size_t>> inner;
+    pool.Submit([&pool, &inner]() {
+        inner.set_value(ParallelMap<size_t>(&pool, 8, [](size_t i) { return i * i; }));
+    });
+    std::future<std::vector<size_t>> result = inner.get_future();
+    CHECK(result.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+    CHECK(result.get() == std::vector<size_t>({ 0, 1, 4, 9, 16, 25, 36, 49 }));
+    pool.Stop();
+}
+
+struct WalkFixture {
+    FakeAudioEndpointSource endpoints;
+    FakeContainerSource containers;
+    ContainerNameIndex names{ containers };
+    ConnectorRegistry registry{ endpoints, names };
+
+    explicit WalkFixture(WorkerPool* pool) {
+        endpoints.SetWorkerPool(pool);
+    }
+
+    ~WalkFixture() {
+        registry.Stop();
+        names.Stop();
+    }
+};
+
+TEST_CASE(EndpointWalkAndGroupingMatchSerial) {
+    constexpr uint32_t DEVICES = 40;
+    WorkerPool pool;
+    pool.Start(4);
+    WalkFixture serial(nullptr);
+    WalkFixture parallel(&pool);
+
+    // The endpoints of each device are spread over the enumeration, and several devices share a name,
+    // so both the controls of a connector and the connectors with the same name keep their order only
+    // if the walk does
+    std::vector<std::shared_ptr<FakeConnectorControl>> controls;
+    for (uint32_t device = 0; device < DEVICES; ++device) {
+        controls.emplace_back(std::make_shared<FakeConnectorControl>());
+        // The last few containers have no name and can't be shown
+        if (device < DEVICES - 4) {
+            std::wstring name = device % 3 == 0 ? L"Headphones" : L"Device " + std::to_wstring(device);
+            serial.containers.SetContainerName(TestGuid(device + 1), name);
+            parallel.containers.SetContainerName(TestGuid(device + 1), name);
+        }
+    }
+    for (uint32_t profile = 0; profile < 3; ++profile) {
+        for (uint32_t device = 0; device < DEVICES; ++device) {
+            std::wstring id = L"bth." + std::to_wstring(device) + L"." + std::to_wstring(profile);
+            AudioEndpoint endpoint{ id, TestGuid(device + 1), (device + profile) % 2 == 0, { controls[device] } };
+            // Speakers and such without a bluetooth driver are dropped by the walk
+            if (device % 5 == 0 && profile == 2)
+                endpoint.controls.clear();
+            serial.endpoints.AddEndpoint(endpoint);
+            parallel.endpoints.AddEndpoint(endpoint);
+        }
+    }
+    parallel.endpoints.SetResolveLatency(SimulatedLatency(std::chrono::microseconds(100), 1.0));
+
+    std::vector<AudioEndpoint> expectedEndpoints = serial.endpoints.EnumerateEndpoints();
+    std::vector<AudioEndpoint> endpoints = parallel.endpoints.EnumerateEndpoints();
+    CHECK_EQUAL(endpoints.size(), expectedEndpoints.size());
+    for (size_t i = 0; i < endpoints.size(); ++i) {
+        CHECK(endpoints[i].id == expectedEndpoints[i].id);
+        CHECK(GUIDEqualityComparer{}(endpoints[i].containerId, expectedEndpoints[i].containerId));
+        CHECK_EQUAL(endpoints[i].isActive, expectedEndpoints[i].isActive);
+        CHECK(endpoints[i].controls == expectedEndpoints[i].controls);
+    }
+
+    serial.names.Start();
+    serial.registry.Start();
+    parallel.names.Start();
+    parallel.registry.Start();
+    serial.registry.Refresh();
+    parallel.registry.Refresh();
+    std::vector<BluetoothConnector> expected = serial.registry.Snapshot();
+    std::vector<BluetoothConnector> connectors = parallel.registry.Snapshot();
+    pool.Stop();
+
+    CHECK_EQUAL(expected.size(), static_cast<size_t>(DEVICES - 4));
+    CHECK_EQUAL(connectors.size(), expected.size());
+    for (size_t i = 0; i < connectors.size(); ++i) {
+        CHECK(GUIDEqualityComparer{}(connectors[i].ContainerId(), expected[i].ContainerId()));
+        CHECK(connectors[i].DeviceName() == expected[i].DeviceName());
+        CHECK(connectors[i].EndpointIds() == expected[i].EndpointIds());
+        CHECK_EQUAL(connectors[i].IsConnected(), expected[i].IsConnected());
+    }
+}
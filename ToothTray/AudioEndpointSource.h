@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include <optional>
+
+#include "Guid.h"
+#include "ConnectorControl.h"
+
+// A render endpoint that is connected to a bluetooth audio driver.
+struct AudioEndpoint {
+    std::wstring id;
+    GUID containerId;
+    bool isActive;
+    std::vector<std::shared_ptr<IConnectorControl>> controls;
+};
+
+// Receives endpoint changes from an IAudioEndpointSource. Calls can come from any thread.
+class IAudioEndpointListener {
+public:
+    virtual ~IAudioEndpointListener() = default;
+
+    virtual void OnEndpointAdded(std::wstring_view endpointId) = 0;
+    virtual void OnEndpointRemoved(std::wstring_view endpointId) = 0;
+    virtual void OnEndpointStateChanged(std::wstring_view endpointId, bool isActive) = 0;
+};
+
+class IAudioEndpointSource {
+public:
+    virtual ~IAudioEndpointSource() = default;
+
+    // All bluetooth audio endpoints in any state.
+    virtual std::vector<AudioEndpoint> EnumerateEndpoints() = 0;
+    // Resolves a single endpoint. Empty if it doesn't exist or isn't a bluetooth audio endpoint.
+    virtual std::optional<AudioEndpoint> GetEndpoint(std::wstring_view endpointId) = 0;
+
+    // Pass nullptr to stop receiving notifications.
+    virtual void SetListener(IAudioEndpointListener* listener) = 0;
+};
@@ -1,147 +1,267 @@
-#include <Unknwn.h>
-#include "framework.h"
-#include "BluetoothAudioDevices.h"
-
-#include <combaseapi.h>
-#include <wil/resource.h>
-#include <mmdeviceapi.h>
-#include <Functiondiscoverykeys_devpkey.h>
-#include <propvarutil.h>
-
-#include "DeviceContainerEnumerator.h"
-#include "debuglog.h"
-
-std::wstring GetDeviceName(IPropertyStore& propertyStore) {
-    wil::unique_prop_variant propName;
-    PropVariantInit(&propName);
-    propertyStore.GetValue(PKEY_Device_FriendlyName, &propName);
-    LPCWSTR name = propName.vt == VT_EMPTY ? L"no name" : propName.pwszVal;
-    return std::wstring(name);
-}
-
-GUID GetContainerId(IPropertyStore& propertyStore) {
-    wil::unique_prop_variant propContainerId;
-    PropVariantInit(&propContainerId);
-    propertyStore.GetValue(PKEY_Device_ContainerId, &propContainerId);
-    GUID containerId = propContainerId.vt == VT_EMPTY ? GUID_NULL : *propContainerId.puuid;
-    return containerId;
-}
-
-std::vector<BluetoothConnector> BluetoothAudioDeviceEnumerator::EnumerateAudioDevices() {
-    std::unordered_map<GUID, BluetoothConnector, GUIDHasher, GUIDEqualityComparer> bluetoothConnectors;
-    std::unordered_map<GUID, std::wstring, GUIDHasher, GUIDEqualityComparer> containers = DeviceContainerEnumerator::EnumerateContainers();
-
-    wil::com_ptr<IMMDeviceEnumerator> pEnumerator;
-    HRESULT hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL, CLSCTX_ALL, __uuidof(IMMDeviceEnumerator), pEnumerator.put_void());
-    DebugLogHresult(hr);
-
-    wil::com_ptr <IMMDeviceCollection> pDevices;
-    hr = pEnumerator->EnumAudioEndpoints(eRender, DEVICE_STATEMASK_ALL, pDevices.put());
-    DebugLogHresult(hr);
-
-    UINT deviceCount = 0;
-    hr = pDevices->GetCount(&deviceCount);
-
-    for (UINT i = 0; i < deviceCount; ++i) {
-        wil::com_ptr<IMMDevice> pDevice;
-        pDevices->Item(i, pDevice.put());
-
-        // No need to get IMMEndpoint because we already know it's a render device
-        //winrt::com_ptr<IMMEndpoint> pEndPoint = pDevice.as<IMMEndpoint>();
-
-        wil::unique_cotaskmem_string pDeviceId;
-        pDevice->GetId(pDeviceId.put());
-
-        DWORD state;
-        pDevice->GetState(&state);
-        LPCWSTR stateStr;
-        switch (state) {
-        case DEVICE_STATE_ACTIVE:
-            stateStr = L"active";
-            break;
-        case DEVICE_STATE_DISABLED:
-            stateStr = L"disabled";
-            break;
-        case DEVICE_STATE_NOTPRESENT:
-            stateStr = L"absent";
-            break;
-        case DEVICE_STATE_UNPLUGGED:
-            stateStr = L"unplugged";
-            break;
-        }
-
-
-        wil::com_ptr<IPropertyStore> pPropertyStore;
-        pDevice->OpenPropertyStore(STGM_READ, pPropertyStore.put());
-        std::wstring deviceName = GetDeviceName(*pPropertyStore.get());
-        GUID containerId = GetContainerId(*pPropertyStore.get());
-
-        DebugLogl(DebugLogStream{} << L"device name: " << deviceName << L", state: " << stateStr << ", id: " << pDeviceId.get() << ", container: " << containerId);
-
-        wil::com_ptr<IDeviceTopology> pTopology;
-        pDevice->Activate(__uuidof(IDeviceTopology), CLSCTX_ALL, NULL, pTopology.put_void());
-
-        UINT connectorCount;
-        pTopology->GetConnectorCount(&connectorCount);
-        for (UINT i = 0; i < connectorCount; ++i) {
-            wil::com_ptr<IConnector> pConnector;
-            pTopology->GetConnector(i, pConnector.put());
-
-            wil::com_ptr<IConnector> pOtherConnector;
-            pConnector->GetConnectedTo(pOtherConnector.put());
-            if (pOtherConnector == nullptr)
-                continue;
-
-            wil::com_ptr<IPart> pPart{ pOtherConnector.query<IPart>() };
-            wil::com_ptr<IDeviceTopology> pOtherTopology;
-            pPart->GetTopologyObject(pOtherTopology.put());
-            wil::unique_cotaskmem_string otherDeviceId;
-            pOtherTopology->GetDeviceId(otherDeviceId.put());
-
-            DebugLogl(DebugLogStream{} << L"connected to " << otherDeviceId.get());
-
-            if (!std::wstring_view(otherDeviceId.get()).starts_with(LR""({2}.\\?\bth)"")) // bthenum or bthhfenum
-                continue;
-
-            wil::com_ptr<IMMDevice> pOtherDevice;
-            pEnumerator->GetDevice(otherDeviceId.get(), pOtherDevice.put());
-
-            wil::com_ptr<IKsControl> pKsControl;
-            pOtherDevice->Activate(__uuidof(IKsControl), CLSCTX_ALL, NULL, pKsControl.put_void());
-
-            std::unordered_map<GUID, BluetoothConnector, GUIDHasher, GUIDEqualityComparer>::iterator ite = bluetoothConnectors.find(containerId);
-            if (ite == bluetoothConnectors.end()) {
-                std::unordered_map<GUID, std::wstring, GUIDHasher, GUIDEqualityComparer>::const_iterator containerIte = containers.find(containerId);
-                if (containerIte != containers.cend()) {
-                    const std::wstring& containerName = containerIte->second;
-                    ite = bluetoothConnectors.emplace(std::piecewise_construct, std::forward_as_tuple(containerId), std::forward_as_tuple(containerName)).first;
-                }
-            }
-
-            ite->second.addConnectorControl(pKsControl, state);
-        }
-    }
-    
-    std::vector<BluetoothConnector> connectors;
-    for (auto ite = bluetoothConnectors.begin(); ite != bluetoothConnectors.end(); ++ite)
-        connectors.emplace_back(std::move(ite->second));
-    return connectors;
-}
-
-void BluetoothConnector::addConnectorControl(const wil::com_ptr<IKsControl>& connectorControl, DWORD state) {
-    m_ksControls.emplace_back(connectorControl);
-    m_isConnected |= state == DEVICE_STATE_ACTIVE;
-}
-
-void BluetoothConnector::GetKsBtAudioProperty(ULONG property) {
-    KSPROPERTY ksProperty;
-    ksProperty.Set = KSPROPSETID_BtAudio;
-    ksProperty.Id = property;
-    ksProperty.Flags = KSPROPERTY_TYPE_GET;
-
-    ULONG bytesReturned;
-    for (wil::com_ptr<IKsControl> &ksControl : m_ksControls) {
-        HRESULT hr = ksControl->KsProperty(&ksProperty, sizeof(ksProperty), NULL, 0, &bytesReturned);
-        DebugLogHresult(hr);
-    }
-}
+#include <Unknwn.h>
+#include "framework.h"
+#include "BluetoothAudioDevices.h"
+
+#include <combaseapi.h>
+#include <wil/resource.h>
+#include <mmdeviceapi.h>
+#include <Functiondiscoverykeys_devpkey.h>
+#include <propvarutil.h>
+
+#include "debuglog.h"
+#include "Trace.h"
+
+std::wstring GetDeviceName(IPropertyStore& propertyStore) {
+    wil::unique_prop_variant propName;
+    PropVariantInit(&propName);
+    propertyStore.GetValue(PKEY_Device_FriendlyName, &propName);
+    LPCWSTR name = propName.vt == VT_EMPTY ? L"no name" : propName.pwszVal;
+    return std::wstring(name);
+}
+
+GUID GetContainerId(IPropertyStore& propertyStore) {
+    wil::unique_prop_variant propContainerId;
+    PropVariantInit(&propContainerId);
+    propertyStore.GetValue(PKEY_Device_ContainerId, &propContainerId);
+    GUID containerId = propContainerId.vt == VT_EMPTY ? GUID_NULL : *propContainerId.puuid;
+    return containerId;
+}
+
+LPCWSTR DeviceStateString(DWORD state) {
+    switch (state) {
+    case DEVICE_STATE_ACTIVE:
+        return L"active";
+    case DEVICE_STATE_DISABLED:
+        return L"disabled";
+    case DEVICE_STATE_NOTPRESENT:
+        return L"absent";
+    case DEVICE_STATE_UNPLUGGED:
+        return L"unplugged";
+    default:
+        return L"unknown";
+    }
+}
+
+BluetoothAudioDeviceEnumerator::~BluetoothAudioDeviceEnumerator() {
+    SetListener(nullptr);
+}
+
+IMMDeviceEnumerator& BluetoothAudioDeviceEnumerator::Enumerator() {
+    if (m_enumerator == nullptr) {
+        HRESULT hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL, CLSCTX_ALL, __uuidof(IMMDeviceEnumerator), m_enumerator.put_void());
+        DebugLogHresult(hr);
+    }
+    return *m_enumerator.get();
+}
+
+std::vector<AudioEndpoint> BluetoothAudioDeviceEnumerator::EnumerateEndpoints() {
+    TRACE_SPAN("EnumerateEndpoints");
+    std::vector<AudioEndpoint> endpoints;
+
+    wil::com_ptr <IMMDeviceCollection> pDevices;
+    HRESULT hr = Enumerator().EnumAudioEndpoints(eRender, DEVICE_STATEMASK_ALL, pDevices.put());
+    DebugLogHresult(hr);
+
+    UINT deviceCount = 0;
+    hr = pDevices->GetCount(&deviceCount);
+
+    std::vector<wil::com_ptr<IMMDevice>> devices(deviceCount);
+    for (UINT i = 0; i < deviceCount; ++i)
+        pDevices->Item(i, devices[i].put());
+
+    std::vector<std::optional<AudioEndpoint>> resolved = ParallelMap<std::optional<AudioEndpoint>>(m_workerPool, devices.size(), [this, &devices](size_t i) {
+        return ResolveEndpoint(*devices[i].get());
+    });
+
+    for (std::optional<AudioEndpoint>& endpoint : resolved) {
+        if (endpoint.has_value())
+            endpoints.emplace_back(std::move(*endpoint));
+    }
+
+    return endpoints;
+}
+
+std::optional<AudioEndpoint> BluetoothAudioDeviceEnumerator::GetEndpoint(std::wstring_view endpointId) {
+    wil::com_ptr<IMMDevice> pDevice;
+    HRESULT hr = Enumerator().GetDevice(std::wstring(endpointId).c_str(), pDevice.put());
+    if (FAILED(hr) || pDevice == nullptr)
+        return std::nullopt;
+
+    // Notifications are for capture endpoints too
+    wil::com_ptr<IMMEndpoint> pEndpoint = pDevice.try_query<IMMEndpoint>();
+    EDataFlow dataFlow;
+    if (pEndpoint == nullptr || FAILED(pEndpoint->GetDataFlow(&dataFlow)) || dataFlow != eRender)
+        return std::nullopt;
+
+    return ResolveEndpoint(*pDevice.get());
+}
+
+std::optional<AudioEndpoint> BluetoothAudioDeviceEnumerator::ResolveEndpoint(IMMDevice& device) {
+    TRACE_SPAN("ResolveEndpoint");
+    wil::unique_cotaskmem_string pDeviceId;
+    device.GetId(pDeviceId.put());
+
+    DWORD state;
+    device.GetState(&state);
+
+    wil::com_ptr<IPropertyStore> pPropertyStore;
+    device.OpenPropertyStore(STGM_READ, pPropertyStore.put());
+    std::wstring deviceName = GetDeviceName(*pPropertyStore.get());
+    GUID containerId = GetContainerId(*pPropertyStore.get());
+
+    LOG_DEBUG(L"device name: {}, state: {}, id: {}, container: {}", deviceName, DeviceStateString(state), pDeviceId.get(), containerId);
+
+    AudioEndpoint endpoint{ std::wstring(pDeviceId.get()), containerId, state == DEVICE_STATE_ACTIVE };
+
+    wil::com_ptr<IDeviceTopology> pTopology;
+    HRESULT hr = device.Activate(__uuidof(IDeviceTopology), CLSCTX_ALL, NULL, pTopology.put_void());
+    if (FAILED(hr)) {
+        DebugLogHresult(hr);
+        return std::nullopt;
+    }
+
+    UINT connectorCount;
+    pTopology->GetConnectorCount(&connectorCount);
+    for (UINT i = 0; i < connectorCount; ++i) {
+        wil::com_ptr<IConnector> pConnector;
+        pTopology->GetConnector(i, pConnector.put());
+
+        wil::com_ptr<IConnector> pOtherConnector;
+        pConnector->GetConnectedTo(pOtherConnector.put());
+        if (pOtherConnector == nullptr)
+            continue;
+
+        wil::com_ptr<IPart> pPart{ pOtherConnector.query<IPart>() };
+        wil::com_ptr<IDeviceTopology> pOtherTopology;
+        pPart->GetTopologyObject(pOtherTopology.put());
+        wil::unique_cotaskmem_string otherDeviceId;
+        pOtherTopology->GetDeviceId(otherDeviceId.put());
+
+        LOG_TRACE(L"connected to {}", otherDeviceId.get());
+
+        if (!std::wstring_view(otherDeviceId.get()).starts_with(LR""({2}.\\?\bth)"")) // bthenum or bthhfenum
+            continue;
+
+        wil::com_ptr<IMMDevice> pOtherDevice;
+        Enumerator().GetDevice(otherDeviceId.get(), pOtherDevice.put());
+
+        wil::com_ptr<IKsControl> pKsControl;
+        pOtherDevice->Activate(__uuidof(IKsControl), CLSCTX_ALL, NULL, pKsControl.put_void());
+
+        endpoint.controls.emplace_back(std::make_shared<KsConnectorControl>(pKsControl, endpoint.id, containerId, m_latencyTracker));
+    }
+
+    if (endpoint.controls.empty())
+        return std::nullopt;
+    return endpoint;
+}
+
+void BluetoothAudioDeviceEnumerator::SetListener(IAudioEndpointListener* listener) {
+    if (listener == nullptr) {
+        if (m_notificationClient != nullptr) {
+            m_notificationClient->SetListener(nullptr);
+            HRESULT hr = Enumerator().UnregisterEndpointNotificationCallback(m_notificationClient.get());
+            DebugLogHresult(hr);
+            m_notificationClient.reset();
+        }
+        return;
+    }
+
+    if (m_notificationClient == nullptr) {
+        m_notificationClient.attach(new EndpointNotificationClient(m_latencyTracker));
+        HRESULT hr = Enumerator().RegisterEndpointNotificationCallback(m_notificationClient.get());
+        DebugLogHresult(hr);
+    }
+    m_notificationClient->SetListener(listener);
+}
+
+ULONG EndpointNotificationClient::AddRef() {
+    return ++m_refCount;
+}
+
+ULONG EndpointNotificationClient::Release() {
+    ULONG refCount = --m_refCount;
+    if (refCount == 0)
+        delete this;
+    return refCount;
+}
+
+HRESULT EndpointNotificationClient::QueryInterface(REFIID riid, VOID** ppvInterface) {
+    if (riid == IID_IUnknown || riid == __uuidof(IMMNotificationClient)) {
+        AddRef();
+        *ppvInterface = static_cast<IMMNotificationClient*>(this);
+        return S_OK;
+    }
+
+    *ppvInterface = NULL;
+    return E_NOINTERFACE;
+}
+
+HRESULT EndpointNotificationClient::OnDeviceAdded(LPCWSTR pwstrDeviceId) {
+    IAudioEndpointListener* listener = m_listener;
+    if (listener != nullptr)
+        listener->OnEndpointAdded(pwstrDeviceId);
+    return S_OK;
+}
+
+HRESULT EndpointNotificationClient::OnDeviceRemoved(LPCWSTR pwstrDeviceId) {
+    IAudioEndpointListener* listener = m_listener;
+    if (listener != nullptr)
+        listener->OnEndpointRemoved(pwstrDeviceId);
+    return S_OK;
+}
+
+static long long Milliseconds(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+}
+
+static void LogConnectLatency(const ConnectLatencySample& sample, const DeviceLatencySummary& summary) {
+    const LatencySummary& latencies = sample.connect ? summary.connect : summary.disconnect;
+    LOG_INFO(L"{} of {} followed after {}ms: p50={}ms, p90={}ms, p99={}ms over {}", sample.connect ? L"Connect" : L"Disconnect", sample.containerId,
+        Milliseconds(sample.elapsed), Milliseconds(latencies.p50), Milliseconds(latencies.p90), Milliseconds(latencies.p99), latencies.count);
+}
+
+HRESULT EndpointNotificationClient::OnDeviceStateChanged(LPCWSTR pwstrDeviceId, DWORD dwNewState) {
+    LOG_INFO(L"endpoint state changed: {}, id: {}", DeviceStateString(dwNewState), pwstrDeviceId);
+    if (m_latencyTracker != nullptr) {
+        std::optional<ConnectLatencySample> sample = m_latencyTracker->EndpointStateChanged(pwstrDeviceId, dwNewState == DEVICE_STATE_ACTIVE, std::chrono::steady_clock::now());
+        if (sample.has_value())
+            LogConnectLatency(*sample, *m_latencyTracker->Summary(sample->containerId));
+    }
+
+    IAudioEndpointListener* listener = m_listener;
+    if (listener != nullptr)
+        listener->OnEndpointStateChanged(pwstrDeviceId, dwNewState == DEVICE_STATE_ACTIVE);
+    return S_OK;
+}
+
+HRESULT EndpointNotificationClient::OnDefaultDeviceChanged(EDataFlow flow, ERole role, LPCWSTR pwstrDefaultDeviceId) {
+    UNREFERENCED_PARAMETER(flow);
+    UNREFERENCED_PARAMETER(role);
+    UNREFERENCED_PARAMETER(pwstrDefaultDeviceId);
+    return S_OK;
+}
+
+HRESULT EndpointNotificationClient::OnPropertyValueChanged(LPCWSTR pwstrDeviceId, const PROPERTYKEY key) {
+    UNREFERENCED_PARAMETER(pwstrDeviceId);
+    UNREFERENCED_PARAMETER(key);
+    return S_OK;
+}
+
+HRESULT KsConnectorControl::GetKsBtAudioProperty(ULONG property) {
+    KSPROPERTY ksProperty;
+    ksProperty.Set = KSPROPSETID_BtAudio;
+    ksProperty.Id = property;
+    ksProperty.Flags = KSPROPERTY_TYPE_GET;
+
+    ULONG bytesReturned;
+    TRACE_SPAN(property == KSPROPERTY_ONESHOT_RECONNECT ? "KsProperty(ONESHOT_RECONNECT)" : "KsProperty(ONESHOT_DISCONNECT)");
+    bool connect = property == KSPROPERTY_ONESHOT_RECONNECT;
+    bool timed = m_latencyTracker != nullptr && m_latencyTracker->CallStarted(m_endpointId, m_containerId, connect, std::chrono::steady_clock::now());
+    HRESULT hr = m_ksControl->KsProperty(&ksProperty, sizeof(ksProperty), NULL, 0, &bytesReturned);
+    DebugLogHresult(hr);
+    // Otherwise the endpoint changing state for another reason later would be taken for this call
+    if (timed && FAILED(hr))
+        m_latencyTracker->CallFailed(m_endpointId, connect);
+    return hr;
+}
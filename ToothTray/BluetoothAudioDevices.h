@@ -1,57 +1,94 @@
-#pragma once
-#include <vector>
-#include <string>
-
-#include <combaseapi.h>
-#include <wil/com.h>
-#include <wil/resource.h>
-#include <devicetopology.h>
-#include <mmdeviceapi.h>
-
-class BluetoothConnector {
-public:
-    BluetoothConnector(const BluetoothConnector& other) = delete;
-    BluetoothConnector& operator=(const BluetoothConnector&) = delete;
-    BluetoothConnector(BluetoothConnector&& other) = default;
-    BluetoothConnector& operator=(BluetoothConnector&&) = default;
-
-    BluetoothConnector(const std::wstring& containerName)
-        : m_deviceName(containerName), m_isConnected(false) {}
-
-    std::wstring_view DeviceName() const {
-        return std::wstring_view(m_deviceName);
-    }
-
-    void addConnectorControl(const wil::com_ptr<IKsControl>& connectorControl, DWORD state);
-
-    bool IsConnected() {
-        return m_isConnected;
-    }
-
-    void Connect() {
-        GetKsBtAudioProperty(KSPROPERTY_ONESHOT_RECONNECT);
-    }
-
-    void Disconnect() {
-        GetKsBtAudioProperty(KSPROPERTY_ONESHOT_DISCONNECT);
-    }
-private:
-    std::wstring m_deviceName;
-    bool m_isConnected;
-    std::vector<wil::com_ptr<IKsControl>> m_ksControls;
-
-    void GetKsBtAudioProperty(ULONG property);
-};
-
-class BluetoothAudioDeviceEnumerator {
-public:
-    std::vector<BluetoothConnector> EnumerateAudioDevices();
-    std::vector<BluetoothConnector>::iterator ConnectorsBegin() {
-        return m_bluetoothConnectors.begin();
-    }
-    std::vector<BluetoothConnector>::iterator ConnectorsEnd() {
-        return m_bluetoothConnectors.end();
-    }
-private:
-    std::vector<BluetoothConnector> m_bluetoothConnectors;
-};
+#pragma once
+#include <vector>
+#include <string>
+#include <atomic>
+
+#include <combaseapi.h>
+#include <wil/com.h>
+#include <wil/resource.h>
+#include <devicetopology.h>
+#include <mmdeviceapi.h>
+
+#include "AudioEndpointSource.h"
+#include "BluetoothConnector.h"
+#include "ConnectLatencyTracker.h"
+#include "WorkerPool.h"
+
+class KsConnectorControl : public IConnectorControl {
+public:
+    // The endpoint is the render endpoint whose topology led to the control. Calls are reported to
+    // the tracker, when there is one, to time how long the endpoint takes to follow.
+    KsConnectorControl(const wil::com_ptr<IKsControl>& ksControl, std::wstring_view endpointId, const GUID& containerId, ConnectLatencyTracker* latencyTracker)
+        : m_ksControl(ksControl), m_endpointId(endpointId), m_containerId(containerId), m_latencyTracker(latencyTracker) {}
+
+    long Connect() override {
+        return GetKsBtAudioProperty(KSPROPERTY_ONESHOT_RECONNECT);
+    }
+
+    long Disconnect() override {
+        return GetKsBtAudioProperty(KSPROPERTY_ONESHOT_DISCONNECT);
+    }
+private:
+    wil::com_ptr<IKsControl> m_ksControl;
+    std::wstring m_endpointId;
+    GUID m_containerId;
+    ConnectLatencyTracker* m_latencyTracker;
+
+    HRESULT GetKsBtAudioProperty(ULONG property);
+};
+
+// Forwards endpoint notifications to an IAudioEndpointListener.
+// Based on the CMMNotificationClient sample in the IMMNotificationClient documentation.
+class EndpointNotificationClient : public IMMNotificationClient {
+public:
+    explicit EndpointNotificationClient(ConnectLatencyTracker* latencyTracker) : m_refCount(1), m_listener(nullptr), m_latencyTracker(latencyTracker) {}
+
+    void SetListener(IAudioEndpointListener* listener) {
+        m_listener = listener;
+    }
+
+    ULONG STDMETHODCALLTYPE AddRef() override;
+    ULONG STDMETHODCALLTYPE Release() override;
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, VOID** ppvInterface) override;
+
+    HRESULT STDMETHODCALLTYPE OnDeviceAdded(LPCWSTR pwstrDeviceId) override;
+    HRESULT STDMETHODCALLTYPE OnDeviceRemoved(LPCWSTR pwstrDeviceId) override;
+    HRESULT STDMETHODCALLTYPE OnDeviceStateChanged(LPCWSTR pwstrDeviceId, DWORD dwNewState) override;
+    HRESULT STDMETHODCALLTYPE OnDefaultDeviceChanged(EDataFlow flow, ERole role, LPCWSTR pwstrDefaultDeviceId) override;
+    HRESULT STDMETHODCALLTYPE OnPropertyValueChanged(LPCWSTR pwstrDeviceId, const PROPERTYKEY key) override;
+private:
+    std::atomic<ULONG> m_refCount;
+    std::atomic<IAudioEndpointListener*> m_listener;
+    ConnectLatencyTracker* m_latencyTracker;
+};
+
+// Finds the bluetooth audio endpoints with Core Audio and forwards IMMNotificationClient notifications.
+class BluetoothAudioDeviceEnumerator : public IAudioEndpointSource {
+public:
+    BluetoothAudioDeviceEnumerator() : m_workerPool(nullptr), m_latencyTracker(nullptr) {}
+    ~BluetoothAudioDeviceEnumerator();
+
+    // Walks the topologies of the endpoints in parallel on the pool. The pool's workers must be in the MTA.
+    // Without a pool the endpoints are walked one at a time.
+    void SetWorkerPool(WorkerPool* pool) {
+        m_workerPool = pool;
+    }
+
+    // Times connects and disconnects of the endpoints resolved and notified after this call.
+    void SetLatencyTracker(ConnectLatencyTracker* tracker) {
+        m_latencyTracker = tracker;
+    }
+
+    std::vector<AudioEndpoint> EnumerateEndpoints() override;
+    std::optional<AudioEndpoint> GetEndpoint(std::wstring_view endpointId) override;
+    void SetListener(IAudioEndpointListener* listener) override;
+private:
+    wil::com_ptr<IMMDeviceEnumerator> m_enumerator;
+    wil::com_ptr<EndpointNotificationClient> m_notificationClient;
+    WorkerPool* m_workerPool;
+    ConnectLatencyTracker* m_latencyTracker;
+
+    // Created on first use because the apartment isn't initialized yet when globals are constructed.
+    IMMDeviceEnumerator& Enumerator();
+    std::optional<AudioEndpoint> ResolveEndpoint(IMMDevice& device);
+};
@@ -0,0 +1,74 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "Guid.h"
+#include "ConnectorControl.h"
+#include "NamePool.h"
+
+// A connectable bluetooth audio device: the audio endpoints sharing a device container, with the
+// container's name and the driver controls of every endpoint.
+class BluetoothConnector {
+public:
+    BluetoothConnector(const GUID& containerId, InternedName containerName)
+        : m_containerId(containerId), m_deviceName(containerName), m_isConnected(false) {}
+
+    const GUID& ContainerId() const {
+        return m_containerId;
+    }
+
+    std::wstring_view DeviceName() const {
+        return m_deviceName.View();
+    }
+
+    // Shared with every other copy of the name, so copying a connector doesn't copy it
+    InternedName DeviceNameHandle() const {
+        return m_deviceName;
+    }
+
+    void addConnectorControl(const std::shared_ptr<IConnectorControl>& connectorControl, bool isActive) {
+        m_ksControls.emplace_back(connectorControl);
+        m_isConnected |= isActive;
+    }
+
+    void addEndpointId(std::wstring_view endpointId) {
+        m_endpointIds.emplace_back(endpointId);
+    }
+
+    // The audio endpoints the controls came from, so the connector can be resolved again later
+    const std::vector<std::wstring>& EndpointIds() const {
+        return m_endpointIds;
+    }
+
+    bool IsConnected() const {
+        return m_isConnected;
+    }
+
+    // Both return the first failed HRESULT, or 0 when every control succeeded.
+    long Connect() const {
+        long result = 0;
+        for (const std::shared_ptr<IConnectorControl>& ksControl : m_ksControls) {
+            long hr = ksControl->Connect();
+            if (hr < 0 && result >= 0)
+                result = hr;
+        }
+        return result;
+    }
+
+    long Disconnect() const {
+        long result = 0;
+        for (const std::shared_ptr<IConnectorControl>& ksControl : m_ksControls) {
+            long hr = ksControl->Disconnect();
+            if (hr < 0 && result >= 0)
+                result = hr;
+        }
+        return result;
+    }
+private:
+    GUID m_containerId;
+    InternedName m_deviceName;
+    bool m_isConnected;
+    std::vector<std::shared_ptr<IConnectorControl>> m_ksControls;
+    std::vector<std::wstring> m_endpointIds;
+};
@@ -1,6 +1,6 @@
-#include "BluetoothDeviceClass.h"
-
-std::wostream& operator<<(std::wostream& stream, BluetoothDeviceClass cod) {
-    stream << GET_COD_MAJOR(cod.cod) << L'.' << GET_COD_MINOR(cod.cod) << L"." << GET_COD_SERVICE(cod.cod);
-    return stream;
+#include "BluetoothDeviceClass.h"
+
+std::wostream& operator<<(std::wostream& stream, BluetoothDeviceClass cod) {
+    stream << GET_COD_MAJOR(cod.cod) << L'.' << GET_COD_MINOR(cod.cod) << L"." << GET_COD_SERVICE(cod.cod);
+    return stream;
 }
\ No newline at end of file
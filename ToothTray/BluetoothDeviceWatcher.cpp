@@ -1,142 +1,224 @@
-#include "BluetoothDeviceWatcher.h"
-
-#include <winrt\Windows.Foundation.Collections.h>
-#include <winrt\Windows.Devices.Enumeration.h>
-#include <debugapi.h>
-#include <sstream>
-
-void DeviceEnumerationCompleted(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Foundation::IInspectable _) {
-    UNREFERENCED_PARAMETER(watcher);
-    OutputDebugStringW(L"Device enumeration completed.\r\n");
-}
-
-void OutputDeviceProperties(std::wostringstream& sout, const winrt::Windows::Foundation::Collections::IMapView<winrt::hstring, winrt::Windows::Foundation::IInspectable>& properties) {
-    for (const auto& kvp : properties) {
-        const winrt::hstring&& propName = kvp.Key();
-        if (propName == L"System.Devices.Aep.ContainerId") {
-            winrt::guid containerId = kvp.Value().as<winrt::guid>();
-            sout << propName.c_str();
-        }
-        else {
-            sout << propName.c_str() << ", ";
-        }
-    }
-    sout << std::endl;
-}
-
-BluetoothDeviceWatcher::BluetoothDeviceWatcher() {
-    winrt::hstring pairedSelector = winrt::Windows::Devices::Bluetooth::BluetoothDevice::GetDeviceSelectorFromPairingState(true);
-    m_watcher = winrt::Windows::Devices::Enumeration::DeviceInformation::CreateWatcher(pairedSelector, nullptr, winrt::Windows::Devices::Enumeration::DeviceInformationKind::AssociationEndpoint);
-
-    m_devicedEnumerationCompletedRevoker = m_watcher.EnumerationCompleted(winrt::auto_revoke, DeviceEnumerationCompleted);
-    m_devicedAddedRevoker = m_watcher.Added(winrt::auto_revoke, { this, &BluetoothDeviceWatcher::DeviceAdded });
-    m_devicedUpdatedRevoker = m_watcher.Updated(winrt::auto_revoke, { this, &BluetoothDeviceWatcher::DeviceUpdated });
-    m_deviceRemovedRevoker = m_watcher.Removed(winrt::auto_revoke, { this, &BluetoothDeviceWatcher::DeviceRemoved });
-}
-
-void BluetoothDeviceWatcher::Start()
-{
-    m_watcher.Start();
-}
-
-void BluetoothDeviceWatcher::DeviceAdded(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Devices::Enumeration::DeviceInformation info) {
-    UNREFERENCED_PARAMETER(watcher);
-
-    winrt::hstring&& name = info.Name();
-    winrt::hstring&& id = info.Id();
-    winrt::Windows::Devices::Enumeration::DeviceInformationKind kind = info.Kind();
-    bool isEnabled = info.IsEnabled();
-    winrt::Windows::Devices::Enumeration::DeviceInformationPairing&& pairing = info.Pairing();
-    bool canPair = pairing.CanPair();
-    bool isPaired = pairing.IsPaired();
-
-    std::wostringstream sout;
-    sout << L"Device added: ";
-    sout << L"name: " << name.c_str() << ", ";
-    sout << L"id: " << id.c_str() << ", ";
-    sout << L"kind: " << static_cast<int>(kind) << ", ";
-    sout << L"is enabled: " << isEnabled << ", ";
-    sout << L"can pair: " << canPair << ", ";
-    sout << L"is paired: " << isPaired << ", ";
-
-    OutputDeviceProperties(sout, info.Properties());
-
-    const std::wstring&& output = sout.str();
-    OutputDebugStringW(output.c_str());
-
-    m_devices.emplace(std::piecewise_construct, std::forward_as_tuple(id), std::forward_as_tuple(name, canPair, isPaired));
-
-    winrt::Windows::Devices::Bluetooth::BluetoothDevice device = winrt::Windows::Devices::Bluetooth::BluetoothDevice::FromIdAsync(id).get();
-        //.Completed(
-        //[](winrt::Windows::Devices::Bluetooth::BluetoothDevice device) {
-            OutputDebugStringW(L"found bluetooth device\r\n");
-        //}
-    //);
-}
-
-void BluetoothDeviceWatcher::DeviceUpdated(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Devices::Enumeration::DeviceInformationUpdate update) {
-    UNREFERENCED_PARAMETER(watcher);
-
-    winrt::hstring&& id = update.Id();
-    winrt::Windows::Devices::Enumeration::DeviceInformationKind kind = update.Kind();
-
-    std::wostringstream sout;
-    sout << L"Device updated: ";
-    sout << L"id: " << id.c_str() << L", ";
-    sout << L"kind: " << static_cast<int>(kind) << L", ";
-
-    const winrt::Windows::Foundation::Collections::IMapView<winrt::hstring, winrt::Windows::Foundation::IInspectable>&& properties = update.Properties();
-    OutputDeviceProperties(sout, properties);
-
-    OutputDebugStringW(sout.str().c_str());
-
-    sout.str(L"");
-    DeviceInfo& info = m_devices.at(id);
-    sout << info.name.c_str() << L" updated: ";
-    for (const auto& kvp : properties) {
-        const winrt::hstring&& propName = kvp.Key();
-        winrt::Windows::Foundation::IInspectable&& value = kvp.Value();
-
-        if (propName == L"System.ItemNameDisplay") {
-            winrt::hstring name = winrt::unbox_value<winrt::hstring>(value);
-            if (info.name == name)
-                continue;
-            sout << L"name: " << info.name.c_str() << L" -> " << name.c_str() << L"; ";
-            info.name = name;
-        }
-        else if (propName == L"System.Devices.Aep.CanPair") {
-            bool canPair = winrt::unbox_value<bool>(value);
-            if (info.canPair == canPair)
-                continue;
-            sout << L"can pair: " << info.canPair << L" -> " << canPair << L"; ";
-            info.canPair = canPair;
-        }
-        else if (propName == L"System.Devices.Aep.IsPaired") {
-            bool isPaired = winrt::unbox_value<bool>(value);
-            if (info.isPaired == isPaired)
-                continue;
-            sout << L"is paired: " << info.isPaired << L" -> " << isPaired << L"; ";
-            info.isPaired = isPaired;
-        }
-    }
-    sout << std::endl;
-    OutputDebugStringW(sout.str().c_str());
-}
-
-void BluetoothDeviceWatcher::DeviceRemoved(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Devices::Enumeration::DeviceInformationUpdate update) {
-    UNREFERENCED_PARAMETER(watcher);
-
-    winrt::hstring&& id = update.Id();
-
-    std::wostringstream sout;
-    sout << L"Device removed: ";
-    sout << L"id: " << id.c_str() << ", ";
-
-    const DeviceInfo& info = m_devices.at(id);
-    sout << L"name: " << info.name.c_str() << ", ";
-
-    OutputDeviceProperties(sout, update.Properties());
-
-    const std::wstring&& output = sout.str();
-    OutputDebugStringW(output.c_str());
-}
+#include "BluetoothDeviceWatcher.h"
+#include "debuglog.h"
+
+#include <winrt\Windows.Foundation.Collections.h>
+#include <winrt\Windows.Devices.Enumeration.h>
+#include <sstream>
+
+#include "DevicePropertyDispatch.h"
+
+using DevicePropertyMap = winrt::Windows::Foundation::Collections::IMapView<winrt::hstring, winrt::Windows::Foundation::IInspectable>;
+
+std::wstring DevicePropertyNames(const DevicePropertyMap& properties) {
+    std::wostringstream sout;
+    for (const auto& kvp : properties) {
+        if (sout.tellp() > 0)
+            sout << L", ";
+        sout << kvp.Key().c_str();
+    }
+    return sout.str();
+}
+
+static bool ApplyName(DeviceInfo& info, const winrt::Windows::Foundation::IInspectable& value) {
+    InternedName name = NamePool::Shared().Intern(winrt::unbox_value_or<winrt::hstring>(value, winrt::hstring()));
+    if (info.name == name)
+        return false;
+    LOG_INFO(L"{} updated: name: {} -> {}", info.name, info.name, name);
+    info.name = name;
+    return true;
+}
+
+static bool ApplyCanPair(DeviceInfo& info, const winrt::Windows::Foundation::IInspectable& value) {
+    bool canPair = winrt::unbox_value_or<bool>(value, false);
+    if (info.canPair == canPair)
+        return false;
+    LOG_INFO(L"{} updated: can pair: {} -> {}", info.name, info.canPair, canPair);
+    info.canPair = canPair;
+    return true;
+}
+
+static bool ApplyIsPaired(DeviceInfo& info, const winrt::Windows::Foundation::IInspectable& value) {
+    bool isPaired = winrt::unbox_value_or<bool>(value, false);
+    if (info.isPaired == isPaired)
+        return false;
+    LOG_INFO(L"{} updated: is paired: {} -> {}", info.name, info.isPaired, isPaired);
+    info.isPaired = isPaired;
+    return true;
+}
+
+static bool ApplyIsConnected(DeviceInfo& info, const winrt::Windows::Foundation::IInspectable& value) {
+    bool isConnected = winrt::unbox_value_or<bool>(value, false);
+    if (info.isConnected == isConnected)
+        return false;
+    LOG_INFO(L"{} updated: is connected: {} -> {}", info.name, info.isConnected, isConnected);
+    info.isConnected = isConnected;
+    return true;
+}
+
+static bool ApplySignalStrength(DeviceInfo& info, const winrt::Windows::Foundation::IInspectable& value) {
+    // Empty while the device is out of range
+    std::optional<int32_t> signalStrength;
+    if (value != nullptr)
+        signalStrength = winrt::unbox_value<int32_t>(value);
+    if (info.signalStrength == signalStrength)
+        return false;
+    LOG_DEBUG(L"{} updated: signal strength: {} dBm", info.name, signalStrength.value_or(0));
+    info.signalStrength = signalStrength;
+    return true;
+}
+
+static bool ApplyContainerId(DeviceInfo& info, const winrt::Windows::Foundation::IInspectable& value) {
+    winrt::guid containerId = winrt::unbox_value_or<winrt::guid>(value, winrt::guid{});
+    if (info.containerId == containerId)
+        return false;
+    info.containerId = containerId;
+    return true;
+}
+
+static bool ApplyProtocolId(DeviceInfo& info, const winrt::Windows::Foundation::IInspectable& value) {
+    winrt::guid protocolId = winrt::unbox_value_or<winrt::guid>(value, winrt::guid{});
+    if (info.protocolId == protocolId)
+        return false;
+    info.protocolId = protocolId;
+    return true;
+}
+
+// Every property the watcher keeps track of. Looking a name up costs the same however many there are.
+static constexpr DevicePropertyDispatch<DeviceInfo, winrt::Windows::Foundation::IInspectable, 7> WATCHED_PROPERTIES(
+    std::array<DevicePropertyHandler<DeviceInfo, winrt::Windows::Foundation::IInspectable>, 7>{ {
+        { L"System.ItemNameDisplay", ApplyName },
+        { L"System.Devices.Aep.CanPair", ApplyCanPair },
+        { L"System.Devices.Aep.IsPaired", ApplyIsPaired },
+        { L"System.Devices.Aep.IsConnected", ApplyIsConnected },
+        { L"System.Devices.Aep.SignalStrength", ApplySignalStrength },
+        { L"System.Devices.Aep.ContainerId", ApplyContainerId },
+        { L"System.Devices.Aep.ProtocolId", ApplyProtocolId },
+    } });
+
+// Applies every watched property of an added or updated device in one pass, returns whether any changed.
+static bool ApplyDeviceProperties(DeviceInfo& info, const DevicePropertyMap& properties) {
+    bool changed = false;
+    for (const auto& kvp : properties)
+        changed |= WATCHED_PROPERTIES.Apply(info, kvp.Key(), kvp.Value());
+    return changed;
+}
+
+void BluetoothDeviceResolver::ResolveAsync(const std::wstring& id, Completion completed) {
+    using winrt::Windows::Devices::Bluetooth::BluetoothDevice;
+    using winrt::Windows::Foundation::AsyncStatus;
+
+    try {
+        BluetoothDevice::FromIdAsync(winrt::hstring(id)).Completed(
+            [completed](const winrt::Windows::Foundation::IAsyncOperation<BluetoothDevice>& operation, AsyncStatus status) {
+                std::optional<ResolvedDevice> resolved;
+                try {
+                    BluetoothDevice device = status == AsyncStatus::Completed ? operation.GetResults() : nullptr;
+                    if (device != nullptr) {
+                        bool connected = device.ConnectionStatus() == winrt::Windows::Devices::Bluetooth::BluetoothConnectionStatus::Connected;
+                        resolved = ResolvedDevice{ device.BluetoothAddress(), device.ClassOfDevice().RawValue(), connected };
+                    }
+                }
+                catch (const winrt::hresult_error& e) {
+                    LOG_WARNING(L"Failed to resolve a bluetooth device: {}", e.message());
+                }
+                completed(resolved);
+            });
+    }
+    catch (const winrt::hresult_error& e) {
+        LOG_WARNING(L"Failed to resolve bluetooth device {}: {}", id, e.message());
+        completed(std::nullopt);
+    }
+}
+
+BluetoothDeviceWatcher::BluetoothDeviceWatcher()
+    : m_resolutions(m_resolver, MAX_CONCURRENT_RESOLVES, [this](const std::wstring& id, const std::optional<ResolvedDevice>& device) { DeviceResolved(id, device); }) {
+    winrt::hstring pairedSelector = winrt::Windows::Devices::Bluetooth::BluetoothDevice::GetDeviceSelectorFromPairingState(true);
+    std::vector<winrt::hstring> requestedProperties;
+    for (const DevicePropertyHandler<DeviceInfo, winrt::Windows::Foundation::IInspectable>& handler : WATCHED_PROPERTIES.Handlers())
+        requestedProperties.emplace_back(handler.name);
+    m_watcher = winrt::Windows::Devices::Enumeration::DeviceInformation::CreateWatcher(pairedSelector, std::move(requestedProperties), winrt::Windows::Devices::Enumeration::DeviceInformationKind::AssociationEndpoint);
+
+    m_devicedEnumerationCompletedRevoker = m_watcher.EnumerationCompleted(winrt::auto_revoke, { this, &BluetoothDeviceWatcher::DeviceEnumerationCompleted });
+    m_devicedAddedRevoker = m_watcher.Added(winrt::auto_revoke, { this, &BluetoothDeviceWatcher::DeviceAdded });
+    m_devicedUpdatedRevoker = m_watcher.Updated(winrt::auto_revoke, { this, &BluetoothDeviceWatcher::DeviceUpdated });
+    m_deviceRemovedRevoker = m_watcher.Removed(winrt::auto_revoke, { this, &BluetoothDeviceWatcher::DeviceRemoved });
+}
+
+void BluetoothDeviceWatcher::Start()
+{
+    m_watcher.Start();
+}
+
+void BluetoothDeviceWatcher::DeviceEnumerationCompleted(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Foundation::IInspectable _) {
+    UNREFERENCED_PARAMETER(watcher);
+
+    DeviceResolutionMetrics metrics = m_resolutions.Metrics();
+    LOG_DEBUG(L"Device enumeration completed. Resolves: queued={}, peak queued={}, in flight={}, p50={}us",
+        metrics.queued, metrics.peakQueued, metrics.inFlight,
+        std::chrono::duration_cast<std::chrono::microseconds>(metrics.resolveLatency.Percentile(50)).count());
+}
+
+void BluetoothDeviceWatcher::DeviceAdded(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Devices::Enumeration::DeviceInformation info) {
+    UNREFERENCED_PARAMETER(watcher);
+
+    winrt::hstring&& name = info.Name();
+    winrt::hstring&& id = info.Id();
+    winrt::Windows::Devices::Enumeration::DeviceInformationKind kind = info.Kind();
+    bool isEnabled = info.IsEnabled();
+    winrt::Windows::Devices::Enumeration::DeviceInformationPairing&& pairing = info.Pairing();
+    bool canPair = pairing.CanPair();
+    bool isPaired = pairing.IsPaired();
+
+    LOG_DEBUG(L"Device added: name: {}, id: {}, kind: {}, is enabled: {}, can pair: {}, is paired: {}", name, id, kind, isEnabled, canPair, isPaired);
+    // Collecting the property names is only worth it when they're logged.
+    if constexpr (LogLevelEnabled(LogLevel::Trace))
+        LOG_TRACE(L"Device added properties: {}", DevicePropertyNames(info.Properties()));
+
+    DeviceInfo device(NamePool::Shared().Intern(name), canPair, isPaired);
+    ApplyDeviceProperties(device, info.Properties());
+    m_devices.Put(id, std::move(device));
+
+    // Resolving can take a while per device, which would hold up the watcher's other events
+    m_resolutions.Enqueue(std::wstring(id));
+}
+
+void BluetoothDeviceWatcher::DeviceResolved(const std::wstring& id, const std::optional<ResolvedDevice>& device) {
+    if (!device.has_value())
+        return;
+
+    // Removed while it was resolving
+    m_devices.Update(winrt::hstring(id), [&device](DeviceInfo& info) {
+        LOG_DEBUG(L"Found bluetooth device {}: address={}, class={}, connected={}", info.name, device->address, device->classOfDevice, device->connected);
+        info.device = device;
+        return true;
+    });
+}
+
+void BluetoothDeviceWatcher::DeviceUpdated(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Devices::Enumeration::DeviceInformationUpdate update) {
+    UNREFERENCED_PARAMETER(watcher);
+
+    winrt::hstring&& id = update.Id();
+    winrt::Windows::Devices::Enumeration::DeviceInformationKind kind = update.Kind();
+
+    const DevicePropertyMap&& properties = update.Properties();
+    LOG_DEBUG(L"Device updated: id: {}, kind: {}", id, kind);
+    if constexpr (LogLevelEnabled(LogLevel::Trace))
+        LOG_TRACE(L"Device updated properties: {}", DevicePropertyNames(properties));
+
+    bool known = m_devices.Update(id, [&properties](DeviceInfo& info) { return ApplyDeviceProperties(info, properties); });
+    // Updates can race ahead of the add, or come after the removal
+    if (!known)
+        LOG_WARNING(L"Ignoring the update of unknown device {}", id);
+}
+
+void BluetoothDeviceWatcher::DeviceRemoved(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Devices::Enumeration::DeviceInformationUpdate update) {
+    UNREFERENCED_PARAMETER(watcher);
+
+    winrt::hstring&& id = update.Id();
+    m_resolutions.Cancel(std::wstring(id));
+
+    std::shared_ptr<const DeviceInfo> info = m_devices.Remove(id);
+    LOG_DEBUG(L"Device removed: id: {}, name: {}", id, info != nullptr ? info->name : InternedName());
+    if constexpr (LogLevelEnabled(LogLevel::Trace))
+        LOG_TRACE(L"Device removed properties: {}", DevicePropertyNames(update.Properties()));
+}
@@ -1,36 +1,74 @@
-#pragma once
-
-#include "framework.h"
-#include <winrt\Windows.Foundation.h>
-#include <winrt\Windows.Devices.Bluetooth.h>
-#include <unordered_map>
-
-class DeviceInfo {
-public:
-    winrt::hstring name;
-    bool canPair;
-    bool isPaired;
-
-    DeviceInfo(winrt::hstring name, bool canPair, bool isPaired)
-        : name(name), canPair(canPair), isPaired(isPaired) {}
-};
-
-class BluetoothDeviceWatcher {
-public:
-    BluetoothDeviceWatcher();
-
-    void Start();
-private:
-    winrt::Windows::Devices::Enumeration::DeviceWatcher m_watcher{ nullptr };
-    winrt::Windows::Devices::Enumeration::DeviceWatcher::EnumerationCompleted_revoker m_devicedEnumerationCompletedRevoker;
-    winrt::Windows::Devices::Enumeration::DeviceWatcher::Added_revoker m_devicedAddedRevoker;
-    winrt::Windows::Devices::Enumeration::DeviceWatcher::Updated_revoker m_devicedUpdatedRevoker;
-    winrt::Windows::Devices::Enumeration::DeviceWatcher::Removed_revoker m_deviceRemovedRevoker;
-
-    std::unordered_map<winrt::hstring, DeviceInfo> m_devices;
-
-    void DeviceAdded(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Devices::Enumeration::DeviceInformation info);
-    void DeviceUpdated(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Devices::Enumeration::DeviceInformationUpdate update);
-    void DeviceRemoved(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Devices::Enumeration::DeviceInformationUpdate update);
-};
-
+#pragma once
+
+#include "framework.h"
+#include <winrt\Windows.Foundation.h>
+#include <winrt\Windows.Devices.Bluetooth.h>
+#include <cstdint>
+#include <optional>
+
+#include "NamePool.h"
+#include "DeviceStateStore.h"
+#include "DeviceResolutionQueue.h"
+
+class DeviceInfo {
+public:
+    InternedName name;
+    bool canPair;
+    bool isPaired;
+    // Requested from the watcher, see WATCHED_PROPERTIES
+    bool isConnected = false;
+    std::optional<int32_t> signalStrength;
+    winrt::guid containerId{};
+    winrt::guid protocolId{};
+    // Filled in once the device object has been resolved
+    std::optional<ResolvedDevice> device;
+
+    DeviceInfo(InternedName name, bool canPair, bool isPaired)
+        : name(name), canPair(canPair), isPaired(isPaired) {}
+};
+
+// Resolves the bluetooth device object of a watcher id with BluetoothDevice::FromIdAsync.
+class BluetoothDeviceResolver : public IDeviceResolver {
+public:
+    void ResolveAsync(const std::wstring& id, Completion completed) override;
+};
+
+using WatchedDevices = DeviceStateStore<winrt::hstring, DeviceInfo>;
+
+class BluetoothDeviceWatcher {
+public:
+    // The initial enumeration adds every paired device at once, so their resolves overlap up to this
+    static constexpr size_t MAX_CONCURRENT_RESOLVES = 4;
+
+    BluetoothDeviceWatcher();
+
+    void Start();
+
+    // A consistent view of every device, which the watcher threads never change under the caller.
+    std::shared_ptr<const Snapshot<WatchedDevices::Map>> Devices() const {
+        return m_devices.Current();
+    }
+
+    DeviceResolutionMetrics ResolutionMetrics() {
+        return m_resolutions.Metrics();
+    }
+private:
+    // The watcher raises its events on any thread, and resolves complete on others
+    WatchedDevices m_devices;
+    BluetoothDeviceResolver m_resolver;
+    // Destroyed before the devices, after waiting for the resolves that are running
+    DeviceResolutionQueue m_resolutions;
+
+    winrt::Windows::Devices::Enumeration::DeviceWatcher m_watcher{ nullptr };
+    winrt::Windows::Devices::Enumeration::DeviceWatcher::EnumerationCompleted_revoker m_devicedEnumerationCompletedRevoker;
+    winrt::Windows::Devices::Enumeration::DeviceWatcher::Added_revoker m_devicedAddedRevoker;
+    winrt::Windows::Devices::Enumeration::DeviceWatcher::Updated_revoker m_devicedUpdatedRevoker;
+    winrt::Windows::Devices::Enumeration::DeviceWatcher::Removed_revoker m_deviceRemovedRevoker;
+
+    void DeviceEnumerationCompleted(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Foundation::IInspectable _);
+    void DeviceAdded(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Devices::Enumeration::DeviceInformation info);
+    void DeviceUpdated(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Devices::Enumeration::DeviceInformationUpdate update);
+    void DeviceRemoved(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Devices::Enumeration::DeviceInformationUpdate update);
+    void DeviceResolved(const std::wstring& id, const std::optional<ResolvedDevice>& device);
+};
+
@@ -1,196 +1,274 @@
-#include "BluetoothSocket.h"
-
-void DebugLogSocketResult(INT result, LPCWSTR operation) {
-    if (result == SOCKET_ERROR) {
-        int error = WSAGetLastError();
-        DebugLogl(DebugLogStream{} << operation << L" failed: socket_error=" << error);
-
-        if (error == WSA_E_NO_MORE) {
-            DebugLog(L"Lookup completed\r\n");
-        }
-        else if (error == WSAEFAULT) {
-            DebugLog(L"Buffer too small\r\n");
-        }
-        else if (error == WSASERVICE_NOT_FOUND) {
-            DebugLog(L"Service not available\r\n");
-        }
-        else {
-            DebugLog(L"Unknown error\r\n");
-        }
-    }
-}
-
-int EnumerateBluetoothDevicesAndServices() {
-    WSADATA wsaData;
-    int wsaResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
-    if (0 != wsaResult) {
-        DebugLog(L"Failed to initialize WinSocks2\r\n");
-        return wsaResult;
-    }
-
-    bool foundCh510 = false;
-    BTH_ADDR ch510Addr;
-    BTH_QUERY_DEVICE deviceQuery;
-    deviceQuery.LAP = 0x9E8B33; // General/Unlimited Inquiry Access Code (GIAC)
-    deviceQuery.length = 10; // query for 10 seconds
-
-    BLOB deviceQueryBlob;
-    deviceQueryBlob.cbSize = sizeof(BTH_QUERY_DEVICE);
-    deviceQueryBlob.pBlobData = reinterpret_cast<BYTE*>(&deviceQuery);
-
-    WSAQUERYSET querySet{ sizeof(WSAQUERYSET) };
-    querySet.dwNameSpace = NS_BTH;
-    querySet.lpBlob = &deviceQueryBlob;
-    HANDLE hLookup;
-    INT lookupResult = WSALookupServiceBeginW(&querySet, LUP_CONTAINERS | LUP_FLUSHCACHE, &hLookup);
-
-    if (lookupResult == ERROR_SUCCESS) {
-        LookupService lookupService(hLookup);
-        while (true) {
-            lookupResult = lookupService.LookupNext(LUP_RETURN_TYPE | LUP_RETURN_NAME | LUP_RETURN_ADDR | LUP_RES_SERVICE);
-            if (lookupResult != ERROR_SUCCESS)
-                break;
-
-            const WSAQUERYSET* queryResult = lookupService.QueryResult();
-
-            bool connected = queryResult->dwOutputFlags & BTHNS_RESULT_DEVICE_CONNECTED;
-            bool remembered = queryResult->dwOutputFlags & BTHNS_RESULT_DEVICE_REMEMBERED;
-            bool authenticated = queryResult->dwOutputFlags & BTHNS_RESULT_DEVICE_AUTHENTICATED;
-            CSADDR_INFO* addresses = queryResult->lpcsaBuffer;
-
-            DebugLogStream dlog;
-            dlog << L"Found device: name=" << queryResult->lpszServiceInstanceName << L", class=" << BluetoothDeviceClass(queryResult->lpServiceClassId->Data1);
-            for (unsigned int i = 0; i < queryResult->dwNumberOfCsAddrs; ++i) {
-                SOCKADDR_BTH* remote = reinterpret_cast<SOCKADDR_BTH*>(addresses[i].RemoteAddr.lpSockaddr);
-                dlog << L", address" << i << L'=' << remote->btAddr;
-            }
-
-            dlog.Logl();
-
-            if (std::wstring(L"WH-CH510").compare(queryResult->lpszServiceInstanceName) == 0) {
-                foundCh510 = true;
-                ch510Addr = reinterpret_cast<SOCKADDR_BTH*>(addresses[0].RemoteAddr.lpSockaddr)->btAddr;
-            }
-        }
-    }
-
-    DebugLogSocketResult(lookupResult, L"Device lookup");
-
-    if (hLookup != NULL && WSALookupServiceEnd(hLookup) != ERROR_SUCCESS)
-        DebugLog(L"Failed to end device look up\r\n");
-
-    if (foundCh510) {
-        EnumerateBluetoothServices(ch510Addr);
-    }
-
-    return S_OK;
-}
-
-INT LookupService::LookupNext(DWORD dwControlFlags) {
-    DWORD queryResultLength = m_bufferLength;
-    INT lookupResult = WSALookupServiceNextW(m_hLookup, dwControlFlags, &queryResultLength, reinterpret_cast<WSAQUERYSET*>(m_buffer.get()));
-
-    if (lookupResult == SOCKET_ERROR && WSAGetLastError() == WSAEFAULT && queryResultLength != 0) {
-        m_bufferLength = queryResultLength;
-        m_buffer = std::make_unique<BYTE[]>(m_bufferLength);
-        lookupResult = WSALookupServiceNextW(m_hLookup, dwControlFlags, &queryResultLength, reinterpret_cast<WSAQUERYSET*>(m_buffer.get()));
-    }
-
-    return lookupResult;
-}
-
-void EnumerateBluetoothServices(BTH_ADDR address) {
-    GUID targetService = PUBLIC_BROWSE_ROOT;
-    WCHAR deviceAddress[256];
-    DWORD deviceAddressLength = 256;
-    SOCKADDR_BTH socketAddress{ AF_BTH, address };
-    if (SOCKET_ERROR == WSAAddressToStringW(reinterpret_cast<SOCKADDR*>(&socketAddress), sizeof(SOCKADDR_BTH), NULL, deviceAddress, &deviceAddressLength)) {
-        DebugLogl(DebugLogStream{} << L"Failed converting device address to string: error=" << WSAGetLastError());
-    }
-
-    WSAQUERYSET serviceQuery{ sizeof(WSAQUERYSET) };
-    serviceQuery.dwNameSpace = NS_BTH;
-    serviceQuery.lpServiceClassId = &targetService;
-    serviceQuery.dwNumberOfCsAddrs = 0;
-    serviceQuery.lpszContext = deviceAddress;
-
-    HANDLE hLookup;
-    // if LUP_FLUSHCACHE is specified, it only works when the device is online
-    INT lookupResult = WSALookupServiceBeginW(&serviceQuery, LUP_FLUSHCACHE, &hLookup);
-
-    if (lookupResult == ERROR_SUCCESS) {
-        LookupService lookupService(hLookup);
-        while (true) {
-            lookupResult = lookupService.LookupNext(LUP_RETURN_TYPE | LUP_RETURN_NAME | LUP_RETURN_ADDR | LUP_RES_SERVICE | LUP_RETURN_BLOB);
-            if (lookupResult != ERROR_SUCCESS)
-                break;
-
-            const WSAQUERYSET* queryResult = lookupService.QueryResult();
-
-            CSADDR_INFO* addresses = queryResult->lpcsaBuffer;
-
-            DebugLogStream dlog;
-            dlog << L"Found service: name=" << queryResult->lpszServiceInstanceName;
-
-            // The simple search returns the service record as the blob
-            /* General SDP Service Attributes
-            * 0, service record handle
-            * 1, service class id list, most specifc to most general
-            * 2, service record state
-            * 3, service id
-            * 4, protocol descriptor list
-            * 5, browse group list
-            * 6, language based attribute list
-            *   +0, service name
-            *   +1, service description
-            *   +2, provider name
-            * 8, service availibity
-            * 9, bluetooth profile descriptor list
-            * 13, additional protocol descriptor list
-            */
-            BOOL enumResult = BluetoothSdpEnumAttributes(queryResult->lpBlob->pBlobData, queryResult->lpBlob->cbSize, [](ULONG attrId, BYTE* attrValue, ULONG attrValueLength, VOID* param) -> BOOL {
-                DebugLogStream* dlog = reinterpret_cast<DebugLogStream*>(param);
-                switch (attrId) {
-                case 1: // service class id list
-                {
-                    *dlog << L", serviceClassIds=[";
-
-                    HBLUETOOTH_CONTAINER_ELEMENT hContainer = NULL;
-                    SDP_ELEMENT_DATA value;
-                    while (true) {
-                        DWORD result = BluetoothSdpGetContainerElementData(attrValue, attrValueLength, &hContainer, &value);
-                        if (result != ERROR_SUCCESS) {
-                            if (result != ERROR_NO_MORE_ITEMS)
-                                *dlog << L"failed to enumerate service class id list";
-                            break;
-                        }
-
-                        if (value.type != SDP_TYPE_UUID) {
-                            *dlog << L"unexpected class id type,";
-                            continue;
-                        }
-
-                        if (value.specificType == SDP_ST_UUID16)
-                            *dlog << std::hex << value.data.uuid16 << std::dec;
-                        else if (value.specificType == SDP_ST_UUID32)
-                            *dlog << std::hex << value.data.uuid32 << std::dec;
-                        else if (value.specificType == SDP_ST_UUID128)
-                            *dlog << value.data.uuid128;
-                        *dlog << L',';
-                    }
-
-                    *dlog << L']';
-                    break;
-                }
-                default:
-                    *dlog << L", attrbute=" << attrId;
-                }
-                return TRUE;
-                }, &dlog);
-            if (enumResult == FALSE)
-                dlog << L", failed to enum attributes";
-
-            dlog.Logl();
-        }
-    }
-}
+#include "BluetoothSocket.h"
+
+#include <span>
+#include <sstream>
+#include <optional>
+#include <string_view>
+
+void DebugLogSocketResult(INT result, LPCWSTR operation) {
+    if (result == SOCKET_ERROR) {
+        int error = WSAGetLastError();
+        LOG_WARNING(L"{} failed: socket_error={}", operation, error);
+
+        if (error == WSA_E_NO_MORE) {
+            LOG_DEBUG(L"Lookup completed");
+        }
+        else if (error == WSAEFAULT) {
+            LOG_DEBUG(L"Buffer too small");
+        }
+        else if (error == WSASERVICE_NOT_FOUND) {
+            LOG_DEBUG(L"Service not available");
+        }
+        else {
+            LOG_WARNING(L"Unknown error");
+        }
+    }
+}
+
+// One device lookup. Without an inquiry length it returns the devices the stack already knows right away.
+static void LookupDevices(DiscoverySession& session, std::optional<std::chrono::seconds> inquiry) {
+    BTH_QUERY_DEVICE deviceQuery{};
+    deviceQuery.LAP = 0x9E8B33; // General/Unlimited Inquiry Access Code (GIAC)
+    deviceQuery.length = inquiry.has_value() ? static_cast<UCHAR>(inquiry->count()) : 0;
+
+    BLOB deviceQueryBlob;
+    deviceQueryBlob.cbSize = sizeof(BTH_QUERY_DEVICE);
+    deviceQueryBlob.pBlobData = reinterpret_cast<BYTE*>(&deviceQuery);
+
+    WSAQUERYSET querySet{ sizeof(WSAQUERYSET) };
+    querySet.dwNameSpace = NS_BTH;
+    querySet.lpBlob = &deviceQueryBlob;
+    HANDLE hLookup = NULL;
+    // Flushing the cache is what issues the inquiry
+    INT lookupResult = WSALookupServiceBeginW(&querySet, LUP_CONTAINERS | (inquiry.has_value() ? LUP_FLUSHCACHE : 0), &hLookup);
+
+    if (lookupResult == ERROR_SUCCESS) {
+        LookupService lookupService(hLookup);
+        while (!session.Stopped()) {
+            lookupResult = lookupService.LookupNext(LUP_RETURN_TYPE | LUP_RETURN_NAME | LUP_RETURN_ADDR | LUP_RES_SERVICE);
+            if (lookupResult != ERROR_SUCCESS)
+                break;
+
+            const WSAQUERYSET* queryResult = lookupService.QueryResult();
+            if (queryResult->dwNumberOfCsAddrs == 0)
+                continue;
+
+            CSADDR_INFO* addresses = queryResult->lpcsaBuffer;
+            DiscoveredDevice device{
+                reinterpret_cast<SOCKADDR_BTH*>(addresses[0].RemoteAddr.lpSockaddr)->btAddr,
+                queryResult->lpszServiceInstanceName != nullptr ? queryResult->lpszServiceInstanceName : L"",
+                queryResult->lpServiceClassId->Data1,
+                (queryResult->dwOutputFlags & BTHNS_RESULT_DEVICE_CONNECTED) != 0,
+                (queryResult->dwOutputFlags & BTHNS_RESULT_DEVICE_REMEMBERED) != 0,
+                (queryResult->dwOutputFlags & BTHNS_RESULT_DEVICE_AUTHENTICATED) != 0,
+            };
+            LOG_DEBUG(L"Found device: name={}, class={}, address={}", device.name, BluetoothDeviceClass(device.classOfDevice), device.address);
+
+            session.Report(device);
+        }
+    }
+
+    if (!session.Stopped())
+        DebugLogSocketResult(lookupResult, L"Device lookup");
+
+    if (hLookup != NULL && WSALookupServiceEnd(hLookup) != ERROR_SUCCESS)
+        LOG_WARNING(L"Failed to end device look up");
+}
+
+bool DiscoverBluetoothDevices(const DiscoveryCallback& onDevice, std::chrono::seconds timeout) {
+    DiscoverySession session(onDevice, timeout);
+    LookupDevices(session, std::nullopt);
+    while (std::optional<std::chrono::seconds> inquiry = session.NextInquiry())
+        LookupDevices(session, inquiry);
+    return session.Stopped();
+}
+
+int EnumerateBluetoothDevicesAndServices() {
+    WSADATA wsaData;
+    int wsaResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
+    if (0 != wsaResult) {
+        LOG_WARNING(L"Failed to initialize WinSocks2");
+        return wsaResult;
+    }
+
+    DiscoveryTarget ch510{ std::nullopt, L"WH-CH510" };
+    std::optional<BTH_ADDR> ch510Addr;
+    DiscoverBluetoothDevices([&ch510, &ch510Addr](const DiscoveredDevice& device) {
+        if (!ch510.Matches(device))
+            return DiscoveryControl::Continue;
+        ch510Addr = device.address;
+        return DiscoveryControl::Stop;
+    }, DEVICE_INQUIRY_TIMEOUT);
+
+    if (ch510Addr.has_value()) {
+        EnumerateBluetoothServices(*ch510Addr);
+    }
+
+    WSACleanup();
+    return S_OK;
+}
+
+INT LookupService::LookupNext(DWORD dwControlFlags) {
+    DWORD queryResultLength = m_bufferLength;
+    INT lookupResult = WSALookupServiceNextW(m_hLookup, dwControlFlags, &queryResultLength, reinterpret_cast<WSAQUERYSET*>(m_buffer.get()));
+
+    if (lookupResult == SOCKET_ERROR && WSAGetLastError() == WSAEFAULT && queryResultLength != 0) {
+        m_bufferLength = queryResultLength;
+        m_buffer = std::make_unique<BYTE[]>(m_bufferLength);
+        lookupResult = WSALookupServiceNextW(m_hLookup, dwControlFlags, &queryResultLength, reinterpret_cast<WSAQUERYSET*>(m_buffer.get()));
+    }
+
+    return lookupResult;
+}
+
+static void DebugLogSdpUuid(std::wostringstream& dlog, const SdpUuid& uuid) {
+    std::optional<uint32_t> shortValue = uuid.ShortValue();
+    if (shortValue.has_value())
+        dlog << std::hex << *shortValue << std::dec;
+    else
+        dlog << uuid.value;
+}
+
+// Only ever an argument of LOG_DEBUG, which doesn't evaluate it when debug logging is compiled out.
+// The record is formatted right away rather than by the log drain, since its bytes don't outlive the lookup.
+static std::wstring FormatServiceRecord(std::span<const uint8_t> bytes) {
+    std::wostringstream dlog;
+    dlog << L"Found service:";
+
+    /* General SDP Service Attributes
+    * 0, service record handle
+    * 1, service class id list, most specifc to most general
+    * 2, service record state
+    * 3, service id
+    * 4, protocol descriptor list
+    * 5, browse group list
+    * 6, language based attribute list
+    *   +0, service name
+    *   +1, service description
+    *   +2, provider name
+    * 8, service availibity
+    * 9, bluetooth profile descriptor list
+    * 13, additional protocol descriptor list
+    */
+    SdpRecord record(bytes);
+    if (!record.IsValid())
+        return L"Found service: malformed service record";
+
+    for (const SdpAttribute& attribute : record) {
+        switch (attribute.id) {
+        case SDP_ATTRIBUTE_SERVICE_NAME:
+        {
+            std::optional<std::string_view> name = attribute.value.AsText();
+            if (name.has_value())
+                dlog << L" name=" << std::wstring(name->begin(), name->end());
+            break;
+        }
+        case SDP_ATTRIBUTE_SERVICE_CLASS_ID_LIST:
+            dlog << L", serviceClassIds=[";
+            for (const SdpElement& classId : SdpSequence(attribute.value)) {
+                std::optional<SdpUuid> uuid = classId.AsUuid();
+                if (!uuid.has_value())
+                    dlog << L"unexpected class id type";
+                else
+                    DebugLogSdpUuid(dlog, *uuid);
+                dlog << L',';
+            }
+            dlog << L']';
+            break;
+        case SDP_ATTRIBUTE_PROTOCOL_DESCRIPTOR_LIST:
+            dlog << L", protocols=[";
+            for (const SdpProtocolDescriptor& protocol : SdpProtocolDescriptorList(attribute.value)) {
+                DebugLogSdpUuid(dlog, protocol.protocol);
+                if (protocol.parameter.has_value())
+                    dlog << L':' << *protocol.parameter;
+                dlog << L',';
+            }
+            dlog << L']';
+            break;
+        case SDP_ATTRIBUTE_PROFILE_DESCRIPTOR_LIST:
+            dlog << L", profiles=[";
+            for (const SdpProfileDescriptor& profile : SdpProfileDescriptorList(attribute.value)) {
+                DebugLogSdpUuid(dlog, profile.profile);
+                dlog << L" v" << std::hex << profile.version << std::dec << L',';
+            }
+            dlog << L']';
+            break;
+        default:
+            dlog << L", attrbute=" << attribute.id;
+        }
+    }
+
+    return dlog.str();
+}
+
+std::optional<std::vector<std::vector<uint8_t>>> QueryServiceRecords(BTH_ADDR address) {
+    GUID targetService = PUBLIC_BROWSE_ROOT;
+    WCHAR deviceAddress[256];
+    DWORD deviceAddressLength = 256;
+    SOCKADDR_BTH socketAddress{ AF_BTH, address };
+    if (SOCKET_ERROR == WSAAddressToStringW(reinterpret_cast<SOCKADDR*>(&socketAddress), sizeof(SOCKADDR_BTH), NULL, deviceAddress, &deviceAddressLength)) {
+        LOG_WARNING(L"Failed converting device address to string: error={}", WSAGetLastError());
+        return std::nullopt;
+    }
+
+    WSAQUERYSET serviceQuery{ sizeof(WSAQUERYSET) };
+    serviceQuery.dwNameSpace = NS_BTH;
+    serviceQuery.lpServiceClassId = &targetService;
+    serviceQuery.dwNumberOfCsAddrs = 0;
+    serviceQuery.lpszContext = deviceAddress;
+
+    HANDLE hLookup = NULL;
+    // if LUP_FLUSHCACHE is specified, it only works when the device is online
+    INT lookupResult = WSALookupServiceBeginW(&serviceQuery, LUP_FLUSHCACHE, &hLookup);
+    if (lookupResult != ERROR_SUCCESS) {
+        DebugLogSocketResult(lookupResult, L"Service lookup");
+        return std::nullopt;
+    }
+
+    std::vector<std::vector<uint8_t>> records;
+    {
+        LookupService lookupService(hLookup);
+        while (true) {
+            lookupResult = lookupService.LookupNext(LUP_RETURN_TYPE | LUP_RETURN_NAME | LUP_RETURN_ADDR | LUP_RES_SERVICE | LUP_RETURN_BLOB);
+            if (lookupResult != ERROR_SUCCESS)
+                break;
+
+            // The simple search returns the service record as the blob
+            const BLOB* blob = lookupService.QueryResult()->lpBlob;
+            if (blob != nullptr)
+                records.emplace_back(blob->pBlobData, blob->pBlobData + blob->cbSize);
+        }
+    }
+
+    bool completed = lookupResult == SOCKET_ERROR && WSAGetLastError() == WSA_E_NO_MORE;
+    if (!completed)
+        DebugLogSocketResult(lookupResult, L"Service lookup");
+    if (WSALookupServiceEnd(hLookup) != ERROR_SUCCESS)
+        LOG_WARNING(L"Failed to end service look up");
+
+    if (!completed)
+        return std::nullopt;
+    return records;
+}
+
+void EnumerateBluetoothServices(BTH_ADDR address) {
+    std::optional<std::vector<std::vector<uint8_t>>> records = QueryServiceRecords(address);
+    if (!records.has_value())
+        return;
+
+    for (const std::vector<uint8_t>& record : *records)
+        LOG_DEBUG(L"{}", FormatServiceRecord(record));
+}
+
+std::optional<std::vector<std::vector<uint8_t>>> BluetoothServiceLookup::QueryServiceRecords(uint64_t address) {
+    // Winsock is reference counted, and this runs on pool threads independent of the rest of the app
+    WSADATA wsaData;
+    if (0 != WSAStartup(MAKEWORD(2, 2), &wsaData)) {
+        LOG_WARNING(L"Failed to initialize WinSocks2");
+        return std::nullopt;
+    }
+
+    std::optional<std::vector<std::vector<uint8_t>>> records = ::QueryServiceRecords(address);
+    WSACleanup();
+    return records;
+}
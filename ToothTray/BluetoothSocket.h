@@ -1,31 +1,52 @@
-#pragma once
-#include "framework.h"
-
-#include <winsock2.h>
-#include <ws2bth.h>
-#include <bluetoothapis.h>
-
-#include "debuglog.h"
-#include "BluetoothDeviceClass.h"
-
-void DebugLogSocketResult(INT result, LPCWSTR operation);
-
-constexpr GUID SERVICE_BASE = GUID{ 0x00000000, 0x0000, 0x1000, 0x80, 0x00, 0x00, 0x80, 0x5f, 0x9b, 0x34, 0xfb };
-constexpr GUID PUBLIC_BROWSE_ROOT = GUID{ 0x00001002, 0x0000, 0x1000, 0x80, 0x00, 0x00, 0x80, 0x5f, 0x9b, 0x34, 0xfb };
-
-class LookupService {
-public:
-    LookupService(HANDLE hLookup) : m_hLookup(hLookup), m_bufferLength(sizeof(WSAQUERYSET)), m_buffer(std::make_unique<BYTE[]>(m_bufferLength)) {}
-
-    INT LookupNext(DWORD dwControlFlags);
-
-    const WSAQUERYSET* QueryResult() { return reinterpret_cast<WSAQUERYSET*>(m_buffer.get()); }
-private:
-    HANDLE m_hLookup;
-    DWORD m_bufferLength;
-    std::unique_ptr<BYTE[]> m_buffer;
-};
-
-int EnumerateBluetoothDevicesAndServices();
-
-void EnumerateBluetoothServices(BTH_ADDR address);
+#pragma once
+#include "framework.h"
+
+#include <winsock2.h>
+#include <ws2bth.h>
+#include <bluetoothapis.h>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+#include "debuglog.h"
+#include "BluetoothDeviceClass.h"
+#include "SdpRecordCache.h"
+#include "DeviceDiscovery.h"
+
+void DebugLogSocketResult(INT result, LPCWSTR operation);
+
+constexpr GUID SERVICE_BASE = GUID{ 0x00000000, 0x0000, 0x1000, 0x80, 0x00, 0x00, 0x80, 0x5f, 0x9b, 0x34, 0xfb };
+constexpr GUID PUBLIC_BROWSE_ROOT = GUID{ 0x00001002, 0x0000, 0x1000, 0x80, 0x00, 0x00, 0x80, 0x5f, 0x9b, 0x34, 0xfb };
+
+class LookupService {
+public:
+    LookupService(HANDLE hLookup) : m_hLookup(hLookup), m_bufferLength(sizeof(WSAQUERYSET)), m_buffer(std::make_unique<BYTE[]>(m_bufferLength)) {}
+
+    INT LookupNext(DWORD dwControlFlags);
+
+    const WSAQUERYSET* QueryResult() { return reinterpret_cast<WSAQUERYSET*>(m_buffer.get()); }
+private:
+    HANDLE m_hLookup;
+    DWORD m_bufferLength;
+    std::unique_ptr<BYTE[]> m_buffer;
+};
+
+// The inquiry this used to run in one go
+constexpr std::chrono::seconds DEVICE_INQUIRY_TIMEOUT{ 10 };
+
+// Reports the devices the stack knows first, then the ones found by inquiries of growing length.
+// True if the callback stopped the discovery before the timeout.
+bool DiscoverBluetoothDevices(const DiscoveryCallback& onDevice, std::chrono::seconds timeout = DEVICE_INQUIRY_TIMEOUT);
+
+int EnumerateBluetoothDevicesAndServices();
+
+void EnumerateBluetoothServices(BTH_ADDR address);
+
+// Every service record of the device. Empty if the device isn't in range.
+std::optional<std::vector<std::vector<uint8_t>>> QueryServiceRecords(BTH_ADDR address);
+
+class BluetoothServiceLookup : public ISdpRecordSource {
+public:
+    std::optional<std::vector<std::vector<uint8_t>>> QueryServiceRecords(uint64_t address) override;
+};
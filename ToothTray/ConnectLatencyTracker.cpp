@@ -0,0 +1,211 @@
+#include "ConnectLatencyTracker.h"
+
+#include <cstring>
+
+#include "Log.h"
+#include "MappedFile.h"
+
+static_assert(LatencyHistogram::BUCKET_COUNT <= UINT16_MAX, "bucket indices and counts are stored in 16 bits");
+
+// The sections of a validated file
+struct ConnectLatencyTables {
+    std::span<const ConnectLatencyDevice> devices;
+    std::span<const ConnectLatencyBucket> buckets;
+};
+
+static uint32_t Checksum(std::span<const uint8_t> bytes) {
+    uint32_t hash = 2166136261u;
+    for (uint8_t byte : bytes)
+        hash = (hash ^ byte) * 16777619u;
+    return hash;
+}
+
+static void Append(std::vector<uint8_t>& bytes, const void* data, size_t size) {
+    const uint8_t* begin = static_cast<const uint8_t*>(data);
+    bytes.insert(bytes.end(), begin, begin + size);
+}
+
+static std::optional<ConnectLatencyTables> ReadTables(std::span<const uint8_t> bytes) {
+    if (bytes.size() < sizeof(ConnectLatencyHeader))
+        return std::nullopt;
+
+    ConnectLatencyHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (header.magic != ConnectLatencyTracker::MAGIC || header.version != ConnectLatencyTracker::VERSION)
+        return std::nullopt;
+
+    // 64 bit sizes so a corrupt count can't overflow
+    uint64_t devicesOffset = sizeof(ConnectLatencyHeader);
+    uint64_t bucketsOffset = devicesOffset + uint64_t{ header.deviceCount } * sizeof(ConnectLatencyDevice);
+    if (bucketsOffset + uint64_t{ header.bucketCount } * sizeof(ConnectLatencyBucket) != bytes.size())
+        return std::nullopt;
+
+    return ConnectLatencyTables{
+        { reinterpret_cast<const ConnectLatencyDevice*>(bytes.data() + devicesOffset), header.deviceCount },
+        { reinterpret_cast<const ConnectLatencyBucket*>(bytes.data() + bucketsOffset), header.bucketCount },
+    };
+}
+
+bool ValidateConnectLatencies(std::span<const uint8_t> bytes) {
+    std::optional<ConnectLatencyTables> tables = ReadTables(bytes);
+    if (!tables.has_value())
+        return false;
+
+    ConnectLatencyHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (Checksum(bytes.subspan(sizeof(header))) != header.checksum)
+        return false;
+
+    for (const ConnectLatencyDevice& device : tables->devices) {
+        if (uint64_t{ device.firstBucket } + device.connectBuckets + device.disconnectBuckets > tables->buckets.size())
+            return false;
+    }
+    for (const ConnectLatencyBucket& bucket : tables->buckets) {
+        if (bucket.index >= LatencyHistogram::BUCKET_COUNT)
+            return false;
+    }
+    return true;
+}
+
+ConnectLatencyTracker::DeviceHistograms& ConnectLatencyTracker::Device(const GUID& containerId) {
+    std::unique_ptr<DeviceHistograms>& histograms = m_devices[containerId];
+    if (histograms == nullptr)
+        histograms = std::make_unique<DeviceHistograms>();
+    return *histograms;
+}
+
+bool ConnectLatencyTracker::CallStarted(std::wstring_view endpointId, const GUID& containerId, bool connect, TimePoint now) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Calls that were never followed would otherwise pile up
+    std::erase_if(m_pending, [now](const std::pair<const std::wstring, PendingCall>& pending) {
+        return now - pending.second.started > PENDING_TIMEOUT;
+    });
+
+    PendingCall call{ containerId, connect, now };
+    std::pair<std::unordered_map<std::wstring, PendingCall>::iterator, bool> inserted = m_pending.try_emplace(std::wstring(endpointId), call);
+    if (inserted.second)
+        return true;
+    if (inserted.first->second.connect == connect)
+        return false;
+    inserted.first->second = call;
+    return true;
+}
+
+void ConnectLatencyTracker::CallFailed(std::wstring_view endpointId, bool connect) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::unordered_map<std::wstring, PendingCall>::iterator ite = m_pending.find(std::wstring(endpointId));
+    if (ite != m_pending.end() && ite->second.connect == connect)
+        m_pending.erase(ite);
+}
+
+std::optional<ConnectLatencySample> ConnectLatencyTracker::EndpointStateChanged(std::wstring_view endpointId, bool isActive, TimePoint now) {
+    LatencyHistogram* histogram;
+    ConnectLatencySample sample;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::unordered_map<std::wstring, PendingCall>::iterator ite = m_pending.find(std::wstring(endpointId));
+        if (ite == m_pending.end() || ite->second.connect != isActive)
+            return std::nullopt;
+
+        sample = ConnectLatencySample{ ite->second.containerId, isActive, now - ite->second.started };
+        m_pending.erase(ite);
+        if (sample.elapsed > PENDING_TIMEOUT)
+            return std::nullopt;
+
+        DeviceHistograms& device = Device(sample.containerId);
+        histogram = isActive ? &device.connect : &device.disconnect;
+    }
+
+    histogram->Record(sample.elapsed);
+    return sample;
+}
+
+DeviceLatencySummary ConnectLatencyTracker::Summarize(const GUID& containerId, const DeviceHistograms& histograms) {
+    auto summarize = [](const LatencyHistogram& histogram) {
+        return LatencySummary{ histogram.Count(), histogram.Percentile(50), histogram.Percentile(90), histogram.Percentile(99) };
+    };
+    return DeviceLatencySummary{ containerId, summarize(histograms.connect), summarize(histograms.disconnect) };
+}
+
+std::optional<DeviceLatencySummary> ConnectLatencyTracker::Summary(const GUID& containerId) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    GuidMap<std::unique_ptr<DeviceHistograms>>::const_iterator ite = m_devices.find(containerId);
+    if (ite == m_devices.cend())
+        return std::nullopt;
+    return Summarize(containerId, *ite->second);
+}
+
+std::vector<DeviceLatencySummary> ConnectLatencyTracker::Summaries() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<DeviceLatencySummary> summaries;
+    summaries.reserve(m_devices.size());
+    for (const std::pair<GUID, std::unique_ptr<DeviceHistograms>>& device : m_devices)
+        summaries.push_back(Summarize(device.first, *device.second));
+    return summaries;
+}
+
+void ConnectLatencyTracker::Load(const std::filesystem::path& path) {
+    std::shared_ptr<const MappedFile> file = MappedFile::Open(path);
+    if (file == nullptr)
+        return;
+    if (!ValidateConnectLatencies(file->Bytes())) {
+        LOG_WARNING(L"Ignoring the outdated or corrupt connect latencies {}", path.wstring());
+        return;
+    }
+
+    ConnectLatencyTables tables = *ReadTables(file->Bytes());
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const ConnectLatencyDevice& device : tables.devices) {
+        DeviceHistograms& histograms = Device(device.containerId);
+        std::span<const ConnectLatencyBucket> buckets = tables.buckets.subspan(device.firstBucket, device.connectBuckets + device.disconnectBuckets);
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            LatencyHistogram& histogram = i < device.connectBuckets ? histograms.connect : histograms.disconnect;
+            histogram.Add(buckets[i].index, buckets[i].count);
+        }
+    }
+}
+
+bool ConnectLatencyTracker::Save(const std::filesystem::path& path) const {
+    if (path.empty())
+        return false;
+
+    std::vector<ConnectLatencyDevice> devices;
+    std::vector<ConnectLatencyBucket> buckets;
+    auto appendBuckets = [&buckets](const LatencyHistogram& histogram) {
+        size_t first = buckets.size();
+        for (size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+            uint32_t count = histogram.BucketCount(i);
+            if (count != 0)
+                buckets.push_back(ConnectLatencyBucket{ static_cast<uint16_t>(i), 0, count });
+        }
+        return static_cast<uint16_t>(buckets.size() - first);
+    };
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // Also keeps a session that exits before loading from replacing the earlier counts
+        if (m_devices.empty())
+            return true;
+        devices.reserve(m_devices.size());
+        for (const std::pair<GUID, std::unique_ptr<DeviceHistograms>>& device : m_devices) {
+            ConnectLatencyDevice entry{ device.first, static_cast<uint32_t>(buckets.size()), 0, 0 };
+            entry.connectBuckets = appendBuckets(device.second->connect);
+            entry.disconnectBuckets = appendBuckets(device.second->disconnect);
+            devices.push_back(entry);
+        }
+    }
+
+    ConnectLatencyHeader header{ MAGIC, VERSION, static_cast<uint32_t>(devices.size()), static_cast<uint32_t>(buckets.size()), 0 };
+    std::vector<uint8_t> bytes;
+    bytes.reserve(sizeof(header) + devices.size() * sizeof(ConnectLatencyDevice) + buckets.size() * sizeof(ConnectLatencyBucket));
+    Append(bytes, &header, sizeof(header));
+    Append(bytes, devices.data(), devices.size() * sizeof(ConnectLatencyDevice));
+    Append(bytes, buckets.data(), buckets.size() * sizeof(ConnectLatencyBucket));
+    header.checksum = Checksum(std::span<const uint8_t>(bytes).subspan(sizeof(header)));
+    std::memcpy(bytes.data(), &header, sizeof(header));
+
+    if (!MappedFile::WriteAtomically(path, bytes)) {
+        LOG_WARNING(L"Failed to write the connect latencies {}", path.wstring());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <span>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <filesystem>
+#include <string_view>
+#include <unordered_map>
+
+#include "Guid.h"
+#include "GuidMap.h"
+#include "LatencyHistogram.h"
+
+// The file holds only the buckets in use: a header, one entry per device and the buckets they point
+// to. Native endian, like the other caches.
+struct ConnectLatencyHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t deviceCount;
+    uint32_t bucketCount;
+    // FNV-1a of everything after the header
+    uint32_t checksum;
+};
+
+// The connect buckets of a device come first, then the disconnect ones
+struct ConnectLatencyDevice {
+    GUID containerId;
+    uint32_t firstBucket;
+    uint16_t connectBuckets;
+    uint16_t disconnectBuckets;
+};
+
+struct ConnectLatencyBucket {
+    uint16_t index;
+    uint16_t reserved;
+    uint32_t count;
+};
+
+struct LatencySummary {
+    uint64_t count;
+    LatencyHistogram::Duration p50;
+    LatencyHistogram::Duration p90;
+    LatencyHistogram::Duration p99;
+};
+
+// A connect or disconnect the endpoint followed
+struct ConnectLatencySample {
+    GUID containerId;
+    bool connect;
+    std::chrono::steady_clock::duration elapsed;
+};
+
+struct DeviceLatencySummary {
+    GUID containerId;
+    LatencySummary connect;
+    LatencySummary disconnect;
+};
+
+// Times how long the endpoints of each device take to follow a driver call: from the connect call
+// until the endpoint is active, or from the disconnect call until it isn't. The driver returns long
+// before that, so the call's own duration says little about what the user waits for.
+// Calls and state changes can come from any thread.
+class ConnectLatencyTracker {
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    static constexpr uint32_t MAGIC = 0x484C5454; // "TTLH"
+    static constexpr uint32_t VERSION = 1;
+    // An endpoint that hasn't followed by then isn't going to, e.g. because the device was out of range
+    static constexpr std::chrono::seconds PENDING_TIMEOUT{ 60 };
+
+    ConnectLatencyTracker() = default;
+
+    ConnectLatencyTracker(const ConnectLatencyTracker&) = delete;
+    ConnectLatencyTracker& operator=(const ConnectLatencyTracker&) = delete;
+
+    // Called right before the driver call. A repeated call for the same endpoint and direction,
+    // e.g. for its second control, keeps the first start; only a call that started timing returns true.
+    bool CallStarted(std::wstring_view endpointId, const GUID& containerId, bool connect, TimePoint now);
+    // Called for a failed driver call that started timing, since the endpoint won't follow it.
+    void CallFailed(std::wstring_view endpointId, bool connect);
+    // Returns the sample when this completes a call; it's recorded for the device.
+    std::optional<ConnectLatencySample> EndpointStateChanged(std::wstring_view endpointId, bool isActive, TimePoint now);
+
+    std::optional<DeviceLatencySummary> Summary(const GUID& containerId) const;
+    std::vector<DeviceLatencySummary> Summaries() const;
+
+    // Adds the counts of an earlier session. A missing, outdated or corrupt file is ignored.
+    void Load(const std::filesystem::path& path);
+    // Leaves the file alone while nothing was recorded or loaded.
+    bool Save(const std::filesystem::path& path) const;
+private:
+    struct DeviceHistograms {
+        LatencyHistogram connect;
+        LatencyHistogram disconnect;
+    };
+
+    struct PendingCall {
+        GUID containerId;
+        bool connect;
+        TimePoint started;
+    };
+
+    // Guards the maps. Histograms are never removed, so they are recorded into after unlocking.
+    mutable std::mutex m_mutex;
+    GuidMap<std::unique_ptr<DeviceHistograms>> m_devices;
+    std::unordered_map<std::wstring, PendingCall> m_pending;
+
+    DeviceHistograms& Device(const GUID& containerId);
+    static DeviceLatencySummary Summarize(const GUID& containerId, const DeviceHistograms& histograms);
+};
+
+// Checks the header, the checksum and every bucket against the file size and the histogram.
+bool ValidateConnectLatencies(std::span<const uint8_t> bytes);
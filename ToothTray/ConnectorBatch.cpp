@@ -0,0 +1,96 @@
+#include "ConnectorBatch.h"
+
+BatchPlan ConnectorBatch::DisconnectAll(const std::vector<BluetoothConnector>& connectors) {
+    std::vector<BatchCommand> stage;
+    for (const BluetoothConnector& connector : connectors) {
+        if (connector.IsConnected())
+            stage.emplace_back(BatchCommand{ connector, ConnectorCommandType::Disconnect });
+    }
+    return BatchPlan{ std::move(stage) };
+}
+
+BatchPlan ConnectorBatch::ConnectAll(const std::vector<BluetoothConnector>& connectors) {
+    std::vector<BatchCommand> stage;
+    for (const BluetoothConnector& connector : connectors) {
+        if (!connector.IsConnected())
+            stage.emplace_back(BatchCommand{ connector, ConnectorCommandType::Connect });
+    }
+    return BatchPlan{ std::move(stage) };
+}
+
+BatchPlan ConnectorBatch::SwitchTo(const std::vector<BluetoothConnector>& connectors, const GUID& target) {
+    std::vector<BatchCommand> disconnects;
+    std::vector<BatchCommand> connects;
+    for (const BluetoothConnector& connector : connectors) {
+        if (GUIDEqualityComparer{}(connector.ContainerId(), target)) {
+            if (!connector.IsConnected())
+                connects.emplace_back(BatchCommand{ connector, ConnectorCommandType::Connect });
+        }
+        else if (connector.IsConnected()) {
+            disconnects.emplace_back(BatchCommand{ connector, ConnectorCommandType::Disconnect });
+        }
+    }
+    return BatchPlan{ std::move(disconnects), std::move(connects) };
+}
+
+void ConnectorBatch::RunAsync(BatchPlan plan) {
+    std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+    batch->plan = std::move(plan);
+    batch->start = std::chrono::steady_clock::now();
+    batch->stage = 0;
+    batch->remaining = 0;
+    batch->failed = false;
+    batch->result.skipped = 0;
+    RunStage(batch);
+}
+
+void ConnectorBatch::RunStage(const std::shared_ptr<Batch>& batch) {
+    size_t stage = batch->stage;
+    while (stage < batch->plan.size() && batch->plan[stage].empty())
+        ++stage;
+    if (stage == batch->plan.size()) {
+        Finish(*batch);
+        return;
+    }
+
+    // Set before the first command is enqueued, since its completion may come before the next one is
+    const std::vector<BatchCommand>& commands = batch->plan[stage];
+    {
+        std::lock_guard<std::mutex> lock(batch->mutex);
+        batch->stage = stage;
+        batch->remaining = commands.size();
+    }
+
+    for (const BatchCommand& command : commands) {
+        m_commandQueue.Enqueue(command.connector, command.type, [this, batch, &command](const ConnectorCommandCompletion& completion) {
+            Completed(batch, command, completion);
+        });
+    }
+}
+
+void ConnectorBatch::Completed(const std::shared_ptr<Batch>& batch, const BatchCommand& command, const ConnectorCommandCompletion& completion) {
+    {
+        std::lock_guard<std::mutex> lock(batch->mutex);
+        batch->result.outcomes.emplace_back(BatchOutcome{ completion.containerId, command.connector.DeviceNameHandle(), completion.type, completion.result, completion.hr, completion.elapsed });
+        if (completion.result != ConnectorCommandResult::Succeeded)
+            batch->failed = true;
+        if (--batch->remaining > 0)
+            return;
+        ++batch->stage;
+    }
+
+    // E.g. connecting while a disconnect failed may leave two devices fighting over one audio link
+    if (batch->failed) {
+        for (size_t stage = batch->stage; stage < batch->plan.size(); ++stage)
+            batch->result.skipped += batch->plan[stage].size();
+        Finish(*batch);
+        return;
+    }
+    RunStage(batch);
+}
+
+void ConnectorBatch::Finish(Batch& batch) {
+    batch.result.wallTime = std::chrono::steady_clock::now() - batch.start;
+    if (m_completed)
+        m_completed(batch.result);
+}
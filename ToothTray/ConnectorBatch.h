@@ -0,0 +1,80 @@
+#pragma once
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <functional>
+
+#include "BluetoothConnector.h"
+#include "NamePool.h"
+#include "ConnectorCommandQueue.h"
+
+struct BatchCommand {
+    BluetoothConnector connector;
+    ConnectorCommandType type;
+};
+
+// Commands in a stage are independent and run concurrently. A stage starts when every command of the
+// previous one succeeded; otherwise the rest of the plan is skipped.
+using BatchPlan = std::vector<std::vector<BatchCommand>>;
+
+struct BatchOutcome {
+    GUID containerId;
+    InternedName deviceName;
+    ConnectorCommandType type;
+    ConnectorCommandResult result;
+    // The HRESULT of the driver calls, when they returned
+    long hr;
+    std::chrono::steady_clock::duration elapsed;
+};
+
+struct BatchResult {
+    std::vector<BatchOutcome> outcomes;
+    // Commands of the stages after a failed one
+    size_t skipped;
+    std::chrono::steady_clock::duration wallTime;
+
+    bool Succeeded() const {
+        for (const BatchOutcome& outcome : outcomes) {
+            if (outcome.result != ConnectorCommandResult::Succeeded)
+                return false;
+        }
+        return skipped == 0;
+    }
+};
+
+// Connects or disconnects several devices at once. The commands go through the command queue, so they
+// share its timeout and never run alongside a click on the same device.
+class ConnectorBatch {
+public:
+    // Called on a command queue thread when a batch is done, or on the caller's if the queue isn't running.
+    using CompletedCallback = std::function<void(const BatchResult&)>;
+
+    ConnectorBatch(ConnectorCommandQueue& commandQueue, CompletedCallback completed) : m_commandQueue(commandQueue), m_completed(std::move(completed)) {}
+
+    static BatchPlan DisconnectAll(const std::vector<BluetoothConnector>& connectors);
+    static BatchPlan ConnectAll(const std::vector<BluetoothConnector>& connectors);
+    // Disconnects every other connected device, then connects the target.
+    // Some adapters only carry one audio link at a time, so the target waits for the disconnects.
+    static BatchPlan SwitchTo(const std::vector<BluetoothConnector>& connectors, const GUID& target);
+
+    // Doesn't wait; each stage is started by the completion of the previous one.
+    void RunAsync(BatchPlan plan);
+private:
+    struct Batch {
+        BatchPlan plan;
+        std::chrono::steady_clock::time_point start;
+        std::mutex mutex;
+        size_t stage;
+        size_t remaining;
+        bool failed;
+        BatchResult result;
+    };
+
+    ConnectorCommandQueue& m_commandQueue;
+    CompletedCallback m_completed;
+
+    void RunStage(const std::shared_ptr<Batch>& batch);
+    void Completed(const std::shared_ptr<Batch>& batch, const BatchCommand& command, const ConnectorCommandCompletion& completion);
+    void Finish(Batch& batch);
+};
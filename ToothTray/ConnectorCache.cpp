@@ -0,0 +1,210 @@
+#include "ConnectorCache.h"
+
+#include <cstring>
+#include <optional>
+
+#include "Log.h"
+#include "NamePool.h"
+
+static_assert(sizeof(ConnectorCacheEntry) % alignof(wchar_t) == 0 && sizeof(ConnectorCacheEndpoint) % alignof(wchar_t) == 0,
+    "the text has to start aligned after the tables");
+
+// The sections of a validated file
+struct ConnectorCacheTables {
+    std::span<const ConnectorCacheEntry> connectors;
+    std::span<const ConnectorCacheEndpoint> endpoints;
+    std::span<const wchar_t> text;
+};
+
+static uint32_t Checksum(std::span<const uint8_t> bytes) {
+    uint32_t hash = 2166136261u;
+    for (uint8_t byte : bytes)
+        hash = (hash ^ byte) * 16777619u;
+    return hash;
+}
+
+static void Append(std::vector<uint8_t>& bytes, const void* data, size_t size) {
+    const uint8_t* begin = static_cast<const uint8_t*>(data);
+    bytes.insert(bytes.end(), begin, begin + size);
+}
+
+static std::optional<ConnectorCacheTables> ReadTables(std::span<const uint8_t> bytes) {
+    if (bytes.size() < sizeof(ConnectorCacheHeader))
+        return std::nullopt;
+
+    ConnectorCacheHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (header.magic != ConnectorCache::MAGIC || header.version != ConnectorCache::VERSION)
+        return std::nullopt;
+
+    // 64 bit sizes so a corrupt count can't overflow
+    uint64_t connectorsOffset = sizeof(ConnectorCacheHeader);
+    uint64_t endpointsOffset = connectorsOffset + uint64_t{ header.connectorCount } * sizeof(ConnectorCacheEntry);
+    uint64_t textOffset = endpointsOffset + uint64_t{ header.endpointCount } * sizeof(ConnectorCacheEndpoint);
+    if (textOffset + uint64_t{ header.textSize } * sizeof(wchar_t) != bytes.size())
+        return std::nullopt;
+
+    return ConnectorCacheTables{
+        { reinterpret_cast<const ConnectorCacheEntry*>(bytes.data() + connectorsOffset), header.connectorCount },
+        { reinterpret_cast<const ConnectorCacheEndpoint*>(bytes.data() + endpointsOffset), header.endpointCount },
+        { reinterpret_cast<const wchar_t*>(bytes.data() + textOffset), header.textSize },
+    };
+}
+
+bool ValidateConnectorCache(std::span<const uint8_t> bytes) {
+    std::optional<ConnectorCacheTables> tables = ReadTables(bytes);
+    if (!tables.has_value())
+        return false;
+
+    ConnectorCacheHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (Checksum(bytes.subspan(sizeof(header))) != header.checksum)
+        return false;
+
+    for (const ConnectorCacheEntry& connector : tables->connectors) {
+        if (uint64_t{ connector.nameOffset } + connector.nameLength > tables->text.size())
+            return false;
+        if (uint64_t{ connector.firstEndpoint } + connector.endpointCount > tables->endpoints.size())
+            return false;
+    }
+    for (const ConnectorCacheEndpoint& endpoint : tables->endpoints) {
+        if (uint64_t{ endpoint.idOffset } + endpoint.idLength > tables->text.size())
+            return false;
+    }
+    return true;
+}
+
+std::vector<uint8_t> SerializeConnectorCache(std::span<const BluetoothConnector> connectors) {
+    std::vector<ConnectorCacheEntry> entries;
+    std::vector<ConnectorCacheEndpoint> endpoints;
+    std::wstring text;
+    entries.reserve(connectors.size());
+    for (const BluetoothConnector& connector : connectors) {
+        ConnectorCacheEntry entry{ connector.ContainerId(), static_cast<uint32_t>(text.size()), static_cast<uint32_t>(connector.DeviceName().size()),
+            static_cast<uint32_t>(endpoints.size()), static_cast<uint32_t>(connector.EndpointIds().size()), connector.IsConnected() ? CONNECTOR_CACHE_CONNECTED : 0 };
+        entries.push_back(entry);
+        text.append(connector.DeviceName());
+        for (const std::wstring& endpointId : connector.EndpointIds()) {
+            endpoints.push_back(ConnectorCacheEndpoint{ static_cast<uint32_t>(text.size()), static_cast<uint32_t>(endpointId.size()) });
+            text.append(endpointId);
+        }
+    }
+
+    ConnectorCacheHeader header{ ConnectorCache::MAGIC, ConnectorCache::VERSION, static_cast<uint32_t>(entries.size()),
+        static_cast<uint32_t>(endpoints.size()), static_cast<uint32_t>(text.size()), 0 };
+
+    std::vector<uint8_t> bytes;
+    bytes.reserve(sizeof(header) + entries.size() * sizeof(ConnectorCacheEntry) + endpoints.size() * sizeof(ConnectorCacheEndpoint)
+        + text.size() * sizeof(wchar_t));
+    Append(bytes, &header, sizeof(header));
+    Append(bytes, entries.data(), entries.size() * sizeof(ConnectorCacheEntry));
+    Append(bytes, endpoints.data(), endpoints.size() * sizeof(ConnectorCacheEndpoint));
+    Append(bytes, text.data(), text.size() * sizeof(wchar_t));
+
+    header.checksum = Checksum(std::span<const uint8_t>(bytes).subspan(sizeof(header)));
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    return bytes;
+}
+
+long CachedEndpointControl::Connect() {
+    return Invoke(&IConnectorControl::Connect);
+}
+
+long CachedEndpointControl::Disconnect() {
+    return Invoke(&IConnectorControl::Disconnect);
+}
+
+long CachedEndpointControl::Invoke(long (IConnectorControl::*call)()) {
+    std::optional<AudioEndpoint> endpoint = m_source.GetEndpoint(m_endpointId);
+    if (!endpoint.has_value()) {
+        LOG_WARNING(L"The cached endpoint {} is gone", m_endpointId);
+        return ENDPOINT_NOT_FOUND;
+    }
+
+    long result = 0;
+    for (const std::shared_ptr<IConnectorControl>& control : endpoint->controls) {
+        long hr = (control.get()->*call)();
+        if (hr < 0 && result >= 0)
+            result = hr;
+    }
+    return result;
+}
+
+void ConnectorCache::Open(const std::filesystem::path& path) {
+    m_files = VersionedMappedFile(path);
+    Map(m_files.Open([&path](std::span<const uint8_t> bytes) {
+        if (ValidateConnectorCache(bytes))
+            return true;
+        LOG_WARNING(L"Ignoring an outdated or corrupt version of the connector cache {}", path.wstring());
+        return false;
+    }));
+}
+
+void ConnectorCache::Map(std::shared_ptr<const MappedFile> file) {
+    m_file = std::move(file);
+    if (m_file == nullptr) {
+        m_connectors = {};
+        m_endpoints = {};
+        m_text = {};
+        return;
+    }
+
+    // Validated already
+    ConnectorCacheTables tables = *ReadTables(m_file->Bytes());
+    m_connectors = tables.connectors;
+    m_endpoints = tables.endpoints;
+    m_text = tables.text;
+}
+
+std::vector<BluetoothConnector> ConnectorCache::Connectors(IAudioEndpointSource& source) const {
+    std::vector<BluetoothConnector> connectors;
+    connectors.reserve(Size());
+    for (size_t i = 0; i < Size(); ++i) {
+        CachedConnector cached = At(i);
+        BluetoothConnector& connector = connectors.emplace_back(cached.ContainerId(), NamePool::Shared().Intern(cached.Name()));
+        for (size_t j = 0; j < cached.EndpointCount(); ++j) {
+            connector.addConnectorControl(std::make_shared<CachedEndpointControl>(source, cached.EndpointId(j)), cached.IsConnected());
+            connector.addEndpointId(cached.EndpointId(j));
+        }
+    }
+    return connectors;
+}
+
+bool ConnectorCache::Holds(std::span<const BluetoothConnector> connectors) const {
+    if (m_file == nullptr || connectors.size() != Size())
+        return false;
+
+    for (size_t i = 0; i < connectors.size(); ++i) {
+        const BluetoothConnector& connector = connectors[i];
+        CachedConnector cached = At(i);
+        if (!GUIDEqualityComparer{}(connector.ContainerId(), cached.ContainerId()) || connector.DeviceName() != cached.Name()
+            || connector.IsConnected() != cached.IsConnected() || connector.EndpointIds().size() != cached.EndpointCount())
+            return false;
+        for (size_t j = 0; j < cached.EndpointCount(); ++j) {
+            if (connector.EndpointIds()[j] != cached.EndpointId(j))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool ConnectorCache::Save(std::span<const BluetoothConnector> connectors) {
+    if (m_files.Path().empty() || Holds(connectors))
+        return true;
+
+    std::vector<uint8_t> bytes = SerializeConnectorCache(connectors);
+    std::shared_ptr<const MappedFile> file = m_files.Write(bytes);
+    if (file == nullptr) {
+        LOG_WARNING(L"Failed to write the connector cache {}", m_files.Path().wstring());
+        return false;
+    }
+    LOG_DEBUG(L"Saved {} connectors to the connector cache", connectors.size());
+
+    // Checked again like any other file, rather than trusting what was written
+    if (!ValidateConnectorCache(file->Bytes())) {
+        LOG_WARNING(L"The connector cache {} was corrupt after writing", m_files.Path().wstring());
+        file = nullptr;
+    }
+    Map(std::move(file));
+    return true;
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <span>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+#include "Guid.h"
+#include "MappedFile.h"
+#include "AudioEndpointSource.h"
+#include "BluetoothConnector.h"
+
+// The file is a header followed by the connector and endpoint tables and the text they point into,
+// so it's used straight from the mapping. Like the service record cache it's native endian and
+// the text is wchar_t, since the file never leaves the machine.
+struct ConnectorCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t connectorCount;
+    uint32_t endpointCount;
+    // In wchar_t
+    uint32_t textSize;
+    // FNV-1a of everything after the header
+    uint32_t checksum;
+};
+
+constexpr uint32_t CONNECTOR_CACHE_CONNECTED = 0x1;
+
+// In menu order
+struct ConnectorCacheEntry {
+    GUID containerId;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t firstEndpoint;
+    uint32_t endpointCount;
+    uint32_t flags;
+};
+
+struct ConnectorCacheEndpoint {
+    uint32_t idOffset;
+    uint32_t idLength;
+};
+
+// A connector in the cache. Only valid while the cache it came from keeps its mapping.
+class CachedConnector {
+public:
+    CachedConnector(const ConnectorCacheEntry& entry, std::span<const ConnectorCacheEndpoint> endpoints, std::span<const wchar_t> text)
+        : m_entry(entry), m_endpoints(endpoints), m_text(text) {}
+
+    const GUID& ContainerId() const {
+        return m_entry.containerId;
+    }
+
+    std::wstring_view Name() const {
+        return { m_text.data() + m_entry.nameOffset, m_entry.nameLength };
+    }
+
+    bool IsConnected() const {
+        return (m_entry.flags & CONNECTOR_CACHE_CONNECTED) != 0;
+    }
+
+    size_t EndpointCount() const {
+        return m_endpoints.size();
+    }
+
+    std::wstring_view EndpointId(size_t index) const {
+        return { m_text.data() + m_endpoints[index].idOffset, m_endpoints[index].idLength };
+    }
+private:
+    const ConnectorCacheEntry& m_entry;
+    std::span<const ConnectorCacheEndpoint> m_endpoints;
+    std::span<const wchar_t> m_text;
+};
+
+// Stands in for the driver controls of an endpoint known from the cache. Each call resolves the
+// endpoint, which is much cheaper than the enumeration the live connector is waiting for.
+class CachedEndpointControl : public IConnectorControl {
+public:
+    // HRESULT_FROM_WIN32(ERROR_NOT_FOUND), when the endpoint is gone
+    static constexpr long ENDPOINT_NOT_FOUND = static_cast<int32_t>(0x80070490);
+
+    CachedEndpointControl(IAudioEndpointSource& source, std::wstring_view endpointId)
+        : m_source(source), m_endpointId(endpointId) {}
+
+    long Connect() override;
+    long Disconnect() override;
+private:
+    IAudioEndpointSource& m_source;
+    std::wstring m_endpointId;
+
+    long Invoke(long (IConnectorControl::*call)());
+};
+
+// The connectors of the last enumeration, persisted in a memory-mapped file so the first menu after
+// startup doesn't wait for the next one. Opening checks the file in a single pass and reading it
+// allocates nothing. Not thread-safe: it's read before the enumeration starts, and only the
+// enumeration thread saves after that.
+class ConnectorCache {
+public:
+    static constexpr uint32_t MAGIC = 0x43434354; // "TCCC"
+    static constexpr uint32_t VERSION = 1;
+
+    ConnectorCache() = default;
+
+    ConnectorCache(const ConnectorCache&) = delete;
+    ConnectorCache& operator=(const ConnectorCache&) = delete;
+
+    // A missing, outdated or corrupt file leaves the cache empty; it's rewritten on the next save.
+    void Open(const std::filesystem::path& path);
+
+    size_t Size() const {
+        return m_connectors.size();
+    }
+
+    CachedConnector At(size_t index) const {
+        const ConnectorCacheEntry& entry = m_connectors[index];
+        return CachedConnector(entry, m_endpoints.subspan(entry.firstEndpoint, entry.endpointCount), m_text);
+    }
+
+    // Connectors to show until the enumeration publishes, with controls that resolve their endpoints
+    // from the source when used.
+    std::vector<BluetoothConnector> Connectors(IAudioEndpointSource& source) const;
+
+    // Writes a new version of the file unless it holds these connectors already, and maps it. The
+    // mapped version can't be replaced on Windows. Returns false if writing failed.
+    bool Save(std::span<const BluetoothConnector> connectors);
+private:
+    VersionedMappedFile m_files;
+    std::shared_ptr<const MappedFile> m_file;
+    std::span<const ConnectorCacheEntry> m_connectors;
+    std::span<const ConnectorCacheEndpoint> m_endpoints;
+    std::span<const wchar_t> m_text;
+
+    bool Holds(std::span<const BluetoothConnector> connectors) const;
+    void Map(std::shared_ptr<const MappedFile> file);
+};
+
+// Checks the header, the checksum and every offset against the file size, so a truncated or corrupt
+// file is rejected up front and reading it doesn't need bounds checks.
+bool ValidateConnectorCache(std::span<const uint8_t> bytes);
+
+std::vector<uint8_t> SerializeConnectorCache(std::span<const BluetoothConnector> connectors);
@@ -0,0 +1,195 @@
+#include "ConnectorCommandQueue.h"
+
+ConnectorCommandQueue::ConnectorCommandQueue(std::chrono::steady_clock::duration timeout, CompletedCallback completed)
+    : m_state(std::make_shared<State>()) {
+    m_state->timeout = timeout;
+    m_state->completed = std::move(completed);
+}
+
+ConnectorCommandQueue::~ConnectorCommandQueue() {
+    Stop();
+}
+
+void ConnectorCommandQueue::Start(std::function<void()> callStarted, std::function<void()> callFinished) {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    if (m_state->running)
+        return;
+
+    m_state->running = true;
+    m_state->callStarted = std::move(callStarted);
+    m_state->callFinished = std::move(callFinished);
+    m_watchdog = std::thread(&ConnectorCommandQueue::Watch, m_state);
+}
+
+void ConnectorCommandQueue::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        if (!m_state->running)
+            return;
+        m_state->running = false;
+    }
+    m_state->changed.notify_all();
+
+    // The watchdog keeps going until every running call returned or timed out
+    m_watchdog.join();
+
+    std::vector<Finished> dropped;
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        for (std::pair<GUID, DeviceCommands>& device : m_state->devices) {
+            if (device.second.queued.has_value())
+                dropped.emplace_back(Finish(*device.second.queued, ConnectorCommandResult::Cancelled, 0));
+        }
+        m_state->devices.clear();
+    }
+
+    Report(*m_state, dropped);
+}
+
+bool ConnectorCommandQueue::Enqueue(const BluetoothConnector& connector, ConnectorCommandType type, CompletedCallback waiter) {
+    std::vector<Finished> cancelled;
+    bool accepted;
+    {
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        if (!m_state->running) {
+            lock.unlock();
+            if (waiter) {
+                Command command{ 0, type, connector, std::chrono::steady_clock::now(), {}, false, {} };
+                waiter(Finish(command, ConnectorCommandResult::Cancelled, 0).completion);
+            }
+            return false;
+        }
+
+        DeviceCommands& commands = m_state->devices[connector.ContainerId()];
+        if (commands.queued.has_value()) {
+            if (commands.queued->type == type) {
+                if (waiter)
+                    commands.queued->waiters.emplace_back(std::move(waiter));
+                return false;
+            }
+
+            cancelled.emplace_back(Finish(*commands.queued, ConnectorCommandResult::Cancelled, 0));
+            commands.queued.reset();
+        }
+
+        // A command that timed out may never finish, so another click queues a new attempt behind it.
+        accepted = !(commands.running.has_value() && commands.running->type == type && !commands.running->timedOut);
+        if (accepted) {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            commands.queued.emplace(Command{ m_state->nextCommandId++, type, connector, now, now, false, {} });
+            if (waiter)
+                commands.queued->waiters.emplace_back(std::move(waiter));
+            DispatchQueued(m_state, commands);
+        }
+        else if (waiter) {
+            commands.running->waiters.emplace_back(std::move(waiter));
+        }
+    }
+
+    Report(*m_state, cancelled);
+    return accepted;
+}
+
+void ConnectorCommandQueue::DispatchQueued(const std::shared_ptr<State>& state, DeviceCommands& commands) {
+    if (commands.running.has_value() || !commands.queued.has_value() || !state->running)
+        return;
+
+    commands.running = std::move(commands.queued);
+    commands.queued.reset();
+    commands.running->deadline = std::chrono::steady_clock::now() + state->timeout;
+    ++state->awaitedCalls;
+
+    // The waiters stay with the running entry, which reports the completion
+    Command call{ commands.running->id, commands.running->type, commands.running->connector, commands.running->enqueued, commands.running->deadline, false, {} };
+    std::thread([state, call, started = state->callStarted, finished = state->callFinished]() {
+        if (started)
+            started();
+        long hr = call.type == ConnectorCommandType::Connect ? call.connector.Connect() : call.connector.Disconnect();
+        if (finished)
+            finished();
+        Returned(state, call, hr);
+    }).detach();
+    state->changed.notify_all();
+}
+
+void ConnectorCommandQueue::Returned(const std::shared_ptr<State>& state, const Command& call, long hr) {
+    std::vector<Finished> completions;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        GuidMap<DeviceCommands>::iterator ite = state->devices.find(call.connector.ContainerId());
+        // Gone when the queue stopped while the call was timed out
+        if (ite == state->devices.end())
+            return;
+
+        DeviceCommands& commands = ite->second;
+        if (commands.running.has_value() && commands.running->id == call.id) {
+            if (!commands.running->timedOut)
+                completions.emplace_back(Finish(*commands.running, hr < 0 ? ConnectorCommandResult::Failed : ConnectorCommandResult::Succeeded, hr));
+            commands.running.reset();
+        }
+
+        DispatchQueued(state, commands);
+        if (!commands.running.has_value() && !commands.queued.has_value())
+            state->devices.erase(ite);
+    }
+
+    if (completions.empty())
+        return;
+    // The callbacks may still use the queue, so Stop waits until they're done too
+    Report(*state, completions);
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        --state->awaitedCalls;
+    }
+    state->changed.notify_all();
+}
+
+void ConnectorCommandQueue::Watch(const std::shared_ptr<State>& state) {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while (state->running || state->awaitedCalls > 0) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::optional<std::chrono::steady_clock::time_point> nextDeadline;
+        std::vector<Finished> timedOut;
+
+        for (std::pair<GUID, DeviceCommands>& device : state->devices) {
+            std::optional<Command>& running = device.second.running;
+            if (!running.has_value() || running->timedOut)
+                continue;
+
+            if (running->deadline <= now) {
+                running->timedOut = true;
+                --state->awaitedCalls;
+                timedOut.emplace_back(Finish(*running, ConnectorCommandResult::TimedOut, 0));
+            }
+            else if (!nextDeadline.has_value() || running->deadline < *nextDeadline) {
+                nextDeadline = running->deadline;
+            }
+        }
+
+        if (!timedOut.empty()) {
+            lock.unlock();
+            Report(*state, timedOut);
+            lock.lock();
+            continue;
+        }
+
+        if (nextDeadline.has_value())
+            state->changed.wait_until(lock, *nextDeadline);
+        else
+            state->changed.wait(lock);
+    }
+}
+
+void ConnectorCommandQueue::Report(const State& state, std::vector<Finished>& finished) {
+    for (Finished& command : finished) {
+        if (state.completed)
+            state.completed(command.completion);
+        for (CompletedCallback& waiter : command.waiters)
+            waiter(command.completion);
+    }
+}
+
+ConnectorCommandQueue::Finished ConnectorCommandQueue::Finish(Command& command, ConnectorCommandResult result, long hr) {
+    ConnectorCommandCompletion completion{ command.connector.ContainerId(), command.type, result, hr, std::chrono::steady_clock::now() - command.enqueued };
+    return Finished{ completion, std::move(command.waiters) };
+}
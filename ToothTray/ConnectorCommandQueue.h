@@ -0,0 +1,113 @@
+#pragma once
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <functional>
+#include <condition_variable>
+
+#include "BluetoothConnector.h"
+#include "GuidMap.h"
+
+enum class ConnectorCommandType {
+    Connect,
+    Disconnect,
+};
+
+enum class ConnectorCommandResult {
+    Succeeded,
+    Failed,
+    // The driver didn't return in time. The call keeps running on its own thread and later commands for
+    // the device wait for it; commands for other devices don't.
+    TimedOut,
+    // Replaced by the opposite command before it ran.
+    Cancelled,
+};
+
+struct ConnectorCommandCompletion {
+    GUID containerId;
+    ConnectorCommandType type;
+    ConnectorCommandResult result;
+    // The HRESULT of the driver calls, when they returned.
+    long hr;
+    std::chrono::steady_clock::duration elapsed;
+};
+
+// Runs connect and disconnect off the UI thread, at most one at a time per device. Each driver call gets
+// a thread of its own, so a hung driver only holds up its own device.
+// A command for a device that already has the same command queued or running is collapsed into it,
+// and a command replaces a queued one of the opposite type, e.g. disconnecting cancels a queued connect.
+class ConnectorCommandQueue {
+public:
+    // Called on a worker thread for every command that was accepted.
+    using CompletedCallback = std::function<void(const ConnectorCommandCompletion&)>;
+
+    ConnectorCommandQueue(std::chrono::steady_clock::duration timeout, CompletedCallback completed);
+    ~ConnectorCommandQueue();
+
+    ConnectorCommandQueue(const ConnectorCommandQueue&) = delete;
+    ConnectorCommandQueue& operator=(const ConnectorCommandQueue&) = delete;
+
+    // The callbacks run on each call's thread before and after the driver call, e.g. to initialize COM.
+    void Start(std::function<void()> callStarted = nullptr, std::function<void()> callFinished = nullptr);
+    // Waits for the commands already running until they finish or time out; queued ones are reported as
+    // cancelled. Calls that timed out are left behind and report nothing when they return.
+    void Stop();
+
+    // Returns false when the command was collapsed into one already queued or running.
+    // waiter is called once with the completion of the command this one ran as or was collapsed into,
+    // including a Cancelled one when the queue is stopped or not running.
+    bool Enqueue(const BluetoothConnector& connector, ConnectorCommandType type, CompletedCallback waiter = nullptr);
+private:
+    struct Command {
+        uint64_t id;
+        ConnectorCommandType type;
+        BluetoothConnector connector;
+        std::chrono::steady_clock::time_point enqueued;
+        std::chrono::steady_clock::time_point deadline;
+        bool timedOut;
+        std::vector<CompletedCallback> waiters;
+    };
+
+    struct Finished {
+        ConnectorCommandCompletion completion;
+        std::vector<CompletedCallback> waiters;
+    };
+
+    struct DeviceCommands {
+        std::optional<Command> running;
+        std::optional<Command> queued;
+    };
+
+    // Everything a call touches when it returns. A call that timed out can return after the queue is
+    // gone, so its thread shares this instead of pointing at the queue.
+    struct State {
+        std::chrono::steady_clock::duration timeout;
+        CompletedCallback completed;
+        std::function<void()> callStarted;
+        std::function<void()> callFinished;
+
+        std::mutex mutex;
+        GuidMap<DeviceCommands> devices;
+        uint64_t nextCommandId = 1;
+        bool running = false;
+        // Calls that haven't timed out and whose completion isn't reported yet, which Stop waits for
+        size_t awaitedCalls = 0;
+        // Signals the watchdog that a deadline was added or a call returned
+        std::condition_variable changed;
+    };
+
+    std::shared_ptr<State> m_state;
+    std::thread m_watchdog;
+
+    // Must be called with the lock held.
+    static void DispatchQueued(const std::shared_ptr<State>& state, DeviceCommands& commands);
+    static void Returned(const std::shared_ptr<State>& state, const Command& call, long hr);
+    static void Watch(const std::shared_ptr<State>& state);
+    static void Report(const State& state, std::vector<Finished>& finished);
+
+    // Takes the waiters of the command, so they're called only once.
+    static Finished Finish(Command& command, ConnectorCommandResult result, long hr);
+};
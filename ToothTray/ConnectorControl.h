@@ -0,0 +1,12 @@
+#pragma once
+
+// A control that asks the bluetooth audio driver to connect or disconnect one profile of a device.
+// On Windows this wraps the IKsControl of the KS filter connected to an audio endpoint.
+class IConnectorControl {
+public:
+    virtual ~IConnectorControl() = default;
+
+    // Both return an HRESULT.
+    virtual long Connect() = 0;
+    virtual long Disconnect() = 0;
+};
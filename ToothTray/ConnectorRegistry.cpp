@@ -0,0 +1,258 @@
+#include "ConnectorRegistry.h"
+
+#include <algorithm>
+
+#include "GuidMap.h"
+#include "Trace.h"
+
+ConnectorRegistry::~ConnectorRegistry() {
+    Stop();
+}
+
+void ConnectorRegistry::Start() {
+    m_containerNames.SetChangedCallback([this](const GUID&) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_snapshotDirty = true;
+        }
+        NotifyChanged();
+    });
+    m_source.SetListener(this);
+}
+
+void ConnectorRegistry::Stop() {
+    m_source.SetListener(nullptr);
+    m_containerNames.SetChangedCallback(nullptr);
+}
+
+void ConnectorRegistry::Refresh() {
+    TRACE_SPAN("ConnectorRegistry::Refresh");
+    uint64_t started;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        started = BeginResolve();
+    }
+    std::vector<AudioEndpoint> endpoints = m_source.EnumerateEndpoints();
+
+    // Warm the index so that building the snapshot doesn't have to resolve names
+    for (const AudioEndpoint& endpoint : endpoints)
+        m_containerNames.Lookup(endpoint.containerId);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Endpoints patched during the enumeration keep their patched state
+    for (const std::pair<const std::wstring, EndpointPatch>& patch : m_patches) {
+        if (patch.second.generation <= started)
+            continue;
+
+        std::erase_if(endpoints, [&patch](const AudioEndpoint& endpoint) { return endpoint.id == patch.first; });
+        std::vector<AudioEndpoint>::iterator current = FindEndpoint(patch.first);
+        if (current != m_endpoints.end())
+            endpoints.emplace_back(std::move(*current));
+    }
+
+    m_endpoints = std::move(endpoints);
+    m_ignoredEndpoints.clear();
+    m_snapshotDirty = true;
+    EndResolve();
+}
+
+void ConnectorRegistry::SetChangedCallback(std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_changedCallback = std::move(callback);
+}
+
+void ConnectorRegistry::NotifyChanged() {
+    std::function<void()> callback;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        callback = m_changedCallback;
+    }
+
+    if (callback)
+        callback();
+}
+
+std::vector<BluetoothConnector> ConnectorRegistry::Snapshot() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_snapshotDirty)
+        BuildSnapshot();
+    return m_snapshot;
+}
+
+std::optional<BluetoothConnector> ConnectorRegistry::ResolveContainer(const GUID& containerId) {
+    TRACE_SPAN("ConnectorRegistry::ResolveContainer");
+    std::vector<std::wstring> endpointIds;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const AudioEndpoint& endpoint : m_endpoints) {
+            if (GUIDEqualityComparer{}(endpoint.containerId, containerId))
+                endpointIds.push_back(endpoint.id);
+        }
+    }
+    for (const std::wstring& endpointId : endpointIds)
+        ResolveEndpoint(endpointId);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::optional<InternedName> containerName = m_containerNames.Lookup(containerId);
+    if (!containerName.has_value())
+        return std::nullopt;
+
+    BluetoothConnector connector(containerId, *containerName);
+    for (const AudioEndpoint& endpoint : m_endpoints) {
+        if (GUIDEqualityComparer{}(endpoint.containerId, containerId))
+            AddEndpoint(connector, endpoint);
+    }
+    if (connector.EndpointIds().empty())
+        return std::nullopt;
+    return connector;
+}
+
+void ConnectorRegistry::OnEndpointAdded(std::wstring_view endpointId) {
+    ResolveEndpoint(endpointId);
+}
+
+void ConnectorRegistry::OnEndpointRemoved(std::wstring_view endpointId) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // Even when unknown, since a resolve of it may be running
+        Patched(endpointId, true);
+        m_ignoredEndpoints.erase(std::wstring(endpointId));
+
+        std::vector<AudioEndpoint>::iterator ite = FindEndpoint(endpointId);
+        if (ite == m_endpoints.end())
+            return;
+
+        m_endpoints.erase(ite);
+        m_snapshotDirty = true;
+    }
+    NotifyChanged();
+}
+
+void ConnectorRegistry::OnEndpointStateChanged(std::wstring_view endpointId, bool isActive) {
+    bool known;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_ignoredEndpoints.contains(std::wstring(endpointId)))
+            return;
+
+        // The topology doesn't change with the state, so a known endpoint only needs the flag patched.
+        std::vector<AudioEndpoint>::iterator ite = FindEndpoint(endpointId);
+        known = ite != m_endpoints.end();
+        if (known) {
+            if (ite->isActive == isActive)
+                return;
+            ite->isActive = isActive;
+            Patched(endpointId, false);
+            m_snapshotDirty = true;
+        }
+    }
+
+    if (known)
+        NotifyChanged();
+    else
+        ResolveEndpoint(endpointId);
+}
+
+std::vector<AudioEndpoint>::iterator ConnectorRegistry::FindEndpoint(std::wstring_view endpointId) {
+    return std::find_if(m_endpoints.begin(), m_endpoints.end(), [endpointId](const AudioEndpoint& endpoint) {
+        return endpoint.id == endpointId;
+    });
+}
+
+uint64_t ConnectorRegistry::BeginResolve() {
+    ++m_resolving;
+    return m_generation;
+}
+
+void ConnectorRegistry::EndResolve() {
+    // Nothing running can be older than the patches anymore
+    if (--m_resolving == 0)
+        m_patches.clear();
+}
+
+void ConnectorRegistry::Patched(std::wstring_view endpointId, bool removed) {
+    ++m_generation;
+    if (m_resolving > 0)
+        m_patches.insert_or_assign(std::wstring(endpointId), EndpointPatch{ m_generation, removed });
+}
+
+bool ConnectorRegistry::RemovedSince(std::wstring_view endpointId, uint64_t generation) const {
+    std::unordered_map<std::wstring, EndpointPatch>::const_iterator ite = m_patches.find(std::wstring(endpointId));
+    return ite != m_patches.end() && ite->second.removed && ite->second.generation > generation;
+}
+
+void ConnectorRegistry::ResolveEndpoint(std::wstring_view endpointId) {
+    uint64_t started;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        started = BeginResolve();
+    }
+
+    // Resolving talks to the drivers, so it's done without holding the lock.
+    std::optional<AudioEndpoint> endpoint = m_source.GetEndpoint(endpointId);
+
+    if (endpoint.has_value())
+        m_containerNames.Lookup(endpoint->containerId);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        bool stale = RemovedSince(endpointId, started);
+        EndResolve();
+        if (stale)
+            return;
+
+        Patched(endpointId, !endpoint.has_value());
+        std::vector<AudioEndpoint>::iterator ite = FindEndpoint(endpointId);
+        if (!endpoint.has_value()) {
+            m_ignoredEndpoints.emplace(endpointId);
+            if (ite == m_endpoints.end())
+                return;
+            m_endpoints.erase(ite);
+        }
+        else {
+            m_ignoredEndpoints.erase(std::wstring(endpointId));
+            if (ite == m_endpoints.end())
+                m_endpoints.emplace_back(std::move(*endpoint));
+            else
+                *ite = std::move(*endpoint);
+        }
+        m_snapshotDirty = true;
+    }
+    NotifyChanged();
+}
+
+void ConnectorRegistry::AddEndpoint(BluetoothConnector& connector, const AudioEndpoint& endpoint) {
+    connector.addEndpointId(endpoint.id);
+    for (const std::shared_ptr<IConnectorControl>& control : endpoint.controls)
+        connector.addConnectorControl(control, endpoint.isActive);
+}
+
+void ConnectorRegistry::BuildSnapshot() {
+    TRACE_SPAN("ConnectorRegistry::BuildSnapshot");
+    std::vector<BluetoothConnector> connectors;
+    GuidMap<size_t> connectorIndices;
+    connectorIndices.reserve(m_endpoints.size());
+
+    for (const AudioEndpoint& endpoint : m_endpoints) {
+        GuidMap<size_t>::iterator ite = connectorIndices.find(endpoint.containerId);
+        if (ite == connectorIndices.end()) {
+            // Endpoints without a named container can't be shown.
+            // The names are cached already unless a container was renamed since the endpoint was resolved.
+            std::optional<InternedName> containerName = m_containerNames.Lookup(endpoint.containerId);
+            if (!containerName.has_value())
+                continue;
+
+            ite = connectorIndices.emplace(endpoint.containerId, connectors.size()).first;
+            connectors.emplace_back(endpoint.containerId, *containerName);
+        }
+
+        AddEndpoint(connectors[ite->second], endpoint);
+    }
+
+    std::stable_sort(connectors.begin(), connectors.end(), [](const BluetoothConnector& a, const BluetoothConnector& b) {
+        return a.DeviceName() < b.DeviceName();
+    });
+
+    m_snapshot = std::move(connectors);
+    m_snapshotDirty = false;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <mutex>
+#include <cstdint>
+#include <optional>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "AudioEndpointSource.h"
+#include "BluetoothConnector.h"
+#include "ContainerNameIndex.h"
+
+// Keeps the bluetooth connectors up to date from endpoint notifications, so that showing the menu
+// doesn't have to enumerate and walk the topology of every endpoint again.
+// Only the endpoint named in a notification is resolved again.
+class ConnectorRegistry : public IAudioEndpointListener {
+public:
+    ConnectorRegistry(IAudioEndpointSource& source, ContainerNameIndex& containerNames)
+        : m_source(source), m_containerNames(containerNames), m_snapshotDirty(true), m_generation(0), m_resolving(0) {}
+    ~ConnectorRegistry();
+
+    ConnectorRegistry(const ConnectorRegistry&) = delete;
+    ConnectorRegistry& operator=(const ConnectorRegistry&) = delete;
+
+    // Subscribes to the source. Refresh does the initial enumeration.
+    void Start();
+    void Stop();
+    // Enumerates everything again, dropping the patched state.
+    void Refresh();
+
+    // Connectors grouped by device container, ordered by name.
+    std::vector<BluetoothConnector> Snapshot();
+    // Resolves the known endpoints of one container again, e.g. to open their driver controls before
+    // the device is used, and returns its connector as resolved. Empty if none of them is left.
+    std::optional<BluetoothConnector> ResolveContainer(const GUID& containerId);
+
+    // Called without any lock held after a notification changed the connectors.
+    void SetChangedCallback(std::function<void()> callback);
+
+    void OnEndpointAdded(std::wstring_view endpointId) override;
+    void OnEndpointRemoved(std::wstring_view endpointId) override;
+    void OnEndpointStateChanged(std::wstring_view endpointId, bool isActive) override;
+private:
+    IAudioEndpointSource& m_source;
+    ContainerNameIndex& m_containerNames;
+
+    std::mutex m_mutex;
+    // In enumeration order so that the controls of a connector keep a stable order.
+    std::vector<AudioEndpoint> m_endpoints;
+    // Endpoints known not to be bluetooth audio endpoints, so their notifications are cheap to skip.
+    std::unordered_set<std::wstring> m_ignoredEndpoints;
+    std::vector<BluetoothConnector> m_snapshot;
+    bool m_snapshotDirty;
+    std::function<void()> m_changedCallback;
+
+    // Resolves and refreshes run without the lock, so a notification can patch an endpoint meanwhile.
+    // While any is running, each patched endpoint remembers when, and results older than the patch
+    // are dropped; otherwise a removed endpoint could be put back by a resolve that started before.
+    struct EndpointPatch {
+        uint64_t generation;
+        bool removed;
+    };
+    uint64_t m_generation;
+    size_t m_resolving;
+    std::unordered_map<std::wstring, EndpointPatch> m_patches;
+
+    uint64_t BeginResolve();
+    void EndResolve();
+    void Patched(std::wstring_view endpointId, bool removed);
+    bool RemovedSince(std::wstring_view endpointId, uint64_t generation) const;
+
+    std::vector<AudioEndpoint>::iterator FindEndpoint(std::wstring_view endpointId);
+    void ResolveEndpoint(std::wstring_view endpointId);
+    void NotifyChanged();
+    static void AddEndpoint(BluetoothConnector& connector, const AudioEndpoint& endpoint);
+    void BuildSnapshot();
+};
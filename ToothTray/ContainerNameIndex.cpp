@@ -0,0 +1,64 @@
+#include "ContainerNameIndex.h"
+
+ContainerNameIndex::~ContainerNameIndex() {
+    Stop();
+}
+
+void ContainerNameIndex::Start() {
+    m_source.SetListener(this);
+}
+
+void ContainerNameIndex::Stop() {
+    m_source.SetListener(nullptr);
+}
+
+std::optional<InternedName> ContainerNameIndex::Lookup(const GUID& containerId) {
+    uint64_t invalidations;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        GuidMap<InternedName>::const_iterator ite = m_names.find(containerId);
+        if (ite != m_names.cend())
+            return ite->second;
+        invalidations = m_invalidations;
+    }
+
+    // Resolving can block on the system, so it's done without holding the lock.
+    std::optional<std::wstring> name = m_source.ResolveContainerName(containerId);
+    if (!name.has_value())
+        return std::nullopt;
+
+    InternedName interned = NamePool::Shared().Intern(*name);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_invalidations == invalidations)
+        m_names.insert_or_assign(containerId, interned);
+    return interned;
+}
+
+void ContainerNameIndex::Invalidate(const GUID& containerId) {
+    std::function<void(const GUID&)> callback;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_invalidations;
+        if (m_names.erase(containerId) == 0)
+            return;
+        callback = m_changedCallback;
+    }
+
+    if (callback)
+        callback(containerId);
+}
+
+void ContainerNameIndex::Clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_invalidations;
+    m_names.clear();
+}
+
+void ContainerNameIndex::SetChangedCallback(std::function<void(const GUID&)> callback) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_changedCallback = std::move(callback);
+}
+
+void ContainerNameIndex::OnContainerChanged(const GUID& containerId) {
+    Invalidate(containerId);
+}
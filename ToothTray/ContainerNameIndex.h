@@ -0,0 +1,66 @@
+#pragma once
+#include <string>
+#include <mutex>
+#include <cstdint>
+#include <optional>
+#include <functional>
+
+#include "Guid.h"
+#include "GuidMap.h"
+#include "NamePool.h"
+
+// Receives changes of device containers from an IContainerSource. Calls can come from any thread.
+class IContainerListener {
+public:
+    virtual ~IContainerListener() = default;
+
+    // The container was renamed or removed.
+    virtual void OnContainerChanged(const GUID& containerId) = 0;
+};
+
+class IContainerSource {
+public:
+    virtual ~IContainerSource() = default;
+
+    // Looks up a single container. Empty if it doesn't exist.
+    virtual std::optional<std::wstring> ResolveContainerName(const GUID& containerId) = 0;
+
+    // Pass nullptr to stop receiving notifications.
+    virtual void SetListener(IContainerListener* listener) = 0;
+};
+
+// Caches the names of the containers that are actually asked for, instead of enumerating every
+// container on the system each time. Entries are dropped when the source reports a change.
+class ContainerNameIndex : public IContainerListener {
+public:
+    ContainerNameIndex(IContainerSource& source) : m_source(source), m_invalidations(0) {}
+    ~ContainerNameIndex();
+
+    ContainerNameIndex(const ContainerNameIndex&) = delete;
+    ContainerNameIndex& operator=(const ContainerNameIndex&) = delete;
+
+    void Start();
+    void Stop();
+
+    // Resolves from the source on a cache miss. Missing containers aren't cached because the device
+    // may be paired later. Names are interned in the shared pool, so a container resolved again after
+    // a change keeps sharing the string when its name didn't actually change.
+    std::optional<InternedName> Lookup(const GUID& containerId);
+    void Invalidate(const GUID& containerId);
+    void Clear();
+
+    // Called after an entry has been invalidated, without any lock held.
+    void SetChangedCallback(std::function<void(const GUID&)> callback);
+
+    void OnContainerChanged(const GUID& containerId) override;
+private:
+    IContainerSource& m_source;
+
+    std::mutex m_mutex;
+    GuidMap<InternedName> m_names;
+    // Counts invalidations, cached or not. A name resolved while one happened may be the old name,
+    // so it's returned but not cached; renames are rare enough that the next lookup resolving again
+    // costs nothing.
+    uint64_t m_invalidations;
+    std::function<void(const GUID&)> m_changedCallback;
+};
@@ -0,0 +1,345 @@
+#include "ControlProtocol.h"
+
+#include <cstdio>
+#include <cwctype>
+#include <algorithm>
+
+static constexpr std::string_view WHITESPACE = " \t\r\n";
+static constexpr std::string_view NAME_END = " \t\r\n;";
+
+static std::string_view Trim(std::string_view text) {
+    size_t first = text.find_first_not_of(WHITESPACE);
+    if (first == std::string_view::npos)
+        return {};
+    return text.substr(first, text.find_last_not_of(WHITESPACE) - first + 1);
+}
+
+static void AppendCodePoint(std::wstring& text, char32_t codePoint) {
+    if constexpr (sizeof(wchar_t) == 2) {
+        if (codePoint >= 0x10000) {
+            codePoint -= 0x10000;
+            text.push_back(static_cast<wchar_t>(0xD800 + (codePoint >> 10)));
+            text.push_back(static_cast<wchar_t>(0xDC00 + (codePoint & 0x3FF)));
+            return;
+        }
+    }
+    text.push_back(static_cast<wchar_t>(codePoint));
+}
+
+// Rejects overlong forms, surrogates and truncated sequences.
+static std::optional<std::wstring> DecodeUtf8(std::string_view text) {
+    std::wstring decoded;
+    decoded.reserve(text.size());
+    for (size_t i = 0; i < text.size();) {
+        unsigned char lead = static_cast<unsigned char>(text[i]);
+        size_t length = lead < 0x80 ? 1 : (lead & 0xE0) == 0xC0 ? 2 : (lead & 0xF0) == 0xE0 ? 3 : (lead & 0xF8) == 0xF0 ? 4 : 0;
+        if (length == 0 || i + length > text.size())
+            return std::nullopt;
+
+        char32_t codePoint = length == 1 ? lead : lead & (0x7F >> length);
+        for (size_t j = 1; j < length; ++j) {
+            unsigned char continuation = static_cast<unsigned char>(text[i + j]);
+            if ((continuation & 0xC0) != 0x80)
+                return std::nullopt;
+            codePoint = (codePoint << 6) | (continuation & 0x3F);
+        }
+
+        static constexpr char32_t SMALLEST[] = { 0, 0, 0x80, 0x800, 0x10000 };
+        if (codePoint < SMALLEST[length] || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF))
+            return std::nullopt;
+        AppendCodePoint(decoded, codePoint);
+        i += length;
+    }
+    return decoded;
+}
+
+static void AppendUtf8(std::string& text, char32_t codePoint) {
+    if (codePoint < 0x80) {
+        text += static_cast<char>(codePoint);
+    }
+    else if (codePoint < 0x800) {
+        text += static_cast<char>(0xC0 | (codePoint >> 6));
+        text += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+    else if (codePoint < 0x10000) {
+        text += static_cast<char>(0xE0 | (codePoint >> 12));
+        text += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        text += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+    else {
+        text += static_cast<char>(0xF0 | (codePoint >> 18));
+        text += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        text += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        text += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+}
+
+static void AppendJsonString(std::string& json, std::string_view value) {
+    json += '"';
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            json += '\\';
+            json += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+            json += escaped;
+        }
+        else {
+            json += c;
+        }
+    }
+    json += '"';
+}
+
+// Device names come from the system as UTF-16, so a lone surrogate is possible and becomes U+FFFD.
+static void AppendJsonString(std::string& json, std::wstring_view value) {
+    std::string utf8;
+    utf8.reserve(value.size());
+    for (size_t i = 0; i < value.size(); ++i) {
+        char32_t codePoint = static_cast<char32_t>(value[i]);
+        if constexpr (sizeof(wchar_t) == 2) {
+            if (codePoint >= 0xD800 && codePoint <= 0xDBFF && i + 1 < value.size() && value[i + 1] >= 0xDC00 && value[i + 1] <= 0xDFFF)
+                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (static_cast<char32_t>(value[++i]) - 0xDC00);
+        }
+        if ((codePoint >= 0xD800 && codePoint <= 0xDFFF) || codePoint > 0x10FFFF)
+            codePoint = 0xFFFD;
+        AppendUtf8(utf8, codePoint);
+    }
+    AppendJsonString(json, std::string_view(utf8));
+}
+
+std::string FormatControlGuid(const GUID& guid) {
+    char text[40];
+    std::snprintf(text, sizeof(text), "{%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X}", static_cast<unsigned>(guid.Data1), guid.Data2, guid.Data3,
+        guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3], guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7]);
+    return text;
+}
+
+std::optional<GUID> ParseControlGuid(std::wstring_view text) {
+    // {XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}
+    if (text.size() != 38 || text.front() != L'{' || text.back() != L'}')
+        return std::nullopt;
+
+    uint8_t bytes[16];
+    size_t count = 0;
+    for (size_t i = 1; i < 37;) {
+        if (i == 9 || i == 14 || i == 19 || i == 24) {
+            if (text[i++] != L'-')
+                return std::nullopt;
+            continue;
+        }
+        uint8_t byte = 0;
+        for (size_t j = 0; j < 2; ++j, ++i) {
+            wchar_t c = text[i];
+            if (!iswxdigit(c))
+                return std::nullopt;
+            byte = static_cast<uint8_t>((byte << 4) | (iswdigit(c) ? c - L'0' : towlower(c) - L'a' + 10));
+        }
+        bytes[count++] = byte;
+    }
+
+    GUID guid{};
+    guid.Data1 = (uint32_t{ bytes[0] } << 24) | (uint32_t{ bytes[1] } << 16) | (uint32_t{ bytes[2] } << 8) | bytes[3];
+    guid.Data2 = static_cast<uint16_t>((bytes[4] << 8) | bytes[5]);
+    guid.Data3 = static_cast<uint16_t>((bytes[6] << 8) | bytes[7]);
+    std::copy(bytes + 8, bytes + 16, guid.Data4);
+    return guid;
+}
+
+// The first ';' after the command at the start of the request, or the end of the request. Only a
+// device starting with a quote is quoted; a quote further into a bare name is part of the name.
+static size_t CommandEnd(std::string_view request) {
+    size_t nameStart = std::min(request.find_first_not_of(WHITESPACE), request.size());
+    size_t nameEnd = std::min(request.find_first_of(NAME_END, nameStart), request.size());
+    size_t argument = request.find_first_not_of(WHITESPACE, nameEnd);
+    if (argument == std::string_view::npos || request[argument] != '"')
+        return std::min(request.find(';', nameEnd), request.size());
+
+    for (size_t i = argument + 1; i < request.size(); ++i) {
+        if (request[i] == '\\')
+            ++i;
+        else if (request[i] == '"')
+            return std::min(request.find(';', i), request.size());
+    }
+    return request.size();
+}
+
+// The text between the quotes, which have to enclose the whole device.
+static std::optional<std::string> Unquote(std::string_view text, std::string& error) {
+    std::string unquoted;
+    for (size_t i = 1; i < text.size(); ++i) {
+        char c = text[i];
+        if (c == '"') {
+            if (i + 1 == text.size())
+                return unquoted;
+            error = "text after quoted device";
+            return std::nullopt;
+        }
+        if (c == '\\' && ++i < text.size())
+            c = text[i];
+        unquoted += c;
+    }
+    error = "unterminated quote";
+    return std::nullopt;
+}
+
+std::optional<ControlCommand> ParseControlCommand(std::string_view text, std::string& error) {
+    text = Trim(text);
+    size_t nameEnd = std::min(text.find_first_of(WHITESPACE), text.size());
+    std::string_view name = text.substr(0, nameEnd);
+    std::string_view argument = Trim(text.substr(nameEnd));
+
+    static constexpr std::pair<std::string_view, ControlCommandType> COMMANDS[] = {
+        { "list", ControlCommandType::List },
+        { "connect", ControlCommandType::Connect },
+        { "disconnect", ControlCommandType::Disconnect },
+        { "switch", ControlCommandType::Switch },
+    };
+    const std::pair<std::string_view, ControlCommandType>* command = std::find_if(std::begin(COMMANDS), std::end(COMMANDS),
+        [name](const std::pair<std::string_view, ControlCommandType>& command) { return command.first == name; });
+    if (command == std::end(COMMANDS)) {
+        error = "unknown command";
+        return std::nullopt;
+    }
+
+    if ((command->second == ControlCommandType::List) != argument.empty()) {
+        error = command->second == ControlCommandType::List ? "list takes no device" : "missing device";
+        return std::nullopt;
+    }
+
+    std::optional<std::string> unquoted;
+    if (!argument.empty() && argument.front() == '"') {
+        unquoted = Unquote(argument, error);
+        if (!unquoted.has_value())
+            return std::nullopt;
+        if (unquoted->empty()) {
+            error = "missing device";
+            return std::nullopt;
+        }
+        argument = *unquoted;
+    }
+
+    std::optional<std::wstring> device = DecodeUtf8(argument);
+    if (!device.has_value()) {
+        error = "invalid UTF-8";
+        return std::nullopt;
+    }
+    return ControlCommand{ command->second, std::move(*device) };
+}
+
+static bool SameName(std::wstring_view a, std::wstring_view b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](wchar_t x, wchar_t y) { return towlower(x) == towlower(y); });
+}
+
+static const BluetoothConnector* FindDevice(const std::vector<BluetoothConnector>& connectors, std::wstring_view device, std::string& error) {
+    std::optional<GUID> containerId = ParseControlGuid(device);
+    const BluetoothConnector* found = nullptr;
+    for (const BluetoothConnector& connector : connectors) {
+        bool matches = containerId.has_value() ? GUIDEqualityComparer{}(connector.ContainerId(), *containerId) : SameName(connector.DeviceName(), device);
+        if (!matches)
+            continue;
+        if (found != nullptr) {
+            error = "ambiguous device name";
+            return nullptr;
+        }
+        found = &connector;
+    }
+    if (found == nullptr)
+        error = "no such device";
+    return found;
+}
+
+static void AppendDevice(std::string& json, const BluetoothConnector& connector) {
+    json += "\"id\":";
+    AppendJsonString(json, std::string_view(FormatControlGuid(connector.ContainerId())));
+    json += ",\"name\":";
+    AppendJsonString(json, connector.DeviceName());
+}
+
+static std::string_view CommandName(ControlCommandType type) {
+    switch (type) {
+    case ControlCommandType::List:
+        return "list";
+    case ControlCommandType::Connect:
+        return "connect";
+    case ControlCommandType::Disconnect:
+        return "disconnect";
+    case ControlCommandType::Switch:
+        return "switch";
+    }
+    return "";
+}
+
+void ControlRequestHandler::Execute(const ControlCommand& command, const ConnectorSnapshot& snapshot, std::string& json) {
+    json += "{\"command\":";
+    AppendJsonString(json, CommandName(command.type));
+
+    if (command.type == ControlCommandType::List) {
+        json += ",\"generation\":" + std::to_string(snapshot.generation) + ",\"devices\":[";
+        for (size_t i = 0; i < snapshot.value.size(); ++i) {
+            json += i > 0 ? ",{" : "{";
+            AppendDevice(json, snapshot.value[i]);
+            json += snapshot.value[i].IsConnected() ? ",\"connected\":true}" : ",\"connected\":false}";
+        }
+        json += "]}";
+        return;
+    }
+
+    std::string error;
+    const BluetoothConnector* connector = FindDevice(snapshot.value, command.device, error);
+    if (connector == nullptr) {
+        json += ",\"error\":";
+        AppendJsonString(json, std::string_view(error));
+        json += '}';
+        return;
+    }
+
+    json += ',';
+    AppendDevice(json, *connector);
+    if (command.type == ControlCommandType::Switch) {
+        BatchPlan plan = ConnectorBatch::SwitchTo(snapshot.value, connector->ContainerId());
+        size_t disconnects = plan[0].size();
+        size_t connects = plan[1].size();
+        if (disconnects + connects > 0)
+            m_batch.RunAsync(std::move(plan));
+        json += ",\"disconnects\":" + std::to_string(disconnects) + ",\"connects\":" + std::to_string(connects) + '}';
+        return;
+    }
+
+    // False when the same command is already queued or running for the device
+    bool accepted = m_commandQueue.Enqueue(*connector, command.type == ControlCommandType::Connect ? ConnectorCommandType::Connect : ConnectorCommandType::Disconnect);
+    json += accepted ? ",\"accepted\":true}" : ",\"accepted\":false}";
+}
+
+std::string ControlRequestHandler::Handle(std::string_view request) {
+    std::shared_ptr<const ConnectorSnapshot> snapshot = m_snapshot();
+    std::string json = "[";
+    bool first = true;
+    while (!request.empty()) {
+        size_t end = CommandEnd(request);
+        std::string_view text = Trim(request.substr(0, end));
+        request.remove_prefix(std::min(end + 1, request.size()));
+        if (text.empty())
+            continue;
+
+        if (!first)
+            json += ',';
+        first = false;
+
+        std::string error;
+        std::optional<ControlCommand> command = ParseControlCommand(text, error);
+        if (command.has_value()) {
+            Execute(*command, *snapshot, json);
+            continue;
+        }
+
+        // The request isn't echoed, it may not even be UTF-8; results are in order anyway
+        json += "{\"error\":";
+        AppendJsonString(json, std::string_view(error));
+        json += '}';
+    }
+    json += "]\n";
+    return json;
+}
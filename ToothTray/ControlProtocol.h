@@ -0,0 +1,69 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <string_view>
+
+#include "Guid.h"
+#include "EnumerationPipeline.h"
+#include "ConnectorCommandQueue.h"
+#include "ConnectorBatch.h"
+
+// The control channel lets scripts drive the app without the menu. A request is one UTF-8 line of
+// commands separated by ';', and the response is one line with a JSON array holding a result object
+// per command, in order:
+//
+//   list; disconnect WH-CH510; switch {5F1A0C3E-8D2B-4E9A-9C1D-0A2B3C4D5E6F}
+//
+// list                 the devices of the current snapshot, with their id, name and connected state
+// connect <device>     queues a connect, like clicking a disconnected device
+// disconnect <device>  queues a disconnect
+// switch <device>      disconnects every other connected device, then connects this one unless a disconnect failed
+//
+// A device is its container id in braces or its name, ignoring case. A name with a ';' in it, or one
+// starting with a quote, goes in double quotes, where a backslash keeps the character after it:
+//
+//   connect "Living room; left"; connect "Say \"hi\""
+//
+// Commands only queue the driver calls, so they are answered right away; the outcome shows in a later
+// list.
+enum class ControlCommandType {
+    List,
+    Connect,
+    Disconnect,
+    Switch,
+};
+
+struct ControlCommand {
+    ControlCommandType type;
+    // Empty for list
+    std::wstring device;
+};
+
+// Empty with the reason set when the command is malformed.
+std::optional<ControlCommand> ParseControlCommand(std::string_view text, std::string& error);
+
+// "{5F1A0C3E-8D2B-4E9A-9C1D-0A2B3C4D5E6F}"
+std::string FormatControlGuid(const GUID& guid);
+std::optional<GUID> ParseControlGuid(std::wstring_view text);
+
+// Answers requests from the published snapshot, so a round trip never waits for an enumeration.
+// Every command of a request sees the same snapshot. Thread-safe.
+class ControlRequestHandler {
+public:
+    using SnapshotFunction = std::function<std::shared_ptr<const ConnectorSnapshot>()>;
+
+    ControlRequestHandler(SnapshotFunction snapshot, ConnectorCommandQueue& commandQueue, ConnectorBatch& batch)
+        : m_snapshot(std::move(snapshot)), m_commandQueue(commandQueue), m_batch(batch) {}
+
+    // The response line, including the newline.
+    std::string Handle(std::string_view request);
+private:
+    SnapshotFunction m_snapshot;
+    ConnectorCommandQueue& m_commandQueue;
+    ConnectorBatch& m_batch;
+
+    void Execute(const ControlCommand& command, const ConnectorSnapshot& snapshot, std::string& json);
+};
@@ -0,0 +1,340 @@
+#include "ControlServer.h"
+
+#include <vector>
+#include <climits>
+#include <algorithm>
+
+#include "Log.h"
+
+#ifdef _WIN32
+#include "framework.h"
+#else
+#include <poll.h>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#endif
+
+static constexpr std::string_view REQUEST_TOO_LONG = "[{\"error\":\"request too long\"}]\n";
+static constexpr std::chrono::steady_clock::time_point NO_DEADLINE = std::chrono::steady_clock::time_point::max();
+
+// Milliseconds left until the deadline, or -1 without one
+static long long Remaining(std::chrono::steady_clock::time_point deadline) {
+    if (deadline == NO_DEADLINE)
+        return -1;
+    long long remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+    return std::clamp<long long>(remaining, 0, INT_MAX);
+}
+
+#ifdef _WIN32
+static constexpr DWORD PIPE_BUFFER_SIZE = 4096;
+
+// Waits for an overlapped operation to finish, or cancels it once the stop event is set or the deadline passed.
+static bool Complete(HANDLE pipe, OVERLAPPED& overlapped, HANDLE stopEvent, std::chrono::steady_clock::time_point deadline, DWORD& transferred) {
+    HANDLE handles[] = { overlapped.hEvent, stopEvent };
+    long long remaining = Remaining(deadline);
+    if (WaitForMultipleObjects(2, handles, FALSE, remaining < 0 ? INFINITE : static_cast<DWORD>(remaining)) != WAIT_OBJECT_0) {
+        CancelIoEx(pipe, &overlapped);
+        GetOverlappedResult(pipe, &overlapped, &transferred, TRUE);
+        return false;
+    }
+    return GetOverlappedResult(pipe, &overlapped, &transferred, FALSE) != FALSE;
+}
+
+// A descriptor whose DACL only lets the user running the app in. Without one the pipe would get the
+// default DACL, which also grants read access to everyone and anonymous logons.
+struct PipeSecurity {
+    std::vector<BYTE> user;
+    std::vector<BYTE> acl;
+    SECURITY_DESCRIPTOR descriptor;
+    SECURITY_ATTRIBUTES attributes;
+};
+
+static bool InitializePipeSecurity(PipeSecurity& security) {
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token))
+        return false;
+    DWORD size = 0;
+    GetTokenInformation(token, TokenUser, NULL, 0, &size);
+    security.user.resize(size);
+    BOOL queried = size > 0 && GetTokenInformation(token, TokenUser, security.user.data(), size, &size);
+    CloseHandle(token);
+    if (!queried)
+        return false;
+
+    PSID sid = reinterpret_cast<TOKEN_USER*>(security.user.data())->User.Sid;
+    DWORD aclSize = sizeof(ACL) + sizeof(ACCESS_ALLOWED_ACE) - sizeof(DWORD) + GetLengthSid(sid);
+    security.acl.resize(aclSize);
+    PACL acl = reinterpret_cast<PACL>(security.acl.data());
+    if (!InitializeAcl(acl, aclSize, ACL_REVISION) || !AddAccessAllowedAce(acl, ACL_REVISION, GENERIC_ALL, sid))
+        return false;
+    if (!InitializeSecurityDescriptor(&security.descriptor, SECURITY_DESCRIPTOR_REVISION) || !SetSecurityDescriptorDacl(&security.descriptor, TRUE, acl, FALSE))
+        return false;
+
+    security.attributes = SECURITY_ATTRIBUTES{ sizeof(SECURITY_ATTRIBUTES), &security.descriptor, FALSE };
+    return true;
+}
+
+ControlServer::ControlServer(Handler handler, std::chrono::milliseconds idleTimeout)
+    : m_handler(std::move(handler)), m_idleTimeout(idleTimeout), m_pipe(INVALID_HANDLE_VALUE), m_ioEvent(NULL), m_stopEvent(NULL) {}
+
+bool ControlServer::Start(const std::filesystem::path& address) {
+    if (m_thread.joinable())
+        return false;
+
+    PipeSecurity security;
+    if (!InitializePipeSecurity(security)) {
+        LOG_WARNING(L"Control pipe security could not be set up: {}", GetLastError());
+        return false;
+    }
+
+    // Remote clients are refused outright, and the DACL only lets this user in
+    m_pipe = CreateNamedPipeW(address.c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1, PIPE_BUFFER_SIZE, PIPE_BUFFER_SIZE, 0, &security.attributes);
+    m_ioEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    m_stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (m_pipe == INVALID_HANDLE_VALUE || m_ioEvent == NULL || m_stopEvent == NULL) {
+        LOG_WARNING(L"Control pipe {} could not be created: {}", address.wstring(), GetLastError());
+        Close();
+        return false;
+    }
+
+    m_address = address;
+    m_thread = std::thread(&ControlServer::Serve, this);
+    return true;
+}
+
+void ControlServer::Stop() {
+    if (!m_thread.joinable())
+        return;
+
+    SetEvent(m_stopEvent);
+    m_thread.join();
+    Close();
+}
+
+bool ControlServer::Accept() {
+    OVERLAPPED overlapped{};
+    overlapped.hEvent = m_ioEvent;
+    if (ConnectNamedPipe(m_pipe, &overlapped))
+        return true;
+
+    DWORD error = GetLastError();
+    if (error == ERROR_PIPE_CONNECTED)
+        return WaitForSingleObject(m_stopEvent, 0) != WAIT_OBJECT_0;
+    DWORD transferred = 0;
+    return error == ERROR_IO_PENDING && Complete(m_pipe, overlapped, m_stopEvent, NO_DEADLINE, transferred);
+}
+
+bool ControlServer::Receive(char* buffer, size_t size, size_t& received, std::chrono::steady_clock::time_point deadline) {
+    OVERLAPPED overlapped{};
+    overlapped.hEvent = m_ioEvent;
+    DWORD transferred = 0;
+    if (!ReadFile(m_pipe, buffer, static_cast<DWORD>(size), NULL, &overlapped) && GetLastError() != ERROR_IO_PENDING)
+        return false;
+    if (!Complete(m_pipe, overlapped, m_stopEvent, deadline, transferred) || transferred == 0)
+        return false;
+
+    received = transferred;
+    return true;
+}
+
+bool ControlServer::Send(std::string_view data, std::chrono::steady_clock::time_point deadline) {
+    while (!data.empty()) {
+        OVERLAPPED overlapped{};
+        overlapped.hEvent = m_ioEvent;
+        DWORD transferred = 0;
+        if (!WriteFile(m_pipe, data.data(), static_cast<DWORD>(data.size()), NULL, &overlapped) && GetLastError() != ERROR_IO_PENDING)
+            return false;
+        if (!Complete(m_pipe, overlapped, m_stopEvent, deadline, transferred))
+            return false;
+        data.remove_prefix(transferred);
+    }
+    return true;
+}
+
+void ControlServer::Disconnect() {
+    DisconnectNamedPipe(m_pipe);
+}
+
+void ControlServer::Close() {
+    if (m_pipe != INVALID_HANDLE_VALUE)
+        CloseHandle(m_pipe);
+    if (m_ioEvent != NULL)
+        CloseHandle(m_ioEvent);
+    if (m_stopEvent != NULL)
+        CloseHandle(m_stopEvent);
+    m_pipe = INVALID_HANDLE_VALUE;
+    m_ioEvent = NULL;
+    m_stopEvent = NULL;
+}
+#else
+// Waits until fd is ready, or returns false once the stop eventfd is written or the deadline passed.
+static bool WaitReady(int fd, short events, int stop, std::chrono::steady_clock::time_point deadline = NO_DEADLINE) {
+    pollfd fds[] = { { fd, events, 0 }, { stop, POLLIN, 0 } };
+    int ready;
+    while ((ready = poll(fds, 2, static_cast<int>(Remaining(deadline)))) < 0) {
+        if (errno != EINTR)
+            return false;
+    }
+    return ready > 0 && (fds[1].revents & POLLIN) == 0;
+}
+
+ControlServer::ControlServer(Handler handler, std::chrono::milliseconds idleTimeout)
+    : m_handler(std::move(handler)), m_idleTimeout(idleTimeout), m_listener(-1), m_client(-1), m_stop(-1) {}
+
+bool ControlServer::Start(const std::filesystem::path& address) {
+    if (m_thread.joinable())
+        return false;
+
+    sockaddr_un socketAddress{};
+    socketAddress.sun_family = AF_UNIX;
+    std::string path = address.string();
+    if (path.empty() || path.size() >= sizeof(socketAddress.sun_path))
+        return false;
+    path.copy(socketAddress.sun_path, path.size());
+
+    m_listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    m_stop = eventfd(0, EFD_CLOEXEC);
+    if (m_listener < 0 || m_stop < 0) {
+        LOG_WARNING(L"Control socket could not be created: {}", errno);
+        Close();
+        return false;
+    }
+
+    // A socket file left by a crashed run refuses connections and is replaced; a served one is kept
+    const sockaddr* socketAddressPointer = reinterpret_cast<const sockaddr*>(&socketAddress);
+    if (connect(m_listener, socketAddressPointer, sizeof(socketAddress)) == 0) {
+        LOG_WARNING(L"Control socket {} is already served", address.wstring());
+        Close();
+        return false;
+    }
+    if (errno == ECONNREFUSED)
+        unlink(path.c_str());
+
+    if (bind(m_listener, socketAddressPointer, sizeof(socketAddress)) < 0 || chmod(path.c_str(), S_IRUSR | S_IWUSR) < 0 || listen(m_listener, 4) < 0) {
+        LOG_WARNING(L"Control socket {} could not be bound: {}", address.wstring(), errno);
+        Close();
+        return false;
+    }
+
+    m_address = address;
+    m_thread = std::thread(&ControlServer::Serve, this);
+    return true;
+}
+
+void ControlServer::Stop() {
+    if (!m_thread.joinable())
+        return;
+
+    uint64_t one = 1;
+    while (write(m_stop, &one, sizeof(one)) < 0 && errno == EINTR) {}
+    m_thread.join();
+    Close();
+    unlink(m_address.c_str());
+}
+
+bool ControlServer::Accept() {
+    while (WaitReady(m_listener, POLLIN, m_stop)) {
+        m_client = accept4(m_listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (m_client < 0)
+            continue;
+
+        // The socket file is private already; this also keeps out anyone it was passed to
+        ucred credentials{};
+        socklen_t length = sizeof(credentials);
+        if (getsockopt(m_client, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0 && credentials.uid == geteuid())
+            return true;
+        Disconnect();
+    }
+    return false;
+}
+
+bool ControlServer::Receive(char* buffer, size_t size, size_t& received, std::chrono::steady_clock::time_point deadline) {
+    if (!WaitReady(m_client, POLLIN, m_stop, deadline))
+        return false;
+
+    ssize_t count;
+    while ((count = recv(m_client, buffer, size, 0)) < 0 && errno == EINTR) {}
+    if (count <= 0)
+        return false;
+
+    received = static_cast<size_t>(count);
+    return true;
+}
+
+bool ControlServer::Send(std::string_view data, std::chrono::steady_clock::time_point deadline) {
+    while (!data.empty()) {
+        if (!WaitReady(m_client, POLLOUT, m_stop, deadline))
+            return false;
+
+        ssize_t count = send(m_client, data.data(), data.size(), MSG_NOSIGNAL);
+        if (count < 0 && errno != EINTR)
+            return false;
+        if (count > 0)
+            data.remove_prefix(static_cast<size_t>(count));
+    }
+    return true;
+}
+
+void ControlServer::Disconnect() {
+    close(m_client);
+    m_client = -1;
+}
+
+void ControlServer::Close() {
+    if (m_listener >= 0)
+        close(m_listener);
+    if (m_stop >= 0)
+        close(m_stop);
+    m_listener = -1;
+    m_stop = -1;
+}
+#endif
+
+ControlServer::~ControlServer() {
+    Stop();
+}
+
+void ControlServer::Serve() {
+    while (Accept()) {
+        ServeClient();
+        Disconnect();
+    }
+}
+
+void ControlServer::ServeClient() {
+    std::string pending;
+    char buffer[4096];
+    size_t received = 0;
+    // Renewed by every request, and given to the response too
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + m_idleTimeout;
+    while (Receive(buffer, sizeof(buffer), received, deadline)) {
+        pending.append(buffer, received);
+
+        size_t start = 0;
+        for (size_t end = pending.find('\n'); end != std::string::npos; end = pending.find('\n', start)) {
+            std::string_view request(pending.data() + start, end - start);
+            if (!request.empty() && request.back() == '\r')
+                request.remove_suffix(1);
+            if (request.size() > MAX_REQUEST_LENGTH) {
+                Send(REQUEST_TOO_LONG, deadline);
+                return;
+            }
+            std::string response = m_handler(request);
+            deadline = std::chrono::steady_clock::now() + m_idleTimeout;
+            if (!Send(response, deadline))
+                return;
+            start = end + 1;
+        }
+        pending.erase(0, start);
+
+        if (pending.size() > MAX_REQUEST_LENGTH) {
+            Send(REQUEST_TOO_LONG, deadline);
+            return;
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <string>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <filesystem>
+#include <string_view>
+
+// Serves line-based requests to local clients: a named pipe on Windows, a Unix domain socket
+// elsewhere so the server loop can run off Windows too. One client is served at a time, and each
+// response is written before the next line is read. A client that sends nothing or stops reading
+// for the idle timeout is dropped, so it can't keep the others out.
+class ControlServer {
+public:
+    // Gets a request line without its line break and returns the whole response, line break included
+    using Handler = std::function<std::string(std::string_view request)>;
+
+    // A client sending a longer line gets an error and is dropped
+    static constexpr size_t MAX_REQUEST_LENGTH = 64 * 1024;
+    static constexpr std::chrono::milliseconds IDLE_TIMEOUT{ 5000 };
+
+    explicit ControlServer(Handler handler, std::chrono::milliseconds idleTimeout = IDLE_TIMEOUT);
+    ~ControlServer();
+
+    ControlServer(const ControlServer&) = delete;
+    ControlServer& operator=(const ControlServer&) = delete;
+
+    // A pipe name like \\.\pipe\ToothTray on Windows, a socket path elsewhere. False when the address
+    // is taken, so another process can't pose as the server.
+    bool Start(const std::filesystem::path& address);
+    // Drops the connected client, if any, and joins the server thread.
+    void Stop();
+private:
+    Handler m_handler;
+    std::chrono::milliseconds m_idleTimeout;
+    std::filesystem::path m_address;
+    std::thread m_thread;
+#ifdef _WIN32
+    // The single pipe instance clients connect to in turn; I/O is overlapped so Stop can cancel it
+    void* m_pipe;
+    void* m_ioEvent;
+    void* m_stopEvent;
+#else
+    int m_listener;
+    int m_client;
+    // An eventfd, written by Stop
+    int m_stop;
+#endif
+
+    void Serve();
+    void ServeClient();
+
+    // Blocking, but return false once Stop is called or the deadline passed
+    bool Accept();
+    bool Receive(char* buffer, size_t size, size_t& received, std::chrono::steady_clock::time_point deadline);
+    bool Send(std::string_view data, std::chrono::steady_clock::time_point deadline);
+    void Disconnect();
+    void Close();
+};
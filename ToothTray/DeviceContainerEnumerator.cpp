@@ -1,24 +1,99 @@
-#include "DeviceContainerEnumerator.h"
-
-#include <winrt\Windows.Foundation.Collections.h>
-#include <combaseapi.h>
-
-static GUID from_id(winrt::hstring id) {
-	GUID guid;
-	HRESULT hr = CLSIDFromString(id.c_str(), &guid);
-	DebugLogHresult(hr);
-	return guid;
-}
-
-std::unordered_map<GUID, std::wstring, GUIDHasher, GUIDEqualityComparer> DeviceContainerEnumerator::EnumerateContainers() {
-	std::unordered_map<GUID, std::wstring, GUIDHasher, GUIDEqualityComparer> containers;
-
-	winrt::Windows::Devices::Enumeration::DeviceInformationCollection collection =
-		winrt::Windows::Devices::Enumeration::DeviceInformation::FindAllAsync(winrt::hstring(), nullptr, winrt::Windows::Devices::Enumeration::DeviceInformationKind::DeviceContainer).get();
-
-	for (winrt::Windows::Devices::Enumeration::DeviceInformation info : collection) {
-		containers.insert_or_assign(from_id(info.Id()), std::wstring(info.Name().c_str()));
-	}
-
-	return containers;
-}
+#include "DeviceContainerEnumerator.h"
+
+#include <winrt\Windows.Foundation.Collections.h>
+#include <combaseapi.h>
+#include <cwchar>
+#include <cstring>
+
+#include "Trace.h"
+
+static GUID from_id(winrt::hstring id) {
+	GUID guid;
+	HRESULT hr = CLSIDFromString(id.c_str(), &guid);
+	DebugLogHresult(hr);
+	return guid;
+}
+
+static winrt::hstring to_id(const GUID& guid) {
+	WCHAR id[39];
+	StringFromGUID2(guid, id, ARRAYSIZE(id));
+	return winrt::hstring(id);
+}
+
+std::optional<std::wstring> DeviceContainerEnumerator::ResolveContainerName(const GUID& containerId) {
+	TRACE_SPAN("ResolveContainerName");
+	try {
+		winrt::Windows::Devices::Enumeration::DeviceInformation info =
+			winrt::Windows::Devices::Enumeration::DeviceInformation::CreateFromIdAsync(to_id(containerId), {}, winrt::Windows::Devices::Enumeration::DeviceInformationKind::DeviceContainer).get();
+		return std::wstring(info.Name().c_str());
+	}
+	catch (const winrt::hresult_error& error) {
+		LOG_WARNING(L"Failed to resolve container {}: {}", containerId, error.code().value);
+		return std::nullopt;
+	}
+}
+
+std::optional<GUID> DeviceContainerEnumerator::FindBluetoothContainer(uint64_t address) {
+	TRACE_SPAN("FindBluetoothContainer");
+	// The association endpoint of a classic bluetooth device, by its address
+	wchar_t selector[160];
+	std::swprintf(selector, ARRAYSIZE(selector),
+		L"System.Devices.Aep.ProtocolId:=\"{e0cbf06c-cd8b-4647-bb8a-263b43f0f974}\" AND System.Devices.Aep.DeviceAddress:=\"%02llx:%02llx:%02llx:%02llx:%02llx:%02llx\"",
+		(address >> 40) & 0xff, (address >> 32) & 0xff, (address >> 24) & 0xff, (address >> 16) & 0xff, (address >> 8) & 0xff, address & 0xff);
+	try {
+		winrt::Windows::Devices::Enumeration::DeviceInformationCollection devices =
+			winrt::Windows::Devices::Enumeration::DeviceInformation::FindAllAsync(selector, { L"System.Devices.Aep.ContainerId" }, winrt::Windows::Devices::Enumeration::DeviceInformationKind::AssociationEndpoint).get();
+		for (const winrt::Windows::Devices::Enumeration::DeviceInformation& device : devices) {
+			std::optional<winrt::guid> containerId = device.Properties().TryLookup(L"System.Devices.Aep.ContainerId").try_as<winrt::guid>();
+			if (!containerId.has_value())
+				continue;
+			GUID guid;
+			std::memcpy(&guid, &*containerId, sizeof(guid));
+			return guid;
+		}
+	}
+	catch (const winrt::hresult_error& error) {
+		LOG_WARNING(L"Failed to find the container of {}: {}", address, error.code().value);
+	}
+	return std::nullopt;
+}
+
+void DeviceContainerEnumerator::SetListener(IContainerListener* listener) {
+	m_listener = listener;
+
+	if (listener == nullptr) {
+		if (m_watcher != nullptr) {
+			m_watcher.Stop();
+			m_containerAddedRevoker.revoke();
+			m_containerUpdatedRevoker.revoke();
+			m_containerRemovedRevoker.revoke();
+			m_watcher = nullptr;
+		}
+		return;
+	}
+
+	if (m_watcher != nullptr)
+		return;
+
+	// The watcher goes through all containers once when started, but that's in the background instead of on every lookup.
+	m_watcher = winrt::Windows::Devices::Enumeration::DeviceInformation::CreateWatcher(winrt::hstring(), nullptr, winrt::Windows::Devices::Enumeration::DeviceInformationKind::DeviceContainer);
+	// Updated and Removed are only raised when Added has a handler
+	m_containerAddedRevoker = m_watcher.Added(winrt::auto_revoke, [](auto&&, auto&&) {});
+	m_containerUpdatedRevoker = m_watcher.Updated(winrt::auto_revoke, { this, &DeviceContainerEnumerator::ContainerUpdated });
+	m_containerRemovedRevoker = m_watcher.Removed(winrt::auto_revoke, { this, &DeviceContainerEnumerator::ContainerRemoved });
+	m_watcher.Start();
+}
+
+void DeviceContainerEnumerator::ContainerUpdated(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Devices::Enumeration::DeviceInformationUpdate update) {
+	// Only a rename affects the cached names
+	if (update.Properties().HasKey(L"System.ItemNameDisplay"))
+		ContainerRemoved(watcher, update);
+}
+
+void DeviceContainerEnumerator::ContainerRemoved(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Devices::Enumeration::DeviceInformationUpdate update) {
+	UNREFERENCED_PARAMETER(watcher);
+
+	IContainerListener* listener = m_listener;
+	if (listener != nullptr)
+		listener->OnContainerChanged(from_id(update.Id()));
+}
@@ -1,23 +1,26 @@
-#pragma once
-
-#include <winrt\Windows.Devices.Enumeration.h>
-#include <unordered_map>
-
-#include "debuglog.h"
-
-struct GUIDEqualityComparer {
-	bool operator()(const GUID& guid1, const GUID& guid2) const {
-		return std::memcmp(&guid1, &guid2, sizeof(GUID)) == 0;
-	}
-};
-
-struct GUIDHasher {
-	UINT operator()(const GUID& guid) const {
-		return guid.Data1 ^ ((guid.Data2 << 16) | guid.Data3) ^ (*(UINT*)guid.Data4) ^ (*(UINT*)(guid.Data4 + 4));
-	}
-};
-
-class DeviceContainerEnumerator {
-public:
-	static std::unordered_map<GUID, std::wstring, GUIDHasher, GUIDEqualityComparer> EnumerateContainers();
-};
\ No newline at end of file
+#pragma once
+
+#include <winrt\Windows.Devices.Enumeration.h>
+#include <atomic>
+#include <cstdint>
+
+#include "ContainerNameIndex.h"
+#include "debuglog.h"
+
+class DeviceContainerEnumerator : public IContainerSource {
+public:
+	std::optional<std::wstring> ResolveContainerName(const GUID& containerId) override;
+	void SetListener(IContainerListener* listener) override;
+
+	// The container of the paired bluetooth device with the address. Blocks until the system answers.
+	std::optional<GUID> FindBluetoothContainer(uint64_t address);
+private:
+	winrt::Windows::Devices::Enumeration::DeviceWatcher m_watcher{ nullptr };
+	winrt::Windows::Devices::Enumeration::DeviceWatcher::Added_revoker m_containerAddedRevoker;
+	winrt::Windows::Devices::Enumeration::DeviceWatcher::Updated_revoker m_containerUpdatedRevoker;
+	winrt::Windows::Devices::Enumeration::DeviceWatcher::Removed_revoker m_containerRemovedRevoker;
+	std::atomic<IContainerListener*> m_listener = nullptr;
+
+	void ContainerUpdated(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Devices::Enumeration::DeviceInformationUpdate update);
+	void ContainerRemoved(winrt::Windows::Devices::Enumeration::DeviceWatcher watcher, winrt::Windows::Devices::Enumeration::DeviceInformationUpdate update);
+};
@@ -0,0 +1,47 @@
+#include "DeviceDiscovery.h"
+
+#include <algorithm>
+
+// An empty name or class means the pass didn't learn it, so only the others replace what's known.
+// The flags are always taken from the latest pass.
+static bool Merge(DiscoveredDevice& known, const DiscoveredDevice& device) {
+    bool changed = false;
+    if (!device.name.empty() && device.name != known.name) {
+        known.name = device.name;
+        changed = true;
+    }
+    if (device.classOfDevice != 0 && device.classOfDevice != known.classOfDevice) {
+        known.classOfDevice = device.classOfDevice;
+        changed = true;
+    }
+    if (device.connected != known.connected || device.remembered != known.remembered || device.authenticated != known.authenticated) {
+        known.connected = device.connected;
+        known.remembered = device.remembered;
+        known.authenticated = device.authenticated;
+        changed = true;
+    }
+    return changed;
+}
+
+bool DiscoverySession::Report(const DiscoveredDevice& device) {
+    if (m_stopped)
+        return false;
+
+    auto [ite, inserted] = m_reported.try_emplace(device.address, device);
+    if (!inserted && !Merge(ite->second, device))
+        return true;
+
+    if (m_callback(ite->second) == DiscoveryControl::Stop)
+        m_stopped = true;
+    return !m_stopped;
+}
+
+std::optional<std::chrono::seconds> DiscoverySession::NextInquiry() {
+    if (m_stopped || m_remaining.count() <= 0)
+        return std::nullopt;
+
+    std::chrono::seconds inquiry = std::min(m_nextInquiry, m_remaining);
+    m_remaining -= inquiry;
+    m_nextInquiry *= 2;
+    return inquiry;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <functional>
+#include <unordered_map>
+
+struct DiscoveredDevice {
+    uint64_t address;
+    std::wstring name;
+    uint32_t classOfDevice;
+    bool connected;
+    bool remembered;
+    bool authenticated;
+};
+
+enum class DiscoveryControl {
+    Continue,
+    Stop,
+};
+
+// Called for every device as soon as it's found. Returning Stop ends the discovery.
+using DiscoveryCallback = std::function<DiscoveryControl(const DiscoveredDevice&)>;
+
+// Stops the discovery at the first device matching every given field.
+struct DiscoveryTarget {
+    std::optional<uint64_t> address;
+    std::optional<std::wstring> name;
+
+    bool Matches(const DiscoveredDevice& device) const {
+        return (!address.has_value() || *address == device.address) && (!name.has_value() || *name == device.name);
+    }
+};
+
+// Windows only reports inquiry results once the whole inquiry is over, so instead of one long
+// inquiry the discovery first reports the devices the stack already knows, then runs inquiries that
+// start short and double in length until the timeout is used up. A device in range shows up after
+// the first short inquiry, and the caller can stop as soon as it has what it's looking for.
+class DiscoverySession {
+public:
+    DiscoverySession(DiscoveryCallback callback, std::chrono::seconds timeout, std::chrono::seconds firstInquiry = std::chrono::seconds(2))
+        : m_callback(std::move(callback)), m_remaining(timeout), m_nextInquiry(firstInquiry), m_stopped(false) {}
+
+    // Passes the device to the callback the first time it's found. When a later pass reports it again,
+    // the new fields are merged into what's known and the callback only gets the merged device if that
+    // changed, e.g. when an inquiry found the name a cached result didn't have.
+    // False once the callback asked to stop.
+    bool Report(const DiscoveredDevice& device);
+
+    bool Stopped() const {
+        return m_stopped;
+    }
+
+    // The length of the next inquiry, empty when stopped or out of time.
+    std::optional<std::chrono::seconds> NextInquiry();
+private:
+    DiscoveryCallback m_callback;
+    std::chrono::seconds m_remaining;
+    std::chrono::seconds m_nextInquiry;
+    std::unordered_map<uint64_t, DiscoveredDevice> m_reported;
+    bool m_stopped;
+};
@@ -0,0 +1,86 @@
+#include "DeviceEventScheduler.h"
+
+#include <algorithm>
+
+DeviceEventScheduler::DeviceEventScheduler(const DeviceEventSchedulerOptions& options, FireCallback fire, TimePoint now)
+    : m_options(options), m_fire(std::move(fire)), m_origin(now), m_currentTick(0), m_wheel(WHEEL_SLOTS) {
+    m_options.tick = std::max(m_options.tick, std::chrono::milliseconds(1));
+}
+
+uint64_t DeviceEventScheduler::TickOf(TimePoint time) const {
+    if (time <= m_origin)
+        return 0;
+    return static_cast<uint64_t>((time - m_origin) / m_options.tick);
+}
+
+uint64_t DeviceEventScheduler::Ticks(std::chrono::milliseconds duration) const {
+    // Rounded up, so nothing fires before its window is over
+    return static_cast<uint64_t>((duration + m_options.tick - std::chrono::milliseconds(1)) / m_options.tick);
+}
+
+void DeviceEventScheduler::Post(uint64_t device, uint32_t classes, TimePoint now) {
+    // Rounded up like the durations, so nothing fires before its window is over. The window counts
+    // from the post even when that tick was processed already; only the due tick has to lie ahead.
+    uint64_t tick = TickOf(now);
+    if (now > m_origin + tick * m_options.tick)
+        ++tick;
+    auto [ite, inserted] = m_pending.try_emplace(device, Pending{ 0, tick, 0 });
+    Pending& pending = ite->second;
+    pending.classes |= classes;
+
+    uint64_t dueTick = std::min(tick + Ticks(m_options.window), pending.firstTick + Ticks(m_options.maxDelay));
+    dueTick = std::max(dueTick, m_currentTick);
+    if (inserted) {
+        pending.dueTick = dueTick;
+        m_wheel[dueTick % WHEEL_SLOTS].push_back(device);
+    }
+    else {
+        // Only ever later; the entry moves when its current slot comes up
+        pending.dueTick = std::max(pending.dueTick, dueTick);
+    }
+}
+
+void DeviceEventScheduler::Advance(TimePoint now) {
+    uint64_t nowTick = TickOf(now);
+    DeviceEventBatch batch{ {}, 0 };
+
+    // Past a full turn of the wheel, every slot gets visited once and is enough
+    uint64_t firstTick = m_currentTick;
+    if (nowTick >= firstTick + WHEEL_SLOTS)
+        firstTick = nowTick + 1 - WHEEL_SLOTS;
+
+    for (uint64_t tick = firstTick; tick <= nowTick && !m_pending.empty(); ++tick) {
+        std::vector<uint64_t>& slot = m_wheel[tick % WHEEL_SLOTS];
+        std::vector<uint64_t> devices;
+        devices.swap(slot);
+        for (uint64_t device : devices) {
+            std::unordered_map<uint64_t, Pending>::iterator ite = m_pending.find(device);
+            if (ite == m_pending.end())
+                continue;
+
+            if (ite->second.dueTick > nowTick) {
+                m_wheel[ite->second.dueTick % WHEEL_SLOTS].push_back(device);
+                continue;
+            }
+            batch.changes.push_back(DeviceEventChange{ device, ite->second.classes });
+            batch.classes |= ite->second.classes;
+            m_pending.erase(ite);
+        }
+    }
+    m_currentTick = std::max(m_currentTick, nowTick + 1);
+
+    if (batch.changes.empty())
+        return;
+    // Independent of the order the wheel was visited in
+    std::sort(batch.changes.begin(), batch.changes.end(), [](const DeviceEventChange& a, const DeviceEventChange& b) { return a.device < b.device; });
+    m_fire(batch);
+}
+
+std::optional<DeviceEventScheduler::TimePoint> DeviceEventScheduler::NextDeadline() const {
+    std::optional<uint64_t> dueTick;
+    for (const std::pair<const uint64_t, Pending>& pending : m_pending)
+        dueTick = std::min(dueTick.value_or(UINT64_MAX), pending.second.dueTick);
+    if (!dueTick.has_value())
+        return std::nullopt;
+    return m_origin + *dueTick * m_options.tick;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <functional>
+#include <unordered_map>
+
+enum DeviceEventClass : uint32_t {
+    // DBT_DEVNODES_CHANGED, which doesn't say which device
+    DEVICE_EVENT_NODES_CHANGED = 1 << 0,
+    DEVICE_EVENT_ARRIVAL = 1 << 1,
+    DEVICE_EVENT_REMOVAL = 1 << 2,
+    // HCI and L2CAP connection events
+    DEVICE_EVENT_CONNECTION = 1 << 3,
+    DEVICE_EVENT_RANGE = 1 << 4,
+};
+
+// Events that aren't about a particular device are posted for this address
+constexpr uint64_t DEVICE_EVENT_ANY_DEVICE = 0;
+
+struct DeviceEventChange {
+    uint64_t device;
+    // The union of the DeviceEventClass flags posted for the device
+    uint32_t classes;
+};
+
+struct DeviceEventBatch {
+    std::vector<DeviceEventChange> changes;
+    uint32_t classes;
+};
+
+struct DeviceEventSchedulerOptions {
+    // A device's events are collected until it has been quiet this long
+    std::chrono::milliseconds window{ 250 };
+    // but no longer than this after its first event, so a steady stream still fires
+    std::chrono::milliseconds maxDelay{ 1000 };
+    // The resolution of the timer wheel
+    std::chrono::milliseconds tick{ 10 };
+};
+
+// Collapses bursts of device events into one batch per quiet period. Time only moves when the caller
+// passes it in, so the same sequence of calls always fires the same batches.
+// Pending devices sit in a timer wheel; a device whose deadline moved is put back when its old slot
+// comes up, so posting is O(1). Not thread-safe.
+class DeviceEventScheduler {
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+    using FireCallback = std::function<void(const DeviceEventBatch&)>;
+
+    static constexpr size_t WHEEL_SLOTS = 256;
+
+    DeviceEventScheduler(const DeviceEventSchedulerOptions& options, FireCallback fire, TimePoint now);
+
+    void Post(uint64_t device, uint32_t classes, TimePoint now);
+
+    // Fires one batch with every device that is due by now.
+    void Advance(TimePoint now);
+
+    // When Advance has to be called next, empty when nothing is pending.
+    std::optional<TimePoint> NextDeadline() const;
+
+    size_t PendingCount() const {
+        return m_pending.size();
+    }
+private:
+    struct Pending {
+        uint32_t classes;
+        uint64_t firstTick;
+        uint64_t dueTick;
+    };
+
+    DeviceEventSchedulerOptions m_options;
+    FireCallback m_fire;
+    TimePoint m_origin;
+    // Every tick before this one has been processed
+    uint64_t m_currentTick;
+    std::vector<std::vector<uint64_t>> m_wheel;
+    std::unordered_map<uint64_t, Pending> m_pending;
+
+    uint64_t TickOf(TimePoint time) const;
+    uint64_t Ticks(std::chrono::milliseconds duration) const;
+};
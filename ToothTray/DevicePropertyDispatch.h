@@ -0,0 +1,84 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+
+// FNV-1a over the length and the last few code units, mixed with a seed so the table can look for one
+// without collisions. Property names share long prefixes like "System.Devices.Aep.", so the end is
+// what tells them apart, and the compare after the lookup checks the rest.
+constexpr uint32_t DevicePropertyHash(std::wstring_view name, uint32_t seed) {
+    constexpr size_t HASHED_SUFFIX = 8;
+    uint32_t hash = (2166136261u ^ seed ^ static_cast<uint32_t>(name.size())) * 16777619u;
+    for (size_t i = name.size() - std::min(name.size(), HASHED_SUFFIX); i < name.size(); ++i) {
+        hash ^= static_cast<uint16_t>(name[i]);
+        hash *= 16777619u;
+    }
+    // The low bits pick the slot, and without this they'd only depend on the low bits of the input
+    return hash ^ (hash >> 16);
+}
+
+template <typename Target, typename Value>
+struct DevicePropertyHandler {
+    std::wstring_view name;
+    // Decodes the value and writes it to the target if it differs, returns whether it did.
+    bool (*apply)(Target& target, const Value& value);
+};
+
+// Maps property names to their handlers with a perfect hash that is found at compile time: every
+// name has a slot of its own, so a lookup is one hash and one string compare however many
+// properties are handled. Names without a handler are rejected by the compare.
+template <typename Target, typename Value, size_t N>
+class DevicePropertyDispatch {
+public:
+    using Handler = DevicePropertyHandler<Target, Value>;
+
+    static constexpr size_t SLOTS = std::bit_ceil(N * 2);
+
+    consteval DevicePropertyDispatch(const std::array<Handler, N>& handlers) : m_handlers(handlers), m_seed(0), m_slots{} {
+        static_assert(N < EMPTY, "A slot holds the handler index in a byte");
+        for (uint32_t seed = 0; seed < MAX_SEED; ++seed) {
+            if (TryPlace(seed))
+                return;
+        }
+        // Not a constant expression, so the build fails when no seed works
+        throw "no collision-free seed for the property names";
+    }
+
+    const Handler* Find(std::wstring_view name) const {
+        uint8_t index = m_slots[DevicePropertyHash(name, m_seed) & (SLOTS - 1)];
+        if (index == EMPTY || m_handlers[index].name != name)
+            return nullptr;
+        return &m_handlers[index];
+    }
+
+    // Returns whether the property is handled and changed the target.
+    bool Apply(Target& target, std::wstring_view name, const Value& value) const {
+        const Handler* handler = Find(name);
+        return handler != nullptr && handler->apply(target, value);
+    }
+
+    const std::array<Handler, N>& Handlers() const {
+        return m_handlers;
+    }
+private:
+    static constexpr uint8_t EMPTY = 0xff;
+    static constexpr uint32_t MAX_SEED = 1 << 16;
+
+    std::array<Handler, N> m_handlers;
+    uint32_t m_seed;
+    std::array<uint8_t, SLOTS> m_slots;
+
+    constexpr bool TryPlace(uint32_t seed) {
+        m_slots.fill(EMPTY);
+        for (size_t i = 0; i < N; ++i) {
+            uint8_t& slot = m_slots[DevicePropertyHash(m_handlers[i].name, seed) & (SLOTS - 1)];
+            if (slot != EMPTY)
+                return false;
+            slot = static_cast<uint8_t>(i);
+        }
+        m_seed = seed;
+        return true;
+    }
+};
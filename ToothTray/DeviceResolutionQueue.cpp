@@ -0,0 +1,128 @@
+#include "DeviceResolutionQueue.h"
+
+#include <algorithm>
+
+#include "Log.h"
+
+DeviceResolutionQueue::~DeviceResolutionQueue() {
+    Stop();
+}
+
+bool DeviceResolutionQueue::Enqueue(const std::wstring& id) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_stopped)
+        return false;
+
+    std::unordered_map<std::wstring, Job>::iterator ite = m_jobs.find(id);
+    if (ite != m_jobs.end()) {
+        // Added back while its earlier resolve is still running, which can deliver it after all
+        if (ite->second.state == JobState::Cancelled)
+            ite->second.state = JobState::Resolving;
+        return false;
+    }
+
+    m_jobs.emplace(id, Job{ JobState::Queued, std::chrono::steady_clock::now(), {} });
+    m_queue.push_back(id);
+    ++m_queued;
+    m_peakQueued = std::max(m_peakQueued, m_queued);
+
+    Pump(lock);
+    return true;
+}
+
+void DeviceResolutionQueue::Cancel(const std::wstring& id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::unordered_map<std::wstring, Job>::iterator ite = m_jobs.find(id);
+    if (ite == m_jobs.end())
+        return;
+
+    if (ite->second.state == JobState::Queued) {
+        // Its entry in m_queue is skipped when it comes up
+        m_jobs.erase(ite);
+        --m_queued;
+        if (m_jobs.empty())
+            m_idle.notify_all();
+    }
+    else {
+        ite->second.state = JobState::Cancelled;
+    }
+}
+
+void DeviceResolutionQueue::Stop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_stopped = true;
+    for (std::unordered_map<std::wstring, Job>::iterator ite = m_jobs.begin(); ite != m_jobs.end();) {
+        if (ite->second.state == JobState::Queued)
+            ite = m_jobs.erase(ite);
+        else
+            ++ite;
+    }
+    m_queue.clear();
+    m_queued = 0;
+
+    m_idle.wait(lock, [this] { return m_inFlight == 0 && !m_pumping; });
+}
+
+void DeviceResolutionQueue::WaitIdle() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_jobs.empty() && m_inFlight == 0 && !m_pumping; });
+}
+
+DeviceResolutionMetrics DeviceResolutionQueue::Metrics() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return DeviceResolutionMetrics{ m_queued, m_peakQueued, m_inFlight, m_resolvedCount, m_failedCount, m_waitLatency, m_resolveLatency };
+}
+
+void DeviceResolutionQueue::Pump(std::unique_lock<std::mutex>& lock) {
+    if (m_pumping)
+        return;
+
+    // Whoever is already pumping sees the freed slot before it stops
+    m_pumping = true;
+    while (!m_stopped && m_inFlight < m_maxInFlight && !m_queue.empty()) {
+        std::wstring id = std::move(m_queue.front());
+        m_queue.pop_front();
+        std::unordered_map<std::wstring, Job>::iterator ite = m_jobs.find(id);
+        if (ite == m_jobs.end() || ite->second.state != JobState::Queued)
+            continue;
+
+        Job& job = ite->second;
+        job.state = JobState::Resolving;
+        job.started = std::chrono::steady_clock::now();
+        m_waitLatency.Add(job.started - job.enqueued);
+        --m_queued;
+        ++m_inFlight;
+
+        lock.unlock();
+        m_resolver.ResolveAsync(id, [this, id](std::optional<ResolvedDevice> device) { Completed(id, device); });
+        lock.lock();
+    }
+    m_pumping = false;
+    m_idle.notify_all();
+}
+
+void DeviceResolutionQueue::Completed(const std::wstring& id, const std::optional<ResolvedDevice>& device) {
+    bool deliver;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Job& job = m_jobs.at(id);
+        std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - job.started;
+        m_resolveLatency.Add(elapsed);
+        ++(device.has_value() ? m_resolvedCount : m_failedCount);
+        deliver = job.state == JobState::Resolving && !m_stopped;
+
+        LOG_DEBUG(L"Resolved device {}: found={}, {}us, queued={}, in flight={}", id, device.has_value(),
+            std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count(), m_queued, m_inFlight);
+    }
+
+    // Still counted as in flight, so Stop and WaitIdle wait for the result to be written
+    if (deliver && m_resolved)
+        m_resolved(id, device);
+
+    // Nothing is touched once the lock is released, Stop may be waiting to destroy the queue
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_jobs.erase(id);
+    --m_inFlight;
+    Pump(lock);
+    m_idle.notify_all();
+}
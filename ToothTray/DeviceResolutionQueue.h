@@ -0,0 +1,107 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <optional>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "LatencyStats.h"
+
+// What resolving a device id to the device object adds to the watcher's information.
+struct ResolvedDevice {
+    uint64_t address;
+    uint32_t classOfDevice;
+    bool connected;
+};
+
+// Starts resolving a device and calls completed once, on any thread and possibly before returning.
+// An empty result means the device couldn't be resolved.
+class IDeviceResolver {
+public:
+    using Completion = std::function<void(std::optional<ResolvedDevice>)>;
+
+    virtual ~IDeviceResolver() = default;
+    virtual void ResolveAsync(const std::wstring& id, Completion completed) = 0;
+};
+
+struct DeviceResolutionMetrics {
+    size_t queued;
+    size_t peakQueued;
+    size_t inFlight;
+    size_t resolved;
+    size_t failed;
+    // From enqueuing to the resolve starting, and from starting to its completion
+    LatencyStats waitLatency;
+    LatencyStats resolveLatency;
+};
+
+// Resolves added devices without blocking the thread they were added on. At most maxInFlight
+// resolves run at once and the rest wait in order. A device that is queued or resolving again is
+// only resolved once, and results for devices cancelled in the meantime are dropped.
+class DeviceResolutionQueue {
+public:
+    // Called on the thread the resolve completed on.
+    using ResolvedCallback = std::function<void(const std::wstring& id, const std::optional<ResolvedDevice>& device)>;
+
+    DeviceResolutionQueue(IDeviceResolver& resolver, size_t maxInFlight, ResolvedCallback resolved)
+        : m_resolver(resolver), m_maxInFlight(maxInFlight == 0 ? 1 : maxInFlight), m_resolved(std::move(resolved)) {}
+    ~DeviceResolutionQueue();
+
+    DeviceResolutionQueue(const DeviceResolutionQueue&) = delete;
+    DeviceResolutionQueue& operator=(const DeviceResolutionQueue&) = delete;
+
+    // Returns false when the device is already queued or resolving.
+    bool Enqueue(const std::wstring& id);
+    // Drops the device from the queue, or discards its result when it's resolving.
+    void Cancel(const std::wstring& id);
+
+    // Drops everything queued and waits for the resolves that are running.
+    void Stop();
+    // Waits until nothing is queued or resolving.
+    void WaitIdle();
+
+    DeviceResolutionMetrics Metrics();
+private:
+    enum class JobState {
+        Queued,
+        Resolving,
+        // Cancelled while resolving, the result is dropped
+        Cancelled,
+    };
+
+    struct Job {
+        JobState state;
+        std::chrono::steady_clock::time_point enqueued;
+        std::chrono::steady_clock::time_point started;
+    };
+
+    IDeviceResolver& m_resolver;
+    size_t m_maxInFlight;
+    ResolvedCallback m_resolved;
+
+    std::mutex m_mutex;
+    std::condition_variable m_idle;
+    std::unordered_map<std::wstring, Job> m_jobs;
+    std::deque<std::wstring> m_queue;
+    // Jobs waiting to start; m_queue can also hold ids that were cancelled
+    size_t m_queued = 0;
+    size_t m_inFlight = 0;
+    // Set while a thread is starting resolves, so completions that run inline don't recurse.
+    // The thread uses the queue without the lock meanwhile, so Stop waits for it too.
+    bool m_pumping = false;
+    bool m_stopped = false;
+
+    size_t m_peakQueued = 0;
+    size_t m_resolvedCount = 0;
+    size_t m_failedCount = 0;
+    LatencyStats m_waitLatency;
+    LatencyStats m_resolveLatency;
+
+    // Called and returns with the lock held.
+    void Pump(std::unique_lock<std::mutex>& lock);
+    void Completed(const std::wstring& id, const std::optional<ResolvedDevice>& device);
+};
@@ -0,0 +1,77 @@
+#pragma once
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+
+#include "SnapshotPublisher.h"
+
+// Device state that is written from several threads and read as a whole from others.
+// Every write publishes a new immutable map, so a reader takes a consistent snapshot with one atomic
+// load and keeps it for as long as it likes; writers only wait for each other. Values are shared
+// between snapshots and copied only when written, so a write costs a copy of the pointers.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class DeviceStateStore {
+public:
+    using Map = std::unordered_map<Key, std::shared_ptr<const Value>, Hash>;
+
+    DeviceStateStore() = default;
+
+    DeviceStateStore(const DeviceStateStore&) = delete;
+    DeviceStateStore& operator=(const DeviceStateStore&) = delete;
+
+    std::shared_ptr<const Snapshot<Map>> Current() const {
+        return m_publisher.Current();
+    }
+
+    std::shared_ptr<const Value> Find(const Key& key) const {
+        std::shared_ptr<const Snapshot<Map>> snapshot = m_publisher.Current();
+        typename Map::const_iterator ite = snapshot->value.find(key);
+        return ite == snapshot->value.cend() ? nullptr : ite->second;
+    }
+
+    // Adds the value or replaces the one stored for the key.
+    void Put(const Key& key, Value value) {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        Map map = m_publisher.Current()->value;
+        map.insert_or_assign(key, std::make_shared<const Value>(std::move(value)));
+        m_publisher.Publish(std::move(map));
+    }
+
+    // Calls update with a copy of the stored value and publishes it if update returns true.
+    // Returns false when nothing is stored for the key, and leaves the store as it was.
+    bool Update(const Key& key, const std::function<bool(Value&)>& update) {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        std::shared_ptr<const Snapshot<Map>> current = m_publisher.Current();
+        typename Map::const_iterator ite = current->value.find(key);
+        if (ite == current->value.cend())
+            return false;
+
+        Value value = *ite->second;
+        if (!update(value))
+            return true;
+
+        Map map = current->value;
+        map.insert_or_assign(key, std::make_shared<const Value>(std::move(value)));
+        m_publisher.Publish(std::move(map));
+        return true;
+    }
+
+    // Returns the value that was removed, empty when nothing was stored for the key.
+    std::shared_ptr<const Value> Remove(const Key& key) {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        std::shared_ptr<const Snapshot<Map>> current = m_publisher.Current();
+        typename Map::const_iterator ite = current->value.find(key);
+        if (ite == current->value.cend())
+            return nullptr;
+
+        std::shared_ptr<const Value> removed = ite->second;
+        Map map = current->value;
+        map.erase(key);
+        m_publisher.Publish(std::move(map));
+        return removed;
+    }
+private:
+    std::mutex m_writeMutex;
+    SnapshotPublisher<Map> m_publisher;
+};
@@ -0,0 +1,51 @@
+#include "DeviceTable.h"
+
+#include <algorithm>
+
+static uint8_t FlagsOf(const DiscoveredDevice& device) {
+    return (device.connected ? DEVICE_CONNECTED : 0)
+        | (device.remembered ? DEVICE_REMEMBERED : 0)
+        | (device.authenticated ? DEVICE_AUTHENTICATED : 0);
+}
+
+DeviceTable::Row DeviceTable::Observe(const DiscoveredDevice& device, std::chrono::steady_clock::time_point seen) {
+    auto [ite, inserted] = m_rows.try_emplace(device.address, static_cast<Row>(m_addresses.size()));
+    Row row = ite->second;
+    if (inserted) {
+        m_addresses.push_back(device.address);
+        m_classes.push_back(device.classOfDevice);
+        m_flags.push_back(FlagsOf(device));
+        m_lastSeen.push_back(seen);
+        m_names.push_back(NamePool::Shared().Intern(device.name));
+        return row;
+    }
+
+    if (device.classOfDevice != 0)
+        m_classes[row] = device.classOfDevice;
+    m_flags[row] = FlagsOf(device);
+    // Hits from overlapping inquiries can arrive out of order
+    m_lastSeen[row] = std::max(m_lastSeen[row], seen);
+    if (!device.name.empty())
+        m_names[row] = NamePool::Shared().Intern(device.name);
+    return row;
+}
+
+std::optional<DeviceTable::Row> DeviceTable::Find(uint64_t address) const {
+    auto ite = m_rows.find(address);
+    if (ite == m_rows.end())
+        return std::nullopt;
+    return ite->second;
+}
+
+void DeviceTable::Select(const DeviceQuery& query, std::vector<Row>& rows) const {
+    size_t size = m_addresses.size();
+    for (size_t row = 0; row < size; ++row) {
+        if (query.seenSince.has_value() && m_lastSeen[row] < *query.seenSince)
+            continue;
+        if (query.majorClass.has_value() && DeviceMajorClass(m_classes[row]) != *query.majorClass)
+            continue;
+        if ((m_flags[row] & query.flags) != query.flags)
+            continue;
+        rows.push_back(static_cast<Row>(row));
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+
+#include "DeviceDiscovery.h"
+#include "NamePool.h"
+
+enum DeviceFlags : uint8_t {
+    DEVICE_CONNECTED = 1 << 0,
+    DEVICE_REMEMBERED = 1 << 1,
+    DEVICE_AUTHENTICATED = 1 << 2,
+};
+
+// Major device classes from the class of device, as in the Bluetooth assigned numbers
+constexpr uint8_t DEVICE_MAJOR_CLASS_AUDIO = 0x04;
+
+constexpr uint8_t DeviceMajorClass(uint32_t classOfDevice) {
+    return static_cast<uint8_t>((classOfDevice >> 8) & 0x1f);
+}
+
+// What a scan of the table selects. Unset fields match every device.
+struct DeviceQuery {
+    std::optional<std::chrono::steady_clock::time_point> seenSince;
+    std::optional<uint8_t> majorClass;
+    // Every one of these flags has to be set
+    uint8_t flags = 0;
+};
+
+// Every device seen by inquiries and radio events, one row per address. Each field is its own column,
+// so a scan only touches the columns it filters on. Not thread-safe.
+class DeviceTable {
+public:
+    using Row = uint32_t;
+
+    DeviceTable() = default;
+
+    DeviceTable(const DeviceTable&) = delete;
+    DeviceTable& operator=(const DeviceTable&) = delete;
+
+    // Adds the device, or updates its row in place when the address was seen before.
+    // An empty name or a class of 0 doesn't replace a known one, since inquiries and radio events
+    // often report them later.
+    Row Observe(const DiscoveredDevice& device, std::chrono::steady_clock::time_point seen);
+
+    std::optional<Row> Find(uint64_t address) const;
+
+    // Appends the rows that match, in the order they were first seen.
+    void Select(const DeviceQuery& query, std::vector<Row>& rows) const;
+
+    size_t Size() const {
+        return m_addresses.size();
+    }
+
+    uint64_t Address(Row row) const { return m_addresses[row]; }
+    uint32_t ClassOfDevice(Row row) const { return m_classes[row]; }
+    uint8_t Flags(Row row) const { return m_flags[row]; }
+    std::chrono::steady_clock::time_point LastSeen(Row row) const { return m_lastSeen[row]; }
+    InternedName NameHandle(Row row) const { return m_names[row]; }
+    std::wstring_view Name(Row row) const { return m_names[row].View(); }
+private:
+    std::vector<uint64_t> m_addresses;
+    std::vector<uint32_t> m_classes;
+    std::vector<uint8_t> m_flags;
+    std::vector<std::chrono::steady_clock::time_point> m_lastSeen;
+    std::vector<InternedName> m_names;
+
+    std::unordered_map<uint64_t, Row> m_rows;
+};
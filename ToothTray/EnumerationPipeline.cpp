@@ -0,0 +1,65 @@
+#include "EnumerationPipeline.h"
+
+EnumerationPipeline::~EnumerationPipeline() {
+    Stop();
+}
+
+void EnumerationPipeline::Start(std::function<void()> workerStarted, std::function<void()> workerStopping) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_running)
+        return;
+
+    m_running = true;
+    m_fullRefreshPending = true;
+    m_refreshPending = true;
+    m_worker = std::thread(&EnumerationPipeline::Run, this, std::move(workerStarted), std::move(workerStopping));
+}
+
+void EnumerationPipeline::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running)
+            return;
+        m_running = false;
+    }
+    m_requested.notify_all();
+
+    if (m_worker.joinable())
+        m_worker.join();
+}
+
+void EnumerationPipeline::RequestRefresh(bool full) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_fullRefreshPending |= full;
+        m_refreshPending = true;
+    }
+    m_requested.notify_one();
+}
+
+void EnumerationPipeline::Run(std::function<void()> workerStarted, std::function<void()> workerStopping) {
+    if (workerStarted)
+        workerStarted();
+
+    while (true) {
+        bool full;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_requested.wait(lock, [this] { return m_refreshPending || !m_running; });
+            if (!m_running)
+                break;
+
+            // Everything requested so far is covered by this enumeration
+            full = m_fullRefreshPending;
+            m_fullRefreshPending = false;
+            m_refreshPending = false;
+        }
+
+        uint64_t generation = m_publisher.Publish(m_enumerate(full));
+        if (m_published)
+            m_published(generation);
+    }
+
+    if (workerStopping)
+        workerStopping();
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+#include "BluetoothConnector.h"
+#include "SnapshotPublisher.h"
+
+using ConnectorSnapshot = Snapshot<std::vector<BluetoothConnector>>;
+
+// Runs the enumeration on a worker thread and publishes the connectors as immutable snapshots,
+// so the UI thread only ever reads the current one.
+// Refresh requests made while an enumeration is running are coalesced into a single one that runs after it.
+class EnumerationPipeline {
+public:
+    // full is true when everything has to be enumerated again rather than read from what's already known.
+    using EnumerateFunction = std::function<std::vector<BluetoothConnector>(bool full)>;
+    // Called on the worker thread after a snapshot is published.
+    using PublishedCallback = std::function<void(uint64_t generation)>;
+
+    EnumerationPipeline(EnumerateFunction enumerate, PublishedCallback published)
+        : m_enumerate(std::move(enumerate)), m_published(std::move(published)), m_running(false), m_fullRefreshPending(false), m_refreshPending(false) {}
+    ~EnumerationPipeline();
+
+    EnumerationPipeline(const EnumerationPipeline&) = delete;
+    EnumerationPipeline& operator=(const EnumerationPipeline&) = delete;
+
+    // Starts the worker with a full refresh. The callbacks run on the worker thread before and after
+    // all enumerations, e.g. to initialize COM.
+    void Start(std::function<void()> workerStarted = nullptr, std::function<void()> workerStopping = nullptr);
+    void Stop();
+
+    void RequestRefresh(bool full);
+
+    // Publishes connectors known before the first enumeration, e.g. from the last run, without
+    // calling the published callback. Call before Start.
+    void Seed(std::vector<BluetoothConnector>&& connectors) {
+        m_publisher.Publish(std::move(connectors));
+    }
+
+    std::shared_ptr<const ConnectorSnapshot> Current() const {
+        return m_publisher.Current();
+    }
+private:
+    EnumerateFunction m_enumerate;
+    PublishedCallback m_published;
+    SnapshotPublisher<std::vector<BluetoothConnector>> m_publisher;
+
+    std::mutex m_mutex;
+    std::condition_variable m_requested;
+    bool m_running;
+    bool m_fullRefreshPending;
+    bool m_refreshPending;
+    std::thread m_worker;
+
+    void Run(std::function<void()> workerStarted, std::function<void()> workerStopping);
+};
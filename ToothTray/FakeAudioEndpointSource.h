@@ -0,0 +1,167 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <functional>
+
+#include "AudioEndpointSource.h"
+#include "SimulatedLatency.h"
+#include "WorkerPool.h"
+
+// A connector control that counts the calls, for exercising the connector logic without a driver.
+// Every call can be made to take a while or to fail, like a slow or broken driver.
+class FakeConnectorControl : public IConnectorControl {
+public:
+    void SetLatency(SimulatedLatency latency) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_latency = latency;
+    }
+
+    // Called on the calling thread as soon as a call reaches the driver, before its latency.
+    void SetCallObserver(std::function<void()> observer) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_observer = std::move(observer);
+    }
+
+    // A negative HRESULT makes the calls fail.
+    void SetResult(long result) {
+        m_result = result;
+    }
+
+    long Connect() override {
+        ++m_connectCount;
+        return Call();
+    }
+
+    long Disconnect() override {
+        ++m_disconnectCount;
+        return Call();
+    }
+
+    int ConnectCount() const { return m_connectCount; }
+    int DisconnectCount() const { return m_disconnectCount; }
+private:
+    std::atomic<int> m_connectCount = 0;
+    std::atomic<int> m_disconnectCount = 0;
+    std::atomic<long> m_result = 0;
+    std::mutex m_mutex;
+    SimulatedLatency m_latency;
+    std::function<void()> m_observer;
+
+    long Call() {
+        SimulatedLatency latency;
+        std::function<void()> observer;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            latency = m_latency;
+            observer = m_observer;
+        }
+
+        if (observer)
+            observer();
+        latency.Wait();
+        return m_result;
+    }
+};
+
+// An in-memory endpoint source. Changes made through it notify the listener like the system would,
+// and every resolve can be delayed to simulate the cost of walking a topology.
+class FakeAudioEndpointSource : public IAudioEndpointSource {
+public:
+    // The time each endpoint's topology walk takes
+    void SetResolveLatency(SimulatedLatency latency) {
+        m_resolveLatency = latency;
+    }
+
+    // Resolves in parallel on the pool, like BluetoothAudioDeviceEnumerator.
+    void SetWorkerPool(WorkerPool* pool) {
+        m_workerPool = pool;
+    }
+
+    size_t ResolveCount() const {
+        return m_resolveCount;
+    }
+
+    // An endpoint without controls is treated like one that isn't connected to a bluetooth driver.
+    void AddEndpoint(const AudioEndpoint& endpoint) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_endpoints.emplace_back(endpoint);
+        }
+        if (m_listener != nullptr)
+            m_listener->OnEndpointAdded(endpoint.id);
+    }
+
+    void RemoveEndpoint(std::wstring_view endpointId) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::erase_if(m_endpoints, [endpointId](const AudioEndpoint& endpoint) { return endpoint.id == endpointId; });
+        }
+        if (m_listener != nullptr)
+            m_listener->OnEndpointRemoved(endpointId);
+    }
+
+    void SetEndpointState(std::wstring_view endpointId, bool isActive) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (AudioEndpoint& endpoint : m_endpoints) {
+                if (endpoint.id == endpointId)
+                    endpoint.isActive = isActive;
+            }
+        }
+        if (m_listener != nullptr)
+            m_listener->OnEndpointStateChanged(endpointId, isActive);
+    }
+
+    std::vector<AudioEndpoint> EnumerateEndpoints() override {
+        std::vector<AudioEndpoint> all;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            all = m_endpoints;
+        }
+
+        std::vector<std::optional<AudioEndpoint>> resolved = ParallelMap<std::optional<AudioEndpoint>>(m_workerPool, all.size(), [this, &all](size_t i) -> std::optional<AudioEndpoint> {
+            Resolve();
+            if (all[i].controls.empty())
+                return std::nullopt;
+            return all[i];
+        });
+
+        std::vector<AudioEndpoint> endpoints;
+        for (std::optional<AudioEndpoint>& endpoint : resolved) {
+            if (endpoint.has_value())
+                endpoints.emplace_back(std::move(*endpoint));
+        }
+        return endpoints;
+    }
+
+    std::optional<AudioEndpoint> GetEndpoint(std::wstring_view endpointId) override {
+        Resolve();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const AudioEndpoint& endpoint : m_endpoints) {
+            if (endpoint.id == endpointId && !endpoint.controls.empty())
+                return endpoint;
+        }
+        return std::nullopt;
+    }
+
+    void SetListener(IAudioEndpointListener* listener) override {
+        m_listener = listener;
+    }
+private:
+    std::mutex m_mutex;
+    std::vector<AudioEndpoint> m_endpoints;
+    IAudioEndpointListener* m_listener = nullptr;
+    WorkerPool* m_workerPool = nullptr;
+    SimulatedLatency m_resolveLatency;
+    std::atomic<size_t> m_resolveCount = 0;
+
+    void Resolve() {
+        ++m_resolveCount;
+        m_resolveLatency.Wait();
+    }
+};
@@ -0,0 +1,62 @@
+#pragma once
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "ContainerNameIndex.h"
+#include "SimulatedLatency.h"
+
+// An in-memory container source. Renames and removals notify the listener like the device watcher
+// would, and every resolve can be delayed to simulate the cost of querying the system.
+class FakeContainerSource : public IContainerSource {
+public:
+    void SetResolveLatency(SimulatedLatency latency) {
+        m_resolveLatency = latency;
+    }
+
+    size_t ResolveCount() const {
+        return m_resolveCount;
+    }
+
+    void SetContainerName(const GUID& containerId, const std::wstring& name) {
+        bool existed;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            existed = !m_names.insert_or_assign(containerId, name).second;
+        }
+        if (existed && m_listener != nullptr)
+            m_listener->OnContainerChanged(containerId);
+    }
+
+    void RemoveContainer(const GUID& containerId) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_names.erase(containerId);
+        }
+        if (m_listener != nullptr)
+            m_listener->OnContainerChanged(containerId);
+    }
+
+    std::optional<std::wstring> ResolveContainerName(const GUID& containerId) override {
+        ++m_resolveCount;
+        m_resolveLatency.Wait();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        GuidMap<std::wstring>::const_iterator ite = m_names.find(containerId);
+        if (ite == m_names.cend())
+            return std::nullopt;
+        return ite->second;
+    }
+
+    void SetListener(IContainerListener* listener) override {
+        m_listener = listener;
+    }
+private:
+    std::mutex m_mutex;
+    GuidMap<std::wstring> m_names;
+    IContainerListener* m_listener = nullptr;
+    SimulatedLatency m_resolveLatency;
+    std::atomic<size_t> m_resolveCount = 0;
+};
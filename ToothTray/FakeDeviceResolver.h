@@ -0,0 +1,68 @@
+#pragma once
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <unordered_map>
+
+#include "DeviceResolutionQueue.h"
+#include "SimulatedLatency.h"
+#include "WorkerPool.h"
+
+// An in-memory device resolver. Resolves complete on a worker pool after the simulated latency, or
+// inline when no started pool is given, and the most resolves seen running at once is recorded.
+class FakeDeviceResolver : public IDeviceResolver {
+public:
+    void SetWorkerPool(WorkerPool* pool) {
+        m_pool = pool;
+    }
+
+    void SetResolveLatency(SimulatedLatency latency) {
+        m_resolveLatency = latency;
+    }
+
+    void AddDevice(const std::wstring& id, const ResolvedDevice& device) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_devices.insert_or_assign(id, device);
+    }
+
+    size_t ResolveCount() const {
+        return m_resolveCount;
+    }
+
+    size_t PeakConcurrency() const {
+        return m_peakConcurrency;
+    }
+
+    void ResolveAsync(const std::wstring& id, Completion completed) override {
+        ++m_resolveCount;
+        size_t running = ++m_running;
+        size_t peak = m_peakConcurrency;
+        while (running > peak && !m_peakConcurrency.compare_exchange_weak(peak, running)) {}
+
+        auto resolve = [this, id, completed = std::move(completed)]() {
+            m_resolveLatency.Wait();
+            std::optional<ResolvedDevice> device;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                std::unordered_map<std::wstring, ResolvedDevice>::const_iterator ite = m_devices.find(id);
+                if (ite != m_devices.cend())
+                    device = ite->second;
+            }
+            --m_running;
+            completed(device);
+        };
+
+        if (m_pool != nullptr && m_pool->ThreadCount() > 0)
+            m_pool->Submit(std::move(resolve));
+        else
+            resolve();
+    }
+private:
+    std::mutex m_mutex;
+    std::unordered_map<std::wstring, ResolvedDevice> m_devices;
+    WorkerPool* m_pool = nullptr;
+    SimulatedLatency m_resolveLatency;
+    std::atomic<size_t> m_resolveCount = 0;
+    std::atomic<size_t> m_running = 0;
+    std::atomic<size_t> m_peakConcurrency = 0;
+};
@@ -0,0 +1,175 @@
+#pragma once
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <initializer_list>
+
+#include "SdpRecordCache.h"
+#include "SimulatedLatency.h"
+
+// Encodes data elements in the wire format, to build records like the ones devices return.
+using SdpBytes = std::vector<uint8_t>;
+
+inline SdpBytes SdpEncodeUInt(uint64_t value, size_t size) {
+    // Size index 0, 1, 2 and 3 for 1, 2, 4 and 8 bytes
+    uint8_t sizeIndex = static_cast<uint8_t>(size == 1 ? 0 : size == 2 ? 1 : size == 4 ? 2 : 3);
+    SdpBytes bytes{ static_cast<uint8_t>((static_cast<uint8_t>(SdpType::UInt) << 3) | sizeIndex) };
+    for (size_t i = size; i > 0; --i)
+        bytes.push_back(static_cast<uint8_t>(value >> (8 * (i - 1))));
+    return bytes;
+}
+
+inline SdpBytes SdpEncodeUuid16(uint16_t value) {
+    return SdpBytes{ static_cast<uint8_t>((static_cast<uint8_t>(SdpType::Uuid) << 3) | 1), static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value) };
+}
+
+inline SdpBytes SdpEncodeUuid128(const GUID& value) {
+    SdpBytes bytes{ static_cast<uint8_t>((static_cast<uint8_t>(SdpType::Uuid) << 3) | 4) };
+    for (int shift = 24; shift >= 0; shift -= 8)
+        bytes.push_back(static_cast<uint8_t>(value.Data1 >> shift));
+    bytes.push_back(static_cast<uint8_t>(value.Data2 >> 8));
+    bytes.push_back(static_cast<uint8_t>(value.Data2));
+    bytes.push_back(static_cast<uint8_t>(value.Data3 >> 8));
+    bytes.push_back(static_cast<uint8_t>(value.Data3));
+    bytes.insert(bytes.end(), value.Data4, value.Data4 + sizeof(value.Data4));
+    return bytes;
+}
+
+// A text or sequence with a 1 or 2 byte length, whichever fits
+inline SdpBytes SdpEncodeVariable(SdpType type, const SdpBytes& value) {
+    SdpBytes bytes;
+    if (value.size() <= UINT8_MAX) {
+        bytes = { static_cast<uint8_t>((static_cast<uint8_t>(type) << 3) | 5), static_cast<uint8_t>(value.size()) };
+    }
+    else {
+        bytes = { static_cast<uint8_t>((static_cast<uint8_t>(type) << 3) | 6), static_cast<uint8_t>(value.size() >> 8), static_cast<uint8_t>(value.size()) };
+    }
+    bytes.insert(bytes.end(), value.begin(), value.end());
+    return bytes;
+}
+
+inline SdpBytes SdpEncodeText(std::string_view text) {
+    return SdpEncodeVariable(SdpType::Text, SdpBytes(text.begin(), text.end()));
+}
+
+inline SdpBytes SdpEncodeSequence(std::initializer_list<SdpBytes> elements) {
+    SdpBytes value;
+    for (const SdpBytes& element : elements)
+        value.insert(value.end(), element.begin(), element.end());
+    return SdpEncodeVariable(SdpType::Sequence, value);
+}
+
+struct SdpEncodedAttribute {
+    uint16_t id;
+    SdpBytes value;
+};
+
+inline SdpBytes SdpEncodeRecord(std::initializer_list<SdpEncodedAttribute> attributes) {
+    SdpBytes value;
+    for (const SdpEncodedAttribute& attribute : attributes) {
+        SdpBytes id = SdpEncodeUInt(attribute.id, 2);
+        value.insert(value.end(), id.begin(), id.end());
+        value.insert(value.end(), attribute.value.begin(), attribute.value.end());
+    }
+    return SdpEncodeVariable(SdpType::Sequence, value);
+}
+
+// The records of typical stereo headphones: an A2DP sink, an AVRCP target with a browsing channel,
+// a hands-free unit and a vendor service with a 128 bit UUID. Shaped after what such devices return.
+inline std::vector<SdpBytes> SdpHeadphoneRecords() {
+    static const GUID VENDOR_SERVICE = { 0x931C7E8A, 0x540F, 0x4686, { 0xB7, 0x98, 0xE8, 0xDF, 0x0A, 0x2A, 0xD9, 0xF7 } };
+    return {
+        SdpEncodeRecord({
+            { 0x0000, SdpEncodeUInt(0x00010001, 4) },
+            { SDP_ATTRIBUTE_SERVICE_CLASS_ID_LIST, SdpEncodeSequence({ SdpEncodeUuid16(0x110B) }) },
+            { SDP_ATTRIBUTE_PROTOCOL_DESCRIPTOR_LIST, SdpEncodeSequence({
+                SdpEncodeSequence({ SdpEncodeUuid16(0x0100), SdpEncodeUInt(0x0019, 2) }),
+                SdpEncodeSequence({ SdpEncodeUuid16(0x0019), SdpEncodeUInt(0x0103, 2) }) }) },
+            { SDP_ATTRIBUTE_PROFILE_DESCRIPTOR_LIST, SdpEncodeSequence({ SdpEncodeSequence({ SdpEncodeUuid16(0x110D), SdpEncodeUInt(0x0103, 2) }) }) },
+            { SDP_ATTRIBUTE_SERVICE_NAME, SdpEncodeText("Audio Sink") },
+            { 0x0311, SdpEncodeUInt(0x000F, 2) },
+        }),
+        SdpEncodeRecord({
+            { 0x0000, SdpEncodeUInt(0x00010002, 4) },
+            { SDP_ATTRIBUTE_SERVICE_CLASS_ID_LIST, SdpEncodeSequence({ SdpEncodeUuid16(0x110C) }) },
+            { SDP_ATTRIBUTE_PROTOCOL_DESCRIPTOR_LIST, SdpEncodeSequence({
+                SdpEncodeSequence({ SdpEncodeUuid16(0x0100), SdpEncodeUInt(0x0017, 2) }),
+                SdpEncodeSequence({ SdpEncodeUuid16(0x0017), SdpEncodeUInt(0x0104, 2) }) }) },
+            // Additional protocol descriptor lists, the deepest nesting records usually have
+            { 0x000D, SdpEncodeSequence({ SdpEncodeSequence({
+                SdpEncodeSequence({ SdpEncodeUuid16(0x0100), SdpEncodeUInt(0x001B, 2) }),
+                SdpEncodeSequence({ SdpEncodeUuid16(0x0017), SdpEncodeUInt(0x0104, 2) }) }) }) },
+            { SDP_ATTRIBUTE_PROFILE_DESCRIPTOR_LIST, SdpEncodeSequence({ SdpEncodeSequence({ SdpEncodeUuid16(0x110E), SdpEncodeUInt(0x0106, 2) }) }) },
+            { SDP_ATTRIBUTE_SERVICE_NAME, SdpEncodeText("AV Remote Control Target") },
+            { 0x0311, SdpEncodeUInt(0x0002, 2) },
+        }),
+        SdpEncodeRecord({
+            { 0x0000, SdpEncodeUInt(0x00010003, 4) },
+            { SDP_ATTRIBUTE_SERVICE_CLASS_ID_LIST, SdpEncodeSequence({ SdpEncodeUuid16(0x111E), SdpEncodeUuid16(0x1203) }) },
+            { SDP_ATTRIBUTE_PROTOCOL_DESCRIPTOR_LIST, SdpEncodeSequence({
+                SdpEncodeSequence({ SdpEncodeUuid16(0x0100) }),
+                SdpEncodeSequence({ SdpEncodeUuid16(0x0003), SdpEncodeUInt(3, 1) }) }) },
+            { SDP_ATTRIBUTE_PROFILE_DESCRIPTOR_LIST, SdpEncodeSequence({ SdpEncodeSequence({ SdpEncodeUuid16(0x111E), SdpEncodeUInt(0x0108, 2) }) }) },
+            { SDP_ATTRIBUTE_SERVICE_NAME, SdpEncodeText("Hands-Free unit") },
+            { 0x0311, SdpEncodeUInt(0x01BF, 2) },
+        }),
+        SdpEncodeRecord({
+            { 0x0000, SdpEncodeUInt(0x00010004, 4) },
+            { SDP_ATTRIBUTE_SERVICE_CLASS_ID_LIST, SdpEncodeSequence({ SdpEncodeUuid128(VENDOR_SERVICE) }) },
+            { SDP_ATTRIBUTE_PROTOCOL_DESCRIPTOR_LIST, SdpEncodeSequence({
+                SdpEncodeSequence({ SdpEncodeUuid16(0x0100) }),
+                SdpEncodeSequence({ SdpEncodeUuid16(0x0003), SdpEncodeUInt(12, 1) }) }) },
+            { SDP_ATTRIBUTE_SERVICE_NAME, SdpEncodeText(std::string(200, 'v') + '\0') },
+        }),
+    };
+}
+
+// An in-memory record source. Every query takes the simulated latency, and a device can be made to
+// fail its queries, like one that went out of range.
+class FakeSdpRecordSource : public ISdpRecordSource {
+public:
+    void SetQueryLatency(SimulatedLatency latency) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_latency = latency;
+    }
+
+    void SetRecords(uint64_t address, std::vector<SdpBytes> records) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_records.insert_or_assign(address, std::move(records));
+    }
+
+    // A device without records fails its queries
+    void RemoveDevice(uint64_t address) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_records.erase(address);
+    }
+
+    size_t QueryCount() const {
+        return m_queryCount;
+    }
+
+    std::optional<std::vector<std::vector<uint8_t>>> QueryServiceRecords(uint64_t address) override {
+        ++m_queryCount;
+        SimulatedLatency latency;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            latency = m_latency;
+        }
+        latency.Wait();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::unordered_map<uint64_t, std::vector<SdpBytes>>::const_iterator ite = m_records.find(address);
+        if (ite == m_records.cend())
+            return std::nullopt;
+        return ite->second;
+    }
+private:
+    std::mutex m_mutex;
+    SimulatedLatency m_latency;
+    std::unordered_map<uint64_t, std::vector<SdpBytes>> m_records;
+    std::atomic<size_t> m_queryCount = 0;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstring>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <guiddef.h>
+#else
+// Same layout as the Windows definition so the platform-neutral code can key by container id anywhere.
+typedef struct _GUID {
+    uint32_t Data1;
+    uint16_t Data2;
+    uint16_t Data3;
+    uint8_t Data4[8];
+} GUID;
+
+constexpr GUID GUID_NULL{};
+#endif
+
+struct GUIDEqualityComparer {
+    bool operator()(const GUID& guid1, const GUID& guid2) const {
+        return std::memcmp(&guid1, &guid2, sizeof(GUID)) == 0;
+    }
+};
+
+// Mixes both 64-bit halves of the GUID through the MurmurHash3 finalizer, so every input bit affects
+// the low bits that index a hash table. The halves are copied out since GUID is only 4-byte aligned.
+struct GUIDHasher {
+    size_t operator()(const GUID& guid) const {
+        uint64_t low;
+        uint64_t high;
+        std::memcpy(&low, &guid, sizeof(low));
+        std::memcpy(&high, reinterpret_cast<const uint8_t*>(&guid) + sizeof(low), sizeof(high));
+        return static_cast<size_t>(Mix(low ^ Mix(high + 0x9e3779b97f4a7c15ull)));
+    }
+private:
+    static uint64_t Mix(uint64_t value) {
+        value ^= value >> 33;
+        value *= 0xff51afd7ed558ccdull;
+        value ^= value >> 33;
+        value *= 0xc4ceb9fe1a85ec53ull;
+        value ^= value >> 33;
+        return value;
+    }
+};
@@ -0,0 +1,200 @@
+#pragma once
+#include <tuple>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+#include <span>
+
+#include "Guid.h"
+
+// A hash map keyed by GUID with contiguous storage.
+// The entries live in a dense vector, in insertion order until something is erased, and an open
+// addressing table with linear probing maps hashes to them. Each table slot keeps the upper half of
+// the hash next to the entry index, so most mismatches are rejected without touching the entries.
+template <typename V>
+class GuidMap {
+public:
+    using value_type = std::pair<GUID, V>;
+    using iterator = typename std::vector<value_type>::iterator;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+
+    GuidMap() = default;
+
+    size_t size() const { return m_entries.size(); }
+    bool empty() const { return m_entries.empty(); }
+
+    iterator begin() { return m_entries.begin(); }
+    iterator end() { return m_entries.end(); }
+    const_iterator begin() const { return m_entries.cbegin(); }
+    const_iterator end() const { return m_entries.cend(); }
+    const_iterator cbegin() const { return m_entries.cbegin(); }
+    const_iterator cend() const { return m_entries.cend(); }
+
+    void clear() {
+        m_entries.clear();
+        std::fill(m_slots.begin(), m_slots.end(), EMPTY);
+    }
+
+    void reserve(size_t count) {
+        m_entries.reserve(count);
+        if (count * MAX_LOAD_DENOMINATOR > m_slots.size() * MAX_LOAD_NUMERATOR)
+            Rehash(count);
+    }
+
+    iterator find(const GUID& key) {
+        size_t slot = FindSlot(key, GUIDHasher{}(key));
+        return slot == NOT_FOUND ? end() : begin() + EntryIndex(m_slots[slot]);
+    }
+
+    const_iterator find(const GUID& key) const {
+        size_t slot = FindSlot(key, GUIDHasher{}(key));
+        return slot == NOT_FOUND ? cend() : cbegin() + EntryIndex(m_slots[slot]);
+    }
+
+    bool contains(const GUID& key) const {
+        return FindSlot(key, GUIDHasher{}(key)) != NOT_FOUND;
+    }
+
+    // Looks up all keys at once, writing nullptr for the missing ones. Hashing every key first keeps
+    // the probes independent of each other, so their memory accesses can overlap.
+    void find_many(std::span<const GUID> keys, std::span<V*> values) {
+        std::vector<size_t> hashes(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i)
+            hashes[i] = GUIDHasher{}(keys[i]);
+
+        for (size_t i = 0; i < keys.size(); ++i) {
+            size_t slot = FindSlot(keys[i], hashes[i]);
+            values[i] = slot == NOT_FOUND ? nullptr : &m_entries[EntryIndex(m_slots[slot])].second;
+        }
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const GUID& key, Args&&... args) {
+        size_t hash = GUIDHasher{}(key);
+        size_t slot = FindSlot(key, hash);
+        if (slot != NOT_FOUND)
+            return { begin() + EntryIndex(m_slots[slot]), false };
+
+        if ((m_entries.size() + 1) * MAX_LOAD_DENOMINATOR > m_slots.size() * MAX_LOAD_NUMERATOR)
+            Rehash(m_entries.size() + 1);
+
+        m_entries.emplace_back(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+        m_slots[FreeSlot(hash)] = MakeSlot(hash, m_entries.size() - 1);
+        return { end() - 1, true };
+    }
+
+    std::pair<iterator, bool> emplace(const GUID& key, V value) {
+        return try_emplace(key, std::move(value));
+    }
+
+    template <typename T>
+    std::pair<iterator, bool> insert_or_assign(const GUID& key, T&& value) {
+        std::pair<iterator, bool> result = try_emplace(key, std::forward<T>(value));
+        if (!result.second)
+            result.first->second = std::forward<T>(value);
+        return result;
+    }
+
+    V& operator[](const GUID& key) {
+        return try_emplace(key).first->second;
+    }
+
+    // Moves the last entry into the erased one's place, so iterators to the last entry are invalidated.
+    size_t erase(const GUID& key) {
+        size_t slot = FindSlot(key, GUIDHasher{}(key));
+        if (slot == NOT_FOUND)
+            return 0;
+
+        size_t entry = EntryIndex(m_slots[slot]);
+        RemoveSlot(slot);
+
+        size_t last = m_entries.size() - 1;
+        if (entry != last) {
+            size_t lastSlot = FindSlot(m_entries[last].first, GUIDHasher{}(m_entries[last].first));
+            m_slots[lastSlot] = MakeSlot(GUIDHasher{}(m_entries[last].first), entry);
+            m_entries[entry] = std::move(m_entries[last]);
+        }
+        m_entries.pop_back();
+        return 1;
+    }
+
+    iterator erase(iterator position) {
+        size_t index = position - begin();
+        erase(GUID(position->first));
+        return begin() + index;
+    }
+private:
+    static constexpr uint64_t EMPTY = 0;
+    static constexpr size_t NOT_FOUND = SIZE_MAX;
+    static constexpr size_t MIN_SLOTS = 8;
+    static constexpr size_t MAX_LOAD_NUMERATOR = 7;
+    static constexpr size_t MAX_LOAD_DENOMINATOR = 8;
+
+    std::vector<value_type> m_entries;
+    // The upper 32 bits of the hash and the entry index plus one. Zero is an empty slot.
+    std::vector<uint64_t> m_slots;
+
+    static uint64_t MakeSlot(size_t hash, size_t entry) {
+        return (static_cast<uint64_t>(hash) & 0xffffffff00000000ull) | static_cast<uint64_t>(entry + 1);
+    }
+
+    static size_t EntryIndex(uint64_t slot) {
+        return static_cast<size_t>((slot & 0xffffffffull) - 1);
+    }
+
+    static bool SameHash(uint64_t slot, size_t hash) {
+        return ((slot ^ static_cast<uint64_t>(hash)) & 0xffffffff00000000ull) == 0;
+    }
+
+    size_t Mask() const {
+        return m_slots.size() - 1;
+    }
+
+    size_t FindSlot(const GUID& key, size_t hash) const {
+        if (m_slots.empty())
+            return NOT_FOUND;
+
+        for (size_t slot = hash & Mask(); ; slot = (slot + 1) & Mask()) {
+            uint64_t value = m_slots[slot];
+            if (value == EMPTY)
+                return NOT_FOUND;
+            if (SameHash(value, hash) && GUIDEqualityComparer{}(m_entries[EntryIndex(value)].first, key))
+                return slot;
+        }
+    }
+
+    size_t FreeSlot(size_t hash) const {
+        size_t slot = hash & Mask();
+        while (m_slots[slot] != EMPTY)
+            slot = (slot + 1) & Mask();
+        return slot;
+    }
+
+    // Backward shift deletion: later slots of the probe run move up, so no tombstones are needed.
+    void RemoveSlot(size_t slot) {
+        size_t hole = slot;
+        for (size_t next = (hole + 1) & Mask(); m_slots[next] != EMPTY; next = (next + 1) & Mask()) {
+            size_t home = GUIDHasher{}(m_entries[EntryIndex(m_slots[next])].first) & Mask();
+            // Move the slot into the hole unless its home lies cyclically in (hole, next]
+            bool homeBetween = hole <= next ? (hole < home && home <= next) : (hole < home || home <= next);
+            if (!homeBetween) {
+                m_slots[hole] = m_slots[next];
+                hole = next;
+            }
+        }
+        m_slots[hole] = EMPTY;
+    }
+
+    void Rehash(size_t count) {
+        size_t slotCount = MIN_SLOTS;
+        while (count * MAX_LOAD_DENOMINATOR > slotCount * MAX_LOAD_NUMERATOR)
+            slotCount *= 2;
+
+        m_slots.assign(slotCount, EMPTY);
+        for (size_t i = 0; i < m_entries.size(); ++i) {
+            size_t hash = GUIDHasher{}(m_entries[i].first);
+            m_slots[FreeSlot(hash)] = MakeSlot(hash, i);
+        }
+    }
+};
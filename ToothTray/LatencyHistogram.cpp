@@ -0,0 +1,34 @@
+#include "LatencyHistogram.h"
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "recording has to be lock-free");
+static_assert(LatencyHistogram::BucketIndex(LatencyHistogram::MAX_VALUE) == LatencyHistogram::BUCKET_COUNT - 1);
+static_assert(LatencyHistogram::BucketLowest(LatencyHistogram::BucketIndex(1000)) <= 1000
+    && LatencyHistogram::BucketHighest(LatencyHistogram::BucketIndex(1000)) >= 1000);
+
+uint64_t LatencyHistogram::Count() const {
+    uint64_t count = 0;
+    for (const std::atomic<uint32_t>& bucket : m_counts)
+        count += bucket.load(std::memory_order_relaxed);
+    return count;
+}
+
+LatencyHistogram::Duration LatencyHistogram::Percentile(double p) const {
+    // Counted from the same loads that are walked, so samples recorded meanwhile can't skew the rank
+    std::array<uint32_t, BUCKET_COUNT> counts;
+    uint64_t total = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        counts[i] = m_counts[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0)
+        return Duration::zero();
+
+    uint64_t rank = std::clamp<uint64_t>(static_cast<uint64_t>(p / 100.0 * total + 0.999999), 1, total);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += counts[i];
+        if (seen >= rank)
+            return Duration(BucketHighest(i));
+    }
+    return Duration(MAX_VALUE);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <bit>
+#include <cstdint>
+#include <algorithm>
+
+// Counts durations in log-linear buckets like an HDR histogram: exact below 64us, then 32 buckets
+// per power of two, so a bucket never spans more than about 3% of its values. Recording is a single
+// relaxed increment, so any number of threads can record while others read; a reader racing a
+// recorder sees the sample or not, never a torn count.
+class LatencyHistogram {
+public:
+    using Duration = std::chrono::microseconds;
+
+    static constexpr uint32_t SUB_BUCKET_BITS = 5;
+    static constexpr uint64_t SUB_BUCKETS = uint64_t{ 1 } << SUB_BUCKET_BITS;
+    static constexpr uint32_t VALUE_BITS = 32;
+    // Longer durations, a bit over an hour, are counted as this
+    static constexpr uint64_t MAX_VALUE = (uint64_t{ 1 } << VALUE_BITS) - 1;
+    // Exact buckets for the values below 2 * SUB_BUCKETS, then SUB_BUCKETS for each further bit
+    static constexpr size_t BUCKET_COUNT = (VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    static constexpr size_t BucketIndex(uint64_t value) {
+        value = std::min(value, MAX_VALUE);
+        int shift = std::max(0, static_cast<int>(std::bit_width(value)) - static_cast<int>(SUB_BUCKET_BITS) - 1);
+        return static_cast<size_t>(shift * SUB_BUCKETS + (value >> shift));
+    }
+
+    static constexpr uint64_t BucketLowest(size_t index) {
+        int shift = index < 2 * SUB_BUCKETS ? 0 : static_cast<int>(index / SUB_BUCKETS) - 1;
+        return (index - shift * SUB_BUCKETS) << shift;
+    }
+
+    static constexpr uint64_t BucketHighest(size_t index) {
+        return index + 1 < BUCKET_COUNT ? BucketLowest(index + 1) - 1 : MAX_VALUE;
+    }
+
+    LatencyHistogram() = default;
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void Record(std::chrono::steady_clock::duration duration) {
+        int64_t microseconds = std::chrono::duration_cast<Duration>(duration).count();
+        m_counts[BucketIndex(static_cast<uint64_t>(std::max<int64_t>(microseconds, 0)))].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Adds counts recorded elsewhere, e.g. in an earlier session.
+    void Add(size_t index, uint32_t count) {
+        m_counts[index].fetch_add(count, std::memory_order_relaxed);
+    }
+
+    uint32_t BucketCount(size_t index) const {
+        return m_counts[index].load(std::memory_order_relaxed);
+    }
+
+    uint64_t Count() const;
+
+    // Nearest-rank percentile for p in [0, 100], as the highest value of its bucket. Zero when empty.
+    Duration Percentile(double p) const;
+private:
+    std::array<std::atomic<uint32_t>, BUCKET_COUNT> m_counts{};
+};
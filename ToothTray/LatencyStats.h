@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+// Collects latency samples and summarizes them by percentile.
+class LatencyStats {
+public:
+    void Add(std::chrono::steady_clock::duration sample) {
+        m_samples.emplace_back(sample);
+        m_sorted = false;
+    }
+
+    size_t Count() const {
+        return m_samples.size();
+    }
+
+    // Nearest-rank percentile, for p in [0, 100].
+    std::chrono::steady_clock::duration Percentile(double p) {
+        if (m_samples.empty())
+            return std::chrono::steady_clock::duration::zero();
+
+        Sort();
+        size_t rank = static_cast<size_t>(p / 100.0 * m_samples.size() + 0.999999);
+        return m_samples[std::clamp<size_t>(rank, 1, m_samples.size()) - 1];
+    }
+
+    std::chrono::steady_clock::duration Max() {
+        return Percentile(100.0);
+    }
+private:
+    std::vector<std::chrono::steady_clock::duration> m_samples;
+    bool m_sorted = true;
+
+    void Sort() {
+        if (!m_sorted) {
+            std::sort(m_samples.begin(), m_samples.end());
+            m_sorted = true;
+        }
+    }
+};
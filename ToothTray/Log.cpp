@@ -0,0 +1,224 @@
+#include "Log.h"
+
+#include <atomic>
+#include <cstddef>
+#include <algorithm>
+
+#include "LogDecoder.h"
+
+// A single producer, single consumer byte ring. The owning thread appends whole records and the
+// drain takes everything up to the published head, so neither side ever waits for the other.
+class LogRing {
+public:
+    static constexpr size_t CAPACITY = 64 * 1024;
+
+    explicit LogRing(uint32_t threadIndex)
+        : m_buffer(std::make_unique<uint8_t[]>(CAPACITY)), m_head(0), m_tail(0), m_dropped(0), m_retired(false), m_threadIndex(threadIndex) {}
+
+    uint32_t ThreadIndex() const {
+        return m_threadIndex;
+    }
+
+    bool TryWrite(const uint8_t* data, size_t size) {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) + size > CAPACITY) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        size_t offset = head % CAPACITY;
+        size_t first = std::min(size, CAPACITY - offset);
+        std::memcpy(m_buffer.get() + offset, data, first);
+        std::memcpy(m_buffer.get(), data + first, size - first);
+        m_head.store(head + size, std::memory_order_release);
+        return true;
+    }
+
+    // Appends all published bytes to records, which then holds only whole records.
+    void ReadAll(std::vector<uint8_t>& records) {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        size_t size = static_cast<size_t>(head - tail);
+        if (size == 0)
+            return;
+
+        size_t offset = tail % CAPACITY;
+        size_t first = std::min(size, CAPACITY - offset);
+        records.insert(records.end(), m_buffer.get() + offset, m_buffer.get() + offset + first);
+        records.insert(records.end(), m_buffer.get(), m_buffer.get() + (size - first));
+        m_tail.store(head, std::memory_order_release);
+    }
+
+    uint64_t TakeDropped() {
+        return m_dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+    void Retire() {
+        m_retired.store(true, std::memory_order_release);
+    }
+
+    bool IsRetired() const {
+        return m_retired.load(std::memory_order_acquire);
+    }
+private:
+    std::unique_ptr<uint8_t[]> m_buffer;
+    std::atomic<uint64_t> m_head;
+    std::atomic<uint64_t> m_tail;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<bool> m_retired;
+    uint32_t m_threadIndex;
+};
+
+// Rings are registered once per thread; after that, logging doesn't take any lock.
+static std::mutex ringsMutex;
+static std::vector<std::shared_ptr<LogRing>> rings;
+static uint32_t nextThreadIndex = 1;
+
+// Serializes drains, since every ring must only have one reader.
+static std::mutex drainMutex;
+
+struct ThreadLogState {
+    std::shared_ptr<LogRing> ring;
+    std::vector<uint8_t> scratch;
+
+    ThreadLogState() {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        ring = std::make_shared<LogRing>(nextThreadIndex++);
+        rings.emplace_back(ring);
+    }
+
+    ~ThreadLogState() {
+        ring->Retire();
+    }
+};
+
+static uint64_t Timestamp() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static ThreadLogState& CurrentThreadLogState() {
+    thread_local ThreadLogState state;
+    return state;
+}
+
+LogRecordBuilder::LogRecordBuilder(LogLevel level, const wchar_t* format, size_t argumentCount)
+    : m_buffer(CurrentThreadLogState().scratch), m_added(0) {
+    LogRecordHeader header{};
+    header.level = level;
+    header.argumentCount = static_cast<uint8_t>(argumentCount);
+    header.timestamp = Timestamp();
+    header.format = format;
+
+    m_buffer.clear();
+    AppendBytes(&header, sizeof(header));
+}
+
+void LogRecordBuilder::AppendBytes(const void* data, size_t size) {
+    size_t offset = m_buffer.size();
+    m_buffer.resize(offset + size);
+    std::memcpy(m_buffer.data() + offset, data, size);
+}
+
+void LogRecordBuilder::AddString(std::wstring_view value) {
+    uint32_t length = static_cast<uint32_t>(std::min(value.size(), MAX_STRING_LENGTH));
+    Append(LogArgumentType::String, length);
+    AppendBytes(value.data(), length * sizeof(wchar_t));
+}
+
+void LogRecordBuilder::Commit() {
+    uint32_t size = static_cast<uint32_t>(m_buffer.size());
+    std::memcpy(m_buffer.data() + offsetof(LogRecordHeader, size), &size, sizeof(size));
+    CurrentThreadLogState().ring->TryWrite(m_buffer.data(), m_buffer.size());
+}
+
+LogDrain::~LogDrain() {
+    Stop();
+}
+
+void LogDrain::Start(Sink sink, std::chrono::milliseconds interval, std::function<void()> started, std::function<void()> stopping) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_running)
+        return;
+
+    m_running = true;
+    m_thread = std::thread(&LogDrain::Run, this, std::move(sink), interval, std::move(started), std::move(stopping));
+}
+
+void LogDrain::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running)
+            return;
+        m_running = false;
+    }
+    m_stopRequested.notify_all();
+    m_thread.join();
+}
+
+void LogDrain::Run(Sink sink, std::chrono::milliseconds interval, std::function<void()> started, std::function<void()> stopping) {
+    if (started)
+        started();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_running) {
+        m_stopRequested.wait_for(lock, interval);
+
+        lock.unlock();
+        Drain(sink);
+        lock.lock();
+    }
+    lock.unlock();
+    // Records made while the last drain was running
+    Drain(sink);
+
+    if (stopping)
+        stopping();
+}
+
+void LogDrain::Drain(const Sink& sink) {
+    std::lock_guard<std::mutex> drainLock(drainMutex);
+
+    std::vector<std::shared_ptr<LogRing>> current;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        current = rings;
+    }
+
+    std::vector<DecodedLogRecord> decoded;
+    std::vector<uint8_t> records;
+    for (const std::shared_ptr<LogRing>& ring : current) {
+        // Read the retired flag first, so a retired ring is only dropped after its last records were read.
+        bool retired = ring->IsRetired();
+
+        records.clear();
+        ring->ReadAll(records);
+        size_t offset = 0;
+        while (offset + sizeof(LogRecordHeader) <= records.size()) {
+            uint32_t size;
+            std::memcpy(&size, records.data() + offset + offsetof(LogRecordHeader, size), sizeof(size));
+            if (size < sizeof(LogRecordHeader) || offset + size > records.size())
+                break;
+
+            std::optional<DecodedLogRecord> record = DecodeLogRecord(records.data() + offset, size, ring->ThreadIndex());
+            if (record.has_value())
+                decoded.emplace_back(std::move(*record));
+            offset += size;
+        }
+
+        uint64_t dropped = ring->TakeDropped();
+        if (dropped > 0)
+            decoded.emplace_back(DecodedLogRecord{ LogLevel::Warning, Timestamp(), ring->ThreadIndex(), std::to_wstring(dropped) + L" log records dropped" });
+
+        if (retired) {
+            std::lock_guard<std::mutex> lock(ringsMutex);
+            rings.erase(std::remove(rings.begin(), rings.end(), ring), rings.end());
+        }
+    }
+
+    std::stable_sort(decoded.begin(), decoded.end(), [](const DecodedLogRecord& a, const DecodedLogRecord& b) {
+        return a.timestamp < b.timestamp;
+    });
+
+    for (const DecodedLogRecord& record : decoded)
+        sink(FormatLogLine(record));
+}
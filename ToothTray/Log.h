@@ -0,0 +1,176 @@
+#pragma once
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <functional>
+#include <string_view>
+#include <type_traits>
+#include <condition_variable>
+
+enum class LogLevel : uint8_t {
+    Trace,
+    Debug,
+    Info,
+    Warning,
+    Error,
+};
+
+// The lowest level that is compiled in, as the LogLevel value.
+#ifndef TOOTHTRAY_LOG_LEVEL
+#ifdef NDEBUG
+#define TOOTHTRAY_LOG_LEVEL 3
+#else
+#define TOOTHTRAY_LOG_LEVEL 0
+#endif
+#endif
+
+constexpr bool LogLevelEnabled(LogLevel level) {
+#if TOOTHTRAY_LOG_LEVEL == 0
+    // Everything is compiled in; comparing would be a tautology
+    static_cast<void>(level);
+    return true;
+#else
+    return static_cast<int>(level) >= TOOTHTRAY_LOG_LEVEL;
+#endif
+}
+
+// Records a message like LOG_INFO(L"name={}, connected={}", name, connected). The format must be a
+// string literal since only its address is recorded; each {} is replaced by the next argument when
+// the record is decoded. A disabled level generates no code, including for the arguments.
+#define TOOTHTRAY_LOG(level, ...) do { if constexpr (LogLevelEnabled(level)) LogWrite(level, __VA_ARGS__); } while (false)
+#define LOG_TRACE(...) TOOTHTRAY_LOG(LogLevel::Trace, __VA_ARGS__)
+#define LOG_DEBUG(...) TOOTHTRAY_LOG(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...) TOOTHTRAY_LOG(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARNING(...) TOOTHTRAY_LOG(LogLevel::Warning, __VA_ARGS__)
+#define LOG_ERROR(...) TOOTHTRAY_LOG(LogLevel::Error, __VA_ARGS__)
+
+enum class LogArgumentType : uint8_t {
+    Bool,
+    Char,
+    Signed,
+    Unsigned,
+    Double,
+    // A length followed by the characters
+    String,
+    // A formatter, a size and the raw bytes of a trivially copyable value
+    Custom,
+};
+
+using LogCustomFormatter = void (*)(std::wostream& stream, const uint8_t* value);
+
+struct LogRecordHeader {
+    // Of the whole record, including this header
+    uint32_t size;
+    LogLevel level;
+    uint8_t argumentCount;
+    uint64_t timestamp;
+    const wchar_t* format;
+};
+
+template <typename T>
+void LogFormatCustom(std::wostream& stream, const uint8_t* value) {
+    alignas(T) uint8_t storage[sizeof(T)];
+    std::memcpy(storage, value, sizeof(T));
+    stream << *reinterpret_cast<const T*>(storage);
+}
+
+// Encodes a record into a per-thread scratch buffer, then copies it into the thread's ring buffer.
+class LogRecordBuilder {
+public:
+    static constexpr size_t MAX_STRING_LENGTH = 4096;
+
+    LogRecordBuilder(LogLevel level, const wchar_t* format, size_t argumentCount);
+
+    template <typename T>
+    void Add(const T& value) {
+        if constexpr (std::is_same_v<T, bool>) {
+            Append(LogArgumentType::Bool, static_cast<uint8_t>(value));
+        }
+        else if constexpr (std::is_same_v<T, wchar_t> || std::is_same_v<T, char>) {
+            Append(LogArgumentType::Char, static_cast<wchar_t>(value));
+        }
+        else if constexpr (std::is_enum_v<T>) {
+            Add(static_cast<std::underlying_type_t<T>>(value));
+        }
+        else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            Append(LogArgumentType::Signed, static_cast<int64_t>(value));
+        }
+        else if constexpr (std::is_integral_v<T>) {
+            Append(LogArgumentType::Unsigned, static_cast<uint64_t>(value));
+        }
+        else if constexpr (std::is_floating_point_v<T>) {
+            Append(LogArgumentType::Double, static_cast<double>(value));
+        }
+        else if constexpr (std::is_convertible_v<const T&, const wchar_t*>) {
+            const wchar_t* string = value;
+            AddString(string == nullptr ? std::wstring_view(L"(null)") : std::wstring_view(string));
+        }
+        else if constexpr (std::is_convertible_v<const T&, std::wstring_view>) {
+            AddString(value);
+        }
+        else {
+            static_assert(std::is_trivially_copyable_v<T>, "Log arguments must be numbers, strings or trivially copyable");
+            LogCustomFormatter formatter = &LogFormatCustom<T>;
+            uint32_t size = sizeof(T);
+            Append(LogArgumentType::Custom, formatter);
+            AppendBytes(&size, sizeof(size));
+            AppendBytes(&value, sizeof(T));
+        }
+        ++m_added;
+    }
+
+    void Commit();
+private:
+    std::vector<uint8_t>& m_buffer;
+    size_t m_added;
+
+    template <typename T>
+    void Append(LogArgumentType type, const T& value) {
+        AppendBytes(&type, sizeof(type));
+        AppendBytes(&value, sizeof(value));
+    }
+
+    void AppendBytes(const void* data, size_t size);
+    void AddString(std::wstring_view value);
+};
+
+template <size_t N, typename... Args>
+void LogWrite(LogLevel level, const wchar_t (&format)[N], const Args&... args) {
+    LogRecordBuilder builder(level, format, sizeof...(Args));
+    (builder.Add(args), ...);
+    builder.Commit();
+}
+
+// Formats the records of all threads off the logging threads and hands them to a sink in time order.
+// Until it's started, records stay in the ring buffers, and a thread drops new records once its buffer is full.
+class LogDrain {
+public:
+    using Sink = std::function<void(const std::wstring& line)>;
+
+    LogDrain() : m_running(false) {}
+    ~LogDrain();
+
+    LogDrain(const LogDrain&) = delete;
+    LogDrain& operator=(const LogDrain&) = delete;
+
+    // The callbacks run on the drain thread, e.g. to lower its priority.
+    void Start(Sink sink, std::chrono::milliseconds interval, std::function<void()> started = nullptr, std::function<void()> stopping = nullptr);
+    // Drains what was recorded so far, then joins the thread.
+    void Stop();
+
+    // Drains the ring buffers on the calling thread.
+    static void Drain(const Sink& sink);
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_stopRequested;
+    bool m_running;
+    std::thread m_thread;
+
+    void Run(Sink sink, std::chrono::milliseconds interval, std::function<void()> started, std::function<void()> stopping);
+};
@@ -0,0 +1,165 @@
+#include "LogDecoder.h"
+
+#include <sstream>
+#include <iomanip>
+
+class RecordReader {
+public:
+    RecordReader(const uint8_t* data, size_t size) : m_data(data), m_remaining(size) {}
+
+    template <typename T>
+    bool Read(T& value) {
+        if (m_remaining < sizeof(T))
+            return false;
+        std::memcpy(&value, m_data, sizeof(T));
+        Skip(sizeof(T));
+        return true;
+    }
+
+    const uint8_t* Take(size_t size) {
+        if (m_remaining < size)
+            return nullptr;
+        const uint8_t* data = m_data;
+        Skip(size);
+        return data;
+    }
+private:
+    const uint8_t* m_data;
+    size_t m_remaining;
+
+    void Skip(size_t size) {
+        m_data += size;
+        m_remaining -= size;
+    }
+};
+
+static bool FormatArgument(RecordReader& reader, std::wostream& stream) {
+    LogArgumentType type;
+    if (!reader.Read(type))
+        return false;
+
+    switch (type) {
+    case LogArgumentType::Bool:
+    {
+        uint8_t value;
+        if (!reader.Read(value))
+            return false;
+        stream << (value != 0);
+        return true;
+    }
+    case LogArgumentType::Char:
+    {
+        wchar_t value;
+        if (!reader.Read(value))
+            return false;
+        stream << value;
+        return true;
+    }
+    case LogArgumentType::Signed:
+    {
+        int64_t value;
+        if (!reader.Read(value))
+            return false;
+        stream << value;
+        return true;
+    }
+    case LogArgumentType::Unsigned:
+    {
+        uint64_t value;
+        if (!reader.Read(value))
+            return false;
+        stream << value;
+        return true;
+    }
+    case LogArgumentType::Double:
+    {
+        double value;
+        if (!reader.Read(value))
+            return false;
+        stream << value;
+        return true;
+    }
+    case LogArgumentType::String:
+    {
+        uint32_t length;
+        if (!reader.Read(length))
+            return false;
+        const uint8_t* characters = reader.Take(length * sizeof(wchar_t));
+        if (characters == nullptr)
+            return false;
+        std::wstring value(length, L'\0');
+        std::memcpy(value.data(), characters, length * sizeof(wchar_t));
+        stream << value;
+        return true;
+    }
+    case LogArgumentType::Custom:
+    {
+        LogCustomFormatter formatter;
+        uint32_t size;
+        if (!reader.Read(formatter) || !reader.Read(size))
+            return false;
+        const uint8_t* value = reader.Take(size);
+        if (value == nullptr)
+            return false;
+        // The formatters restore the stream state themselves, like the GUID one in debuglog.cpp.
+        formatter(stream, value);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+static wchar_t LevelLetter(LogLevel level) {
+    switch (level) {
+    case LogLevel::Trace:
+        return L'T';
+    case LogLevel::Debug:
+        return L'D';
+    case LogLevel::Info:
+        return L'I';
+    case LogLevel::Warning:
+        return L'W';
+    case LogLevel::Error:
+        return L'E';
+    default:
+        return L'?';
+    }
+}
+
+std::optional<DecodedLogRecord> DecodeLogRecord(const uint8_t* data, size_t size, uint32_t threadIndex) {
+    RecordReader reader(data, size);
+    LogRecordHeader header;
+    if (!reader.Read(header) || header.size != size || header.format == nullptr)
+        return std::nullopt;
+
+    std::wostringstream stream;
+    uint8_t formatted = 0;
+    for (const wchar_t* format = header.format; *format != L'\0'; ++format) {
+        if (format[0] == L'{' && format[1] == L'}' && formatted < header.argumentCount) {
+            if (!FormatArgument(reader, stream))
+                return std::nullopt;
+            ++formatted;
+            ++format;
+        }
+        else {
+            stream << *format;
+        }
+    }
+
+    // Arguments without a placeholder are appended, so nothing recorded is lost.
+    for (; formatted < header.argumentCount; ++formatted) {
+        stream << L' ';
+        if (!FormatArgument(reader, stream))
+            return std::nullopt;
+    }
+
+    return DecodedLogRecord{ header.level, header.timestamp, threadIndex, stream.str() };
+}
+
+std::wstring FormatLogLine(const DecodedLogRecord& record) {
+    std::wostringstream stream;
+    stream << L'[' << record.timestamp / 1000000000 << L'.' << std::setfill(L'0') << std::setw(6) << record.timestamp % 1000000000 / 1000
+        << L' ' << LevelLetter(record.level) << L" #" << record.threadIndex << L"] " << record.message << L'\n';
+    return stream.str();
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <optional>
+
+#include "Log.h"
+
+struct DecodedLogRecord {
+    LogLevel level;
+    uint64_t timestamp;
+    uint32_t threadIndex;
+    std::wstring message;
+};
+
+// Turns a binary record back into text, substituting the arguments into the format.
+// Returns nullopt when the record is truncated or malformed.
+std::optional<DecodedLogRecord> DecodeLogRecord(const uint8_t* data, size_t size, uint32_t threadIndex);
+
+// The line written to the sink, e.g. "[12.345678 W #3] message".
+std::wstring FormatLogLine(const DecodedLogRecord& record);
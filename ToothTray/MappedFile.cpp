@@ -0,0 +1,163 @@
+#include "MappedFile.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <system_error>
+
+#ifdef _WIN32
+#include "framework.h"
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::~MappedFile() {
+    if (m_data == nullptr)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+#else
+    munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+}
+
+std::shared_ptr<const MappedFile> MappedFile::Open(const std::filesystem::path& path) {
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+#ifdef _WIN32
+    // Sharing delete lets the file be replaced while it's mapped
+    HANDLE hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    LARGE_INTEGER size{};
+    HANDLE hMapping = NULL;
+    if (GetFileSizeEx(hFile, &size) && size.QuadPart > 0 && static_cast<unsigned long long>(size.QuadPart) <= SIZE_MAX)
+        hMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(hFile);
+    if (hMapping == NULL)
+        return nullptr;
+
+    // The view keeps the mapping alive on its own
+    file->m_data = static_cast<const uint8_t*>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(hMapping);
+    if (file->m_data == nullptr)
+        return nullptr;
+    file->m_size = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat status{};
+    void* data = MAP_FAILED;
+    if (fstat(fd, &status) == 0 && status.st_size > 0)
+        data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return nullptr;
+
+    file->m_data = static_cast<const uint8_t*>(data);
+    file->m_size = static_cast<size_t>(status.st_size);
+#endif
+    return file;
+}
+
+bool MappedFile::WriteAtomically(const std::filesystem::path& path, std::span<const uint8_t> bytes) {
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+
+    std::filesystem::path temporary = path;
+    temporary += L".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        file.flush();
+        if (!file)
+            return false;
+    }
+
+#ifdef _WIN32
+    if (!MoveFileExW(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        DeleteFileW(temporary.c_str());
+        return false;
+    }
+#else
+    if (rename(temporary.c_str(), path.c_str()) != 0) {
+        unlink(temporary.c_str());
+        return false;
+    }
+#endif
+    return true;
+}
+
+std::filesystem::path VersionedMappedFile::VersionPath(uint64_t version) const {
+    std::filesystem::path path = m_path;
+    path.replace_filename(m_path.stem().wstring() + L'.' + std::to_wstring(version) + m_path.extension().wstring());
+    return path;
+}
+
+std::optional<uint64_t> VersionedMappedFile::VersionOf(const std::filesystem::path& file) const {
+    // stem.N.extension
+    std::wstring name = file.filename().wstring();
+    std::wstring prefix = m_path.stem().wstring() + L'.';
+    std::wstring suffix = m_path.extension().wstring();
+    if (name.size() <= prefix.size() + suffix.size() || name.compare(0, prefix.size(), prefix) != 0
+        || name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+        return std::nullopt;
+
+    std::wstring digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+    if (digits.size() > 18 || !std::all_of(digits.begin(), digits.end(), [](wchar_t c) { return c >= L'0' && c <= L'9'; }))
+        return std::nullopt;
+    return std::stoull(digits);
+}
+
+std::vector<uint64_t> VersionedMappedFile::Versions() const {
+    std::vector<uint64_t> versions;
+    std::error_code error;
+    for (std::filesystem::directory_iterator ite(m_path.parent_path(), error), end; !error && ite != end; ite.increment(error)) {
+        std::optional<uint64_t> version = VersionOf(ite->path());
+        if (version.has_value())
+            versions.push_back(*version);
+    }
+    std::sort(versions.begin(), versions.end(), std::greater<uint64_t>());
+    return versions;
+}
+
+std::shared_ptr<const MappedFile> VersionedMappedFile::Open(const Validator& validate) {
+    std::vector<uint64_t> versions = Versions();
+    // Written above every version found, even one that fails, so a name is never reused
+    m_version = versions.empty() ? 0 : versions.front();
+    for (uint64_t version : versions) {
+        std::shared_ptr<const MappedFile> file = MappedFile::Open(VersionPath(version));
+        if (file != nullptr && validate(file->Bytes())) {
+            DeleteOtherVersions(version);
+            return file;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const MappedFile> VersionedMappedFile::Write(std::span<const uint8_t> bytes) {
+    // A new name is never mapped, so renaming the temporary to it works everywhere
+    std::filesystem::path path = VersionPath(m_version + 1);
+    if (!MappedFile::WriteAtomically(path, bytes))
+        return nullptr;
+    ++m_version;
+
+    DeleteOtherVersions(m_version);
+    return MappedFile::Open(path);
+}
+
+void VersionedMappedFile::DeleteOtherVersions(uint64_t kept) {
+    // Those a reader still maps can't be deleted on Windows; they're tried again after the next write
+    std::error_code error;
+    std::filesystem::remove(m_path, error);
+    for (uint64_t version : Versions()) {
+        if (version != kept)
+            std::filesystem::remove(VersionPath(version), error);
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <span>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <functional>
+#include <filesystem>
+
+// A whole file mapped read-only into memory. The mapping stays valid after the file is deleted, or
+// replaced where the system allows it, so readers holding on to a MappedFile never see a partially
+// written file.
+class MappedFile {
+public:
+    MappedFile() : m_data(nullptr), m_size(0) {}
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Null if the file doesn't exist, is empty or can't be mapped.
+    static std::shared_ptr<const MappedFile> Open(const std::filesystem::path& path);
+
+    // Writes the bytes to a temporary file next to path and renames it over path, so the file is
+    // either the old or the new content even if the process dies half way. Windows refuses to replace
+    // a file that is mapped, so a file read through a MappedFile is written with VersionedMappedFile.
+    static bool WriteAtomically(const std::filesystem::path& path, std::span<const uint8_t> bytes);
+
+    std::span<const uint8_t> Bytes() const {
+        return { m_data, m_size };
+    }
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+};
+
+// A file that is rewritten while readers may still map it. Windows can neither rename over nor delete
+// a mapped file, so every write goes to a new numbered version next to the path, e.g. name.cache is
+// kept as name.1.cache, name.2.cache and so on. The others are deleted on every write and open,
+// which only succeeds on Windows once nothing maps them anymore. Not thread-safe.
+class VersionedMappedFile {
+public:
+    using Validator = std::function<bool(std::span<const uint8_t> bytes)>;
+
+    VersionedMappedFile() : m_version(0) {}
+    explicit VersionedMappedFile(std::filesystem::path path) : m_path(std::move(path)), m_version(0) {}
+
+    const std::filesystem::path& Path() const {
+        return m_path;
+    }
+
+    // Maps the newest version that passes validate. Null if there is none.
+    std::shared_ptr<const MappedFile> Open(const Validator& validate);
+    // Writes the bytes as the next version and maps it. Null if it couldn't be written.
+    std::shared_ptr<const MappedFile> Write(std::span<const uint8_t> bytes);
+private:
+    std::filesystem::path m_path;
+    // The newest version found or written
+    uint64_t m_version;
+
+    std::filesystem::path VersionPath(uint64_t version) const;
+    std::optional<uint64_t> VersionOf(const std::filesystem::path& file) const;
+    // Newest first
+    std::vector<uint64_t> Versions() const;
+    // Also deletes a file at the unversioned path, e.g. one written before versions were used.
+    void DeleteOtherVersions(uint64_t kept);
+};
@@ -0,0 +1,109 @@
+#include "MenuModel.h"
+
+#include <algorithm>
+
+#include "GuidMap.h"
+
+// Marks the longest run of entries that are already in increasing order, which is the largest set of
+// entries that can stay where they are.
+static std::vector<bool> LongestIncreasingSubsequence(const std::vector<int32_t>& values) {
+    // tails[k] is the index of the smallest value ending an increasing run of length k + 1
+    std::vector<size_t> tails;
+    std::vector<int32_t> previous(values.size(), -1);
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (values[i] < 0)
+            continue;
+
+        std::vector<size_t>::iterator ite = std::lower_bound(tails.begin(), tails.end(), values[i],
+            [&values](size_t index, int32_t value) { return values[index] < value; });
+        if (ite != tails.begin())
+            previous[i] = static_cast<int32_t>(*(ite - 1));
+        if (ite == tails.end())
+            tails.push_back(i);
+        else
+            *ite = i;
+    }
+
+    std::vector<bool> kept(values.size(), false);
+    for (int32_t i = tails.empty() ? -1 : static_cast<int32_t>(tails.back()); i >= 0; i = previous[i])
+        kept[i] = true;
+    return kept;
+}
+
+std::optional<size_t> MenuModel::IndexOfSlot(uint32_t slot) const {
+    if (slot == 0 || slot > MAX_SLOTS || m_slotIndices[slot] < 0)
+        return std::nullopt;
+    return static_cast<size_t>(m_slotIndices[slot]);
+}
+
+uint32_t MenuModel::AllocateSlot() {
+    if (!m_freeSlots.empty()) {
+        uint32_t slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        return slot;
+    }
+    return m_nextSlot++;
+}
+
+std::vector<MenuPatch> MenuModel::Update(std::span<const MenuItem> items) {
+    items = items.first(std::min<size_t>(items.size(), MAX_SLOTS));
+
+    GuidMap<size_t> oldIndices;
+    oldIndices.reserve(m_entries.size());
+    for (size_t i = 0; i < m_entries.size(); ++i)
+        oldIndices.emplace(m_entries[i].item.containerId, i);
+
+    // Where every new item was before, -1 for new ones and repeated containers
+    std::vector<int32_t> previousPositions(items.size(), -1);
+    std::vector<bool> stillShown(m_entries.size(), false);
+    for (size_t i = 0; i < items.size(); ++i) {
+        GuidMap<size_t>::iterator ite = oldIndices.find(items[i].containerId);
+        if (ite == oldIndices.end() || stillShown[ite->second])
+            continue;
+        previousPositions[i] = static_cast<int32_t>(ite->second);
+        stillShown[ite->second] = true;
+    }
+
+    std::vector<bool> kept = LongestIncreasingSubsequence(previousPositions);
+    std::vector<bool> oldKept(m_entries.size(), false);
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (kept[i])
+            oldKept[previousPositions[i]] = true;
+    }
+
+    std::vector<MenuPatch> patches;
+    // Removing from the back keeps the positions of the entries before valid
+    for (size_t i = m_entries.size(); i-- > 0;) {
+        if (oldKept[i])
+            continue;
+        patches.push_back(MenuPatch{ MenuPatchType::Remove, i, m_entries[i].slot });
+        if (!stillShown[i]) {
+            m_slotIndices[m_entries[i].slot] = -1;
+            m_freeSlots.push_back(m_entries[i].slot);
+        }
+    }
+
+    std::vector<MenuEntry> entries;
+    entries.reserve(items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        const MenuItem& item = items[i];
+        if (previousPositions[i] < 0) {
+            entries.push_back(MenuEntry{ item, AllocateSlot() });
+            patches.push_back(MenuPatch{ MenuPatchType::Insert, i, entries.back().slot });
+            continue;
+        }
+
+        // Moved entries keep their slot, so the command id of a device doesn't change while it's shown
+        const MenuEntry& previous = m_entries[previousPositions[i]];
+        entries.push_back(MenuEntry{ item, previous.slot });
+        if (!kept[i])
+            patches.push_back(MenuPatch{ MenuPatchType::Insert, i, previous.slot });
+        else if (!(previous.item.name == item.name) || previous.item.checked != item.checked)
+            patches.push_back(MenuPatch{ MenuPatchType::Update, i, previous.slot });
+    }
+
+    m_entries = std::move(entries);
+    for (size_t i = 0; i < m_entries.size(); ++i)
+        m_slotIndices[m_entries[i].slot] = static_cast<int32_t>(i);
+    return patches;
+}
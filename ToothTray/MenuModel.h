@@ -0,0 +1,60 @@
+#pragma once
+#include <span>
+#include <vector>
+#include <cstdint>
+#include <optional>
+
+#include "Guid.h"
+#include "NamePool.h"
+
+struct MenuItem {
+    GUID containerId;
+    InternedName name;
+    bool checked;
+};
+
+struct MenuEntry {
+    MenuItem item;
+    // Stable for as long as the device stays in the menu, so it's part of the command id
+    uint32_t slot;
+};
+
+enum class MenuPatchType : uint8_t {
+    Insert,
+    Remove,
+    Update,
+};
+
+// One change to the live menu. Positions are valid when the patches are applied in order; inserts
+// and updates are at the position of the entry in the new model.
+struct MenuPatch {
+    MenuPatchType type;
+    size_t position;
+    uint32_t slot;
+};
+
+// The device items of the menu, keyed by container. Each update diffs the new items against the
+// current ones and returns the fewest patches that turn one into the other: items that keep their
+// relative order are only updated, everything else is removed and inserted where it now belongs.
+class MenuModel {
+public:
+    // Command ids are a base plus the slot, and the resources leave room for this many per base
+    static constexpr uint32_t MAX_SLOTS = 999;
+
+    const std::vector<MenuEntry>& Entries() const {
+        return m_entries;
+    }
+
+    std::optional<size_t> IndexOfSlot(uint32_t slot) const;
+
+    // Items past MAX_SLOTS are left out.
+    std::vector<MenuPatch> Update(std::span<const MenuItem> items);
+private:
+    std::vector<MenuEntry> m_entries;
+    // The entry index of every slot in use, -1 for free slots
+    std::vector<int32_t> m_slotIndices = std::vector<int32_t>(MAX_SLOTS + 1, -1);
+    std::vector<uint32_t> m_freeSlots;
+    uint32_t m_nextSlot = 1;
+
+    uint32_t AllocateSlot();
+};
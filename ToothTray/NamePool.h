@@ -0,0 +1,97 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <string>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+
+class NamePool;
+
+// A handle to a name stored once in a NamePool. Copying it copies a pointer, and equal names from
+// the same pool have equal handles. The pool never frees a name, so handles stay valid forever.
+class InternedName {
+public:
+    InternedName();
+
+    std::wstring_view View() const {
+        return *m_name;
+    }
+
+    operator std::wstring_view() const {
+        return *m_name;
+    }
+
+    // Null-terminated, for Win32 calls
+    const wchar_t* c_str() const {
+        return m_name->c_str();
+    }
+
+    bool empty() const {
+        return m_name->empty();
+    }
+
+    bool operator==(const InternedName& other) const {
+        return m_name == other.m_name;
+    }
+private:
+    const std::wstring* m_name;
+
+    explicit InternedName(const std::wstring* name) : m_name(name) {}
+
+    friend class NamePool;
+};
+
+// Stores every distinct name once. Names come from a handful of paired devices, so nothing is ever
+// removed. Interning is thread-safe; reading an InternedName needs no lock.
+class NamePool {
+public:
+    NamePool() {
+        m_empty = Intern(std::wstring_view());
+    }
+
+    NamePool(const NamePool&) = delete;
+    NamePool& operator=(const NamePool&) = delete;
+
+    // The pool device names from every source go to
+    static NamePool& Shared() {
+        static NamePool pool;
+        return pool;
+    }
+
+    InternedName Intern(std::wstring_view name) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto ite = m_handles.find(name);
+        if (ite != m_handles.end())
+            return InternedName(ite->second);
+
+        // A deque never moves its elements, so the views used as keys stay valid
+        const std::wstring& stored = m_names.emplace_back(name);
+        m_handles.emplace(std::wstring_view(stored), &stored);
+        m_bytes += (stored.size() + 1) * sizeof(wchar_t);
+        return InternedName(&stored);
+    }
+
+    InternedName Empty() const {
+        return m_empty;
+    }
+
+    size_t Size() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_names.size();
+    }
+
+    // Characters stored, without the bookkeeping
+    size_t Bytes() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_bytes;
+    }
+private:
+    std::mutex m_mutex;
+    std::deque<std::wstring> m_names;
+    std::unordered_map<std::wstring_view, const std::wstring*> m_handles;
+    size_t m_bytes = 0;
+    InternedName m_empty{ nullptr };
+};
+
+inline InternedName::InternedName() : InternedName(NamePool::Shared().Empty()) {}
@@ -0,0 +1,66 @@
+#include "PresencePolicy.h"
+
+#include <algorithm>
+
+#include "DeviceTable.h"
+
+PresencePolicy::PresencePolicy(const PresencePolicyOptions& options, TimePoint now)
+    : m_options(options), m_autoConnectTokens(static_cast<double>(options.autoConnectBurst)), m_tokensUpdated(now) {}
+
+void PresencePolicy::SetDevicePolicy(uint64_t address, const DevicePresencePolicy& policy) {
+    m_devices[address].policy = policy;
+}
+
+PresenceDecision PresencePolicy::InRange(uint64_t address, uint32_t classOfDevice, bool paired, bool connected, TimePoint now) {
+    PresenceDecision decision{ false, false };
+    if (!paired || DeviceMajorClass(classOfDevice) != DEVICE_MAJOR_CLASS_AUDIO)
+        return decision;
+
+    DeviceState& device = m_devices[address];
+    bool arrived = !device.inRange && !(device.leftRange.has_value() && now - *device.leftRange < m_options.rejoinGrace);
+    device.inRange = true;
+    device.leftRange.reset();
+    if (!arrived)
+        return decision;
+
+    const DevicePresencePolicy& policy = device.policy.value_or(m_defaultPolicy);
+    if (policy.prewarm && !(device.lastPrewarm.has_value() && now - *device.lastPrewarm < m_options.prewarmInterval)) {
+        decision.prewarm = true;
+        device.lastPrewarm = now;
+    }
+
+    if (policy.autoConnect && !connected && !(device.lastAutoConnect.has_value() && now - *device.lastAutoConnect < m_options.autoConnectInterval)) {
+        RefillTokens(now);
+        if (m_autoConnectTokens >= 1.0) {
+            m_autoConnectTokens -= 1.0;
+            decision.autoConnect = true;
+            device.lastAutoConnect = now;
+        }
+    }
+    return decision;
+}
+
+void PresencePolicy::OutOfRange(uint64_t address, TimePoint now) {
+    std::unordered_map<uint64_t, DeviceState>::iterator ite = m_devices.find(address);
+    if (ite == m_devices.end() || !ite->second.inRange)
+        return;
+
+    ite->second.inRange = false;
+    ite->second.leftRange = now;
+}
+
+size_t PresencePolicy::AutoConnectTokens(TimePoint now) {
+    RefillTokens(now);
+    return static_cast<size_t>(m_autoConnectTokens);
+}
+
+void PresencePolicy::RefillTokens(TimePoint now) {
+    if (now <= m_tokensUpdated)
+        return;
+
+    if (m_options.autoConnectRefill.count() > 0) {
+        double refilled = std::chrono::duration<double>(now - m_tokensUpdated) / m_options.autoConnectRefill;
+        m_autoConnectTokens = std::min(m_autoConnectTokens + refilled, static_cast<double>(m_options.autoConnectBurst));
+    }
+    m_tokensUpdated = now;
+}
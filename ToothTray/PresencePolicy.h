@@ -0,0 +1,67 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+
+// What is done ahead of time when a device comes into range.
+struct DevicePresencePolicy {
+    // Resolve the device's container and driver controls, so its first click doesn't wait for them
+    bool prewarm = true;
+    bool autoConnect = false;
+};
+
+struct PresenceDecision {
+    bool prewarm;
+    bool autoConnect;
+};
+
+struct PresencePolicyOptions {
+    // Leaving range for less than this and coming back isn't a new arrival
+    std::chrono::seconds rejoinGrace{ 30 };
+    // The least time between two prewarms of a device
+    std::chrono::seconds prewarmInterval{ 60 };
+    // The least time between two connect attempts on a device
+    std::chrono::seconds autoConnectInterval{ 600 };
+    // Connect attempts across all devices: this many at once, then one more per refill
+    size_t autoConnectBurst = 2;
+    std::chrono::seconds autoConnectRefill{ 300 };
+};
+
+// Decides what to do about paired audio devices coming into and leaving range. Only an arrival acts:
+// a device that stays in range and reports again, e.g. because its connected flag changed, is left
+// alone, so a device the user disconnected isn't connected again behind their back.
+// Time only moves when the caller passes it in. Not thread-safe.
+class PresencePolicy {
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    PresencePolicy(const PresencePolicyOptions& options, TimePoint now);
+
+    void SetDefaultPolicy(const DevicePresencePolicy& policy) {
+        m_defaultPolicy = policy;
+    }
+
+    void SetDevicePolicy(uint64_t address, const DevicePresencePolicy& policy);
+
+    PresenceDecision InRange(uint64_t address, uint32_t classOfDevice, bool paired, bool connected, TimePoint now);
+    void OutOfRange(uint64_t address, TimePoint now);
+
+    size_t AutoConnectTokens(TimePoint now);
+private:
+    struct DeviceState {
+        std::optional<DevicePresencePolicy> policy;
+        bool inRange = false;
+        std::optional<TimePoint> leftRange;
+        std::optional<TimePoint> lastPrewarm;
+        std::optional<TimePoint> lastAutoConnect;
+    };
+
+    PresencePolicyOptions m_options;
+    DevicePresencePolicy m_defaultPolicy;
+    std::unordered_map<uint64_t, DeviceState> m_devices;
+    double m_autoConnectTokens;
+    TimePoint m_tokensUpdated;
+
+    void RefillTokens(TimePoint now);
+};
@@ -0,0 +1,219 @@
+#include "SdpParser.h"
+
+#include <cstring>
+
+// Bluetooth base UUID 00000000-0000-1000-8000-00805F9B34FB, which 16 and 32 bit UUIDs are aliases in
+static constexpr GUID SDP_BASE_UUID = { 0x00000000, 0x0000, 0x1000, { 0x80, 0x00, 0x00, 0x80, 0x5F, 0x9B, 0x34, 0xFB } };
+
+static uint64_t ReadBigEndian(std::span<const uint8_t> bytes) {
+    uint64_t value = 0;
+    for (uint8_t byte : bytes)
+        value = (value << 8) | byte;
+    return value;
+}
+
+std::optional<uint32_t> SdpUuid::ShortValue() const {
+    if (size == 16 && (value.Data2 != SDP_BASE_UUID.Data2 || value.Data3 != SDP_BASE_UUID.Data3
+        || std::memcmp(value.Data4, SDP_BASE_UUID.Data4, sizeof(value.Data4)) != 0))
+        return std::nullopt;
+    return value.Data1;
+}
+
+std::optional<SdpElement> SdpElement::Parse(std::span<const uint8_t> bytes, size_t& size) {
+    if (bytes.empty())
+        return std::nullopt;
+
+    uint8_t descriptor = bytes[0];
+    uint8_t typeValue = descriptor >> 3;
+    uint8_t sizeIndex = descriptor & 0x07;
+    if (typeValue > static_cast<uint8_t>(SdpType::Url))
+        return std::nullopt;
+    SdpType type = static_cast<SdpType>(typeValue);
+
+    size_t headerSize = 1;
+    size_t valueSize;
+    if (type == SdpType::Nil) {
+        if (sizeIndex != 0)
+            return std::nullopt;
+        valueSize = 0;
+    } else if (sizeIndex <= 4) {
+        valueSize = size_t{ 1 } << sizeIndex;
+    } else {
+        // 5, 6 and 7 are followed by a 1, 2 or 4 byte length
+        size_t lengthSize = size_t{ 1 } << (sizeIndex - 5);
+        if (bytes.size() < 1 + lengthSize)
+            return std::nullopt;
+        valueSize = static_cast<size_t>(ReadBigEndian(bytes.subspan(1, lengthSize)));
+        headerSize += lengthSize;
+    }
+
+    // Only strings, sequences and URLs have a variable length, and only integers are 16 bytes long
+    bool variable = sizeIndex >= 5;
+    bool variableType = type == SdpType::Text || type == SdpType::Sequence || type == SdpType::Alternative || type == SdpType::Url;
+    if (type != SdpType::Nil && variable != variableType)
+        return std::nullopt;
+    if (type == SdpType::Bool && valueSize != 1)
+        return std::nullopt;
+    if (type == SdpType::Uuid && valueSize != 2 && valueSize != 4 && valueSize != 16)
+        return std::nullopt;
+
+    if (bytes.size() - headerSize < valueSize)
+        return std::nullopt;
+
+    size = headerSize + valueSize;
+    return SdpElement(type, bytes.subspan(headerSize, valueSize));
+}
+
+std::optional<uint64_t> SdpElement::AsUInt() const {
+    // 128 bit integers don't fit, and are only used for keys that aren't decoded here
+    if (m_type != SdpType::UInt || m_value.size() > sizeof(uint64_t))
+        return std::nullopt;
+    return ReadBigEndian(m_value);
+}
+
+std::optional<int64_t> SdpElement::AsSInt() const {
+    if (m_type != SdpType::SInt || m_value.size() > sizeof(int64_t))
+        return std::nullopt;
+
+    // Sign extend from the encoded width
+    unsigned shift = static_cast<unsigned>(64 - 8 * m_value.size());
+    return static_cast<int64_t>(ReadBigEndian(m_value) << shift) >> shift;
+}
+
+std::optional<bool> SdpElement::AsBool() const {
+    if (m_type != SdpType::Bool)
+        return std::nullopt;
+    return m_value[0] != 0;
+}
+
+std::optional<SdpUuid> SdpElement::AsUuid() const {
+    if (m_type != SdpType::Uuid)
+        return std::nullopt;
+
+    SdpUuid uuid{ SDP_BASE_UUID, static_cast<uint8_t>(m_value.size()) };
+    if (m_value.size() == 16) {
+        // Big endian on the wire, while the first three GUID fields are native integers
+        uuid.value.Data1 = static_cast<uint32_t>(ReadBigEndian(m_value.subspan(0, 4)));
+        uuid.value.Data2 = static_cast<uint16_t>(ReadBigEndian(m_value.subspan(4, 2)));
+        uuid.value.Data3 = static_cast<uint16_t>(ReadBigEndian(m_value.subspan(6, 2)));
+        std::memcpy(uuid.value.Data4, m_value.data() + 8, sizeof(uuid.value.Data4));
+    } else {
+        uuid.value.Data1 = static_cast<uint32_t>(ReadBigEndian(m_value));
+    }
+    return uuid;
+}
+
+std::optional<std::string_view> SdpElement::AsText() const {
+    if (m_type != SdpType::Text && m_type != SdpType::Url)
+        return std::nullopt;
+
+    // Some stacks include the terminating null
+    std::string_view text(reinterpret_cast<const char*>(m_value.data()), m_value.size());
+    while (!text.empty() && text.back() == '\0')
+        text.remove_suffix(1);
+    return text;
+}
+
+bool SdpSequence::IsWellFormed() const {
+    // Walked without recursion, since the record comes from the remote device. The value of a nested
+    // sequence starts right after its header and its parent continues right after it, so entering
+    // one only has to remember where the parent ends.
+    const uint8_t* parentEnds[SDP_MAX_NESTING];
+    size_t depth = 0;
+    const uint8_t* position = m_bytes.data();
+    const uint8_t* end = position + m_bytes.size();
+    while (position != end || depth > 0) {
+        if (position == end) {
+            end = parentEnds[--depth];
+            continue;
+        }
+
+        size_t size = 0;
+        std::optional<SdpElement> element = SdpElement::Parse(std::span<const uint8_t>(position, end), size);
+        if (!element.has_value())
+            return false;
+        if (!element->IsSequence()) {
+            position += size;
+            continue;
+        }
+
+        if (depth == SDP_MAX_NESTING)
+            return false;
+        parentEnds[depth++] = end;
+        position = element->Value().data();
+        end = position + element->Value().size();
+    }
+    return true;
+}
+
+void SdpRecord::Iterator::Next() {
+    m_atEnd = true;
+    if (m_elements == SdpElementIterator())
+        return;
+
+    // Attribute ids are always 16 bit unsigned integers
+    std::optional<uint64_t> id = m_elements->AsUInt();
+    if (!id.has_value() || m_elements->Value().size() != sizeof(uint16_t)) {
+        m_elements = SdpElementIterator();
+        return;
+    }
+    ++m_elements;
+    if (m_elements == SdpElementIterator())
+        return;
+
+    m_current = SdpAttribute{ static_cast<uint16_t>(*id), *m_elements };
+    m_atEnd = false;
+    ++m_elements;
+}
+
+SdpRecord::SdpRecord(std::span<const uint8_t> bytes) : m_valid(false) {
+    size_t size = 0;
+    std::optional<SdpElement> record = SdpElement::Parse(bytes, size);
+    if (!record.has_value() || record->Type() != SdpType::Sequence)
+        return;
+
+    m_attributes = SdpSequence(*record);
+    m_valid = m_attributes.IsWellFormed();
+}
+
+std::optional<SdpElement> SdpRecord::Find(uint16_t attributeId) const {
+    for (const SdpAttribute& attribute : *this) {
+        if (attribute.id == attributeId)
+            return attribute.value;
+    }
+    return std::nullopt;
+}
+
+std::optional<SdpProtocolDescriptor> DecodeSdpProtocolDescriptor(const SdpElement& element) {
+    // A sequence of the protocol UUID followed by its parameters
+    SdpSequence descriptor(element);
+    SdpElementIterator field = descriptor.begin();
+    if (field == descriptor.end())
+        return std::nullopt;
+
+    std::optional<SdpUuid> protocol = field->AsUuid();
+    if (!protocol.has_value())
+        return std::nullopt;
+
+    SdpProtocolDescriptor result{ *protocol, std::nullopt };
+    if (++field != descriptor.end())
+        result.parameter = field->AsUInt();
+    return result;
+}
+
+std::optional<SdpProfileDescriptor> DecodeSdpProfileDescriptor(const SdpElement& element) {
+    // A sequence of the profile UUID and its 16 bit version
+    SdpSequence descriptor(element);
+    SdpElementIterator field = descriptor.begin();
+    if (field == descriptor.end())
+        return std::nullopt;
+
+    std::optional<SdpUuid> profile = field->AsUuid();
+    if (!profile.has_value() || ++field == descriptor.end())
+        return std::nullopt;
+
+    std::optional<uint64_t> version = field->AsUInt();
+    if (!version.has_value() || *version > UINT16_MAX)
+        return std::nullopt;
+    return SdpProfileDescriptor{ *profile, static_cast<uint16_t>(*version) };
+}
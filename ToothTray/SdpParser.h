@@ -0,0 +1,255 @@
+#pragma once
+#include <span>
+#include <cstdint>
+#include <optional>
+#include <iterator>
+#include <string_view>
+
+#include "Guid.h"
+
+// Views over SDP data elements (Bluetooth Core spec, Vol 3, Part B, 3) that decode the bytes in place.
+// Nothing here allocates or copies the record; the views are only valid as long as the bytes they point to.
+
+enum class SdpType : uint8_t {
+    Nil = 0,
+    UInt = 1,
+    SInt = 2,
+    Uuid = 3,
+    Text = 4,
+    Bool = 5,
+    Sequence = 6,
+    Alternative = 7,
+    Url = 8,
+};
+
+constexpr uint16_t SDP_ATTRIBUTE_SERVICE_CLASS_ID_LIST = 0x0001;
+constexpr uint16_t SDP_ATTRIBUTE_PROTOCOL_DESCRIPTOR_LIST = 0x0004;
+constexpr uint16_t SDP_ATTRIBUTE_PROFILE_DESCRIPTOR_LIST = 0x0009;
+// At the primary language base
+constexpr uint16_t SDP_ATTRIBUTE_SERVICE_NAME = 0x0100;
+
+// Real records nest a handful of sequences; a deeper one is treated as malformed.
+constexpr size_t SDP_MAX_NESTING = 32;
+
+// A UUID of any size, widened to 128 bits with the Bluetooth base UUID.
+struct SdpUuid {
+    GUID value;
+    // 2, 4 or 16 bytes, as it was encoded
+    uint8_t size;
+
+    // The 16 or 32 bit alias, when the UUID is derived from the base UUID.
+    std::optional<uint32_t> ShortValue() const;
+};
+
+class SdpElement {
+public:
+    SdpElement() : m_type(SdpType::Nil) {}
+    SdpElement(SdpType type, std::span<const uint8_t> value) : m_type(type), m_value(value) {}
+
+    // Decodes the element at the start of bytes and sets size to the number of bytes it takes.
+    static std::optional<SdpElement> Parse(std::span<const uint8_t> bytes, size_t& size);
+
+    SdpType Type() const { return m_type; }
+    std::span<const uint8_t> Value() const { return m_value; }
+
+    std::optional<uint64_t> AsUInt() const;
+    std::optional<int64_t> AsSInt() const;
+    std::optional<bool> AsBool() const;
+    std::optional<SdpUuid> AsUuid() const;
+    // Text is usually UTF-8 but the spec doesn't require it, so it's left undecoded.
+    std::optional<std::string_view> AsText() const;
+
+    bool IsSequence() const {
+        return m_type == SdpType::Sequence || m_type == SdpType::Alternative;
+    }
+private:
+    SdpType m_type;
+    std::span<const uint8_t> m_value;
+};
+
+// Iterates the elements of a sequence. Iteration stops early at a malformed element.
+class SdpElementIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = SdpElement;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const SdpElement*;
+    using reference = const SdpElement&;
+
+    SdpElementIterator() = default;
+    explicit SdpElementIterator(std::span<const uint8_t> bytes) : m_remaining(bytes) {
+        Next();
+    }
+
+    reference operator*() const { return m_current; }
+    pointer operator->() const { return &m_current; }
+
+    SdpElementIterator& operator++() {
+        Next();
+        return *this;
+    }
+
+    SdpElementIterator operator++(int) {
+        SdpElementIterator previous = *this;
+        Next();
+        return previous;
+    }
+
+    bool operator==(const SdpElementIterator& other) const {
+        return m_atEnd == other.m_atEnd && (m_atEnd || m_remaining.data() == other.m_remaining.data());
+    }
+private:
+    std::span<const uint8_t> m_remaining;
+    SdpElement m_current;
+    bool m_atEnd = true;
+
+    void Next() {
+        size_t size = 0;
+        std::optional<SdpElement> element = m_remaining.empty() ? std::nullopt : SdpElement::Parse(m_remaining, size);
+        m_atEnd = !element.has_value();
+        if (!m_atEnd) {
+            m_current = *element;
+            m_remaining = m_remaining.subspan(size);
+        }
+    }
+};
+
+class SdpSequence {
+public:
+    SdpSequence() = default;
+    // Anything but a sequence or alternative is an empty sequence.
+    explicit SdpSequence(const SdpElement& element) : m_bytes(element.IsSequence() ? element.Value() : std::span<const uint8_t>()) {}
+
+    SdpElementIterator begin() const { return SdpElementIterator(m_bytes); }
+    SdpElementIterator end() const { return SdpElementIterator(); }
+
+    // True when every byte belongs to a well-formed element, nested at most SDP_MAX_NESTING deep.
+    bool IsWellFormed() const;
+private:
+    std::span<const uint8_t> m_bytes;
+};
+
+struct SdpAttribute {
+    uint16_t id;
+    SdpElement value;
+};
+
+// A service record: a sequence of attribute id and value pairs, as returned in the blob of a service lookup.
+class SdpRecord {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = SdpAttribute;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const SdpAttribute*;
+        using reference = const SdpAttribute&;
+
+        Iterator() = default;
+        explicit Iterator(SdpElementIterator elements) : m_elements(elements) {
+            Next();
+        }
+
+        reference operator*() const { return m_current; }
+        pointer operator->() const { return &m_current; }
+
+        Iterator& operator++() {
+            Next();
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return m_elements == other.m_elements && m_atEnd == other.m_atEnd;
+        }
+    private:
+        SdpElementIterator m_elements;
+        SdpAttribute m_current{};
+        bool m_atEnd = true;
+
+        void Next();
+    };
+
+    explicit SdpRecord(std::span<const uint8_t> bytes);
+
+    bool IsValid() const { return m_valid; }
+
+    Iterator begin() const { return Iterator(m_attributes.begin()); }
+    Iterator end() const { return Iterator(); }
+
+    std::optional<SdpElement> Find(uint16_t attributeId) const;
+private:
+    SdpSequence m_attributes;
+    bool m_valid;
+};
+
+// An entry of the protocol descriptor list, e.g. L2CAP with its PSM or RFCOMM with its channel.
+struct SdpProtocolDescriptor {
+    SdpUuid protocol;
+    // The first protocol specific parameter, if it's an integer
+    std::optional<uint64_t> parameter;
+};
+
+// An entry of the profile descriptor list, e.g. A2DP version 1.3 as 0x0103.
+struct SdpProfileDescriptor {
+    SdpUuid profile;
+    uint16_t version;
+};
+
+// Decodes a descriptor list lazily, skipping entries that don't have the expected shape.
+template <typename Descriptor, std::optional<Descriptor> (*Decode)(const SdpElement&)>
+class SdpDescriptorList {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Descriptor;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Descriptor*;
+        using reference = const Descriptor&;
+
+        Iterator() = default;
+        explicit Iterator(SdpElementIterator elements) : m_elements(elements) {
+            Next();
+        }
+
+        reference operator*() const { return m_current; }
+        pointer operator->() const { return &m_current; }
+
+        Iterator& operator++() {
+            ++m_elements;
+            Next();
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return m_elements == other.m_elements;
+        }
+    private:
+        SdpElementIterator m_elements;
+        Descriptor m_current{};
+
+        void Next() {
+            for (; m_elements != SdpElementIterator(); ++m_elements) {
+                std::optional<Descriptor> descriptor = Decode(*m_elements);
+                if (descriptor.has_value()) {
+                    m_current = *descriptor;
+                    return;
+                }
+            }
+        }
+    };
+
+    SdpDescriptorList() = default;
+    explicit SdpDescriptorList(const SdpElement& list) : m_list(list) {}
+
+    Iterator begin() const { return Iterator(m_list.begin()); }
+    Iterator end() const { return Iterator(); }
+private:
+    SdpSequence m_list;
+};
+
+std::optional<SdpProtocolDescriptor> DecodeSdpProtocolDescriptor(const SdpElement& element);
+std::optional<SdpProfileDescriptor> DecodeSdpProfileDescriptor(const SdpElement& element);
+
+using SdpProtocolDescriptorList = SdpDescriptorList<SdpProtocolDescriptor, &DecodeSdpProtocolDescriptor>;
+using SdpProfileDescriptorList = SdpDescriptorList<SdpProfileDescriptor, &DecodeSdpProfileDescriptor>;
@@ -0,0 +1,256 @@
+#include "SdpRecordCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+#include "Log.h"
+#include "WorkerPool.h"
+
+// The sections of a validated file
+struct SdpCacheTables {
+    std::span<const SdpCacheDevice> devices;
+    std::span<const SdpCacheProfile> profiles;
+    std::span<const SdpCacheRecord> records;
+    std::span<const uint8_t> data;
+};
+
+template <typename T>
+static std::span<const T> TableAt(std::span<const uint8_t> bytes, size_t offset, size_t count) {
+    return { reinterpret_cast<const T*>(bytes.data() + offset), count };
+}
+
+static std::optional<SdpCacheTables> ReadTables(std::span<const uint8_t> bytes) {
+    if (bytes.size() < sizeof(SdpCacheHeader))
+        return std::nullopt;
+
+    SdpCacheHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (header.magic != SdpRecordCache::MAGIC || header.version != SdpRecordCache::VERSION)
+        return std::nullopt;
+
+    // 64 bit sizes so a corrupt count can't overflow
+    uint64_t devicesOffset = sizeof(SdpCacheHeader);
+    uint64_t profilesOffset = devicesOffset + uint64_t{ header.deviceCount } * sizeof(SdpCacheDevice);
+    uint64_t recordsOffset = profilesOffset + uint64_t{ header.profileCount } * sizeof(SdpCacheProfile);
+    uint64_t dataOffset = recordsOffset + uint64_t{ header.recordCount } * sizeof(SdpCacheRecord);
+    if (dataOffset + header.dataSize != bytes.size())
+        return std::nullopt;
+
+    return SdpCacheTables{
+        TableAt<SdpCacheDevice>(bytes, static_cast<size_t>(devicesOffset), header.deviceCount),
+        TableAt<SdpCacheProfile>(bytes, static_cast<size_t>(profilesOffset), header.profileCount),
+        TableAt<SdpCacheRecord>(bytes, static_cast<size_t>(recordsOffset), header.recordCount),
+        bytes.subspan(static_cast<size_t>(dataOffset), header.dataSize),
+    };
+}
+
+bool ValidateSdpCache(std::span<const uint8_t> bytes) {
+    std::optional<SdpCacheTables> tables = ReadTables(bytes);
+    if (!tables.has_value())
+        return false;
+
+    for (size_t i = 0; i < tables->devices.size(); ++i) {
+        const SdpCacheDevice& device = tables->devices[i];
+        if (i > 0 && tables->devices[i - 1].address >= device.address)
+            return false;
+        if (uint64_t{ device.firstProfile } + device.profileCount > tables->profiles.size())
+            return false;
+        if (uint64_t{ device.firstRecord } + device.recordCount > tables->records.size())
+            return false;
+    }
+    for (const SdpCacheRecord& record : tables->records) {
+        if (uint64_t{ record.offset } + record.size > tables->data.size())
+            return false;
+    }
+    return true;
+}
+
+void SdpRecordCache::Open(const std::filesystem::path& path) {
+    std::lock_guard<std::mutex> lock(m_updateMutex);
+    m_files = VersionedMappedFile(path);
+
+    std::shared_ptr<const MappedFile> file = m_files.Open([&path](std::span<const uint8_t> bytes) {
+        bool valid = ValidateSdpCache(bytes);
+        if (!valid)
+            LOG_WARNING(L"Ignoring an outdated or corrupt version of the service record cache {}", path.wstring());
+        return valid;
+    });
+    m_file.store(std::move(file), std::memory_order_release);
+}
+
+std::optional<SdpCachedDevice> SdpRecordCache::Find(uint64_t address) const {
+    std::shared_ptr<const MappedFile> file = m_file.load(std::memory_order_acquire);
+    if (file == nullptr)
+        return std::nullopt;
+
+    // Validated when it was mapped
+    SdpCacheTables tables = *ReadTables(file->Bytes());
+    const SdpCacheDevice* device = std::lower_bound(tables.devices.data(), tables.devices.data() + tables.devices.size(), address,
+        [](const SdpCacheDevice& device, uint64_t address) { return device.address < address; });
+    if (device == tables.devices.data() + tables.devices.size() || device->address != address)
+        return std::nullopt;
+
+    return SdpCachedDevice(std::move(file), *device, tables.profiles.subspan(device->firstProfile, device->profileCount),
+        tables.records.subspan(device->firstRecord, device->recordCount), tables.data);
+}
+
+// Builds the file contents, keeping the devices that aren't replaced
+class SdpCacheBuilder {
+public:
+    void AddDevice(uint64_t address, int64_t updated, std::span<const SdpCacheProfile> profiles, size_t recordCount,
+        const std::function<std::span<const uint8_t>(size_t)>& record) {
+        SdpCacheDevice device{ address, updated, static_cast<uint32_t>(m_profiles.size()), static_cast<uint32_t>(profiles.size()),
+            static_cast<uint32_t>(m_records.size()), static_cast<uint32_t>(recordCount) };
+        m_devices.push_back(device);
+        m_profiles.insert(m_profiles.end(), profiles.begin(), profiles.end());
+        for (size_t i = 0; i < recordCount; ++i) {
+            std::span<const uint8_t> bytes = record(i);
+            m_records.push_back(SdpCacheRecord{ static_cast<uint32_t>(m_data.size()), static_cast<uint32_t>(bytes.size()) });
+            m_data.insert(m_data.end(), bytes.begin(), bytes.end());
+        }
+    }
+
+    std::vector<uint8_t> Build() const {
+        SdpCacheHeader header{ SdpRecordCache::MAGIC, SdpRecordCache::VERSION, static_cast<uint32_t>(m_devices.size()),
+            static_cast<uint32_t>(m_profiles.size()), static_cast<uint32_t>(m_records.size()), static_cast<uint32_t>(m_data.size()) };
+
+        std::vector<uint8_t> bytes;
+        bytes.reserve(sizeof(header) + m_devices.size() * sizeof(SdpCacheDevice) + m_profiles.size() * sizeof(SdpCacheProfile)
+            + m_records.size() * sizeof(SdpCacheRecord) + m_data.size());
+        Append(bytes, &header, sizeof(header));
+        Append(bytes, m_devices.data(), m_devices.size() * sizeof(SdpCacheDevice));
+        Append(bytes, m_profiles.data(), m_profiles.size() * sizeof(SdpCacheProfile));
+        Append(bytes, m_records.data(), m_records.size() * sizeof(SdpCacheRecord));
+        Append(bytes, m_data.data(), m_data.size());
+        return bytes;
+    }
+private:
+    std::vector<SdpCacheDevice> m_devices;
+    std::vector<SdpCacheProfile> m_profiles;
+    std::vector<SdpCacheRecord> m_records;
+    std::vector<uint8_t> m_data;
+
+    static void Append(std::vector<uint8_t>& bytes, const void* data, size_t size) {
+        const uint8_t* begin = static_cast<const uint8_t*>(data);
+        bytes.insert(bytes.end(), begin, begin + size);
+    }
+};
+
+bool SdpRecordCache::Update(uint64_t address, const std::vector<std::vector<uint8_t>>& records, std::chrono::system_clock::time_point updated) {
+    // Decoded once here so lookups can answer which profiles a device has without parsing
+    std::vector<SdpCacheProfile> profiles;
+    for (const std::vector<uint8_t>& bytes : records) {
+        SdpRecord record(bytes);
+        std::optional<SdpElement> list = record.IsValid() ? record.Find(SDP_ATTRIBUTE_PROFILE_DESCRIPTOR_LIST) : std::nullopt;
+        if (!list.has_value())
+            continue;
+        for (const SdpProfileDescriptor& profile : SdpProfileDescriptorList(*list))
+            profiles.push_back(SdpCacheProfile{ profile.profile.value, profile.version, 0 });
+    }
+    int64_t updatedSeconds = std::chrono::duration_cast<std::chrono::seconds>(updated.time_since_epoch()).count();
+
+    std::lock_guard<std::mutex> lock(m_updateMutex);
+    if (m_files.Path().empty())
+        return false;
+
+    std::shared_ptr<const MappedFile> current = m_file.load(std::memory_order_acquire);
+    std::span<const SdpCacheDevice> devices;
+    std::optional<SdpCacheTables> tables;
+    if (current != nullptr) {
+        tables = ReadTables(current->Bytes());
+        devices = tables->devices;
+    }
+
+    SdpCacheBuilder builder;
+    bool added = false;
+    auto addUpdated = [&]() {
+        builder.AddDevice(address, updatedSeconds, profiles, records.size(), [&records](size_t i) { return std::span<const uint8_t>(records[i]); });
+        added = true;
+    };
+    for (const SdpCacheDevice& device : devices) {
+        if (!added && device.address >= address)
+            addUpdated();
+        if (device.address == address)
+            continue;
+        builder.AddDevice(device.address, device.updated, tables->profiles.subspan(device.firstProfile, device.profileCount), device.recordCount,
+            [&tables, &device](size_t i) {
+                const SdpCacheRecord& record = tables->records[device.firstRecord + i];
+                return tables->data.subspan(record.offset, record.size);
+            });
+    }
+    if (!added)
+        addUpdated();
+
+    // Readers may still map the current file, so it's written as a new version
+    std::vector<uint8_t> bytes = builder.Build();
+    std::shared_ptr<const MappedFile> file = m_files.Write(bytes);
+    if (file == nullptr || !ValidateSdpCache(file->Bytes())) {
+        LOG_WARNING(L"Failed to write the service record cache {}", m_files.Path().wstring());
+        return false;
+    }
+    m_file.store(std::move(file), std::memory_order_release);
+    return true;
+}
+
+void SdpRecordCache::SetRefreshSource(WorkerPool* pool, ISdpRecordSource* source, const SdpRefreshPolicy& policy) {
+    std::lock_guard<std::mutex> lock(m_refreshMutex);
+    m_pool = pool;
+    m_source = source;
+    m_policy = policy;
+}
+
+void SdpRecordCache::RequestRefresh(uint64_t address) {
+    std::optional<SdpCachedDevice> cached = Find(address);
+    std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
+
+    std::lock_guard<std::mutex> lock(m_refreshMutex);
+    if (m_pool == nullptr || m_source == nullptr)
+        return;
+    if (cached.has_value() && now - cached->Updated() < m_policy.minimumAge)
+        return;
+
+    RefreshState& state = m_refreshes.try_emplace(address, RefreshState{ false, 0, {} }).first->second;
+    if (state.running || (state.failures > 0 && std::chrono::steady_clock::now() < state.retryAt))
+        return;
+
+    state.running = true;
+    m_pool->Submit([this, address]() { Refresh(address); });
+}
+
+void SdpRecordCache::Refresh(uint64_t address) {
+    ISdpRecordSource* source;
+    {
+        std::lock_guard<std::mutex> lock(m_refreshMutex);
+        source = m_source;
+        // Cleared to drop the queued queries
+        if (source == nullptr) {
+            m_refreshes.erase(address);
+            return;
+        }
+    }
+
+    // Keep the cached records when the device went out of range again before answering
+    std::optional<std::vector<std::vector<uint8_t>>> records = source->QueryServiceRecords(address);
+    if (records.has_value()) {
+        if (Update(address, *records, std::chrono::system_clock::now()))
+            LOG_DEBUG(L"Cached {} service records of {}", records->size(), address);
+    }
+
+    std::lock_guard<std::mutex> lock(m_refreshMutex);
+    if (records.has_value()) {
+        m_refreshes.erase(address);
+        return;
+    }
+
+    RefreshState& state = m_refreshes[address];
+    state.running = false;
+    std::chrono::steady_clock::duration delay = m_policy.retryDelay;
+    for (uint32_t i = 0; i < state.failures && delay < m_policy.maximumRetryDelay; ++i)
+        delay *= 2;
+    delay = std::min(delay, m_policy.maximumRetryDelay);
+    ++state.failures;
+    state.retryAt = std::chrono::steady_clock::now() + delay;
+    LOG_DEBUG(L"Service records of {} failed {} times, retrying in {}s", address, state.failures,
+        std::chrono::duration_cast<std::chrono::seconds>(delay).count());
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <span>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <optional>
+#include <filesystem>
+#include <unordered_map>
+
+#include "Guid.h"
+#include "MappedFile.h"
+#include "SdpParser.h"
+
+class WorkerPool;
+
+// Looks up the service records of a device over the radio, which takes seconds and only works
+// while the device is in range.
+class ISdpRecordSource {
+public:
+    virtual ~ISdpRecordSource() = default;
+
+    // Each record is the raw data element sequence. Empty if the device couldn't be queried.
+    virtual std::optional<std::vector<std::vector<uint8_t>>> QueryServiceRecords(uint64_t address) = 0;
+};
+
+// The file is a header followed by tables of fixed size entries and the record bytes, so it's used
+// straight from the mapping. Integers are native endian since the file never leaves the machine.
+struct SdpCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t deviceCount;
+    uint32_t profileCount;
+    uint32_t recordCount;
+    uint32_t dataSize;
+};
+
+// Sorted by address
+struct SdpCacheDevice {
+    uint64_t address;
+    // Seconds since the epoch
+    int64_t updated;
+    uint32_t firstProfile;
+    uint32_t profileCount;
+    uint32_t firstRecord;
+    uint32_t recordCount;
+};
+
+struct SdpCacheProfile {
+    GUID profile;
+    uint16_t version;
+    uint16_t reserved;
+};
+
+struct SdpCacheRecord {
+    uint32_t offset;
+    uint32_t size;
+};
+
+// A device in the cache. Keeps the mapping it points into alive.
+class SdpCachedDevice {
+public:
+    SdpCachedDevice(std::shared_ptr<const MappedFile> file, const SdpCacheDevice& device,
+        std::span<const SdpCacheProfile> profiles, std::span<const SdpCacheRecord> records, std::span<const uint8_t> data)
+        : m_file(std::move(file)), m_device(device), m_profiles(profiles), m_records(records), m_data(data) {}
+
+    uint64_t Address() const { return m_device.address; }
+    std::chrono::system_clock::time_point Updated() const {
+        return std::chrono::system_clock::time_point(std::chrono::seconds(m_device.updated));
+    }
+
+    // From the profile descriptor lists of all the records
+    std::span<const SdpCacheProfile> Profiles() const { return m_profiles; }
+
+    size_t RecordCount() const { return m_records.size(); }
+    SdpRecord Record(size_t index) const {
+        return SdpRecord(m_data.subspan(m_records[index].offset, m_records[index].size));
+    }
+private:
+    std::shared_ptr<const MappedFile> m_file;
+    SdpCacheDevice m_device;
+    std::span<const SdpCacheProfile> m_profiles;
+    std::span<const SdpCacheRecord> m_records;
+    std::span<const uint8_t> m_data;
+};
+
+// When a device coming into range has its records queried again.
+struct SdpRefreshPolicy {
+    // Records younger than this are kept
+    std::chrono::seconds minimumAge;
+    // A device whose query failed isn't queried again for this long, doubling with every failure in a
+    // row up to maximumRetryDelay. Out of range devices fail slowly, and they're usually still out of range.
+    std::chrono::steady_clock::duration retryDelay;
+    std::chrono::steady_clock::duration maximumRetryDelay;
+};
+
+// Service records of every device that has been queried, persisted in a memory-mapped file.
+// Lookups binary search the mapped tables and don't parse or allocate; updates write a new version of
+// the file and swap in its mapping while readers keep the old one.
+class SdpRecordCache {
+public:
+    static constexpr uint32_t MAGIC = 0x43505354; // "TSPC"
+    static constexpr uint32_t VERSION = 1;
+
+    SdpRecordCache() = default;
+
+    SdpRecordCache(const SdpRecordCache&) = delete;
+    SdpRecordCache& operator=(const SdpRecordCache&) = delete;
+
+    // A missing, outdated or corrupt file leaves the cache empty; it's rewritten on the next update.
+    void Open(const std::filesystem::path& path);
+
+    std::optional<SdpCachedDevice> Find(uint64_t address) const;
+
+    // Replaces the records of the device and rewrites the file.
+    bool Update(uint64_t address, const std::vector<std::vector<uint8_t>>& records, std::chrono::system_clock::time_point updated);
+
+    // Queries the device on the pool, unless its entry is newer than the minimum age, a query for it is
+    // already running or it's waiting to retry a failed one. Meant to be called when the device comes
+    // into range. A query keeps the radio busy for seconds, so the pool should have a single thread.
+    void RequestRefresh(uint64_t address);
+    // A null source drops the queries still queued, e.g. so stopping the pool doesn't wait for them.
+    void SetRefreshSource(WorkerPool* pool, ISdpRecordSource* source, const SdpRefreshPolicy& policy);
+private:
+    struct RefreshState {
+        bool running;
+        // Failed queries in a row
+        uint32_t failures;
+        std::chrono::steady_clock::time_point retryAt;
+    };
+
+    VersionedMappedFile m_files;
+    std::atomic<std::shared_ptr<const MappedFile>> m_file;
+    // Serializes writers
+    std::mutex m_updateMutex;
+
+    std::mutex m_refreshMutex;
+    WorkerPool* m_pool = nullptr;
+    ISdpRecordSource* m_source = nullptr;
+    SdpRefreshPolicy m_policy{};
+    // Devices with a query running or a failed one
+    std::unordered_map<uint64_t, RefreshState> m_refreshes;
+
+    void Refresh(uint64_t address);
+};
+
+// Checks the header and every table against the file size, so a truncated or corrupt file is rejected
+// up front and lookups don't need bounds checks.
+bool ValidateSdpCache(std::span<const uint8_t> bytes);
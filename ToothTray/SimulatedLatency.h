@@ -0,0 +1,35 @@
+#pragma once
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <thread>
+
+// The time a simulated system or driver call takes. Samples are log-normal around the median, which
+// gives the long tail real calls have; a spread of 0 makes every call take exactly the median.
+class SimulatedLatency {
+public:
+    SimulatedLatency() : m_median(0), m_spread(0.0) {}
+    SimulatedLatency(std::chrono::microseconds median, double spread = 0.0) : m_median(median), m_spread(spread) {}
+
+    std::chrono::microseconds Median() const {
+        return m_median;
+    }
+
+    std::chrono::microseconds Sample() const {
+        if (m_median.count() <= 0 || m_spread <= 0.0)
+            return m_median;
+
+        thread_local std::mt19937_64 generator{ std::random_device{}() };
+        std::lognormal_distribution<double> distribution(std::log(static_cast<double>(m_median.count())), m_spread);
+        return std::chrono::microseconds(static_cast<long long>(distribution(generator)));
+    }
+
+    void Wait() const {
+        std::chrono::microseconds latency = Sample();
+        if (latency.count() > 0)
+            std::this_thread::sleep_for(latency);
+    }
+private:
+    std::chrono::microseconds m_median;
+    double m_spread;
+};
@@ -0,0 +1,43 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+template <typename T>
+struct Snapshot {
+    uint64_t generation;
+    T value;
+};
+
+// Publishes immutable snapshots to readers on other threads.
+// The writer fills a new back buffer and swaps it in; readers keep the front buffer they got alive
+// for as long as they use it, so reading never blocks and never sees a half-written snapshot.
+template <typename T>
+class SnapshotPublisher {
+public:
+    SnapshotPublisher() : m_current(std::make_shared<const Snapshot<T>>(Snapshot<T>{ 0, T{} })), m_generation(0) {}
+
+    SnapshotPublisher(const SnapshotPublisher&) = delete;
+    SnapshotPublisher& operator=(const SnapshotPublisher&) = delete;
+
+    // Returns the generation of the published snapshot. When writers race, a snapshot never replaces
+    // one with a newer generation.
+    uint64_t Publish(T&& value) {
+        uint64_t generation = ++m_generation;
+        std::shared_ptr<const Snapshot<T>> back = std::make_shared<const Snapshot<T>>(Snapshot<T>{ generation, std::move(value) });
+
+        std::shared_ptr<const Snapshot<T>> front = m_current.load(std::memory_order_acquire);
+        while (front->generation < generation) {
+            if (m_current.compare_exchange_weak(front, back, std::memory_order_acq_rel, std::memory_order_acquire))
+                break;
+        }
+        return generation;
+    }
+
+    std::shared_ptr<const Snapshot<T>> Current() const {
+        return m_current.load(std::memory_order_acquire);
+    }
+private:
+    std::atomic<std::shared_ptr<const Snapshot<T>>> m_current;
+    std::atomic<uint64_t> m_generation;
+};
@@ -0,0 +1,34 @@
+#include "StartupTimeline.h"
+
+#include <cwchar>
+
+#include "Trace.h"
+
+static uint64_t TraceTime(StartupTimeline::Clock::time_point time) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count());
+}
+
+static void AppendDuration(std::wstring& text, const char* name, StartupTimeline::Clock::duration duration) {
+    for (const char* c = name; *c != '\0'; ++c)
+        text.push_back(static_cast<wchar_t>(*c));
+    wchar_t milliseconds[32];
+    std::swprintf(milliseconds, std::size(milliseconds), L" %.1fms", std::chrono::duration<double, std::milli>(duration).count());
+    text += milliseconds;
+}
+
+void StartupTimeline::Mark(const char* phase, Clock::time_point now) {
+    if (Tracer::Enabled())
+        Tracer::Record(phase, TraceTime(m_last), TraceTime(now));
+    m_phases.push_back(Phase{ phase, now - m_last });
+    m_last = now;
+}
+
+std::wstring StartupTimeline::Format() const {
+    std::wstring text;
+    for (const Phase& phase : m_phases) {
+        AppendDuration(text, phase.name, phase.duration);
+        text += L", ";
+    }
+    AppendDuration(text, "total", Total());
+    return text;
+}
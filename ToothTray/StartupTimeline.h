@@ -0,0 +1,38 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Splits startup into phases, each timed from the end of the one before, for the cold start report.
+// Phases are also recorded as trace spans while tracing. Only used on the thread starting up.
+class StartupTimeline {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Phase {
+        // A string literal, like trace span names
+        const char* name;
+        Clock::duration duration;
+    };
+
+    // start can be before the timeline is created, e.g. when the process was created.
+    explicit StartupTimeline(Clock::time_point start) : m_start(start), m_last(start) {}
+
+    // Ends the current phase under the given name and starts the next one.
+    void Mark(const char* phase, Clock::time_point now = Clock::now());
+
+    const std::vector<Phase>& Phases() const {
+        return m_phases;
+    }
+
+    Clock::duration Total() const {
+        return m_last - m_start;
+    }
+
+    // "window 1.2ms, tray icon 0.4ms, total 1.6ms"
+    std::wstring Format() const;
+private:
+    Clock::time_point m_start;
+    Clock::time_point m_last;
+    std::vector<Phase> m_phases;
+};
@@ -1,180 +1,538 @@
-// ToothTray.cpp : Defines the entry point for the application.
-//
-
-#include "framework.h"
-#include "ToothTray.h"
-#include <memory>
-#include <winrt/base.h>
-
-#include "debuglog.h"
-#include "BluetoothAudioDevices.h"
-#include "TrayIcon.h"
-#include "ToothTrayMenu.h"
-
-#define MAX_LOADSTRING 100
-
-// Global Variables:
-HINSTANCE hInst;                                // current instance
-WCHAR szTitle[MAX_LOADSTRING];                  // The title bar text
-WCHAR szWindowClass[MAX_LOADSTRING];            // the main window class name
-constexpr UINT WM_TRAYICON = WM_APP;
-
-BluetoothAudioDeviceEnumerator bluetoothAudioDeviceEmumerator;
-ToothTrayMenu trayMenu;
-TrayIcon trayIcon;
-
-// Forward declarations of functions included in this code module:
-ATOM                MyRegisterClass(HINSTANCE hInstance);
-BOOL                InitInstance(HINSTANCE, int);
-LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
-INT_PTR CALLBACK    About(HWND, UINT, WPARAM, LPARAM);
-
-int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
-                     _In_opt_ HINSTANCE hPrevInstance,
-                     _In_ LPWSTR    lpCmdLine,
-                     _In_ int       nCmdShow)
-{
-    UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
-
-    // TODO: Place code here.
-    winrt::init_apartment();
-
-    // Initialize global strings
-    LoadStringW(hInstance, IDS_APP_TITLE, szTitle, MAX_LOADSTRING);
-    LoadStringW(hInstance, IDC_TOOTHTRAY, szWindowClass, MAX_LOADSTRING);
-    MyRegisterClass(hInstance);
-
-    // Perform application initialization:
-    if (!InitInstance (hInstance, nCmdShow))
-    {
-        return FALSE;
-    }
-
-    MSG msg;
-
-    // Main message loop:
-    while (GetMessage(&msg, nullptr, 0, 0))
-    {
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
-    }
-
-    return (int) msg.wParam;
-}
-
-//
-//  FUNCTION: MyRegisterClass()
-//
-//  PURPOSE: Registers the window class.
-//
-ATOM MyRegisterClass(HINSTANCE hInstance)
-{
-    WNDCLASSEXW wcex;
-
-    wcex.cbSize = sizeof(WNDCLASSEX);
-
-    wcex.style          = CS_HREDRAW | CS_VREDRAW;
-    wcex.lpfnWndProc    = WndProc;
-    wcex.cbClsExtra     = 0;
-    wcex.cbWndExtra     = 0;
-    wcex.hInstance      = hInstance;
-    wcex.hIcon          = LoadIcon(hInstance, MAKEINTRESOURCE(IDI_TOOTHTRAY));
-    wcex.hCursor        = LoadCursor(nullptr, IDC_ARROW);
-    wcex.hbrBackground  = (HBRUSH)(COLOR_WINDOW+1);
-    wcex.lpszMenuName   = MAKEINTRESOURCEW(IDC_TOOTHTRAY);
-    wcex.lpszClassName  = szWindowClass;
-    wcex.hIconSm        = LoadIcon(wcex.hInstance, MAKEINTRESOURCE(IDI_SMALL));
-
-    return RegisterClassExW(&wcex);
-}
-
-//
-//   FUNCTION: InitInstance(HINSTANCE, int)
-//
-//   PURPOSE: Saves instance handle and creates main window
-//
-//   COMMENTS:
-//
-//        In this function, we save the instance handle in a global variable and
-//        create and display the main program window.
-//
-BOOL InitInstance(HINSTANCE hInstance, int nCmdShow)
-{
-   hInst = hInstance; // Store instance handle in our global variable
-
-   HWND hWnd = CreateWindowW(szWindowClass, szTitle, WS_OVERLAPPEDWINDOW,
-      CW_USEDEFAULT, 0, CW_USEDEFAULT, 0, nullptr, nullptr, hInstance, nullptr);
-
-   if (!hWnd)
-   {
-      return FALSE;
-   }
-
-   //bluetoothRadio = BluetoothRadio::FindFirst();
-   //bluetoothRadio.RegisterDeviceChange(hWnd);
-   //watcher = std::make_unique<BluetoothDeviceWatcher>();
-   //watcher->Start();
-
-   HICON hIcon = (HICON)LoadImageW(hInstance, MAKEINTRESOURCE(IDI_TOOTHTRAY), IMAGE_ICON, 0, 0, LR_DEFAULTSIZE);
-   trayIcon.Initialize(hWnd, hIcon, 0, WM_TRAYICON, NULL);
-
-   //ShowWindow(hWnd, nCmdShow);
-   UpdateWindow(hWnd);
-
-   return TRUE;
-}
-
-
-//
-//  FUNCTION: WndProc(HWND, UINT, WPARAM, LPARAM)
-//
-//  PURPOSE: Processes messages for the main window.
-//
-//  WM_COMMAND  - process the application menu
-//  WM_PAINT    - Paint the main window
-//  WM_DESTROY  - post a quit message and return
-//
-//
-LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
-{
-    switch (message)
-    {
-    case WM_COMMAND:
-        {
-            int commandId = LOWORD(wParam);
-            // Parse the menu selections:
-            switch (commandId)
-            {
-            case IDM_EXIT:
-                DestroyWindow(hWnd);
-                break;
-            default:
-                if (trayMenu.TryHandleCommand(commandId))
-                    break;
-
-                return DefWindowProc(hWnd, message, wParam, lParam);
-            }
-        }
-        break;
-    case WM_DESTROY:
-        PostQuitMessage(0);
-        break;
-    //case WM_DEVICECHANGE:
-    //    BluetoothRadio::HandleDeviceChangeMessage(wParam, lParam);
-    //    break;
-    default:
-        WORD event;
-        if (trayIcon.HandleMessage(message, lParam, &event)) {
-            if (event == WM_CONTEXTMENU || event == NIN_SELECT || event == NIN_KEYSELECT) {
-                std::vector<BluetoothConnector> connectors = bluetoothAudioDeviceEmumerator.EnumerateAudioDevices();
-                trayMenu.BuildMenu(connectors);
-                trayMenu.ShowPopupMenu(hWnd, wParam);
-            }
-            break;
-        }
-
-        return DefWindowProc(hWnd, message, wParam, lParam);
-    }
-    return 0;
-}
+// ToothTray.cpp : Defines the entry point for the application.
+//
+
+#include "framework.h"
+#include "ToothTray.h"
+#include <memory>
+#include <vector>
+#include <cwctype>
+#include <string>
+#include <fstream>
+#include <optional>
+#include <algorithm>
+#include <filesystem>
+#include <shlobj.h>
+#include <winrt/base.h>
+
+#include "debuglog.h"
+#include "Log.h"
+#include "Trace.h"
+#include "BluetoothAudioDevices.h"
+#include "ConnectorRegistry.h"
+#include "EnumerationPipeline.h"
+#include "WorkerPool.h"
+#include "ConnectorCommandQueue.h"
+#include "ConnectorBatch.h"
+#include "BluetoothRadio.h"
+#include "BluetoothSocket.h"
+#include "SdpRecordCache.h"
+#include "ConnectorCache.h"
+#include "StartupTimeline.h"
+#include "ConnectLatencyTracker.h"
+#include "ControlProtocol.h"
+#include "ControlServer.h"
+#include "DeviceTable.h"
+#include "DeviceEventScheduler.h"
+#include "PresencePolicy.h"
+#include "DeviceContainerEnumerator.h"
+#include "TrayIcon.h"
+#include "ToothTrayMenu.h"
+
+#define MAX_LOADSTRING 100
+
+// Global Variables:
+HINSTANCE hInst;                                // current instance
+WCHAR szTitle[MAX_LOADSTRING];                  // The title bar text
+WCHAR szWindowClass[MAX_LOADSTRING];            // the main window class name
+HWND hMainWindow;
+constexpr UINT WM_TRAYICON = WM_APP;
+constexpr UINT WM_CONNECTORS_PUBLISHED = WM_APP + 1;
+constexpr UINT WM_CONNECTOR_COMMAND_COMPLETED = WM_APP + 2;
+constexpr UINT WM_CONNECTOR_BATCH_COMPLETED = WM_APP + 3;
+constexpr UINT WM_DEFERRED_INIT = WM_APP + 4;
+constexpr UINT_PTR DEVICE_EVENT_TIMER = 1;
+
+constexpr size_t BACKGROUND_THREADS = 4;
+constexpr std::chrono::seconds COMMAND_TIMEOUT{ 15 };
+constexpr std::chrono::milliseconds LOG_DRAIN_INTERVAL{ 100 };
+// Devices coming into range more often than this keep their cached service records; a device whose
+// query failed waits a minute, doubling up to an hour
+constexpr SdpRefreshPolicy SDP_REFRESH_POLICY{ std::chrono::hours(1), std::chrono::minutes(1), std::chrono::hours(1) };
+// Saved on exit and when the session ends
+constexpr const wchar_t* CONNECT_LATENCIES_FILE = L"connect-latencies.dat";
+
+LogDrain logDrain;
+// Set with --trace <file>; the trace is written there on exit.
+std::wstring traceFile;
+// Set with --auto-connect <address>, once per device; they are connected when they come into range.
+std::vector<uint64_t> autoConnectAddresses;
+
+WorkerPool backgroundPool;
+// Service record queries, one at a time, so they neither hold up the background pool nor compete for the radio
+WorkerPool sdpRefreshPool;
+// The connectors of the last run, for the menu until the first enumeration publishes
+ConnectorCache connectorCache;
+// How long each device's endpoints take to follow connects and disconnects, kept across sessions
+ConnectLatencyTracker connectLatencies;
+BluetoothAudioDeviceEnumerator bluetoothAudioDeviceEmumerator;
+DeviceContainerEnumerator deviceContainerEnumerator;
+ContainerNameIndex containerNameIndex(deviceContainerEnumerator);
+ConnectorRegistry connectorRegistry(bluetoothAudioDeviceEmumerator, containerNameIndex);
+EnumerationPipeline enumerationPipeline(
+    [](bool full) {
+        if (full)
+            connectorRegistry.Refresh();
+        return connectorRegistry.Snapshot();
+    },
+    [](uint64_t generation) {
+        PostMessageW(hMainWindow, WM_CONNECTORS_PUBLISHED, static_cast<WPARAM>(generation), 0);
+        // Only rewritten when the connectors changed, which is rare next to the publishes
+        connectorCache.Save(enumerationPipeline.Current()->value);
+    });
+ConnectorCommandQueue commandQueue(COMMAND_TIMEOUT, [](const ConnectorCommandCompletion& completion) {
+    // Owned by the message once it's posted
+    std::unique_ptr<ConnectorCommandCompletion> message = std::make_unique<ConnectorCommandCompletion>(completion);
+    if (PostMessageW(hMainWindow, WM_CONNECTOR_COMMAND_COMPLETED, 0, reinterpret_cast<LPARAM>(message.get())))
+        message.release();
+});
+ConnectorBatch connectorBatch(commandQueue, [](const BatchResult& result) {
+    std::unique_ptr<BatchResult> message = std::make_unique<BatchResult>(result);
+    if (PostMessageW(hMainWindow, WM_CONNECTOR_BATCH_COMPLETED, 0, reinterpret_cast<LPARAM>(message.get())))
+        message.release();
+});
+ToothTrayMenu trayMenu(commandQueue, connectorBatch);
+// Lets scripts list and switch devices; answered from the published snapshot, never enumerating
+ControlRequestHandler controlHandler([]() { return enumerationPipeline.Current(); }, commandQueue, connectorBatch);
+ControlServer controlServer([](std::string_view request) { return controlHandler.Handle(request); });
+TrayIcon trayIcon;
+BluetoothRadio bluetoothRadio(nullptr);
+BluetoothServiceLookup serviceLookup;
+SdpRecordCache sdpRecordCache;
+// Devices reported by radio events, only used on the window thread
+DeviceTable deviceTable;
+// Turns bursts of WM_DEVICECHANGE into one refresh, on the window thread
+DeviceEventScheduler deviceEventScheduler(DeviceEventSchedulerOptions{}, [](const DeviceEventBatch& batch) {
+    LOG_INFO(L"Device events: devices={}, classes={}", batch.changes.size(), batch.classes);
+    // Only arrivals and removals can change which endpoints exist
+    enumerationPipeline.RequestRefresh((batch.classes & (DEVICE_EVENT_NODES_CHANGED | DEVICE_EVENT_ARRIVAL | DEVICE_EVENT_REMOVAL)) != 0);
+}, std::chrono::steady_clock::now());
+// Prewarms paired audio devices that come into range, on the window thread
+PresencePolicy presencePolicy(PresencePolicyOptions{}, std::chrono::steady_clock::now());
+std::chrono::steady_clock::time_point ProcessStartTime();
+// Phases up to the tray icon, starting from the process creation so the loader is included
+StartupTimeline startupTimeline(ProcessStartTime());
+
+// Forward declarations of functions included in this code module:
+ATOM                MyRegisterClass(HINSTANCE hInstance);
+BOOL                InitInstance(HINSTANCE, int);
+void                InitSubsystems();
+void                ParseCommandLine();
+void                WriteTrace();
+std::filesystem::path LocalDataPath(const wchar_t* fileName);
+std::wstring        ControlPipeName();
+void                ArmDeviceEventTimer();
+void                PrewarmDevice(uint64_t address, bool autoConnect);
+LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
+INT_PTR CALLBACK    About(HWND, UINT, WPARAM, LPARAM);
+
+int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
+                     _In_opt_ HINSTANCE hPrevInstance,
+                     _In_ LPWSTR    lpCmdLine,
+                     _In_ int       nCmdShow)
+{
+    UNREFERENCED_PARAMETER(hPrevInstance);
+    UNREFERENCED_PARAMETER(lpCmdLine);
+
+    // TODO: Place code here.
+    startupTimeline.Mark("loader");
+    ParseCommandLine();
+
+    // Initialize global strings
+    LoadStringW(hInstance, IDS_APP_TITLE, szTitle, MAX_LOADSTRING);
+    LoadStringW(hInstance, IDC_TOOTHTRAY, szWindowClass, MAX_LOADSTRING);
+    MyRegisterClass(hInstance);
+    startupTimeline.Mark("window class");
+
+    // Perform application initialization:
+    if (!InitInstance (hInstance, nCmdShow))
+    {
+        return FALSE;
+    }
+
+    MSG msg;
+
+    // Main message loop:
+    while (GetMessage(&msg, nullptr, 0, 0))
+    {
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+    }
+
+    WriteTrace();
+    return (int) msg.wParam;
+}
+
+// Parses aa:bb:cc:dd:ee:ff
+static std::optional<uint64_t> ParseBluetoothAddress(std::wstring_view text)
+{
+    uint64_t address = 0;
+    size_t digits = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        wchar_t c = text[i];
+        if (c == L':' && i % 3 == 2)
+            continue;
+        if (i % 3 == 2 || !iswxdigit(c))
+            return std::nullopt;
+        address = (address << 4) | static_cast<uint64_t>(iswdigit(c) ? c - L'0' : towlower(c) - L'a' + 10);
+        ++digits;
+    }
+    if (digits != 12)
+        return std::nullopt;
+    return address;
+}
+
+void ParseCommandLine()
+{
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (argv == nullptr)
+        return;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::wstring_view(argv[i]) == L"--trace" && i + 1 < argc) {
+            traceFile = argv[++i];
+            Tracer::Enable(true);
+        }
+        else if (std::wstring_view(argv[i]) == L"--auto-connect" && i + 1 < argc) {
+            std::optional<uint64_t> address = ParseBluetoothAddress(argv[++i]);
+            if (address.has_value())
+                autoConnectAddresses.push_back(*address);
+        }
+    }
+    LocalFree(argv);
+}
+
+void WriteTrace()
+{
+    if (traceFile.empty())
+        return;
+
+    std::ofstream file(traceFile, std::ios::binary | std::ios::trunc);
+    file << ExportChromeTrace(Tracer::Collect());
+    if (!file)
+        LOG_WARNING(L"Failed to write the trace to {}", traceFile);
+}
+
+std::chrono::steady_clock::time_point ProcessStartTime()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    FILETIME creation, exit, kernel, user, current;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return now;
+    GetSystemTimePreciseAsFileTime(&current);
+
+    // Both in 100ns units of the system clock
+    ULARGE_INTEGER created{ creation.dwLowDateTime, creation.dwHighDateTime };
+    ULARGE_INTEGER current64{ current.dwLowDateTime, current.dwHighDateTime };
+    if (current64.QuadPart < created.QuadPart)
+        return now;
+    return now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<ULONGLONG, std::ratio<1, 10000000>>(current64.QuadPart - created.QuadPart));
+}
+
+// Empty if the local app data folder isn't available
+std::filesystem::path LocalDataPath(const wchar_t* fileName)
+{
+    std::filesystem::path path;
+    PWSTR folder = nullptr;
+    if (SUCCEEDED(SHGetKnownFolderPath(FOLDERID_LocalAppData, 0, NULL, &folder)))
+        path = std::filesystem::path(folder) / L"ToothTray" / fileName;
+    CoTaskMemFree(folder);
+    return path;
+}
+
+// One pipe per logon session, so fast user switching runs an instance for each user
+std::wstring ControlPipeName()
+{
+    DWORD sessionId = 0;
+    ProcessIdToSessionId(GetCurrentProcessId(), &sessionId);
+    return L"\\\\.\\pipe\\ToothTray." + std::to_wstring(sessionId);
+}
+
+// Resolves what the first click on the device needs before it comes, on a background thread: the
+// container and its name, and the driver controls of its endpoints. Only that container's endpoints
+// are resolved, not every endpoint like a refresh would.
+void PrewarmDevice(uint64_t address, bool autoConnect)
+{
+    backgroundPool.Submit([address, autoConnect]() {
+        std::optional<GUID> containerId = deviceContainerEnumerator.FindBluetoothContainer(address);
+        if (!containerId.has_value())
+            return;
+        containerNameIndex.Lookup(*containerId);
+
+        // Paired devices keep their endpoints while away, so the registry knows them already
+        std::optional<BluetoothConnector> connector = connectorRegistry.ResolveContainer(*containerId);
+        if (!autoConnect || !connector.has_value() || connector->IsConnected())
+            return;
+        LOG_INFO(L"Connecting {} now that it's in range", connector->DeviceName());
+        commandQueue.Enqueue(*connector, ConnectorCommandType::Connect);
+    });
+}
+
+// Wakes the window when the next batch of device events is due
+void ArmDeviceEventTimer()
+{
+    std::optional<std::chrono::steady_clock::time_point> deadline = deviceEventScheduler.NextDeadline();
+    if (!deadline.has_value()) {
+        KillTimer(hMainWindow, DEVICE_EVENT_TIMER);
+        return;
+    }
+
+    long long delay = std::chrono::ceil<std::chrono::milliseconds>(*deadline - std::chrono::steady_clock::now()).count();
+    SetTimer(hMainWindow, DEVICE_EVENT_TIMER, static_cast<UINT>(std::max<long long>(delay, USER_TIMER_MINIMUM)), nullptr);
+}
+
+//
+//  FUNCTION: MyRegisterClass()
+//
+//  PURPOSE: Registers the window class.
+//
+ATOM MyRegisterClass(HINSTANCE hInstance)
+{
+    WNDCLASSEXW wcex;
+
+    wcex.cbSize = sizeof(WNDCLASSEX);
+
+    wcex.style          = CS_HREDRAW | CS_VREDRAW;
+    wcex.lpfnWndProc    = WndProc;
+    wcex.cbClsExtra     = 0;
+    wcex.cbWndExtra     = 0;
+    wcex.hInstance      = hInstance;
+    wcex.hIcon          = LoadIcon(hInstance, MAKEINTRESOURCE(IDI_TOOTHTRAY));
+    wcex.hCursor        = LoadCursor(nullptr, IDC_ARROW);
+    wcex.hbrBackground  = (HBRUSH)(COLOR_WINDOW+1);
+    wcex.lpszMenuName   = MAKEINTRESOURCEW(IDC_TOOTHTRAY);
+    wcex.lpszClassName  = szWindowClass;
+    wcex.hIconSm        = LoadIcon(wcex.hInstance, MAKEINTRESOURCE(IDI_SMALL));
+
+    return RegisterClassExW(&wcex);
+}
+
+//
+//   FUNCTION: InitInstance(HINSTANCE, int)
+//
+//   PURPOSE: Saves instance handle and creates main window
+//
+//   COMMENTS:
+//
+//        In this function, we save the instance handle in a global variable and
+//        create and display the main program window.
+//
+BOOL InitInstance(HINSTANCE hInstance, int nCmdShow)
+{
+   hInst = hInstance; // Store instance handle in our global variable
+
+   HWND hWnd = CreateWindowW(szWindowClass, szTitle, WS_OVERLAPPEDWINDOW,
+      CW_USEDEFAULT, 0, CW_USEDEFAULT, 0, nullptr, nullptr, hInstance, nullptr);
+
+   if (!hWnd)
+   {
+      return FALSE;
+   }
+
+   hMainWindow = hWnd;
+   startupTimeline.Mark("window");
+
+   logDrain.Start([](const std::wstring& line) { OutputDebugStringW(line.c_str()); }, LOG_DRAIN_INTERVAL,
+       []() { SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST); });
+   // The first menu comes from the cache; the enumeration then patches whatever went stale
+   connectorCache.Open(LocalDataPath(L"connectors.cache"));
+   if (connectorCache.Size() != 0) {
+       enumerationPipeline.Seed(connectorCache.Connectors(bluetoothAudioDeviceEmumerator));
+       trayMenu.BuildMenu(*enumerationPipeline.Current());
+   }
+   startupTimeline.Mark("cached menu");
+
+   HICON hIcon = (HICON)LoadImageW(hInstance, MAKEINTRESOURCE(IDI_TOOTHTRAY), IMAGE_ICON, 0, 0, LR_DEFAULTSIZE);
+   trayIcon.Initialize(hWnd, hIcon, 0, WM_TRAYICON, NULL);
+   startupTimeline.Mark("tray icon");
+   LOG_INFO(L"Startup to tray icon: {}", startupTimeline.Format());
+
+   // Posted messages are retrieved before input, so this runs before the first click is handled
+   PostMessageW(hWnd, WM_DEFERRED_INIT, 0, 0);
+
+   //ShowWindow(hWnd, nCmdShow);
+   UpdateWindow(hWnd);
+
+   return TRUE;
+}
+
+// Brings up everything the tray icon doesn't need, on the first pass of the message loop after it's
+// shown: COM, the radio, which loads the delay-loaded Bluetooth APIs, the notifications and the
+// worker threads. Winsock is only loaded by the first service record query.
+void InitSubsystems()
+{
+    StartupTimeline deferred(std::chrono::steady_clock::now());
+    winrt::init_apartment();
+    deferred.Mark("apartment");
+
+    try {
+        bluetoothRadio = BluetoothRadio::FindFirst();
+        bluetoothRadio.RegisterDeviceChange(hMainWindow);
+    }
+    catch (const std::exception&) {
+        // Without a radio there are just no in range notifications
+    }
+    //watcher = std::make_unique<BluetoothDeviceWatcher>();
+    //watcher->Start();
+    deferred.Mark("radio");
+
+    connectLatencies.Load(LocalDataPath(CONNECT_LATENCIES_FILE));
+    bluetoothAudioDeviceEmumerator.SetLatencyTracker(&connectLatencies);
+    containerNameIndex.Start();
+    connectorRegistry.SetChangedCallback([]() { enumerationPipeline.RequestRefresh(false); });
+    connectorRegistry.Start();
+    deferred.Mark("notifications");
+
+    backgroundPool.Start(BACKGROUND_THREADS, []() { winrt::init_apartment(); }, []() { winrt::uninit_apartment(); });
+    bluetoothAudioDeviceEmumerator.SetWorkerPool(&backgroundPool);
+    sdpRecordCache.Open(LocalDataPath(L"sdp-records.cache"));
+    sdpRefreshPool.Start(1);
+    sdpRecordCache.SetRefreshSource(&sdpRefreshPool, &serviceLookup, SDP_REFRESH_POLICY);
+    BluetoothRadio::SetInRangeCallback([](const BTH_RADIO_IN_RANGE& radioInRange) {
+        if (!(radioInRange.deviceInfo.flags & BDIF_ADDRESS))
+            return;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        DeviceTable::Row row = deviceTable.Observe(DiscoveredDeviceFromRadioInRange(radioInRange), now);
+        sdpRecordCache.RequestRefresh(radioInRange.deviceInfo.address);
+
+        // The table has the class even when this event doesn't
+        uint8_t flags = deviceTable.Flags(row);
+        PresenceDecision decision = presencePolicy.InRange(deviceTable.Address(row), deviceTable.ClassOfDevice(row),
+            (flags & DEVICE_AUTHENTICATED) != 0, (flags & DEVICE_CONNECTED) != 0, now);
+        if (decision.prewarm || decision.autoConnect) {
+            LOG_INFO(L"{} came into range: prewarm={}, auto connect={}", deviceTable.Name(row), decision.prewarm, decision.autoConnect);
+            PrewarmDevice(deviceTable.Address(row), decision.autoConnect);
+        }
+    });
+    BluetoothRadio::SetOutOfRangeCallback([](uint64_t address) {
+        presencePolicy.OutOfRange(address, std::chrono::steady_clock::now());
+    });
+    for (uint64_t address : autoConnectAddresses)
+        presencePolicy.SetDevicePolicy(address, DevicePresencePolicy{ true, true });
+    BluetoothRadio::SetDeviceEventCallback([](uint64_t device, uint32_t classes) {
+        deviceEventScheduler.Post(device, classes, std::chrono::steady_clock::now());
+        ArmDeviceEventTimer();
+    });
+    commandQueue.Start([]() { winrt::init_apartment(); }, []() { winrt::uninit_apartment(); });
+    enumerationPipeline.Start([]() { winrt::init_apartment(); }, []() { winrt::uninit_apartment(); });
+    deferred.Mark("workers");
+
+    std::wstring pipeName = ControlPipeName();
+    if (controlServer.Start(pipeName))
+        LOG_INFO(L"Serving control requests on {}", pipeName);
+    deferred.Mark("control");
+    LOG_INFO(L"Deferred startup: {}", deferred.Format());
+}
+
+
+//
+//  FUNCTION: WndProc(HWND, UINT, WPARAM, LPARAM)
+//
+//  PURPOSE: Processes messages for the main window.
+//
+//  WM_COMMAND  - process the application menu
+//  WM_PAINT    - Paint the main window
+//  WM_DESTROY  - post a quit message and return
+//
+//
+LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    switch (message)
+    {
+    case WM_COMMAND:
+        {
+            int commandId = LOWORD(wParam);
+            // Parse the menu selections:
+            switch (commandId)
+            {
+            case IDM_EXIT:
+                DestroyWindow(hWnd);
+                break;
+            default:
+                if (trayMenu.TryHandleCommand(commandId))
+                    break;
+
+                return DefWindowProc(hWnd, message, wParam, lParam);
+            }
+        }
+        break;
+    case WM_DESTROY:
+        controlServer.Stop();
+        commandQueue.Stop();
+        enumerationPipeline.Stop();
+        backgroundPool.Stop();
+        sdpRecordCache.SetRefreshSource(nullptr, nullptr, SDP_REFRESH_POLICY);
+        sdpRefreshPool.Stop();
+        connectorRegistry.Stop();
+        containerNameIndex.Stop();
+        connectLatencies.Save(LocalDataPath(CONNECT_LATENCIES_FILE));
+        logDrain.Stop();
+        PostQuitMessage(0);
+        break;
+    case WM_DEFERRED_INIT:
+        InitSubsystems();
+        break;
+    case WM_CONNECTORS_PUBLISHED:
+        // Build the menu ahead of the next click, but not under an open one
+        if (!trayMenu.IsShowing())
+            trayMenu.BuildMenu(*enumerationPipeline.Current());
+        break;
+    case WM_CONNECTOR_COMMAND_COMPLETED:
+    {
+        std::unique_ptr<ConnectorCommandCompletion> completion(reinterpret_cast<ConnectorCommandCompletion*>(lParam));
+        LOG_INFO(L"{} {}: result={}, hr={}, {}ms", completion->type == ConnectorCommandType::Connect ? L"Connect" : L"Disconnect",
+            completion->containerId, completion->result, completion->hr, std::chrono::duration_cast<std::chrono::milliseconds>(completion->elapsed).count());
+        break;
+    }
+    case WM_CONNECTOR_BATCH_COMPLETED:
+    {
+        std::unique_ptr<BatchResult> result(reinterpret_cast<BatchResult*>(lParam));
+        for (const BatchOutcome& outcome : result->outcomes) {
+            LOG_INFO(L"{} {}: result={}, hr={}, {}ms", outcome.type == ConnectorCommandType::Connect ? L"Connect" : L"Disconnect",
+                outcome.deviceName, outcome.result, outcome.hr, std::chrono::duration_cast<std::chrono::milliseconds>(outcome.elapsed).count());
+        }
+        LOG_INFO(L"Batch {} in {}ms, {} skipped", result->Succeeded() ? L"succeeded" : L"failed", std::chrono::duration_cast<std::chrono::milliseconds>(result->wallTime).count(), result->skipped);
+        break;
+    }
+    case WM_ENDSESSION:
+        // The process is ended without a WM_DESTROY when the user logs off
+        if (wParam)
+            connectLatencies.Save(LocalDataPath(CONNECT_LATENCIES_FILE));
+        break;
+    case WM_DEVICECHANGE:
+        BluetoothRadio::HandleDeviceChangeMessage(wParam, lParam);
+        break;
+    case WM_TIMER:
+        if (wParam != DEVICE_EVENT_TIMER)
+            return DefWindowProc(hWnd, message, wParam, lParam);
+        deviceEventScheduler.Advance(std::chrono::steady_clock::now());
+        ArmDeviceEventTimer();
+        break;
+    default:
+        WORD event;
+        if (trayIcon.HandleMessage(message, lParam, &event)) {
+            if (event == WM_CONTEXTMENU || event == NIN_SELECT || event == NIN_KEYSELECT) {
+                TRACE_SPAN("TrayClick");
+                std::shared_ptr<const ConnectorSnapshot> snapshot = enumerationPipeline.Current();
+                if (trayMenu.Generation() != snapshot->generation)
+                    trayMenu.BuildMenu(*snapshot);
+                trayMenu.ShowPopupMenu(hWnd, wParam);
+            }
+            break;
+        }
+
+        return DefWindowProc(hWnd, message, wParam, lParam);
+    }
+    return 0;
+}
@@ -1,68 +1,147 @@
-#include "ToothTrayMenu.h"
-
-#include <unordered_map>
-#include <windowsx.h>
-
-#include "debuglog.h"
-
-void ToothTrayMenu::BuildMenu(std::vector<BluetoothConnector>& connectors) {
-    m_handle.reset(CreatePopupMenu());
-    m_menuData.clear();
-
-    UINT menuPosition = 0;
-    for (std::vector<BluetoothConnector>::iterator ite = connectors.begin(); ite != connectors.end(); ++ite, ++menuPosition) {
-        unsigned int currentMenuItemId = IDM_BLUETOOTH_AUDIO_BASE + menuPosition + 1;
-        std::pair<std::unordered_map<unsigned int, MenuData>::iterator, bool> pair =
-            m_menuData.emplace(std::piecewise_construct, std::forward_as_tuple(currentMenuItemId), std::forward_as_tuple(currentMenuItemId, std::move(*ite)));
-
-        LPWSTR deviceName = (*(pair.first)).second.menuText.data();
-
-        bool checked = (*(pair.first)).second.pConnector.IsConnected();
-
-        DebugLogl(DebugLogStream{} << L"Showing device: " << deviceName << L", connected: " << checked);
-
-        InsertBluetoohConnectorMenuItem(currentMenuItemId, menuPosition, deviceName, checked);
-    }
-
-    InsertBluetoohConnectorMenuItem(IDM_EXIT, menuPosition, (WCHAR*)L"Exit", false);
-}
-
-void ToothTrayMenu::ShowPopupMenu(HWND hwnd, WPARAM mousPosWParam) {
-    int x = GET_X_LPARAM(mousPosWParam);
-    int y = GET_Y_LPARAM(mousPosWParam);
-
-    // https://docs.microsoft.com/en-us/windows/win32/api/winuser/nf-winuser-trackpopupmenuex
-    // To display a context menu for a notification icon, the current window must be the foreground window before the application calls TrackPopupMenu or TrackPopupMenuEx.
-    // Otherwise, the menu will not disappear when the user clicks outside of the menu or the window that created the menu (if it is visible).
-    // If the current window is a child window, you must set the (top-level) parent window as the foreground window.
-    SetForegroundWindow(hwnd);
-
-    TrackPopupMenuEx(m_handle.get(), TPM_LEFTALIGN | TPM_BOTTOMALIGN | TPM_LEFTBUTTON, x, y, hwnd, NULL);
-}
-
-bool ToothTrayMenu::TryHandleCommand(int commandId) {
-    std::unordered_map<unsigned int, MenuData>::iterator pMenuData = m_menuData.find((unsigned int)commandId);
-    if (pMenuData == m_menuData.end())
-        return false;
-
-    MenuData& menuData = (*pMenuData).second;
-    if (menuData.pConnector.IsConnected())
-        menuData.pConnector.Disconnect();
-    else
-        menuData.pConnector.Connect();
-
-    return true;
-}
-
-MENUITEMINFOW ToothTrayMenu::InsertBluetoohConnectorMenuItem(UINT id, UINT position, LPWSTR pText, bool checked) {
-    MENUITEMINFOW menuItem{ sizeof(MENUITEMINFOW) };
-    menuItem.fMask = MIIM_ID | MIIM_STRING | MIIM_STATE;
-    menuItem.fType = MFT_STRING;
-    menuItem.fState = MFS_ENABLED;
-    menuItem.wID = id;
-    menuItem.dwTypeData = pText;
-    menuItem.fState = checked ? MFS_CHECKED : MFS_UNCHECKED;
-    InsertMenuItemW(m_handle.get(), position, TRUE, &menuItem);
-
-    return menuItem;
-}
+#include "ToothTrayMenu.h"
+
+#include <optional>
+#include <windowsx.h>
+
+#include "debuglog.h"
+#include "Trace.h"
+
+void ToothTrayMenu::BuildMenu(const ConnectorSnapshot& snapshot) {
+    TRACE_SPAN("BuildMenu");
+    if (!m_handle) {
+        m_handle.reset(CreatePopupMenu());
+        InsertBluetoohConnectorMenuItem(IDM_EXIT, 0, (WCHAR*)L"Exit", false);
+    }
+    m_generation = snapshot.generation;
+
+    std::vector<MenuItem> items;
+    items.reserve(snapshot.value.size());
+    for (const BluetoothConnector& connector : snapshot.value)
+        items.push_back(MenuItem{ connector.ContainerId(), connector.DeviceNameHandle(), connector.IsConnected() });
+
+    bool hadDevices = !m_model.Entries().empty();
+    std::vector<MenuPatch> patches = m_model.Update(items);
+    size_t deviceCount = m_model.Entries().size();
+    m_connectors.assign(snapshot.value.begin(), snapshot.value.begin() + deviceCount);
+
+    // The switch submenu lists the same devices in the same order, so it takes the same patches
+    for (const MenuPatch& patch : patches) {
+        ApplyPatch(m_handle.get(), IDM_BLUETOOTH_AUDIO_BASE, patch);
+        if (m_switchMenu != nullptr)
+            ApplyPatch(m_switchMenu, IDM_BLUETOOTH_SWITCH_BASE, patch);
+    }
+
+    UINT menuPosition = static_cast<UINT>(deviceCount);
+    if (deviceCount != 0 && !hadDevices) {
+        m_switchMenu = CreatePopupMenu();
+        for (size_t i = 0; i < deviceCount; ++i)
+            ApplyPatch(m_switchMenu, IDM_BLUETOOTH_SWITCH_BASE, MenuPatch{ MenuPatchType::Insert, i, m_model.Entries()[i].slot });
+        // The submenu is destroyed with the menu
+        InsertSubMenu(menuPosition, m_switchMenu, (WCHAR*)L"Switch to");
+        InsertBluetoohConnectorMenuItem(IDM_DISCONNECT_ALL, menuPosition + 1, (WCHAR*)L"Disconnect all", false);
+    }
+    else if (deviceCount == 0 && hadDevices) {
+        // Deleting the submenu item destroys the submenu
+        DeleteMenu(m_handle.get(), menuPosition, MF_BYPOSITION);
+        DeleteMenu(m_handle.get(), menuPosition, MF_BYPOSITION);
+        m_switchMenu = nullptr;
+    }
+}
+
+void ToothTrayMenu::ApplyPatch(HMENU menu, UINT idBase, const MenuPatch& patch) {
+    UINT position = static_cast<UINT>(patch.position);
+    if (patch.type == MenuPatchType::Remove) {
+        DeleteMenu(menu, position, MF_BYPOSITION);
+        return;
+    }
+
+    const MenuItem& item = m_model.Entries()[patch.position].item;
+    // The menu copies the text, so the pooled name is passed as is
+    LPWSTR deviceName = const_cast<LPWSTR>(item.name.c_str());
+    if (patch.type == MenuPatchType::Insert) {
+        LOG_DEBUG(L"Showing device: {}, connected: {}", item.name, item.checked);
+        InsertBluetoohConnectorMenuItem(menu, idBase + patch.slot, position, deviceName, item.checked);
+        return;
+    }
+
+    LOG_DEBUG(L"Updating device: {}, connected: {}", item.name, item.checked);
+    MENUITEMINFOW menuItem{ sizeof(MENUITEMINFOW) };
+    menuItem.fMask = MIIM_STRING | MIIM_STATE;
+    menuItem.dwTypeData = deviceName;
+    menuItem.fState = item.checked ? MFS_CHECKED : MFS_UNCHECKED;
+    SetMenuItemInfoW(menu, position, TRUE, &menuItem);
+}
+
+void ToothTrayMenu::ShowPopupMenu(HWND hwnd, WPARAM mousPosWParam) {
+    int x = GET_X_LPARAM(mousPosWParam);
+    int y = GET_Y_LPARAM(mousPosWParam);
+
+    // https://docs.microsoft.com/en-us/windows/win32/api/winuser/nf-winuser-trackpopupmenuex
+    // To display a context menu for a notification icon, the current window must be the foreground window before the application calls TrackPopupMenu or TrackPopupMenuEx.
+    // Otherwise, the menu will not disappear when the user clicks outside of the menu or the window that created the menu (if it is visible).
+    // If the current window is a child window, you must set the (top-level) parent window as the foreground window.
+    SetForegroundWindow(hwnd);
+
+    m_showing = true;
+    TRACE_SPAN("TrackPopupMenuEx");
+    TrackPopupMenuEx(m_handle.get(), TPM_LEFTALIGN | TPM_BOTTOMALIGN | TPM_LEFTBUTTON, x, y, hwnd, NULL);
+    m_showing = false;
+}
+
+const BluetoothConnector* ToothTrayMenu::FindConnector(UINT idBase, int commandId) const {
+    if (commandId <= static_cast<int>(idBase))
+        return nullptr;
+
+    std::optional<size_t> index = m_model.IndexOfSlot(static_cast<uint32_t>(commandId - idBase));
+    if (!index.has_value())
+        return nullptr;
+    return &m_connectors[*index];
+}
+
+bool ToothTrayMenu::TryHandleCommand(int commandId) {
+    if (commandId == IDM_DISCONNECT_ALL) {
+        m_batch.RunAsync(ConnectorBatch::DisconnectAll(m_connectors));
+        return true;
+    }
+
+    const BluetoothConnector* switchTarget = FindConnector(IDM_BLUETOOTH_SWITCH_BASE, commandId);
+    if (switchTarget != nullptr) {
+        m_batch.RunAsync(ConnectorBatch::SwitchTo(m_connectors, switchTarget->ContainerId()));
+        return true;
+    }
+
+    const BluetoothConnector* connector = FindConnector(IDM_BLUETOOTH_AUDIO_BASE, commandId);
+    if (connector == nullptr)
+        return false;
+
+    ConnectorCommandType type = connector->IsConnected() ? ConnectorCommandType::Disconnect : ConnectorCommandType::Connect;
+    if (!m_commandQueue.Enqueue(*connector, type))
+        LOG_INFO(L"Already connecting or disconnecting: {}", connector->DeviceName());
+
+    return true;
+}
+
+MENUITEMINFOW ToothTrayMenu::InsertBluetoohConnectorMenuItem(UINT id, UINT position, LPWSTR pText, bool checked) {
+    return InsertBluetoohConnectorMenuItem(m_handle.get(), id, position, pText, checked);
+}
+
+MENUITEMINFOW ToothTrayMenu::InsertBluetoohConnectorMenuItem(HMENU menu, UINT id, UINT position, LPWSTR pText, bool checked) {
+    MENUITEMINFOW menuItem{ sizeof(MENUITEMINFOW) };
+    menuItem.fMask = MIIM_ID | MIIM_STRING | MIIM_STATE;
+    menuItem.fType = MFT_STRING;
+    menuItem.fState = MFS_ENABLED;
+    menuItem.wID = id;
+    menuItem.dwTypeData = pText;
+    menuItem.fState = checked ? MFS_CHECKED : MFS_UNCHECKED;
+    InsertMenuItemW(menu, position, TRUE, &menuItem);
+
+    return menuItem;
+}
+
+void ToothTrayMenu::InsertSubMenu(UINT position, HMENU subMenu, LPWSTR pText) {
+    MENUITEMINFOW menuItem{ sizeof(MENUITEMINFOW) };
+    menuItem.fMask = MIIM_STRING | MIIM_SUBMENU;
+    menuItem.hSubMenu = subMenu;
+    menuItem.dwTypeData = pText;
+    InsertMenuItemW(m_handle.get(), position, TRUE, &menuItem);
+}
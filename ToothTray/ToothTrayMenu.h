@@ -1,34 +1,54 @@
-#pragma once
-
-#include "framework.h"
-#include "resource.h"
-
-#include <vector>
-#include <unordered_map>
-
-#include "BluetoothAudioDevices.h"
-
-class ToothTrayMenu {
-private:
-public:
-    ToothTrayMenu() : m_handle(nullptr) {}
-
-    void BuildMenu(std::vector<BluetoothConnector>& connectors);
-
-    void ShowPopupMenu(HWND hwnd, WPARAM mousPosWParam);
-
-    bool TryHandleCommand(int commandId);
-private:
-    struct MenuData {
-        unsigned int menuId;
-        std::wstring menuText;
-        BluetoothConnector pConnector;
-        MenuData(unsigned int menuId, BluetoothConnector&& pConnector)
-            : menuId(menuId), menuText(pConnector.DeviceName()), pConnector(std::move(pConnector)) {}
-    };
-
-    wil::unique_hmenu m_handle;
-    std::unordered_map<unsigned int, MenuData> m_menuData;
-
-    MENUITEMINFOW InsertBluetoohConnectorMenuItem(UINT id, UINT position, LPWSTR pText, bool checked);
+#pragma once
+
+#include "framework.h"
+#include "resource.h"
+
+#include <vector>
+
+#include <wil/resource.h>
+
+#include "EnumerationPipeline.h"
+#include "ConnectorCommandQueue.h"
+#include "ConnectorBatch.h"
+#include "MenuModel.h"
+
+class ToothTrayMenu {
+private:
+public:
+    ToothTrayMenu(ConnectorCommandQueue& commandQueue, ConnectorBatch& batch)
+        : m_commandQueue(commandQueue), m_batch(batch), m_handle(nullptr), m_switchMenu(nullptr), m_generation(UINT64_MAX), m_showing(false) {}
+
+    // Creates the menu the first time, then only patches the items of devices that changed.
+    void BuildMenu(const ConnectorSnapshot& snapshot);
+
+    // The generation of the snapshot the menu was built from.
+    uint64_t Generation() const {
+        return m_generation;
+    }
+
+    bool IsShowing() const {
+        return m_showing;
+    }
+
+    void ShowPopupMenu(HWND hwnd, WPARAM mousPosWParam);
+
+    bool TryHandleCommand(int commandId);
+private:
+    ConnectorCommandQueue& m_commandQueue;
+    ConnectorBatch& m_batch;
+    wil::unique_hmenu m_handle;
+    // Owned by m_handle, null while there are no devices
+    HMENU m_switchMenu;
+    // The device items, which come first in the menu and in the switch submenu
+    MenuModel m_model;
+    // In menu order, for the commands and the batch commands
+    std::vector<BluetoothConnector> m_connectors;
+    uint64_t m_generation;
+    bool m_showing;
+
+    MENUITEMINFOW InsertBluetoohConnectorMenuItem(UINT id, UINT position, LPWSTR pText, bool checked);
+    MENUITEMINFOW InsertBluetoohConnectorMenuItem(HMENU menu, UINT id, UINT position, LPWSTR pText, bool checked);
+    void InsertSubMenu(UINT position, HMENU subMenu, LPWSTR pText);
+    void ApplyPatch(HMENU menu, UINT idBase, const MenuPatch& patch);
+    const BluetoothConnector* FindConnector(UINT idBase, int commandId) const;
 };
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "Trace.h"
+
+#include <mutex>
+#include <memory>
+#include <cstdio>
+#include <algorithm>
+
+std::atomic<bool> Tracer::s_enabled = false;
+
+// The lock is only ever contended while the events are collected.
+struct ThreadTraceBuffer {
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    uint32_t threadIndex;
+};
+
+static std::mutex buffersMutex;
+static std::vector<std::shared_ptr<ThreadTraceBuffer>> buffers;
+static uint32_t nextThreadIndex = 1;
+
+static ThreadTraceBuffer& CurrentThreadTraceBuffer() {
+    thread_local std::shared_ptr<ThreadTraceBuffer> buffer = []() {
+        std::shared_ptr<ThreadTraceBuffer> buffer = std::make_shared<ThreadTraceBuffer>();
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffer->threadIndex = nextThreadIndex++;
+        buffers.emplace_back(buffer);
+        return buffer;
+    }();
+    return *buffer;
+}
+
+void Tracer::Record(const char* name, uint64_t start, uint64_t end) {
+    ThreadTraceBuffer& buffer = CurrentThreadTraceBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    if (buffer.events.size() < MAX_EVENTS_PER_THREAD)
+        buffer.events.emplace_back(TraceEvent{ name, buffer.threadIndex, start, end - start });
+}
+
+std::vector<TraceEvent> Tracer::Collect() {
+    std::vector<std::shared_ptr<ThreadTraceBuffer>> current;
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        current = buffers;
+    }
+
+    std::vector<TraceEvent> events;
+    for (const std::shared_ptr<ThreadTraceBuffer>& buffer : current) {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+        events.insert(events.end(), buffer->events.begin(), buffer->events.end());
+        buffer->events.clear();
+    }
+
+    current.clear();
+    {
+        // A buffer only referenced from the list belongs to a thread that has exited.
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        std::erase_if(buffers, [](const std::shared_ptr<ThreadTraceBuffer>& buffer) { return buffer.use_count() == 1 && buffer->events.empty(); });
+    }
+
+    std::sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) {
+        return a.start < b.start;
+    });
+    return events;
+}
+
+static void AppendJsonString(std::string& json, const char* value) {
+    json += '"';
+    for (const char* c = value; *c != '\0'; ++c) {
+        if (*c == '"' || *c == '\\') {
+            json += '\\';
+            json += *c;
+        }
+        else if (static_cast<unsigned char>(*c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(*c));
+            json += escaped;
+        }
+        else {
+            json += *c;
+        }
+    }
+    json += '"';
+}
+
+std::string ExportChromeTrace(const std::vector<TraceEvent>& events) {
+    // Timestamps are in microseconds, relative to the first event so they stay readable.
+    uint64_t origin = events.empty() ? 0 : events.front().start;
+    for (const TraceEvent& event : events)
+        origin = std::min(origin, event.start);
+
+    std::string json = "{\"traceEvents\":[";
+    for (size_t i = 0; i < events.size(); ++i) {
+        const TraceEvent& event = events[i];
+        if (i > 0)
+            json += ',';
+
+        char fields[128];
+        json += "\n{\"name\":";
+        AppendJsonString(json, event.name);
+        std::snprintf(fields, sizeof(fields), ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+            event.threadIndex, (event.start - origin) / 1000.0, event.duration / 1000.0);
+        json += fields;
+    }
+    json += "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return json;
+}
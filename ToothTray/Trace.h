@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+struct TraceEvent {
+    // A string literal
+    const char* name;
+    uint32_t threadIndex;
+    // Nanoseconds on the steady clock
+    uint64_t start;
+    uint64_t duration;
+};
+
+// Collects completed spans from all threads. Every thread appends to its own buffer, and a thread
+// that records more than MAX_EVENTS_PER_THREAD between two collections drops the rest.
+class Tracer {
+public:
+    static constexpr size_t MAX_EVENTS_PER_THREAD = 16 * 1024;
+
+    static void Enable(bool enabled) {
+        s_enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    static bool Enabled() {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    static uint64_t Now() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    static void Record(const char* name, uint64_t start, uint64_t end);
+    // Takes the events recorded so far, ordered by start time.
+    static std::vector<TraceEvent> Collect();
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+// Records the time from construction to destruction under the given name.
+// While tracing is disabled this is a relaxed load and a branch.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name) : m_name(Tracer::Enabled() ? name : nullptr), m_start(m_name != nullptr ? Tracer::Now() : 0) {}
+
+    ~TraceSpan() {
+        if (m_name != nullptr)
+            Tracer::Record(m_name, m_start, Tracer::Now());
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+private:
+    const char* m_name;
+    uint64_t m_start;
+};
+
+// Spans can be compiled out entirely with TOOTHTRAY_TRACING=0.
+#ifndef TOOTHTRAY_TRACING
+#define TOOTHTRAY_TRACING 1
+#endif
+
+#define TOOTHTRAY_TRACE_CONCAT_INNER(a, b) a##b
+#define TOOTHTRAY_TRACE_CONCAT(a, b) TOOTHTRAY_TRACE_CONCAT_INNER(a, b)
+#if TOOTHTRAY_TRACING
+#define TRACE_SPAN(name) TraceSpan TOOTHTRAY_TRACE_CONCAT(traceSpan, __LINE__)(name)
+#else
+#define TRACE_SPAN(name) do {} while (false)
+#endif
+
+// Formats the events in the Chrome trace event format, for chrome://tracing or Perfetto.
+std::string ExportChromeTrace(const std::vector<TraceEvent>& events);
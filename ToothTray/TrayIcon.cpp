@@ -1 +1 @@
-#include "TrayIcon.h"
+#include "TrayIcon.h"
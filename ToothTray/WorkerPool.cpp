@@ -0,0 +1,100 @@
+#include "WorkerPool.h"
+
+#include <atomic>
+#include <algorithm>
+#include <memory>
+
+WorkerPool::~WorkerPool() {
+    Stop();
+}
+
+void WorkerPool::Start(size_t threadCount, std::function<void()> workerStarted, std::function<void()> workerStopping) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_running)
+        return;
+
+    m_running = true;
+    for (size_t i = 0; i < threadCount; ++i)
+        m_workers.emplace_back(&WorkerPool::Run, this, workerStarted, workerStopping);
+}
+
+void WorkerPool::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running)
+            return;
+        m_running = false;
+    }
+    m_queued.notify_all();
+
+    for (std::thread& worker : m_workers)
+        worker.join();
+    m_workers.clear();
+}
+
+void WorkerPool::Submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.emplace_back(std::move(task));
+    }
+    m_queued.notify_one();
+}
+
+void WorkerPool::ParallelFor(size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0)
+        return;
+
+    struct State {
+        std::atomic<size_t> next = 0;
+        size_t remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+    std::shared_ptr<State> state = std::make_shared<State>();
+    state->remaining = count;
+
+    // Whoever is free takes the next index, which balances endpoints that are slow to walk.
+    std::function<void()> drain = [state, &body, count]() {
+        while (true) {
+            size_t i = state->next++;
+            if (i >= count)
+                return;
+
+            body(i);
+
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (--state->remaining == 0)
+                state->done.notify_all();
+        }
+    };
+
+    size_t helpers = std::min(m_workers.size(), count - 1);
+    for (size_t i = 0; i < helpers; ++i)
+        Submit(drain);
+    drain();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&state] { return state->remaining == 0; });
+}
+
+void WorkerPool::Run(std::function<void()> workerStarted, std::function<void()> workerStopping) {
+    if (workerStarted)
+        workerStarted();
+
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_queued.wait(lock, [this] { return !m_tasks.empty() || !m_running; });
+            if (m_tasks.empty())
+                break;
+
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+
+    if (workerStopping)
+        workerStopping();
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <optional>
+#include <functional>
+#include <condition_variable>
+
+// A fixed number of worker threads running queued tasks.
+class WorkerPool {
+public:
+    WorkerPool() : m_running(false) {}
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // The callbacks run on each worker thread before and after all tasks, e.g. to initialize COM.
+    void Start(size_t threadCount, std::function<void()> workerStarted = nullptr, std::function<void()> workerStopping = nullptr);
+    // Runs the tasks already queued, then joins the workers.
+    void Stop();
+
+    size_t ThreadCount() const {
+        return m_workers.size();
+    }
+
+    void Submit(std::function<void()> task);
+
+    // Runs body(i) for every i in [0, count) and returns when all of them are done.
+    // The calling thread takes part, so this doesn't deadlock even when called from a worker.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& body);
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_queued;
+    std::deque<std::function<void()>> m_tasks;
+    std::vector<std::thread> m_workers;
+    bool m_running;
+
+    void Run(std::function<void()> workerStarted, std::function<void()> workerStopping);
+};
+
+// Maps every index with f, in parallel when a started pool is given. The results keep the index order,
+// so anything merged from them comes out the same as with a serial loop.
+template <typename Result, typename F>
+std::vector<Result> ParallelMap(WorkerPool* pool, size_t count, F f) {
+    std::vector<std::optional<Result>> slots(count);
+    if (pool == nullptr || pool->ThreadCount() == 0 || count < 2) {
+        for (size_t i = 0; i < count; ++i)
+            slots[i].emplace(f(i));
+    }
+    else {
+        pool->ParallelFor(count, [&slots, &f](size_t i) { slots[i].emplace(f(i)); });
+    }
+
+    std::vector<Result> results;
+    results.reserve(count);
+    for (std::optional<Result>& slot : slots)
+        results.emplace_back(std::move(*slot));
+    return results;
+}
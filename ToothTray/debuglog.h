@@ -1,25 +1,11 @@
-#pragma once
-
-#include "framework.h"
-#include <sstream>
-
-inline void DebugLog(PCWCHAR str) {
-    OutputDebugStringW(str);
-}
-
-void DebugLogHresult(HRESULT hr);
-
-class DebugLogStream : public std::wostringstream {
-public:
-    void Log();
-    void Logl();
-};
-inline void DebugLogl(DebugLogStream& stream) {
-    stream.Logl();
-}
-inline void DebugLogl(DebugLogStream&& stream) {
-    stream.Logl();
-}
-
-std::wostream& operator<<(std::wostream& stream, const GUID& guid);
-std::wostream& operator<<(std::wostream& stream, const SYSTEMTIME& time);
\ No newline at end of file
+#pragma once
+
+#include "framework.h"
+#include "Log.h"
+#include <ostream>
+
+void DebugLogHresult(HRESULT hr);
+
+// Decoder-side formatters for log arguments
+std::wostream& operator<<(std::wostream& stream, const GUID& guid);
+std::wostream& operator<<(std::wostream& stream, const SYSTEMTIME& time);
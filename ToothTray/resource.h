@@ -1,31 +1,33 @@
-//{{NO_DEPENDENCIES}}
-// Microsoft Visual C++ generated include file.
-// Used by ToothTray.rc
-//
-#define IDC_MYICON                      2
-#define IDD_TOOTHTRAY_DIALOG            102
-#define IDS_APP_TITLE                   103
-#define IDM_ABOUT                       104
-#define IDM_EXIT                        105
-#define IDI_TOOTHTRAY                   107
-#define IDI_SMALL                       108
-#define IDC_TOOTHTRAY                   109
-#define IDR_MAINFRAME                   128
-#define IDM_BLUETOOTH_AUDIO_BASE        1000
-#define ID_DEVICES_FIN                  32771
-#define IDM_FIND_DEVICES                32772
-#define IDM_ENABLE_CH510                32773
-#define IDM_DISABLE_CH510               32774
-#define IDC_STATIC                      -1
-
-// Next default values for new objects
-// 
-#ifdef APSTUDIO_INVOKED
-#ifndef APSTUDIO_READONLY_SYMBOLS
-#define _APS_NO_MFC                     1
-#define _APS_NEXT_RESOURCE_VALUE        129
-#define _APS_NEXT_COMMAND_VALUE         32775
-#define _APS_NEXT_CONTROL_VALUE         1000
-#define _APS_NEXT_SYMED_VALUE           110
-#endif
-#endif
+//{{NO_DEPENDENCIES}}
+// Microsoft Visual C++ generated include file.
+// Used by ToothTray.rc
+//
+#define IDC_MYICON                      2
+#define IDD_TOOTHTRAY_DIALOG            102
+#define IDS_APP_TITLE                   103
+#define IDM_ABOUT                       104
+#define IDM_EXIT                        105
+#define IDI_TOOTHTRAY                   107
+#define IDI_SMALL                       108
+#define IDC_TOOTHTRAY                   109
+#define IDR_MAINFRAME                   128
+#define IDM_BLUETOOTH_AUDIO_BASE        1000
+#define IDM_BLUETOOTH_SWITCH_BASE       2000
+#define ID_DEVICES_FIN                  32771
+#define IDM_FIND_DEVICES                32772
+#define IDM_ENABLE_CH510                32773
+#define IDM_DISABLE_CH510               32774
+#define IDM_DISCONNECT_ALL              32775
+#define IDC_STATIC                      -1
+
+// Next default values for new objects
+// 
+#ifdef APSTUDIO_INVOKED
+#ifndef APSTUDIO_READONLY_SYMBOLS
+#define _APS_NO_MFC                     1
+#define _APS_NEXT_RESOURCE_VALUE        129
+#define _APS_NEXT_COMMAND_VALUE         32776
+#define _APS_NEXT_CONTROL_VALUE         1000
+#define _APS_NEXT_SYMED_VALUE           110
+#endif
+#endif